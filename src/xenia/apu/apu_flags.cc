@@ -12,3 +12,6 @@
 DEFINE_string(apu, "any", "Audio system. Use: [any, nop, xaudio2]");
 
 DEFINE_bool(mute, false, "Mutes all audio output.");
+
+DEFINE_int32(xma_decoder_threads, 2,
+             "Number of threads decoding kicked XMA contexts.");
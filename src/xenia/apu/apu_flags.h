@@ -16,4 +16,6 @@ DECLARE_string(apu);
 
 DECLARE_bool(mute);
 
+DECLARE_int32(xma_decoder_threads);
+
 #endif  // XENIA_APU_APU_FLAGS_H_
@@ -7,8 +7,13 @@
  ******************************************************************************
  */
 
-#include "xenia/apu/xma_context.h"
 #include "xenia/apu/xma_decoder.h"
+
+#include <algorithm>
+
+#include "xenia/apu/apu_flags.h"
+#include "xenia/apu/xma_context.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/ring_buffer.h"
@@ -58,7 +63,19 @@ XmaDecoder::XmaDecoder(Emulator* emulator)
       processor_(emulator->processor()),
       worker_running_(false),
       context_data_first_ptr_(0),
-      context_data_last_ptr_(0) {}
+      context_data_last_ptr_(0),
+      decode_count_(0),
+      wakeup_count_(0),
+      busy_ticks_(0),
+      total_latency_ticks_(0),
+      max_latency_ticks_(0) {
+  for (auto& word : ready_contexts_) {
+    word = 0;
+  }
+  for (auto& kick_tick : kick_ticks_) {
+    kick_tick = 0;
+  }
+}
 
 XmaDecoder::~XmaDecoder() {}
 
@@ -96,33 +113,117 @@ X_STATUS XmaDecoder::Setup() {
   }
   registers_.next_context = 1;
 
+  start_ticks_ = Clock::QueryHostTickCount();
   worker_running_ = true;
-  worker_thread_ =
-      kernel::object_ref<kernel::XHostThread>(new kernel::XHostThread(
-          emulator()->kernel_state(), 128 * 1024, 0, [this]() {
-            WorkerThreadMain();
-            return 0;
-          }));
-  worker_thread_->set_name("XMA Decoder Worker");
-  worker_thread_->Create();
+  int32_t worker_count = std::max(FLAGS_xma_decoder_threads, 1);
+  for (int32_t i = 0; i < worker_count; ++i) {
+    auto worker_thread =
+        kernel::object_ref<kernel::XHostThread>(new kernel::XHostThread(
+            emulator()->kernel_state(), 128 * 1024, 0, [this]() {
+              WorkerThreadMain();
+              return 0;
+            }));
+    worker_thread->set_name("XMA Decoder Worker");
+    worker_thread->Create();
+    worker_threads_.push_back(std::move(worker_thread));
+  }
 
   return X_STATUS_SUCCESS;
 }
 
 void XmaDecoder::WorkerThreadMain() {
   while (worker_running_) {
-    // Okay, let's loop through XMA contexts to find ones we need to decode!
-    for (uint32_t n = 0; n < kContextCount; n++) {
-      XmaContext& context = contexts_[n];
-      context.Work();
+    int context_id = ClaimReadyContext();
+    if (context_id < 0) {
+      // Nothing to decode; sleep until the next kick.
+      worker_fence_.Wait();
+      ++wakeup_count_;
+      continue;
+    }
+    // Leave the rest of the ready set to another worker.
+    if (has_ready_contexts()) {
+      worker_fence_.Signal();
+    }
+
+    uint64_t kick_ticks = kick_ticks_[context_id].exchange(0);
+    uint64_t start_ticks = Clock::QueryHostTickCount();
+    contexts_[context_id].Work();
+    uint64_t end_ticks = Clock::QueryHostTickCount();
+
+    busy_ticks_ += end_ticks - start_ticks;
+    ++decode_count_;
+    if (kick_ticks) {
+      uint64_t latency_ticks = end_ticks - kick_ticks;
+      total_latency_ticks_ += latency_ticks;
+      uint64_t max_ticks = max_latency_ticks_;
+      while (latency_ticks > max_ticks &&
+             !max_latency_ticks_.compare_exchange_weak(max_ticks,
+                                                       latency_ticks)) {
+      }
     }
   }
+  // Pass shutdown on to the next sleeping worker.
+  worker_fence_.Signal();
+}
+
+void XmaDecoder::MarkContextReady(uint32_t context_id) {
+  uint64_t expected = 0;
+  kick_ticks_[context_id].compare_exchange_strong(expected,
+                                                  Clock::QueryHostTickCount());
+  ready_contexts_[context_id / 64].fetch_or(1ull << (context_id % 64));
+}
+
+int XmaDecoder::ClaimReadyContext() {
+  for (uint32_t i = 0; i < kReadyWordCount; ++i) {
+    uint64_t bits = ready_contexts_[i].load();
+    uint32_t bit_index;
+    while (xe::bit_scan_forward(bits, &bit_index)) {
+      uint64_t bit = 1ull << bit_index;
+      uint64_t previous = ready_contexts_[i].fetch_and(~bit);
+      if (previous & bit) {
+        return int(i * 64 + bit_index);
+      }
+      // Another worker took it first.
+      bits = previous & ~bit;
+    }
+  }
+  return -1;
+}
+
+bool XmaDecoder::has_ready_contexts() const {
+  for (auto& word : ready_contexts_) {
+    if (word.load()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void XmaDecoder::DumpStats() {
+  uint64_t frequency = Clock::host_tick_frequency();
+  uint64_t elapsed_ticks = Clock::QueryHostTickCount() - start_ticks_;
+  uint64_t decode_count = decode_count_;
+  double average_latency_us =
+      decode_count
+          ? total_latency_ticks_ * 1000000.0 / frequency / decode_count
+          : 0.0;
+  XELOGI(
+      "XMA decoder: %llu decodes, kick to decode latency avg %.1fus max "
+      "%.1fus, %llu wakeups, workers busy %.2f%% of %.1fs",
+      decode_count, average_latency_us,
+      max_latency_ticks_ * 1000000.0 / frequency, uint64_t(wakeup_count_),
+      elapsed_ticks ? busy_ticks_ * 100.0 / elapsed_ticks : 0.0,
+      elapsed_ticks / double(frequency));
 }
 
 void XmaDecoder::Shutdown() {
   worker_running_ = false;
   worker_fence_.Signal();
-  worker_thread_.reset();
+  for (auto& worker_thread : worker_threads_) {
+    worker_thread->Wait(0, 0, 0, nullptr);
+  }
+  worker_threads_.clear();
+  DumpStats();
 
   memory()->SystemHeapFree(registers_.context_array_ptr);
 }
@@ -224,10 +325,11 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint64_t value) {
         uint32_t context_id = base_context_id + i;
         XmaContext& context = contexts_[context_id];
         context.Enable();
+        MarkContextReady(context_id);
       }
     }
 
-    // Signal the decoder thread to start processing.
+    // Wake a worker to start processing.
     worker_fence_.Signal();
   } else if (r >= 0x1A40 && r <= 0x1A40 + 9 * 4) {
     // Context lock command.
@@ -241,9 +343,6 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint64_t value) {
         context.Disable();
       }
     }
-
-    // Signal the decoder thread to start processing.
-    worker_fence_.Signal();
   } else if (r >= 0x1A80 && r <= 0x1A80 + 9 * 4) {
     // Context clear command.
     // This will reset the given hardware contexts.
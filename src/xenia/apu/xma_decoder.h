@@ -13,6 +13,7 @@
 #include <atomic>
 #include <mutex>
 #include <queue>
+#include <vector>
 
 #include "xenia/emulator.h"
 #include "xenia/xbox.h"
@@ -55,6 +56,12 @@ class XmaDecoder {
 
  private:
   void WorkerThreadMain();
+  // Queues a kicked context for the workers and wakes one of them.
+  void MarkContextReady(uint32_t context_id);
+  // Takes a queued context off the ready set. Returns -1 if there are none.
+  int ClaimReadyContext();
+  bool has_ready_contexts() const;
+  void DumpStats();
 
   static uint64_t MMIOReadRegisterThunk(void* ppc_context, XmaDecoder* as,
                                         uint32_t addr) {
@@ -71,7 +78,9 @@ class XmaDecoder {
   cpu::Processor* processor_;
 
   std::atomic<bool> worker_running_;
-  kernel::object_ref<kernel::XHostThread> worker_thread_;
+  std::vector<kernel::object_ref<kernel::XHostThread>> worker_threads_;
+  // Signaled when contexts are queued. Workers sleep on it when the ready set
+  // is empty.
   xe::threading::Fence worker_fence_;
 
   xe::mutex lock_;
@@ -100,6 +109,21 @@ class XmaDecoder {
   static const uint32_t kContextCount = 320;
   XmaContext contexts_[kContextCount];
 
+  // Ready set: one bit per context kicked since a worker last claimed it.
+  // Kicks set bits with fetch_or and workers claim them with fetch_and, so
+  // the queue never takes a lock and a context is never queued twice.
+  static const uint32_t kReadyWordCount = (kContextCount + 63) / 64;
+  std::atomic<uint64_t> ready_contexts_[kReadyWordCount];
+
+  // Host tick of the oldest kick not yet picked up, per context.
+  std::atomic<uint64_t> kick_ticks_[kContextCount];
+  uint64_t start_ticks_ = 0;
+  std::atomic<uint64_t> decode_count_;
+  std::atomic<uint64_t> wakeup_count_;
+  std::atomic<uint64_t> busy_ticks_;
+  std::atomic<uint64_t> total_latency_ticks_;
+  std::atomic<uint64_t> max_latency_ticks_;
+
   uint32_t context_data_first_ptr_;
   uint32_t context_data_last_ptr_;
 };
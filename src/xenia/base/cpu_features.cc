@@ -0,0 +1,84 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/cpu_features.h"
+
+#if XE_COMPILER_MSVC
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif  // XE_COMPILER_MSVC
+
+namespace xe {
+
+namespace {
+
+void QueryCpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#if XE_COMPILER_MSVC
+  __cpuidex(reinterpret_cast<int*>(regs), int(leaf), int(subleaf));
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif  // XE_COMPILER_MSVC
+}
+
+// The register state the OS saves on context switches (XCR0).
+uint64_t QueryXcr0() {
+#if XE_COMPILER_MSVC
+  return _xgetbv(0);
+#else
+  uint32_t eax, edx;
+  __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (uint64_t(edx) << 32) | eax;
+#endif  // XE_COMPILER_MSVC
+}
+
+uint32_t DetectCpuFeatures() {
+  uint32_t regs[4];
+  QueryCpuid(0, 0, regs);
+  uint32_t max_leaf = regs[0];
+  if (max_leaf < 1) {
+    return 0;
+  }
+
+  uint32_t features = 0;
+  QueryCpuid(1, 0, regs);
+  if (regs[2] & (1 << 9)) {
+    features |= kCpuFeatureSSSE3;
+  }
+  if (regs[2] & (1 << 25)) {
+    features |= kCpuFeatureAESNI;
+  }
+  bool has_osxsave = (regs[2] & (1 << 27)) != 0;
+  if (!has_osxsave || max_leaf < 7) {
+    return features;
+  }
+
+  uint64_t xcr0 = QueryXcr0();
+  // SSE and AVX state.
+  bool os_saves_ymm = (xcr0 & 0x6) == 0x6;
+  // Plus the opmask and both halves of the ZMM state.
+  bool os_saves_zmm = (xcr0 & 0xE6) == 0xE6;
+  QueryCpuid(7, 0, regs);
+  if (os_saves_ymm && (regs[1] & (1 << 5))) {
+    features |= kCpuFeatureAVX2;
+  }
+  if (os_saves_zmm && (regs[1] & (1 << 16)) && (regs[1] & (1 << 30))) {
+    features |= kCpuFeatureAVX512BW;
+  }
+  return features;
+}
+
+}  // namespace
+
+uint32_t host_cpu_features() {
+  static const uint32_t features = DetectCpuFeatures();
+  return features;
+}
+
+}  // namespace xe
@@ -0,0 +1,51 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_CPU_FEATURES_H_
+#define XENIA_BASE_CPU_FEATURES_H_
+
+#include <cstdint>
+
+#include "xenia/base/platform.h"
+
+// Functions using instructions beyond the build's baseline must be marked
+// with these and only called after checking host_cpu_features(). MSVC allows
+// any instruction anywhere and needs nothing.
+#if XE_COMPILER_MSVC
+#define XE_TARGET_SSSE3
+#define XE_TARGET_AVX2
+#define XE_TARGET_AVX512BW
+#define XE_TARGET_AESNI
+// AVX-512 intrinsics arrived in Visual Studio 2017.
+#define XE_HAS_AVX512_INTRINSICS (_MSC_VER >= 1911)
+#else
+#define XE_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define XE_TARGET_AVX2 __attribute__((target("avx2")))
+#define XE_TARGET_AVX512BW __attribute__((target("avx512f,avx512bw")))
+#define XE_TARGET_AESNI __attribute__((target("aes")))
+#define XE_HAS_AVX512_INTRINSICS 1
+#endif  // XE_COMPILER_MSVC
+
+namespace xe {
+
+enum CpuFeature : uint32_t {
+  kCpuFeatureSSSE3 = 1 << 0,
+  kCpuFeatureAVX2 = 1 << 1,
+  // Includes AVX512F.
+  kCpuFeatureAVX512BW = 1 << 2,
+  kCpuFeatureAESNI = 1 << 3,
+};
+
+// CpuFeature bits for the extensions the host CPU has and the OS saves the
+// registers of. Detected on first use.
+uint32_t host_cpu_features();
+
+}  // namespace xe
+
+#endif  // XENIA_BASE_CPU_FEATURES_H_
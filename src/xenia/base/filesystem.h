@@ -30,6 +30,9 @@ bool IsFolder(const std::wstring& path);
 
 FILE* OpenFile(const std::wstring& path, const char* mode);
 bool DeleteFile(const std::wstring& path);
+// Moves a file, replacing target_path if it exists.
+bool RenameFile(const std::wstring& source_path,
+                const std::wstring& target_path);
 
 struct FileAccess {
   // Implies kFileReadData.
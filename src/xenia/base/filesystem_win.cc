@@ -56,6 +56,14 @@ bool DeleteFile(const std::wstring& path) {
   return DeleteFileW(path.c_str()) ? true : false;
 }
 
+bool RenameFile(const std::wstring& source_path,
+                const std::wstring& target_path) {
+  return MoveFileExW(source_path.c_str(), target_path.c_str(),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)
+             ? true
+             : false;
+}
+
 class Win32FileHandle : public FileHandle {
  public:
   Win32FileHandle(std::wstring path, HANDLE handle)
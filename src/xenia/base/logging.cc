@@ -11,8 +11,15 @@
 
 #include <gflags/gflags.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdarg>
+#include <cstdlib>
+#include <cstring>
 #include <mutex>
+#include <thread>
 
 #include "xenia/base/main.h"
 #include "xenia/base/math.h"
@@ -27,6 +34,12 @@
 DEFINE_bool(fast_stdout, false,
             "Don't lock around stdout/stderr. May introduce weirdness.");
 DEFINE_bool(flush_stdout, true, "Flush stdout after each log line.");
+DEFINE_string(log_file, "", "Write log lines to this file instead of stdout.");
+DEFINE_bool(log_async, false,
+            "Queue log lines per thread and write them in batches from a "
+            "background thread. Lines from different threads may be written "
+            "out of order, and lines that don't fit in a thread's queue are "
+            "dropped and counted.");
 
 namespace xe {
 
@@ -34,6 +47,216 @@ std::mutex log_lock;
 
 thread_local std::vector<char> log_buffer(16 * 1024);
 
+FILE* log_output() {
+  static FILE* output = [] {
+    if (!FLAGS_log_file.empty()) {
+      FILE* file = fopen(FLAGS_log_file.c_str(), "w");
+      if (file) {
+        return file;
+      }
+    }
+    return stdout;
+  }();
+  return output;
+}
+
+// Single-producer single-consumer byte ring owned by one logging thread and
+// drained by the writer thread. Positions only ever increase.
+struct LogRing {
+  static const size_t kCapacity = 64 * 1024;
+
+  char data[kCapacity];
+  std::atomic<size_t> write_position{0};
+  std::atomic<size_t> read_position{0};
+  // Set when the owning thread exits, so the writer can free the ring once
+  // it is drained.
+  std::atomic<bool> retired{false};
+
+  // Called by the owning thread only.
+  bool Push(const char* line, size_t length) {
+    size_t write = write_position.load(std::memory_order_relaxed);
+    size_t read = read_position.load(std::memory_order_acquire);
+    if (kCapacity - (write - read) < length) {
+      return false;
+    }
+    size_t offset = write % kCapacity;
+    size_t first_length = std::min(length, kCapacity - offset);
+    std::memcpy(data + offset, line, first_length);
+    std::memcpy(data, line + first_length, length - first_length);
+    write_position.store(write + length, std::memory_order_release);
+    return true;
+  }
+
+  // Called by the writer only.
+  void Drain(std::vector<char>* batch) {
+    size_t read = read_position.load(std::memory_order_relaxed);
+    size_t write = write_position.load(std::memory_order_acquire);
+    for (size_t position = read; position < write;) {
+      size_t offset = position % kCapacity;
+      size_t length = std::min(write - position, kCapacity - offset);
+      batch->insert(batch->end(), data + offset, data + offset + length);
+      position += length;
+    }
+    read_position.store(write, std::memory_order_release);
+  }
+};
+
+class AsyncLogWriter {
+ public:
+  static AsyncLogWriter* Get() {
+    // Never destroyed, as threads may log during static destruction. Lines
+    // logged after shutdown take the synchronous path.
+    static AsyncLogWriter* writer = [] {
+      auto writer = new AsyncLogWriter();
+      std::atexit([] { Get()->Shutdown(); });
+      return writer;
+    }();
+    return writer;
+  }
+
+  // Returns false if the line has to be written synchronously instead.
+  bool Write(const char* line, size_t length) {
+    // Counted so that Shutdown's final drain waits for lines that got past
+    // the running_ check.
+    active_writes_.fetch_add(1);
+    bool queued = running_.load() && Queue(line, length);
+    active_writes_.fetch_sub(1);
+    return queued;
+  }
+
+  // Writes out everything queued so far.
+  void Flush() {
+    std::lock_guard<std::mutex> lock(drain_mutex_);
+    DrainLocked();
+  }
+
+ private:
+  struct ThreadRing {
+    ~ThreadRing() {
+      if (ring) {
+        ring->retired.store(true, std::memory_order_release);
+        // The writer may free the ring from now on.
+        ring = nullptr;
+      }
+      exited = true;
+    }
+    LogRing* ring = nullptr;
+    // Set once the thread's thread_locals are being destroyed. Lines logged
+    // from later destructors are written synchronously.
+    bool exited = false;
+  };
+
+  AsyncLogWriter() {
+    running_ = true;
+    thread_ = std::thread([this] { WriterThread(); });
+  }
+
+  bool Queue(const char* line, size_t length) {
+    if (thread_ring_.exited || length > LogRing::kCapacity) {
+      return false;
+    }
+    auto& ring = thread_ring_.ring;
+    if (!ring) {
+      ring = new LogRing();
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      rings_.push_back(ring);
+    }
+    if (!ring->Push(line, length)) {
+      dropped_count_.fetch_add(1, std::memory_order_relaxed);
+      Wake();
+    } else if (ring->write_position - ring->read_position >
+               LogRing::kCapacity / 2) {
+      // Getting full; don't wait for the writer to wake on its own.
+      Wake();
+    }
+    return true;
+  }
+
+  void Wake() {
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+      wake_requested_ = true;
+    }
+    wake_cv_.notify_one();
+  }
+
+  void WriterThread() {
+    xe::threading::set_name("Log Writer");
+    while (running_.load(std::memory_order_acquire)) {
+      {
+        // Batch up whatever arrives in the meantime.
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        wake_cv_.wait_for(lock, std::chrono::milliseconds(5),
+                          [this] { return wake_requested_; });
+        wake_requested_ = false;
+      }
+      Flush();
+    }
+  }
+
+  void Shutdown() {
+    if (!running_.exchange(false)) {
+      return;
+    }
+    Wake();
+    thread_.join();
+    while (active_writes_.load()) {
+      std::this_thread::yield();
+    }
+    Flush();
+  }
+
+  void DrainLocked() {
+    std::vector<LogRing*> rings;
+    {
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      rings = rings_;
+    }
+    batch_.clear();
+    for (auto ring : rings) {
+      // Check before draining, so nothing is pushed after the final drain.
+      bool retired = ring->retired.load(std::memory_order_acquire);
+      ring->Drain(&batch_);
+      if (retired) {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        rings_.erase(std::find(rings_.begin(), rings_.end(), ring));
+        delete ring;
+      }
+    }
+    uint64_t dropped_count = dropped_count_.exchange(0);
+    if (dropped_count) {
+      char line[64];
+      int length = snprintf(line, sizeof(line), "w> %llu log lines dropped\n",
+                            static_cast<unsigned long long>(dropped_count));
+      batch_.insert(batch_.end(), line, line + length);
+    }
+    if (batch_.empty()) {
+      return;
+    }
+    FILE* output = log_output();
+    fwrite(batch_.data(), 1, batch_.size(), output);
+    fflush(output);
+  }
+
+  std::atomic<bool> running_;
+  std::atomic<uint32_t> active_writes_{0};
+  std::thread thread_;
+  std::mutex wake_mutex_;
+  std::condition_variable wake_cv_;
+  bool wake_requested_ = false;
+
+  std::mutex rings_mutex_;
+  std::vector<LogRing*> rings_;
+  static thread_local ThreadRing thread_ring_;
+  std::atomic<uint64_t> dropped_count_{0};
+
+  // Held while draining; the writer thread and Flush callers both drain.
+  std::mutex drain_mutex_;
+  std::vector<char> batch_;
+};
+
+thread_local AsyncLogWriter::ThreadRing AsyncLogWriter::thread_ring_;
+
 void format_log_line(char* buffer, size_t buffer_capacity,
                      const char level_char, const char* fmt, va_list args) {
   char* buffer_ptr;
@@ -69,15 +292,21 @@ void log_line(const char level_char, const char* fmt, ...) {
                   args);
   va_end(args);
 
+  if (FLAGS_log_async &&
+      AsyncLogWriter::Get()->Write(log_buffer.data(),
+                                   std::strlen(log_buffer.data()))) {
+    return;
+  }
+
   if (!FLAGS_fast_stdout) {
     log_lock.lock();
   }
 #if 0  // defined(OutputDebugString)
   OutputDebugStringA(log_buffer.data());
 #else
-  fprintf(stdout, "%s", log_buffer.data());
+  fprintf(log_output(), "%s", log_buffer.data());
   if (FLAGS_flush_stdout) {
-    fflush(stdout);
+    fflush(log_output());
   }
 #endif  // OutputDebugString
   if (!FLAGS_fast_stdout) {
@@ -85,12 +314,23 @@ void log_line(const char level_char, const char* fmt, ...) {
   }
 }
 
+void flush_log() {
+  if (FLAGS_log_async) {
+    AsyncLogWriter::Get()->Flush();
+  } else {
+    fflush(log_output());
+  }
+}
+
 void handle_fatal(const char* fmt, ...) {
   va_list args;
   va_start(args, fmt);
   format_log_line(log_buffer.data(), log_buffer.capacity(), 'X', fmt, args);
   va_end(args);
 
+  // Get everything leading up to the failure out first.
+  flush_log();
+
   if (!FLAGS_fast_stdout) {
     log_lock.lock();
   }
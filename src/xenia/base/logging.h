@@ -40,6 +40,9 @@ void log_line(const char level_char, const char* fmt,
               ...) XE_LOG_LINE_ATTRIBUTE;
 #undef XE_LOG_LINE_ATTRIBUTE
 
+// Writes out any lines still queued by --log_async.
+void flush_log();
+
 void handle_fatal(const char* fmt, ...);
 
 #if XE_OPTION_ENABLE_LOGGING
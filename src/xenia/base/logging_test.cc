@@ -0,0 +1,121 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "third_party/catch/include/catch.hpp"
+#include "xenia/base/logging.h"
+
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+DECLARE_string(log_file);
+DECLARE_bool(log_async);
+
+namespace {
+
+// The log output is opened on first use, so every test here logs to the same
+// file and tells its own lines apart by a marker.
+const char* kLogPath = "xenia-base-tests.log";
+
+size_t CountLines(const char* marker) {
+  xe::flush_log();
+  std::ifstream file(kLogPath);
+  size_t count = 0;
+  for (std::string line; std::getline(file, line);) {
+    if (line.find(marker) != std::string::npos) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+}  // namespace
+
+TEST_CASE("LOG_ASYNC_WRITES_ALL_LINES", "[logging]") {
+  auto old_log_file = FLAGS_log_file;
+  FLAGS_log_file = kLogPath;
+  bool old_async = FLAGS_log_async;
+  FLAGS_log_async = true;
+
+  // Few enough lines that no thread's queue can overflow.
+  const int thread_count = 4;
+  const int line_count = 500;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < thread_count; ++i) {
+    threads.emplace_back([i, line_count] {
+      for (int j = 0; j < line_count; ++j) {
+        XELOGI("async-test thread %d line %d", i, j);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  REQUIRE(CountLines("async-test") == thread_count * line_count);
+
+  FLAGS_log_async = old_async;
+  FLAGS_log_file = old_log_file;
+}
+
+TEST_CASE("LOG_BENCHMARK", "[.][benchmark]") {
+  auto old_log_file = FLAGS_log_file;
+  FLAGS_log_file = kLogPath;
+  bool old_async = FLAGS_log_async;
+  const int line_count = 50000;
+  for (bool async : {false, true}) {
+    FLAGS_log_async = async;
+    for (int thread_count : {1, 4, 8}) {
+      std::vector<double> max_latencies(thread_count);
+      std::vector<double> total_latencies(thread_count);
+      std::vector<std::thread> threads;
+      auto start = std::chrono::high_resolution_clock::now();
+      for (int i = 0; i < thread_count; ++i) {
+        threads.emplace_back([&, i] {
+          for (int j = 0; j < line_count; ++j) {
+            auto line_start = std::chrono::high_resolution_clock::now();
+            XELOGI("benchmark thread %d line %d value %.8X", i, j, j * 7);
+            double latency = std::chrono::duration<double>(
+                                 std::chrono::high_resolution_clock::now() -
+                                 line_start).count();
+            total_latencies[i] += latency;
+            max_latencies[i] = std::max(max_latencies[i], latency);
+          }
+        });
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+      xe::flush_log();
+      auto end = std::chrono::high_resolution_clock::now();
+      double seconds = std::chrono::duration<double>(end - start).count();
+      double total_latency = 0;
+      double max_latency = 0;
+      for (int i = 0; i < thread_count; ++i) {
+        total_latency += total_latencies[i];
+        max_latency = std::max(max_latency, max_latencies[i]);
+      }
+      std::printf(
+          "%s %d threads: %.0f lines/s, caller latency %.2f us avg %.2f us "
+          "max\n",
+          async ? "async" : "sync ", thread_count,
+          thread_count * line_count / seconds,
+          total_latency * 1000000.0 / (thread_count * line_count),
+          max_latency * 1000000.0);
+    }
+  }
+  FLAGS_log_async = old_async;
+  FLAGS_log_file = old_log_file;
+}
@@ -130,13 +130,15 @@ inline bool bit_scan_forward(uint64_t v, uint32_t* out_first_set_index) {
 }
 #else
 inline bool bit_scan_forward(uint32_t v, uint32_t* out_first_set_index) {
+  // ffs counts from 1, _BitScanForward from 0.
   int i = ffs(v);
-  *out_first_set_index = i;
+  *out_first_set_index = i - 1;
   return i != 0;
 }
 inline bool bit_scan_forward(uint64_t v, uint32_t* out_first_set_index) {
+  // ffs counts from 1, _BitScanForward from 0.
   int i = ffsll(v);
-  *out_first_set_index = i;
+  *out_first_set_index = i - 1;
   return i != 0;
 }
 #endif  // XE_PLATFORM_WIN32
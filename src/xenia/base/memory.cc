@@ -9,123 +9,321 @@
 
 #include "xenia/base/memory.h"
 
+#include <immintrin.h>
+
 #include <algorithm>
 
+#include "xenia/base/cpu_features.h"
+
 namespace xe {
 
-// TODO(benvanik): fancy AVX versions.
-// http://gnuradio.org/redmine/projects/gnuradio/repository/revisions/cb32b70b79f430456208a2cd521d028e0ece5d5b/entry/volk/kernels/volk/volk_16u_byteswap.h
-// http://gnuradio.org/redmine/projects/gnuradio/repository/revisions/f2bc76cc65ffba51a141950f98e75364e49df874/entry/volk/kernels/volk/volk_32u_byteswap.h
-// http://gnuradio.org/redmine/projects/gnuradio/repository/revisions/2c4c371885c31222362f70a1cd714415d1398021/entry/volk/kernels/volk/volk_64u_byteswap.h
+namespace {
 
-void copy_and_swap_16_aligned(uint16_t* dest, const uint16_t* src,
-                              size_t count) {
-  return copy_and_swap_16_unaligned(dest, src, count);
+// What each copy_and_swap function swaps within its elements.
+enum SwapType {
+  kSwap16,
+  kSwap32,
+  kSwap64,
+  kSwap16In32,
+};
+
+// pshufb masks for each SwapType, broadcast to every 128-bit lane.
+alignas(16) const uint8_t kSwapMasks[][16] = {
+    {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+    {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+    {7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8},
+    {2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13},
+};
+
+// Copies this large are written with non-temporal stores. They'd mostly
+// evict the cache for output the GPU, not the CPU, reads next.
+const size_t kStreamThreshold = 1024 * 1024;
+
+void SwapScalar(uint8_t* dest, const uint8_t* src, size_t length,
+                SwapType type) {
+  switch (type) {
+    case kSwap16:
+      for (size_t i = 0; i < length; i += 2) {
+        xe::store<uint16_t>(dest + i, xe::load_and_swap<uint16_t>(src + i));
+      }
+      break;
+    case kSwap32:
+      for (size_t i = 0; i < length; i += 4) {
+        xe::store<uint32_t>(dest + i, xe::load_and_swap<uint32_t>(src + i));
+      }
+      break;
+    case kSwap64:
+      for (size_t i = 0; i < length; i += 8) {
+        xe::store<uint64_t>(dest + i, xe::load_and_swap<uint64_t>(src + i));
+      }
+      break;
+    case kSwap16In32:
+      for (size_t i = 0; i < length; i += 4) {
+        uint32_t value = xe::load<uint32_t>(src + i);
+        xe::store<uint32_t>(dest + i, (value >> 16) | (value << 16));
+      }
+      break;
+  }
 }
 
-void copy_and_swap_16_unaligned(uint16_t* dest, const uint16_t* src,
-                                size_t count) {
-  size_t i;
-  __m128i input, output;
+// The vector kernels swap as many whole vectors as fit in length and return
+// how many bytes that was. dest is vector aligned if it can be.
+
+template <SwapType type>
+__m128i SwapSSE2(__m128i input);
+template <>
+__m128i SwapSSE2<kSwap16>(__m128i input) {
+  return _mm_or_si128(_mm_slli_epi16(input, 8), _mm_srli_epi16(input, 8));
+}
+template <>
+__m128i SwapSSE2<kSwap32>(__m128i input) {
+  __m128i byte2mask = _mm_set1_epi32(0x00FF0000);
+  __m128i byte3mask = _mm_set1_epi32(0x0000FF00);
+  __m128i output =
+      _mm_or_si128(_mm_slli_epi32(input, 24), _mm_srli_epi32(input, 24));
+  output = _mm_or_si128(output,
+                        _mm_and_si128(_mm_slli_epi32(input, 8), byte2mask));
+  return _mm_or_si128(output,
+                      _mm_and_si128(_mm_srli_epi32(input, 8), byte3mask));
+}
+template <>
+__m128i SwapSSE2<kSwap64>(__m128i input) {
+  // Swap each word, then the two words.
+  return _mm_shuffle_epi32(SwapSSE2<kSwap32>(input), _MM_SHUFFLE(2, 3, 0, 1));
+}
+template <>
+__m128i SwapSSE2<kSwap16In32>(__m128i input) {
+  return _mm_or_si128(_mm_slli_epi32(input, 16), _mm_srli_epi32(input, 16));
+}
 
-  for (i = 0; i + 8 <= count; i += 8) {
-    input = _mm_loadu_si128((__m128i*)&src[i]);
-    output = _mm_or_si128(_mm_slli_epi16(input, 8), _mm_srli_epi16(input, 8));
-    _mm_storeu_si128((__m128i*)&dest[i], output);
+template <SwapType type>
+size_t SwapVectorsSSE2(uint8_t* dest, const uint8_t* src, size_t length) {
+  size_t i = 0;
+  if (length >= kStreamThreshold &&
+      !(reinterpret_cast<uintptr_t>(dest) & 15)) {
+    for (; i + 16 <= length; i += 16) {
+      __m128i input =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      _mm_stream_si128(reinterpret_cast<__m128i*>(dest + i),
+                       SwapSSE2<type>(input));
+    }
+    _mm_sfence();
+    return i;
   }
+  for (; i + 16 <= length; i += 16) {
+    __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i),
+                     SwapSSE2<type>(input));
+  }
+  return i;
+}
 
-  for (; i < count; ++i) {  // handle residual elements
-    dest[i] = byte_swap(src[i]);
+size_t SwapVectorsSSE2(uint8_t* dest, const uint8_t* src, size_t length,
+                       SwapType type) {
+  switch (type) {
+    case kSwap16:
+      return SwapVectorsSSE2<kSwap16>(dest, src, length);
+    case kSwap32:
+      return SwapVectorsSSE2<kSwap32>(dest, src, length);
+    case kSwap64:
+      return SwapVectorsSSE2<kSwap64>(dest, src, length);
+    case kSwap16In32:
+      return SwapVectorsSSE2<kSwap16In32>(dest, src, length);
   }
+  return 0;
 }
 
-void copy_and_swap_32_aligned(uint32_t* dest, const uint32_t* src,
-                              size_t count) {
-  return copy_and_swap_32_unaligned(dest, src, count);
+XE_TARGET_SSSE3 size_t SwapVectorsSSSE3(uint8_t* dest, const uint8_t* src,
+                                        size_t length, SwapType type) {
+  __m128i mask =
+      _mm_load_si128(reinterpret_cast<const __m128i*>(kSwapMasks[type]));
+  size_t i = 0;
+  if (length >= kStreamThreshold &&
+      !(reinterpret_cast<uintptr_t>(dest) & 15)) {
+    for (; i + 16 <= length; i += 16) {
+      __m128i input =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      _mm_stream_si128(reinterpret_cast<__m128i*>(dest + i),
+                       _mm_shuffle_epi8(input, mask));
+    }
+    _mm_sfence();
+    return i;
+  }
+  for (; i + 16 <= length; i += 16) {
+    __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i),
+                     _mm_shuffle_epi8(input, mask));
+  }
+  return i;
 }
 
-void copy_and_swap_32_unaligned(uint32_t* dest, const uint32_t* src,
-                                size_t count) {
-  size_t i;
-  __m128i input, byte1, byte2, byte3, byte4, output;
-  __m128i byte2mask = _mm_set1_epi32(0x00FF0000);
-  __m128i byte3mask = _mm_set1_epi32(0x0000FF00);
+XE_TARGET_AVX2 size_t SwapVectorsAVX2(uint8_t* dest, const uint8_t* src,
+                                      size_t length, SwapType type) {
+  __m256i mask = _mm256_broadcastsi128_si256(
+      _mm_load_si128(reinterpret_cast<const __m128i*>(kSwapMasks[type])));
+  size_t i = 0;
+  if (length >= kStreamThreshold &&
+      !(reinterpret_cast<uintptr_t>(dest) & 31)) {
+    for (; i + 32 <= length; i += 32) {
+      __m256i input =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+      _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + i),
+                          _mm256_shuffle_epi8(input, mask));
+    }
+    _mm_sfence();
+    return i;
+  }
+  for (; i + 32 <= length; i += 32) {
+    __m256i input =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i),
+                        _mm256_shuffle_epi8(input, mask));
+  }
+  return i;
+}
+
+#if XE_HAS_AVX512_INTRINSICS
+XE_TARGET_AVX512BW size_t SwapVectorsAVX512(uint8_t* dest, const uint8_t* src,
+                                            size_t length, SwapType type) {
+  __m512i mask = _mm512_broadcast_i32x4(
+      _mm_load_si128(reinterpret_cast<const __m128i*>(kSwapMasks[type])));
+  size_t i = 0;
+  if (length >= kStreamThreshold &&
+      !(reinterpret_cast<uintptr_t>(dest) & 63)) {
+    for (; i + 64 <= length; i += 64) {
+      __m512i input =
+          _mm512_loadu_si512(reinterpret_cast<const __m512i*>(src + i));
+      _mm512_stream_si512(reinterpret_cast<__m512i*>(dest + i),
+                          _mm512_shuffle_epi8(input, mask));
+    }
+    _mm_sfence();
+    return i;
+  }
+  for (; i + 64 <= length; i += 64) {
+    __m512i input =
+        _mm512_loadu_si512(reinterpret_cast<const __m512i*>(src + i));
+    _mm512_storeu_si512(reinterpret_cast<__m512i*>(dest + i),
+                        _mm512_shuffle_epi8(input, mask));
+  }
+  return i;
+}
+#endif  // XE_HAS_AVX512_INTRINSICS
 
-  for (i = 0; i + 4 <= count; i += 4) {
-    input = _mm_loadu_si128((__m128i*)&src[i]);
+struct SwapKernel {
+  size_t (*swap_vectors)(uint8_t* dest, const uint8_t* src, size_t length,
+                         SwapType type);
+  size_t vector_size;
+};
 
-    // Do the four shifts
-    byte1 = _mm_slli_epi32(input, 24);
-    byte2 = _mm_slli_epi32(input, 8);
-    byte3 = _mm_srli_epi32(input, 8);
-    byte4 = _mm_srli_epi32(input, 24);
+SwapKernel GetSwapKernel(CopySwapPath path) {
+  switch (path) {
+    default:
+    case CopySwapPath::kSSE2:
+      return {SwapVectorsSSE2, 16};
+    case CopySwapPath::kSSSE3:
+      return {SwapVectorsSSSE3, 16};
+    case CopySwapPath::kAVX2:
+      return {SwapVectorsAVX2, 32};
+#if XE_HAS_AVX512_INTRINSICS
+    case CopySwapPath::kAVX512:
+      return {SwapVectorsAVX512, 64};
+#endif  // XE_HAS_AVX512_INTRINSICS
+  }
+}
+
+SwapKernel& active_swap_kernel() {
+  static SwapKernel kernel = [] {
+    for (auto path : {CopySwapPath::kAVX512, CopySwapPath::kAVX2,
+                      CopySwapPath::kSSSE3}) {
+      if (is_copy_and_swap_path_supported(path)) {
+        return GetSwapKernel(path);
+      }
+    }
+    return GetSwapKernel(CopySwapPath::kSSE2);
+  }();
+  return kernel;
+}
 
-    // Or bytes together
-    output = _mm_or_si128(byte1, byte4);
-    byte2 = _mm_and_si128(byte2, byte2mask);
-    output = _mm_or_si128(output, byte2);
-    byte3 = _mm_and_si128(byte3, byte3mask);
-    output = _mm_or_si128(output, byte3);
+void CopyAndSwap(void* dest_ptr, const void* src_ptr, size_t count,
+                 size_t element_size, SwapType type) {
+  auto dest = reinterpret_cast<uint8_t*>(dest_ptr);
+  auto src = reinterpret_cast<const uint8_t*>(src_ptr);
+  size_t length = count * element_size;
+  const auto& kernel = active_swap_kernel();
 
-    _mm_storeu_si128((__m128i*)&dest[i], output);
+  // Swap single elements up to a vector boundary in dest so that no store
+  // splits a cache line and large copies can stream. Elements that aren't
+  // naturally aligned will never reach one.
+  size_t head = 0;
+  auto dest_address = reinterpret_cast<uintptr_t>(dest);
+  if (!(dest_address % element_size)) {
+    head = (kernel.vector_size - dest_address % kernel.vector_size) %
+           kernel.vector_size;
+    head = std::min(head, length);
   }
+  SwapScalar(dest, src, head, type);
+  size_t done =
+      head + kernel.swap_vectors(dest + head, src + head, length - head, type);
+  SwapScalar(dest + done, src + done, length - done, type);
+}
+
+}  // namespace
 
-  for (; i < count; ++i) {  // handle residual elements
-    dest[i] = byte_swap(src[i]);
+bool is_copy_and_swap_path_supported(CopySwapPath path) {
+  uint32_t features = host_cpu_features();
+  switch (path) {
+    case CopySwapPath::kSSE2:
+      return true;
+    case CopySwapPath::kSSSE3:
+      return (features & kCpuFeatureSSSE3) != 0;
+    case CopySwapPath::kAVX2:
+      return (features & kCpuFeatureAVX2) != 0;
+    case CopySwapPath::kAVX512:
+      return XE_HAS_AVX512_INTRINSICS &&
+             (features & kCpuFeatureAVX512BW) != 0;
+    default:
+      return false;
   }
 }
 
-void copy_and_swap_64_aligned(uint64_t* dest, const uint64_t* src,
+void set_copy_and_swap_path(CopySwapPath path) {
+  assert_true(is_copy_and_swap_path_supported(path));
+  active_swap_kernel() = GetSwapKernel(path);
+}
+
+void copy_and_swap_16_aligned(uint16_t* dest, const uint16_t* src,
                               size_t count) {
-  return copy_and_swap_64_unaligned(dest, src, count);
+  CopyAndSwap(dest, src, count, 2, kSwap16);
 }
 
-void copy_and_swap_64_unaligned(uint64_t* dest, const uint64_t* src,
+void copy_and_swap_16_unaligned(uint16_t* dest, const uint16_t* src,
                                 size_t count) {
-  size_t i;
-  __m128i input, byte1, byte2, byte3, byte4, output;
-  __m128i byte2mask = _mm_set1_epi32(0x00FF0000);
-  __m128i byte3mask = _mm_set1_epi32(0x0000FF00);
-
-  for (i = 0; i + 2 <= count; i += 2) {
-    input = _mm_loadu_si128((__m128i*)&src[i]);
-
-    // Do the four shifts
-    byte1 = _mm_slli_epi32(input, 24);
-    byte2 = _mm_slli_epi32(input, 8);
-    byte3 = _mm_srli_epi32(input, 8);
-    byte4 = _mm_srli_epi32(input, 24);
+  CopyAndSwap(dest, src, count, 2, kSwap16);
+}
 
-    // Or bytes together
-    output = _mm_or_si128(byte1, byte4);
-    byte2 = _mm_and_si128(byte2, byte2mask);
-    output = _mm_or_si128(output, byte2);
-    byte3 = _mm_and_si128(byte3, byte3mask);
-    output = _mm_or_si128(output, byte3);
+void copy_and_swap_32_aligned(uint32_t* dest, const uint32_t* src,
+                              size_t count) {
+  CopyAndSwap(dest, src, count, 4, kSwap32);
+}
 
-    // Reorder the two words
-    output = _mm_shuffle_epi32(output, _MM_SHUFFLE(2, 3, 0, 1));
+void copy_and_swap_32_unaligned(uint32_t* dest, const uint32_t* src,
+                                size_t count) {
+  CopyAndSwap(dest, src, count, 4, kSwap32);
+}
 
-    _mm_storeu_si128((__m128i*)&dest[i], output);
-  }
+void copy_and_swap_64_aligned(uint64_t* dest, const uint64_t* src,
+                              size_t count) {
+  CopyAndSwap(dest, src, count, 8, kSwap64);
+}
 
-  for (; i < count; ++i) {  // handle residual elements
-    dest[i] = byte_swap(src[i]);
-  }
+void copy_and_swap_64_unaligned(uint64_t* dest, const uint64_t* src,
+                                size_t count) {
+  CopyAndSwap(dest, src, count, 8, kSwap64);
 }
 
 void copy_and_swap_16_in_32_aligned(uint32_t* dest, const uint32_t* src,
                                     size_t count) {
-  size_t i;
-  __m128i input, output;
-  for (i = 0; i + 4 <= count; i += 4) {
-    input = _mm_loadu_si128((__m128i*)&src[i]);
-    output = _mm_or_si128(_mm_slli_epi32(input, 16), _mm_srli_epi32(input, 16));
-    _mm_storeu_si128((__m128i*)&dest[i], output);
-  }
-  for (; i < count; ++i) {  // handle residual elements
-    dest[i] = (src[i] >> 16) | (src[i] << 16);
-  }
+  CopyAndSwap(dest, src, count, 4, kSwap16In32);
 }
 
 }  // namespace xe
@@ -89,6 +89,9 @@ inline void* low_address(void* address) {
   return reinterpret_cast<void*>(uint64_t(address) & 0xFFFFFFFF);
 }
 
+// Byte swapping copies. The _aligned versions require elements at their
+// natural alignment. Large copies are written around the cache, as their
+// output is rarely read back by the CPU soon after.
 void copy_and_swap_16_aligned(uint16_t* dest, const uint16_t* src,
                               size_t count);
 void copy_and_swap_16_unaligned(uint16_t* dest, const uint16_t* src,
@@ -104,6 +107,19 @@ void copy_and_swap_64_unaligned(uint64_t* dest, const uint64_t* src,
 void copy_and_swap_16_in_32_aligned(uint32_t* dest, const uint32_t* src,
                                     size_t count);
 
+// Instruction set paths for the copy_and_swap functions. The best one the
+// host supports is used unless set_copy_and_swap_path says otherwise.
+enum class CopySwapPath {
+  kSSE2,
+  kSSSE3,
+  kAVX2,
+  kAVX512,
+};
+bool is_copy_and_swap_path_supported(CopySwapPath path);
+// Makes all copy_and_swap calls take the given, supported, path. Not thread
+// safe; for tests and benchmarks.
+void set_copy_and_swap_path(CopySwapPath path);
+
 template <typename T>
 void copy_and_swap(T* dest, const T* src, size_t count) {
   bool is_aligned = reinterpret_cast<uintptr_t>(dest) % 32 == 0 &&
@@ -10,10 +10,136 @@
 #include "third_party/catch/include/catch.hpp"
 #include "xenia/base/memory.h"
 
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
 using namespace xe;
 using namespace xe::memory;
 
-TEST_CASE("copy_and_swap_16_aligned", "Copy and Swap") {
-  // TODO(benvanik): tests.
-  REQUIRE(true == true);
+namespace {
+
+const CopySwapPath kAllPaths[] = {CopySwapPath::kSSE2, CopySwapPath::kSSSE3,
+                                  CopySwapPath::kAVX2, CopySwapPath::kAVX512};
+const char* kPathNames[] = {"SSE2", "SSSE3", "AVX2", "AVX-512"};
+
+std::vector<uint8_t> MakeSource(size_t length) {
+  std::vector<uint8_t> data(length);
+  for (size_t i = 0; i < length; ++i) {
+    data[i] = uint8_t(i * 7 + 3);
+  }
+  return data;
+}
+
+// Swaps bytes within each element_size group the way the functions should,
+// with 16-in-32 swapping the halves of each word.
+std::vector<uint8_t> ReferenceSwap(const uint8_t* src, size_t length,
+                                   size_t element_size, bool halves) {
+  std::vector<uint8_t> result(length);
+  for (size_t i = 0; i < length; i += element_size) {
+    for (size_t j = 0; j < element_size; ++j) {
+      size_t from = halves ? (j ^ 2) : (element_size - 1 - j);
+      result[i + j] = src[i + from];
+    }
+  }
+  return result;
+}
+
+// Runs one of the copy_and_swap functions by element size.
+void CopyAndSwap(int kind, uint8_t* dest, const uint8_t* src, size_t count) {
+  switch (kind) {
+    case 0:
+      copy_and_swap_16_unaligned(reinterpret_cast<uint16_t*>(dest),
+                                 reinterpret_cast<const uint16_t*>(src), count);
+      break;
+    case 1:
+      copy_and_swap_32_unaligned(reinterpret_cast<uint32_t*>(dest),
+                                 reinterpret_cast<const uint32_t*>(src), count);
+      break;
+    case 2:
+      copy_and_swap_64_unaligned(reinterpret_cast<uint64_t*>(dest),
+                                 reinterpret_cast<const uint64_t*>(src), count);
+      break;
+    case 3:
+      copy_and_swap_16_in_32_aligned(reinterpret_cast<uint32_t*>(dest),
+                                     reinterpret_cast<const uint32_t*>(src),
+                                     count);
+      break;
+  }
+}
+const size_t kElementSizes[] = {2, 4, 8, 4};
+
+void CheckCopyAndSwap(int kind, size_t count, size_t src_offset,
+                      size_t dest_offset) {
+  size_t element_size = kElementSizes[kind];
+  size_t length = count * element_size;
+  auto src = MakeSource(length + src_offset);
+  // Guard bytes on either side catch writes out of bounds.
+  std::vector<uint8_t> dest(length + dest_offset + 64, 0xCD);
+  CopyAndSwap(kind, dest.data() + dest_offset, src.data() + src_offset, count);
+  auto expected =
+      ReferenceSwap(src.data() + src_offset, length, element_size, kind == 3);
+  REQUIRE(std::memcmp(dest.data() + dest_offset, expected.data(), length) ==
+          0);
+  for (size_t i = 0; i < dest_offset; ++i) {
+    REQUIRE(dest[i] == 0xCD);
+  }
+  for (size_t i = dest_offset + length; i < dest.size(); ++i) {
+    REQUIRE(dest[i] == 0xCD);
+  }
+}
+
+}  // namespace
+
+TEST_CASE("copy_and_swap", "Copy and Swap") {
+  for (size_t p = 0; p < 4; ++p) {
+    if (!is_copy_and_swap_path_supported(kAllPaths[p])) {
+      continue;
+    }
+    set_copy_and_swap_path(kAllPaths[p]);
+    INFO(kPathNames[p]);
+    for (int kind = 0; kind < 4; ++kind) {
+      for (size_t count = 0; count < 80; ++count) {
+        for (size_t src_offset = 0; src_offset < 9; ++src_offset) {
+          for (size_t dest_offset : {0, 1, 2, 4, 8, 12, 36}) {
+            CheckCopyAndSwap(kind, count, src_offset, dest_offset);
+          }
+        }
+      }
+      // Past the size where stores bypass the cache.
+      CheckCopyAndSwap(kind, (2 * 1024 * 1024 + 8) / kElementSizes[kind], 0,
+                       0);
+      CheckCopyAndSwap(kind, (2 * 1024 * 1024 + 8) / kElementSizes[kind], 3,
+                       8);
+    }
+  }
+}
+
+TEST_CASE("copy_and_swap_benchmark", "[.][benchmark]") {
+  const size_t kTotalBytes = 1024 * 1024 * 1024;
+  auto src = MakeSource(16 * 1024 * 1024);
+  std::vector<uint8_t> dest(src.size());
+  for (size_t p = 0; p < 4; ++p) {
+    if (!is_copy_and_swap_path_supported(kAllPaths[p])) {
+      continue;
+    }
+    set_copy_and_swap_path(kAllPaths[p]);
+    std::printf("copy_and_swap_32 %s:", kPathNames[p]);
+    for (size_t length = 256; length <= src.size(); length *= 16) {
+      size_t count = length / 4;
+      auto start = std::chrono::high_resolution_clock::now();
+      for (size_t done = 0; done < kTotalBytes; done += length) {
+        copy_and_swap_32_aligned(reinterpret_cast<uint32_t*>(dest.data()),
+                                 reinterpret_cast<const uint32_t*>(src.data()),
+                                 count);
+      }
+      double seconds = std::chrono::duration<double>(
+                           std::chrono::high_resolution_clock::now() - start)
+                           .count();
+      std::printf(" %zuB %.1f GB/s", length,
+                  kTotalBytes / seconds / (1024.0 * 1024.0 * 1024.0));
+    }
+    std::printf("\n");
+  }
 }
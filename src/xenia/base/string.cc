@@ -41,6 +41,15 @@ std::string::size_type find_first_of_case(const std::string& target,
   }
 }
 
+std::string to_lower_ascii(std::string value) {
+  for (auto& c : value) {
+    if (c >= 'A' && c <= 'Z') {
+      c += 'a' - 'A';
+    }
+  }
+  return value;
+}
+
 std::wstring to_absolute_path(const std::wstring& path) {
 #if XE_PLATFORM_WIN32
   wchar_t buffer[xe::max_path];
@@ -25,6 +25,9 @@ std::wstring to_wstring(const std::string& source);
 std::string::size_type find_first_of_case(const std::string& target,
                                           const std::string& search);
 
+// Lowercases ASCII letters only, folding case the same way strcasecmp does.
+std::string to_lower_ascii(std::string value);
+
 // Converts the given path to an absolute path based on cwd.
 std::wstring to_absolute_path(const std::wstring& path);
 
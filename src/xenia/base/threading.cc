@@ -0,0 +1,84 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/threading.h"
+
+#include <algorithm>
+
+#include "xenia/base/platform.h"
+
+namespace xe {
+namespace threading {
+
+#if !XE_PLATFORM_LINUX
+
+// Address waits without a native futex: waiters queue in one of a fixed set
+// of buckets picked by address, each with its own condition variable so a
+// wake only disturbs the thread it picks.
+namespace {
+
+struct AddressWaiter {
+  volatile uint32_t* address;
+  bool woken;
+  std::condition_variable cond;
+};
+
+struct AddressWaitBucket {
+  std::mutex mutex;
+  std::vector<AddressWaiter*> waiters;
+};
+
+AddressWaitBucket* GetAddressWaitBucket(volatile uint32_t* address) {
+  static AddressWaitBucket buckets[256];
+  uintptr_t key = reinterpret_cast<uintptr_t>(address);
+  return &buckets[(key >> 2 ^ key >> 10) % 256];
+}
+
+}  // namespace
+
+void WaitOnAddress(volatile uint32_t* address, uint32_t expected_value,
+                   std::chrono::milliseconds timeout) {
+  auto bucket = GetAddressWaitBucket(address);
+  std::unique_lock<std::mutex> lock(bucket->mutex);
+  if (*address != expected_value) {
+    return;
+  }
+  AddressWaiter waiter;
+  waiter.address = address;
+  waiter.woken = false;
+  bucket->waiters.push_back(&waiter);
+  if (timeout == std::chrono::milliseconds::max()) {
+    waiter.cond.wait(lock, [&waiter] { return waiter.woken; });
+  } else {
+    waiter.cond.wait_for(lock, timeout, [&waiter] { return waiter.woken; });
+  }
+  if (!waiter.woken) {
+    bucket->waiters.erase(
+        std::find(bucket->waiters.begin(), bucket->waiters.end(), &waiter));
+  }
+}
+
+void WakeOneOnAddress(volatile uint32_t* address) {
+  auto bucket = GetAddressWaitBucket(address);
+  std::lock_guard<std::mutex> lock(bucket->mutex);
+  for (auto it = bucket->waiters.begin(); it != bucket->waiters.end(); ++it) {
+    auto waiter = *it;
+    if (waiter->address == address) {
+      bucket->waiters.erase(it);
+      waiter->woken = true;
+      waiter->cond.notify_one();
+      return;
+    }
+  }
+}
+
+#endif  // !XE_PLATFORM_LINUX
+
+}  // namespace threading
+}  // namespace xe
@@ -68,6 +68,17 @@ void MaybeYield();
 // Memory barrier (request - may be ignored).
 void SyncMemory();
 
+// Futex-style parking keyed by address. Blocks the calling thread while
+// *address equals expected_value, until WakeOneOnAddress is called on the
+// same address or the timeout expires. May also return spuriously, so
+// callers must recheck whatever they are waiting for.
+void WaitOnAddress(volatile uint32_t* address, uint32_t expected_value,
+                   std::chrono::milliseconds timeout =
+                       std::chrono::milliseconds::max());
+// Wakes at most one thread blocked in WaitOnAddress on the address. Call
+// after changing the value at the address.
+void WakeOneOnAddress(volatile uint32_t* address);
+
 // Sleeps the current thread for at least as long as the given duration.
 void Sleep(std::chrono::microseconds duration);
 template <typename Rep, typename Period>
@@ -10,7 +10,15 @@
 #include "xenia/base/threading.h"
 
 #include <pthread.h>
+#include <sys/syscall.h>
 #include <time.h>
+#include <unistd.h>
+
+#include "xenia/base/platform.h"
+
+#if XE_PLATFORM_LINUX
+#include <linux/futex.h>
+#endif  // XE_PLATFORM_LINUX
 
 namespace xe {
 namespace threading {
@@ -32,6 +40,28 @@ void set_name(std::thread::native_handle_type handle, const std::string& name) {
 
 void MaybeYield() { pthread_yield_np(); }
 
+// Other platforms use the portable versions in threading.cc.
+#if XE_PLATFORM_LINUX
+
+void WaitOnAddress(volatile uint32_t* address, uint32_t expected_value,
+                   std::chrono::milliseconds timeout) {
+  timespec timeout_spec;
+  timespec* timeout_ptr = nullptr;
+  if (timeout != std::chrono::milliseconds::max()) {
+    timeout_spec.tv_sec = timeout.count() / 1000;
+    timeout_spec.tv_nsec = (timeout.count() % 1000) * 1000000;
+    timeout_ptr = &timeout_spec;
+  }
+  syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, expected_value, timeout_ptr,
+          nullptr, 0);
+}
+
+void WakeOneOnAddress(volatile uint32_t* address) {
+  syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+#endif  // XE_PLATFORM_LINUX
+
 void Sleep(std::chrono::microseconds duration) {
   timespec rqtp = {duration.count() / 1000000, duration.count() % 1000};
   nanosleep(&rqtp, nullptr);
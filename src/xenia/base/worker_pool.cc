@@ -0,0 +1,118 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/worker_pool.h"
+
+#include <algorithm>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace threading {
+
+WorkerPool* WorkerPool::shared() {
+  // Never destroyed, as jobs may still be started during static destruction.
+  static WorkerPool* pool =
+      new WorkerPool(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+  return pool;
+}
+
+WorkerPool::WorkerPool(uint32_t worker_count) {
+  for (uint32_t i = 0; i < worker_count; ++i) {
+    workers_.emplace_back([this]() { WorkerThread(); });
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<xe::mutex> lock(mutex_);
+    shutting_down_ = true;
+  }
+  work_cond_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void WorkerPool::ParallelFor(size_t count, uint32_t max_threads,
+                             const std::function<void(size_t)>& fn) {
+  Job job;
+  job.fn = &fn;
+  job.count = count;
+  job.max_workers = uint32_t(std::min(
+      {size_t(std::max(max_threads, 1u) - 1), count ? count - 1 : 0,
+       workers_.size()}));
+  job.next_index = 0;
+  job.worker_count = 0;
+  if (!job.max_workers) {
+    job.Run();
+    return;
+  }
+
+  {
+    std::lock_guard<xe::mutex> lock(mutex_);
+    jobs_.push_back(&job);
+  }
+  if (job.max_workers == 1) {
+    work_cond_.notify_one();
+  } else {
+    work_cond_.notify_all();
+  }
+  job.Run();
+
+  // Every index has been claimed. Wait for the workers still running them.
+  std::unique_lock<xe::mutex> lock(mutex_);
+  auto it = std::find(jobs_.begin(), jobs_.end(), &job);
+  if (it != jobs_.end()) {
+    jobs_.erase(it);
+  }
+  done_cond_.wait(lock, [&job]() { return !job.worker_count; });
+}
+
+void WorkerPool::Job::Run() {
+  size_t index;
+  while ((index = next_index++) < count) {
+    (*fn)(index);
+  }
+}
+
+void WorkerPool::WorkerThread() {
+  xe::threading::set_name("Worker Pool");
+  std::unique_lock<xe::mutex> lock(mutex_);
+  while (true) {
+    Job* job = nullptr;
+    work_cond_.wait(lock, [this, &job]() {
+      for (auto candidate : jobs_) {
+        if (candidate->worker_count < candidate->max_workers) {
+          job = candidate;
+          return true;
+        }
+      }
+      return shutting_down_;
+    });
+    if (!job) {
+      return;
+    }
+    ++job->worker_count;
+    lock.unlock();
+    job->Run();
+    lock.lock();
+    // Nothing is left for anyone else to join in on.
+    auto it = std::find(jobs_.begin(), jobs_.end(), job);
+    if (it != jobs_.end()) {
+      jobs_.erase(it);
+    }
+    if (!--job->worker_count) {
+      done_cond_.notify_all();
+    }
+  }
+}
+
+}  // namespace threading
+}  // namespace xe
@@ -0,0 +1,76 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_WORKER_POOL_H_
+#define XENIA_BASE_WORKER_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "xenia/base/mutex.h"
+
+namespace xe {
+namespace threading {
+
+// Long-lived threads that split short CPU-bound jobs, such as decrypting or
+// untiling a large buffer, so that each job doesn't create threads of its
+// own. The calling thread always works on its own job as well, so a job
+// still finishes when every worker is busy, including when one job is
+// started from inside another.
+class WorkerPool {
+ public:
+  // The pool shared by everything that splits work across host cores, with
+  // a worker for each host thread but the caller's.
+  static WorkerPool* shared();
+
+  explicit WorkerPool(uint32_t worker_count);
+  ~WorkerPool();
+
+  uint32_t worker_count() const { return uint32_t(workers_.size()); }
+
+  // Calls fn(i) for every i in [0, count) on up to max_threads threads,
+  // the calling thread included, and returns once all calls have returned.
+  void ParallelFor(size_t count, uint32_t max_threads,
+                   const std::function<void(size_t)>& fn);
+
+ private:
+  struct Job {
+    const std::function<void(size_t)>* fn;
+    size_t count;
+    uint32_t max_workers;
+    std::atomic<size_t> next_index;
+    // Workers inside Run. Guarded by mutex_.
+    uint32_t worker_count;
+
+    // Calls fn for unclaimed indices until there are none left.
+    void Run();
+  };
+
+  void WorkerThread();
+
+  std::vector<std::thread> workers_;
+  xe::mutex mutex_;
+  // Signaled when a job is queued or the pool shuts down.
+  std::condition_variable work_cond_;
+  // Signaled when a worker leaves a job.
+  std::condition_variable done_cond_;
+  // Jobs that may still have unclaimed indices.
+  std::deque<Job*> jobs_;
+  bool shutting_down_ = false;
+};
+
+}  // namespace threading
+}  // namespace xe
+
+#endif  // XENIA_BASE_WORKER_POOL_H_
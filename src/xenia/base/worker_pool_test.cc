@@ -0,0 +1,53 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "third_party/catch/include/catch.hpp"
+#include "xenia/base/worker_pool.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using xe::threading::WorkerPool;
+
+TEST_CASE("WORKER_POOL_RUNS_EVERY_INDEX_ONCE", "[threading]") {
+  WorkerPool pool(3);
+  for (uint32_t max_threads : {1, 2, 8}) {
+    std::vector<std::atomic<uint32_t>> calls(1000);
+    for (auto& call : calls) {
+      call = 0;
+    }
+    pool.ParallelFor(calls.size(), max_threads,
+                     [&calls](size_t i) { ++calls[i]; });
+    for (auto& call : calls) {
+      REQUIRE(call.load() == 1);
+    }
+  }
+  // Nothing to do.
+  pool.ParallelFor(0, 4, [](size_t i) { REQUIRE(false); });
+}
+
+TEST_CASE("WORKER_POOL_NESTS_AND_SHARES", "[threading]") {
+  // Jobs started from inside jobs, and from several threads at once, finish
+  // even with every worker busy.
+  WorkerPool pool(2);
+  std::atomic<uint32_t> total(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 3; ++t) {
+    threads.emplace_back([&pool, &total]() {
+      pool.ParallelFor(8, 4, [&pool, &total](size_t i) {
+        pool.ParallelFor(16, 4, [&total](size_t j) { ++total; });
+      });
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  REQUIRE(total.load() == 3 * 8 * 16);
+}
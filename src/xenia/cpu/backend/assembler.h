@@ -12,10 +12,11 @@
 
 #include <memory>
 
+#include "xenia/cpu/function.h"
+
 namespace xe {
 namespace cpu {
 class DebugInfo;
-class Function;
 class FunctionInfo;
 namespace hir {
 class HIRBuilder;
@@ -39,10 +40,21 @@ class Assembler {
   virtual void Reset();
 
   virtual bool Assemble(FunctionInfo* symbol_info, hir::HIRBuilder* builder,
-                        uint32_t debug_info_flags,
+                        uint32_t debug_info_flags, CompileTier tier,
                         std::unique_ptr<DebugInfo> debug_info,
                         Function** out_function) = 0;
 
+  // Attempts to load a previously translated version of the function from a
+  // persistent cache, skipping translation entirely.
+  virtual bool LoadCachedFunction(FunctionInfo* symbol_info,
+                                  Function** out_function) {
+    return false;
+  }
+  // Offers a freshly assembled function to the persistent cache, if any.
+  virtual void StoreCachedFunction(FunctionInfo* symbol_info,
+                                   Function* function,
+                                   uint64_t compile_micros) {}
+
  protected:
   Backend* backend_;
 };
@@ -11,8 +11,10 @@
 
 #include "third_party/capstone/include/capstone.h"
 #include "third_party/capstone/include/x86.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/reset_scope.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
 #include "xenia/cpu/backend/x64/x64_emitter.h"
 #include "xenia/cpu/backend/x64/x64_function.h"
 #include "xenia/cpu/cpu_flags.h"
@@ -67,7 +69,7 @@ void X64Assembler::Reset() {
 }
 
 bool X64Assembler::Assemble(FunctionInfo* symbol_info, HIRBuilder* builder,
-                            uint32_t debug_info_flags,
+                            uint32_t debug_info_flags, CompileTier tier,
                             std::unique_ptr<DebugInfo> debug_info,
                             Function** out_function) {
   SCOPE_profile_cpu_f("cpu");
@@ -78,12 +80,14 @@ bool X64Assembler::Assemble(FunctionInfo* symbol_info, HIRBuilder* builder,
   // Create now, and populate as we go.
   // We may throw it away if we fail.
   auto fn = std::make_unique<X64Function>(symbol_info);
+  fn->set_tier(tier);
 
   // Lower HIR -> x64.
   void* machine_code = nullptr;
   size_t code_size = 0;
-  if (!emitter_->Emit(symbol_info, builder, debug_info_flags, debug_info.get(),
-                      machine_code, code_size, fn->source_map())) {
+  if (!emitter_->Emit(symbol_info, builder, debug_info_flags, tier,
+                      debug_info.get(), machine_code, code_size,
+                      fn->source_map())) {
     return false;
   }
 
@@ -110,6 +114,67 @@ bool X64Assembler::Assemble(FunctionInfo* symbol_info, HIRBuilder* builder,
   return true;
 }
 
+bool X64Assembler::LoadCachedFunction(FunctionInfo* symbol_info,
+                                      Function** out_function) {
+  auto cache_file = x64_backend_->LookupCodeCacheFile(symbol_info->module());
+  if (!cache_file) {
+    return false;
+  }
+  uint64_t start_ticks = Clock::QueryHostTickCount();
+  auto memory = x64_backend_->processor()->memory();
+  auto& cached = cached_function_;
+  if (!cache_file->Load(symbol_info->address(), memory->virtual_membase(),
+                        &cached)) {
+    cache_file->RecordMiss();
+    return false;
+  }
+
+  auto fn = std::make_unique<X64Function>(symbol_info);
+  symbol_info->set_end_address(cached.guest_end_address);
+  size_t code_size = cached.machine_code.size();
+  void* machine_code = x64_backend_->code_cache()->PlaceGuestCode(
+      symbol_info->address(), cached.machine_code.data(), code_size,
+      cached.stack_size, symbol_info);
+  fn->source_map() = std::move(cached.source_map);
+  fn->Setup(reinterpret_cast<uint8_t*>(machine_code), code_size);
+
+  uint64_t load_micros = (Clock::QueryHostTickCount() - start_ticks) *
+                         1000000 / Clock::host_tick_frequency();
+  cache_file->RecordHit(cached, load_micros);
+
+  *out_function = fn.release();
+  return true;
+}
+
+void X64Assembler::StoreCachedFunction(FunctionInfo* symbol_info,
+                                       Function* function,
+                                       uint64_t compile_micros) {
+  // Code that references per-process heap state can't be reused.
+  if (!emitter_->cacheable()) {
+    return;
+  }
+  auto cache_file = x64_backend_->LookupCodeCacheFile(symbol_info->module());
+  if (!cache_file) {
+    return;
+  }
+  auto memory = x64_backend_->processor()->memory();
+  auto x64_function = static_cast<X64Function*>(function);
+  X64CachedFunction cached;
+  cached.guest_address = symbol_info->address();
+  cached.guest_end_address = symbol_info->end_address();
+  cached.guest_hash = X64CodeCacheFile::HashGuestCode(
+      memory->virtual_membase(), cached.guest_address,
+      cached.guest_end_address);
+  cached.stack_size = static_cast<uint32_t>(emitter_->stack_size());
+  cached.compile_micros = static_cast<uint32_t>(compile_micros);
+  cached.machine_code.assign(
+      x64_function->machine_code(),
+      x64_function->machine_code() + x64_function->machine_code_length());
+  cached.relocations = emitter_->relocations();
+  cached.source_map = function->source_map();
+  cache_file->Add(std::move(cached));
+}
+
 void X64Assembler::DumpMachineCode(
     void* machine_code, size_t code_size,
     const std::vector<SourceMapEntry>& source_map, StringBuffer* str) {
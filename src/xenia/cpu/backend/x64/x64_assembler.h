@@ -15,6 +15,7 @@
 
 #include "xenia/base/string_buffer.h"
 #include "xenia/cpu/backend/assembler.h"
+#include "xenia/cpu/backend/x64/x64_code_cache_file.h"
 #include "xenia/cpu/function.h"
 
 namespace xe {
@@ -36,10 +37,15 @@ class X64Assembler : public Assembler {
   void Reset() override;
 
   bool Assemble(FunctionInfo* symbol_info, hir::HIRBuilder* builder,
-                uint32_t debug_info_flags,
+                uint32_t debug_info_flags, CompileTier tier,
                 std::unique_ptr<DebugInfo> debug_info,
                 Function** out_function) override;
 
+  bool LoadCachedFunction(FunctionInfo* symbol_info,
+                          Function** out_function) override;
+  void StoreCachedFunction(FunctionInfo* symbol_info, Function* function,
+                           uint64_t compile_micros) override;
+
  private:
   void DumpMachineCode(void* machine_code, size_t code_size,
                        const std::vector<SourceMapEntry>& source_map,
@@ -51,6 +57,9 @@ class X64Assembler : public Assembler {
   std::unique_ptr<XbyakAllocator> allocator_;
   uintptr_t capstone_handle_;
 
+  // Function loaded from the persistent cache, kept to reuse its buffers.
+  X64CachedFunction cached_function_;
+
   StringBuffer string_buffer_;
 };
 
@@ -9,16 +9,26 @@
 
 #include "xenia/cpu/backend/x64/x64_backend.h"
 
+#include "xenia/base/string.h"
 #include "xenia/cpu/backend/x64/x64_assembler.h"
 #include "xenia/cpu/backend/x64/x64_emitter.h"
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
-#include "xenia/cpu/backend/x64/x64_sequences.h"
+#include "xenia/cpu/backend/x64/x64_code_cache_file.h"
 #include "xenia/cpu/backend/x64/x64_stack_layout.h"
 #include "xenia/cpu/processor.h"
 
 DEFINE_bool(
     enable_haswell_instructions, true,
     "Uses the AVX2/FMA/etc instructions on Haswell processors, if available.");
+DEFINE_bool(jit_patch_calls, true,
+            "Patch direct calls between generated functions to skip the "
+            "indirection table once the target has been compiled.");
+DEFINE_bool(jit_inline_call_cache, false,
+            "Cache the targets of indirect calls (bctrl/etc) at each call site "
+            "instead of always going through the indirection table.");
+DEFINE_string(jit_cache_path, "",
+              "Directory to persist translated code in between runs. Empty to "
+              "disable.");
 
 namespace xe {
 namespace cpu {
@@ -38,6 +48,14 @@ X64Backend::X64Backend(Processor* processor)
     : Backend(processor), code_cache_(nullptr), emitter_data_(0) {}
 
 X64Backend::~X64Backend() {
+  if (code_cache_) {
+    code_cache_->DumpCallSiteStats();
+  }
+  for (auto& it : code_cache_files_) {
+    it.second->Save();
+    it.second->DumpStats();
+  }
+  code_cache_files_.clear();
   if (emitter_data_) {
     processor()->memory()->SystemHeapFree(emitter_data_);
     emitter_data_ = 0;
@@ -49,8 +67,6 @@ bool X64Backend::Initialize() {
     return false;
   }
 
-  RegisterSequences();
-
   // Need movbe to do advanced LOAD/STORE tricks.
   if (FLAGS_enable_haswell_instructions) {
     Xbyak::util::Cpu cpu;
@@ -94,6 +110,14 @@ bool X64Backend::Initialize() {
   // Allocate emitter constant data.
   emitter_data_ = X64Emitter::PlaceData(processor()->memory());
 
+  // Generated code bakes in thunk and constant addresses, so the environment
+  // hash can only be computed once everything above is in place.
+  code_cache_file_enabled_ = !FLAGS_jit_cache_path.empty();
+  if (code_cache_file_enabled_) {
+    code_cache_environment_hash_ = X64CodeCacheFile::ComputeEnvironmentHash(
+        this, thunk_emitter.feature_flags());
+  }
+
   return true;
 }
 
@@ -106,6 +130,26 @@ std::unique_ptr<Assembler> X64Backend::CreateAssembler() {
   return std::make_unique<X64Assembler>(this);
 }
 
+X64CodeCacheFile* X64Backend::LookupCodeCacheFile(Module* module) {
+  if (!code_cache_file_enabled_ || !module) {
+    return nullptr;
+  }
+  uint64_t module_hash = module->content_hash();
+  if (!module_hash) {
+    return nullptr;
+  }
+  std::lock_guard<xe::mutex> guard(code_cache_files_lock_);
+  auto it = code_cache_files_.find(module_hash);
+  if (it != code_cache_files_.end()) {
+    return it->second.get();
+  }
+  auto file = X64CodeCacheFile::Open(this, xe::to_wstring(FLAGS_jit_cache_path),
+                                     module_hash, code_cache_environment_hash_);
+  auto file_ptr = file.get();
+  code_cache_files_[module_hash] = std::move(file);
+  return file_ptr;
+}
+
 using namespace Xbyak;
 
 X64ThunkEmitter::X64ThunkEmitter(X64Backend* backend, XbyakAllocator* allocator)
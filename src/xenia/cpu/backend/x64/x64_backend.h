@@ -13,10 +13,22 @@
 #include <gflags/gflags.h>
 
 #include <memory>
+#include <string>
+#include <unordered_map>
 
+#include "xenia/base/mutex.h"
 #include "xenia/cpu/backend/backend.h"
 
+namespace xe {
+namespace cpu {
+class Module;
+}  // namespace cpu
+}  // namespace xe
+
 DECLARE_bool(enable_haswell_instructions);
+DECLARE_string(jit_cache_path);
+DECLARE_bool(jit_patch_calls);
+DECLARE_bool(jit_inline_call_cache);
 
 namespace xe {
 namespace cpu {
@@ -24,6 +36,7 @@ namespace backend {
 namespace x64 {
 
 class X64CodeCache;
+class X64CodeCacheFile;
 
 #define XENIA_HAS_X64_BACKEND 1
 
@@ -56,9 +69,22 @@ class X64Backend : public Backend {
 
   std::unique_ptr<Assembler> CreateAssembler() override;
 
+  // True if translated functions are persisted to disk between runs.
+  bool code_cache_file_enabled() const { return code_cache_file_enabled_; }
+  // Returns the on-disk code cache for the given module, opening it on first
+  // use. Returns nullptr if caching is disabled or the module cannot be
+  // identified.
+  X64CodeCacheFile* LookupCodeCacheFile(Module* module);
+
  private:
   std::unique_ptr<X64CodeCache> code_cache_;
 
+  bool code_cache_file_enabled_ = false;
+  uint64_t code_cache_environment_hash_ = 0;
+  xe::mutex code_cache_files_lock_;
+  std::unordered_map<uint64_t, std::unique_ptr<X64CodeCacheFile>>
+      code_cache_files_;
+
   uint32_t emitter_data_;
 
   HostToGuestThunk host_to_guest_thunk_;
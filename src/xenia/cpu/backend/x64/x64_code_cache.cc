@@ -13,6 +13,7 @@
 #include <cstring>
 
 #include "xenia/base/assert.h"
+#include "xenia/base/atomic.h"
 #include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
@@ -178,9 +179,27 @@ void* X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
   // Note that we do support code that doesn't have an indirection fixup, so
   // ignore those when we see them.
   if (guest_address) {
-    uint32_t* indirection_slot = reinterpret_cast<uint32_t*>(
-        indirection_table_base_ + (guest_address - kIndirectionTableBase));
-    *indirection_slot = uint32_t(reinterpret_cast<uint64_t>(code_address));
+    std::lock_guard<xe::mutex> call_site_lock(call_site_mutex_);
+    uint32_t* slot = indirection_slot(guest_address);
+    bool first_placement = *slot == indirection_default_value_;
+    // Locked, so that RedirectInlineCallCaches only reads entries after the
+    // new code is visible in the table.
+    xe::atomic_exchange(uint32_t(reinterpret_cast<uint64_t>(code_address)),
+                        slot);
+    // Functions that are recompiled at a higher tier get placed again, in
+    // which case the sites are already counted as patched.
+    auto it = call_sites_.find(guest_address);
+    if (it != call_sites_.end()) {
+      for (auto displacement_address : it->second) {
+        PatchCallSite(displacement_address, code_address);
+      }
+      if (first_placement) {
+        patched_call_site_count_ += it->second.size();
+      }
+    }
+    if (!first_placement) {
+      RedirectInlineCallCaches(guest_address, code_address);
+    }
   }
 
   return code_address;
@@ -220,6 +239,80 @@ uint32_t X64CodeCache::PlaceData(const void* data, size_t length) {
   return uint32_t(uintptr_t(data_address));
 }
 
+uint32_t X64CodeCache::PlaceInlineCallCache(size_t entry_count) {
+  std::vector<uint64_t> entries(entry_count, 0);
+  uint32_t entries_address =
+      PlaceData(entries.data(), entry_count * sizeof(uint64_t));
+  std::lock_guard<xe::mutex> call_site_lock(call_site_mutex_);
+  inline_call_caches_.emplace_back(
+      reinterpret_cast<uint64_t*>(uint64_t(entries_address)), entry_count);
+  return entries_address;
+}
+
+void X64CodeCache::AddCallSite(uint32_t guest_address,
+                               uint8_t* displacement_address) {
+  assert_zero(reinterpret_cast<uintptr_t>(displacement_address) & 3);
+  std::lock_guard<xe::mutex> call_site_lock(call_site_mutex_);
+  ++direct_call_site_count_;
+  call_sites_[guest_address].push_back(displacement_address);
+
+  // Target may have been placed before the caller was.
+  uint32_t target = *indirection_slot(guest_address);
+  if (target != indirection_default_value_) {
+    PatchCallSite(displacement_address,
+                  reinterpret_cast<uint8_t*>(uint64_t(target)));
+    ++patched_call_site_count_;
+  }
+}
+
+void X64CodeCache::PatchCallSite(uint8_t* displacement_address,
+                                 uint8_t* code_address) {
+  // Displacements are relative to the end of the instruction. They are 4b
+  // aligned so this is safe to do while the site is being executed.
+  int32_t displacement =
+      static_cast<int32_t>(code_address - (displacement_address + 4));
+  xe::atomic_exchange(displacement,
+                      reinterpret_cast<int32_t*>(displacement_address));
+}
+
+void X64CodeCache::RedirectInlineCallCaches(uint32_t guest_address,
+                                            uint8_t* code_address) {
+  // Generated code fills entries without taking any lock, so each one is
+  // swapped on its own. An entry filled from the table just before it
+  // changed is either seen here or dropped by the fill itself, which reads
+  // the table again after storing it (see EmitInlineCallCacheMisses).
+  uint64_t new_entry =
+      (uint64_t(reinterpret_cast<uintptr_t>(code_address)) << 32) |
+      guest_address;
+  for (auto& cache : inline_call_caches_) {
+    for (size_t n = 0; n < cache.second; ++n) {
+      uint64_t entry = cache.first[n];
+      if (uint32_t(entry) == guest_address && entry != new_entry &&
+          xe::atomic_cas(entry, new_entry, &cache.first[n])) {
+        ++redirected_inline_call_count_;
+      }
+    }
+  }
+}
+
+X64CodeCache::CallSiteStats X64CodeCache::QueryCallSiteStats() {
+  std::lock_guard<xe::mutex> call_site_lock(call_site_mutex_);
+  CallSiteStats stats;
+  stats.direct_count = direct_call_site_count_;
+  stats.patched_count = patched_call_site_count_;
+  stats.indirect_count = indirect_call_site_count_;
+  stats.redirected_count = redirected_inline_call_count_;
+  return stats;
+}
+
+void X64CodeCache::DumpCallSiteStats() {
+  auto stats = QueryCallSiteStats();
+  XELOGI("JIT: %llu/%llu direct call sites patched, %llu indirect call sites, "
+         "%llu inline call cache entries redirected",
+         stats.patched_count, stats.direct_count, stats.indirect_count,
+         stats.redirected_count);
+}
+
 FunctionInfo* X64CodeCache::LookupFunction(uint64_t host_pc) {
   uint32_t key = uint32_t(host_pc - kGeneratedCodeBase);
   void* fn_entry = std::bsearch(
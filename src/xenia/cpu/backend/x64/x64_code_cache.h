@@ -14,6 +14,7 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "xenia/base/memory.h"
@@ -52,6 +53,33 @@ class X64CodeCache : public CodeCache {
                        size_t code_size, size_t stack_size,
                        FunctionInfo* function_info);
   uint32_t PlaceData(const void* data, size_t length);
+  // Places the zeroed entries of the inline cache of an indirect call site.
+  // Entries are {guest address, host address} qwords filled in by generated
+  // code. Entries for a function are moved to its new code whenever it is
+  // placed again (tier-up).
+  uint32_t PlaceInlineCallCache(size_t entry_count);
+
+  // Registers the rel32 displacement of a direct call/jmp in generated code
+  // that should target the code for guest_address. The site is patched as
+  // soon as the target is placed (or immediately, if it already has been).
+  // Until then it is expected to reach the target via the indirection table.
+  // Sites are repatched whenever the target is placed again (tier-up).
+  void AddCallSite(uint32_t guest_address, uint8_t* displacement_address);
+  // Counts a call that always goes through the indirection table.
+  void RecordIndirectCallSite() { ++indirect_call_site_count_; }
+
+  struct CallSiteStats {
+    // Direct call sites registered with AddCallSite.
+    uint64_t direct_count;
+    // Direct call sites that now jump straight to their target.
+    uint64_t patched_count;
+    // Call sites that always use the indirection table.
+    uint64_t indirect_count;
+    // Inline call cache entries moved to the new code of their target.
+    uint64_t redirected_count;
+  };
+  CallSiteStats QueryCallSiteStats();
+  void DumpCallSiteStats();
 
   FunctionInfo* LookupFunction(uint64_t host_pc) override;
 
@@ -87,6 +115,13 @@ class X64CodeCache : public CodeCache {
                          void* code_address,
                          UnwindReservation unwind_reservation) {}
 
+  uint32_t* indirection_slot(uint32_t guest_address) const {
+    return reinterpret_cast<uint32_t*>(
+        indirection_table_base_ + (guest_address - kIndirectionTableBase));
+  }
+  void PatchCallSite(uint8_t* displacement_address, uint8_t* code_address);
+  void RedirectInlineCallCaches(uint32_t guest_address, uint8_t* code_address);
+
   std::wstring file_name_;
   xe::memory::FileMappingHandle mapping_ = nullptr;
 
@@ -112,6 +147,18 @@ class X64CodeCache : public CodeCache {
   // This can be used to bsearch on host PC to find the guest function.
   // The key is [start address | end address].
   std::vector<std::pair<uint64_t, FunctionInfo*>> generated_code_map_;
+
+  // Guards the call site map and publication of guest code in the
+  // indirection table, so that a site is never missed by a concurrent place.
+  xe::mutex call_site_mutex_;
+  // Displacement addresses of direct calls, by target guest address.
+  std::unordered_map<uint32_t, std::vector<uint8_t*>> call_sites_;
+  uint64_t direct_call_site_count_ = 0;
+  uint64_t patched_call_site_count_ = 0;
+  // Entries and entry counts of every inline call cache placed.
+  std::vector<std::pair<uint64_t*, size_t>> inline_call_caches_;
+  uint64_t redirected_inline_call_count_ = 0;
+  std::atomic<uint64_t> indirect_call_site_count_ = {0};
 };
 
 }  // namespace x64
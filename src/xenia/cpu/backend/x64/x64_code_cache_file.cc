@@ -0,0 +1,519 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/x64/x64_code_cache_file.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "third_party/xxhash/xxhash.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/platform.h"
+#include "xenia/base/string.h"
+#include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
+#include "xenia/cpu/backend/x64/x64_emitter.h"
+#include "xenia/cpu/processor.h"
+
+#if XE_PLATFORM_WIN32
+#include "xenia/base/platform_win.h"
+#else
+#include <dlfcn.h>
+#include <sys/stat.h>
+#if XE_PLATFORM_LINUX
+#include <elf.h>
+#include <link.h>
+#endif  // XE_PLATFORM_LINUX
+#endif  // XE_PLATFORM_WIN32
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+namespace {
+
+const uint32_t kFileMagic = 'XJC0';
+// Bump when the file layout changes.
+const uint32_t kFileVersion = 1;
+
+struct FileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t module_hash;
+  uint64_t environment_hash;
+  uint32_t entry_count;
+  uint32_t reserved;
+};
+static_assert(sizeof(FileHeader) == 32, "File header layout changed");
+
+// Size of the data of an entry: its machine code padded to 16b, followed by
+// its relocations and source map.
+uint64_t GetEntryDataSize(const X64CodeCacheFile::Entry& entry) {
+  return xe::round_up(uint64_t(entry.code_size), 16) +
+         uint64_t(entry.relocation_count) * sizeof(X64Relocation) +
+         uint64_t(entry.source_map_count) * sizeof(SourceMapEntry);
+}
+
+// Checks every entry of a mapped file, so that nothing read through the index
+// later can fall outside of the mapping.
+bool ValidateEntries(const MappedMemory& mapping) {
+  auto header = reinterpret_cast<const FileHeader*>(mapping.data());
+  auto entries = reinterpret_cast<const X64CodeCacheFile::Entry*>(
+      mapping.data() + sizeof(FileHeader));
+  uint64_t data_base = sizeof(FileHeader) +
+                       uint64_t(header->entry_count) *
+                           sizeof(X64CodeCacheFile::Entry);
+  for (uint32_t i = 0; i < header->entry_count; ++i) {
+    auto& entry = entries[i];
+    if (entry.guest_end_address < entry.guest_address) {
+      return false;
+    }
+    // Lookup binary searches the index.
+    if (i && entries[i - 1].guest_address >= entry.guest_address) {
+      return false;
+    }
+    if (entry.data_offset < data_base || entry.data_offset % 16 ||
+        entry.data_offset + GetEntryDataSize(entry) > mapping.size()) {
+      return false;
+    }
+    auto relocations = reinterpret_cast<const X64Relocation*>(
+        mapping.data() + entry.data_offset +
+        xe::round_up(uint64_t(entry.code_size), 16));
+    for (uint32_t j = 0; j < entry.relocation_count; ++j) {
+      auto& relocation = relocations[j];
+      if (uint64_t(relocation.code_offset) + 8 > entry.code_size) {
+        return false;
+      }
+      switch (relocation.type) {
+        case X64RelocationType::kImageAddress:
+          break;
+        case X64RelocationType::kThunk:
+          if (relocation.value > uint64_t(X64ThunkId::kResolveFunction)) {
+            return false;
+          }
+          break;
+        default:
+          return false;
+      }
+    }
+  }
+  return true;
+}
+
+#if !XE_PLATFORM_WIN32
+// Size and modification time of the file at path, which change whenever it
+// is relinked.
+uint64_t QueryFileStamp(const char* path) {
+  struct stat file_stat;
+  if (!path || stat(path, &file_stat) != 0) {
+    return 0;
+  }
+  uint64_t stamp[2] = {uint64_t(file_stat.st_size),
+                       uint64_t(file_stat.st_mtime)};
+  return XXH64(stamp, sizeof(stamp), 0);
+}
+#endif  // !XE_PLATFORM_WIN32
+
+#if XE_PLATFORM_LINUX
+// Hash of the GNU build ID note of the executable, or 0 if it was linked
+// without one.
+uint64_t QueryBuildId() {
+  uint64_t build_id = 0;
+  dl_iterate_phdr(
+      [](struct dl_phdr_info* info, size_t size, void* data) {
+        for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+          auto& phdr = info->dlpi_phdr[i];
+          if (phdr.p_type != PT_NOTE) {
+            continue;
+          }
+          auto note =
+              reinterpret_cast<const uint8_t*>(info->dlpi_addr + phdr.p_vaddr);
+          auto note_end = note + phdr.p_memsz;
+          while (note + sizeof(ElfW(Nhdr)) <= note_end) {
+            auto note_header = reinterpret_cast<const ElfW(Nhdr)*>(note);
+            auto name = note + sizeof(ElfW(Nhdr));
+            auto desc = name + ((note_header->n_namesz + 3) & ~3u);
+            if (note_header->n_type == NT_GNU_BUILD_ID &&
+                note_header->n_namesz == 4 &&
+                std::memcmp(name, "GNU", 4) == 0) {
+              *reinterpret_cast<uint64_t*>(data) =
+                  XXH64(desc, note_header->n_descsz, 0);
+              return 1;
+            }
+            note = desc + ((note_header->n_descsz + 3) & ~3u);
+          }
+        }
+        // The executable is always listed first.
+        return 1;
+      },
+      &build_id);
+  return build_id;
+}
+#endif  // XE_PLATFORM_LINUX
+
+// Identifies the host binary. Image-relative relocations are only valid for
+// the exact binary that produced them.
+uint64_t QueryHostImageId() {
+#if XE_PLATFORM_WIN32
+  // Link timestamp of the executable; changes on every relink.
+  auto image_base = reinterpret_cast<const uint8_t*>(GetModuleHandle(nullptr));
+  auto dos_header = reinterpret_cast<const IMAGE_DOS_HEADER*>(image_base);
+  auto nt_headers = reinterpret_cast<const IMAGE_NT_HEADERS*>(
+      image_base + dos_header->e_lfanew);
+  return nt_headers->FileHeader.TimeDateStamp |
+         (uint64_t(nt_headers->OptionalHeader.SizeOfImage) << 32);
+#elif XE_PLATFORM_LINUX
+  // Build ID if the linker wrote one, otherwise the executable file itself.
+  uint64_t build_id = QueryBuildId();
+  return build_id ? build_id : QueryFileStamp("/proc/self/exe");
+#else
+  // The image containing this function is the executable.
+  Dl_info info;
+  if (!dladdr(reinterpret_cast<void*>(&QueryHostImageId), &info)) {
+    return 0;
+  }
+  return QueryFileStamp(info.dli_fname);
+#endif  // XE_PLATFORM_WIN32
+}
+
+}  // namespace
+
+X64CodeCacheFile::X64CodeCacheFile(X64Backend* backend, std::wstring path,
+                                   uint64_t module_hash,
+                                   uint64_t environment_hash)
+    : backend_(backend),
+      path_(std::move(path)),
+      module_hash_(module_hash),
+      environment_hash_(environment_hash) {}
+
+X64CodeCacheFile::~X64CodeCacheFile() = default;
+
+uint64_t X64CodeCacheFile::ComputeEnvironmentHash(X64Backend* backend,
+                                                  uint32_t feature_flags) {
+  struct {
+    uint32_t file_version;
+    uint32_t codegen_version;
+    uint64_t host_image_id;
+    uint32_t feature_flags;
+    uint32_t emitter_data;
+    uint64_t thunks[3];
+  } environment;
+  std::memset(&environment, 0, sizeof(environment));
+  environment.file_version = kFileVersion;
+  environment.codegen_version = X64Emitter::kCodegenVersion;
+  environment.host_image_id = QueryHostImageId();
+  environment.feature_flags = feature_flags;
+  // The constant table is addressed relative to membase.
+  environment.emitter_data = backend->emitter_data();
+  // Thunks are in the code cache at fixed addresses, but relocate them anyway
+  // and only hash their relative layout.
+  uint64_t code_base = backend->code_cache()->base_address();
+  environment.thunks[0] =
+      reinterpret_cast<uint64_t>(backend->host_to_guest_thunk()) - code_base;
+  environment.thunks[1] =
+      reinterpret_cast<uint64_t>(backend->guest_to_host_thunk()) - code_base;
+  environment.thunks[2] =
+      reinterpret_cast<uint64_t>(backend->resolve_function_thunk()) -
+      code_base;
+  return XXH64(&environment, sizeof(environment), 0);
+}
+
+uint64_t X64CodeCacheFile::ImageOffset(const void* address) {
+  auto anchor = reinterpret_cast<uint64_t>(&X64CodeCacheFile::ImageOffset);
+  return reinterpret_cast<uint64_t>(address) - anchor;
+}
+
+uint64_t X64CodeCacheFile::HashGuestCode(const uint8_t* guest_base,
+                                         uint32_t guest_address,
+                                         uint32_t guest_end_address) {
+  // End address is inclusive of the last instruction.
+  return XXH64(guest_base + guest_address,
+               guest_end_address - guest_address + 4, guest_address);
+}
+
+std::unique_ptr<X64CodeCacheFile> X64CodeCacheFile::Open(
+    X64Backend* backend, const std::wstring& root_path, uint64_t module_hash,
+    uint64_t environment_hash) {
+  wchar_t file_name[32];
+  std::swprintf(file_name, xe::countof(file_name), L"%.16llX.xjc",
+                module_hash);
+  auto path = xe::join_paths(root_path, file_name);
+  auto file = std::unique_ptr<X64CodeCacheFile>(
+      new X64CodeCacheFile(backend, path, module_hash, environment_hash));
+
+  if (!xe::filesystem::PathExists(path)) {
+    // Nothing yet - will be created on save.
+    return file;
+  }
+  auto mapping = MappedMemory::Open(path, MappedMemory::Mode::kRead);
+  if (!mapping || mapping->size() < sizeof(FileHeader)) {
+    XELOGW("JIT cache: unable to map %S, ignoring", path.c_str());
+    return file;
+  }
+  auto header = reinterpret_cast<const FileHeader*>(mapping->data());
+  if (header->magic != kFileMagic || header->version != kFileVersion ||
+      header->module_hash != module_hash) {
+    XELOGW("JIT cache: %S is not a valid cache file, ignoring", path.c_str());
+    return file;
+  }
+  if (header->environment_hash != environment_hash) {
+    XELOGI("JIT cache: %S was built by a different version/host, discarding",
+           path.c_str());
+    return file;
+  }
+  if (sizeof(FileHeader) + header->entry_count * sizeof(Entry) >
+      mapping->size()) {
+    XELOGW("JIT cache: %S is truncated, ignoring", path.c_str());
+    return file;
+  }
+  if (!ValidateEntries(*mapping)) {
+    XELOGW("JIT cache: %S is corrupt, ignoring", path.c_str());
+    return file;
+  }
+  file->entries_ =
+      reinterpret_cast<const Entry*>(mapping->data() + sizeof(FileHeader));
+  file->entry_count_ = header->entry_count;
+  file->mapping_ = std::move(mapping);
+  XELOGI("JIT cache: loaded %d functions from %S", file->entry_count_,
+         path.c_str());
+  return file;
+}
+
+const X64CodeCacheFile::Entry* X64CodeCacheFile::Lookup(
+    uint32_t guest_address, const uint8_t* guest_base) {
+  auto end = entries_ + entry_count_;
+  auto it = std::lower_bound(entries_, end, guest_address,
+                             [](const Entry& entry, uint32_t address) {
+                               return entry.guest_address < address;
+                             });
+  if (it == end || it->guest_address != guest_address) {
+    return nullptr;
+  }
+  if (HashGuestCode(guest_base, it->guest_address, it->guest_end_address) !=
+      it->guest_hash) {
+    // Guest code changed (patched/different title update/etc).
+    ++stale_count_;
+    return nullptr;
+  }
+  return it;
+}
+
+uint64_t X64CodeCacheFile::ResolveRelocation(const X64Relocation& relocation) {
+  switch (relocation.type) {
+    case X64RelocationType::kImageAddress:
+      return reinterpret_cast<uint64_t>(&X64CodeCacheFile::ImageOffset) +
+             relocation.value;
+    case X64RelocationType::kThunk:
+      switch (static_cast<X64ThunkId>(relocation.value)) {
+        case X64ThunkId::kHostToGuest:
+          return reinterpret_cast<uint64_t>(backend_->host_to_guest_thunk());
+        case X64ThunkId::kGuestToHost:
+          return reinterpret_cast<uint64_t>(backend_->guest_to_host_thunk());
+        case X64ThunkId::kResolveFunction:
+          return reinterpret_cast<uint64_t>(
+              backend_->resolve_function_thunk());
+      }
+      break;
+  }
+  assert_always("Unknown relocation");
+  return 0;
+}
+
+bool X64CodeCacheFile::Load(uint32_t guest_address, const uint8_t* guest_base,
+                            X64CachedFunction* out_function) {
+  // Save may replace the mapping at any time otherwise.
+  std::lock_guard<xe::mutex> guard(lock_);
+  auto entry = Lookup(guest_address, guest_base);
+  if (!entry) {
+    return false;
+  }
+  out_function->guest_address = entry->guest_address;
+  out_function->guest_end_address = entry->guest_end_address;
+  out_function->guest_hash = entry->guest_hash;
+  out_function->stack_size = entry->stack_size;
+  out_function->compile_micros = entry->compile_micros;
+
+  // Offsets were all checked against the mapping on Open.
+  const uint8_t* code = mapping_->data() + entry->data_offset;
+  out_function->machine_code.assign(code, code + entry->code_size);
+  auto relocations = reinterpret_cast<const X64Relocation*>(
+      code + xe::round_up(entry->code_size, 16));
+  out_function->relocations.assign(relocations,
+                                   relocations + entry->relocation_count);
+  for (auto& relocation : out_function->relocations) {
+    uint64_t value = ResolveRelocation(relocation);
+    std::memcpy(out_function->machine_code.data() + relocation.code_offset,
+                &value, 8);
+  }
+  auto source_map = reinterpret_cast<const SourceMapEntry*>(
+      relocations + entry->relocation_count);
+  out_function->source_map.assign(source_map,
+                                  source_map + entry->source_map_count);
+  return true;
+}
+
+void X64CodeCacheFile::Add(X64CachedFunction function) {
+  std::lock_guard<xe::mutex> guard(lock_);
+  new_functions_.push_back(std::move(function));
+}
+
+void X64CodeCacheFile::RecordHit(const X64CachedFunction& function,
+                                 uint64_t load_micros) {
+  ++hit_count_;
+  if (function.compile_micros > load_micros) {
+    saved_micros_ += function.compile_micros - load_micros;
+  }
+}
+
+bool X64CodeCacheFile::Save() {
+  std::lock_guard<xe::mutex> guard(lock_);
+  if (new_functions_.empty()) {
+    return true;
+  }
+
+  // Merge new functions over the old ones (new wins, as the old entry must
+  // have been stale for us to have retranslated).
+  std::sort(new_functions_.begin(), new_functions_.end(),
+            [](const X64CachedFunction& a, const X64CachedFunction& b) {
+              return a.guest_address < b.guest_address;
+            });
+  struct Source {
+    const Entry* old_entry;
+    const X64CachedFunction* new_function;
+  };
+  std::vector<Source> sources;
+  sources.reserve(entry_count_ + new_functions_.size());
+  size_t old_index = 0;
+  for (auto& function : new_functions_) {
+    while (old_index < entry_count_ &&
+           entries_[old_index].guest_address < function.guest_address) {
+      sources.push_back({&entries_[old_index++], nullptr});
+    }
+    if (old_index < entry_count_ &&
+        entries_[old_index].guest_address == function.guest_address) {
+      ++old_index;
+    }
+    if (!sources.empty() && sources.back().new_function &&
+        sources.back().new_function->guest_address == function.guest_address) {
+      // Duplicate from racing translations; keep the first.
+      continue;
+    }
+    sources.push_back({nullptr, &function});
+  }
+  while (old_index < entry_count_) {
+    sources.push_back({&entries_[old_index++], nullptr});
+  }
+
+  // Build the whole file in memory so that the old mapping can stay live
+  // until we are done reading from it.
+  std::vector<Entry> index(sources.size());
+  std::vector<uint8_t> data;
+  size_t data_base = sizeof(FileHeader) + index.size() * sizeof(Entry);
+  data_base = xe::round_up(data_base, 16);
+  auto append = [&data](const void* src, size_t length) {
+    auto offset = data.size();
+    data.resize(offset + length);
+    std::memcpy(data.data() + offset, src, length);
+  };
+  for (size_t i = 0; i < sources.size(); ++i) {
+    auto& entry = index[i];
+    auto data_offset = data.size();
+    if (sources[i].old_entry) {
+      auto old_entry = sources[i].old_entry;
+      entry = *old_entry;
+      append(mapping_->data() + old_entry->data_offset,
+             size_t(GetEntryDataSize(*old_entry)));
+    } else {
+      auto function = sources[i].new_function;
+      entry.guest_address = function->guest_address;
+      entry.guest_end_address = function->guest_end_address;
+      entry.guest_hash = function->guest_hash;
+      entry.code_size = uint32_t(function->machine_code.size());
+      entry.stack_size = function->stack_size;
+      entry.compile_micros = function->compile_micros;
+      entry.relocation_count = uint32_t(function->relocations.size());
+      entry.source_map_count = uint32_t(function->source_map.size());
+      append(function->machine_code.data(), function->machine_code.size());
+      data.resize(xe::round_up(data.size(), 16));
+      append(function->relocations.data(),
+             function->relocations.size() * sizeof(X64Relocation));
+      append(function->source_map.data(),
+             function->source_map.size() * sizeof(SourceMapEntry));
+    }
+    entry.data_offset = uint32_t(data_base + data_offset);
+    data.resize(xe::round_up(data.size(), 16));
+  }
+
+  FileHeader header;
+  header.magic = kFileMagic;
+  header.version = kFileVersion;
+  header.module_hash = module_hash_;
+  header.environment_hash = environment_hash_;
+  header.entry_count = uint32_t(index.size());
+  header.reserved = 0;
+
+  // Write a temporary file and swap it in, so that a crash or a full disk
+  // never leaves a truncated cache behind.
+  auto root_path = xe::find_base_path(path_);
+  if (!xe::filesystem::PathExists(root_path)) {
+    xe::filesystem::CreateFolder(root_path);
+  }
+  auto temp_path = path_ + L".tmp";
+  auto file = xe::filesystem::OpenFile(temp_path, "wb");
+  if (!file) {
+    XELOGE("JIT cache: unable to write %S", temp_path.c_str());
+    return false;
+  }
+  static const uint8_t kZeros[16] = {0};
+  size_t header_size = sizeof(FileHeader) + index.size() * sizeof(Entry);
+  bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+  success &= fwrite(index.data(), sizeof(Entry), index.size(), file) ==
+             index.size();
+  success &= fwrite(kZeros, 1, data_base - header_size, file) ==
+             data_base - header_size;
+  success &= fwrite(data.data(), 1, data.size(), file) == data.size();
+  success &= fclose(file) == 0;
+  if (!success) {
+    XELOGE("JIT cache: failed writing %S", temp_path.c_str());
+    xe::filesystem::DeleteFile(temp_path);
+    return false;
+  }
+
+  // Drop our mapping so that the file can be replaced.
+  entries_ = nullptr;
+  entry_count_ = 0;
+  mapping_.reset();
+  if (!xe::filesystem::RenameFile(temp_path, path_)) {
+    XELOGE("JIT cache: unable to replace %S", path_.c_str());
+    xe::filesystem::DeleteFile(temp_path);
+    return false;
+  }
+  new_functions_.clear();
+  return true;
+}
+
+void X64CodeCacheFile::DumpStats() {
+  uint32_t hits = hit_count_;
+  uint32_t lookups = hits + miss_count_;
+  XELOGI(
+      "JIT cache %.16llX: %d/%d hits (%.1f%%), %d stale, %.3fms translation "
+      "time saved",
+      module_hash_, hits, lookups, lookups ? hits * 100.0 / lookups : 0.0,
+      uint32_t(stale_count_), saved_micros_ / 1000.0);
+}
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
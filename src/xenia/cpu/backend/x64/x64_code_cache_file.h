@@ -0,0 +1,156 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BACKEND_X64_X64_CODE_CACHE_FILE_H_
+#define XENIA_BACKEND_X64_X64_CODE_CACHE_FILE_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "xenia/base/mapped_memory.h"
+#include "xenia/base/mutex.h"
+#include "xenia/cpu/function.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+class X64Backend;
+
+enum class X64RelocationType : uint32_t {
+  // 64-bit address of something within the host executable image (functions,
+  // static tables). Stored relative to the image anchor.
+  kImageAddress,
+  // 64-bit address of one of the X64Backend thunks. Stored as X64ThunkId.
+  kThunk,
+};
+
+enum class X64ThunkId : uint32_t {
+  kHostToGuest,
+  kGuestToHost,
+  kResolveFunction,
+};
+
+// An absolute address baked into generated code that must be rewritten when
+// the code is loaded in a different process. All relocations are the 8 byte
+// immediate of a movabs.
+struct X64Relocation {
+  uint32_t code_offset;
+  X64RelocationType type;
+  uint64_t value;
+};
+
+// A translated function as stored in a code cache file.
+struct X64CachedFunction {
+  uint32_t guest_address;
+  uint32_t guest_end_address;
+  uint64_t guest_hash;
+  uint32_t stack_size;
+  uint32_t compile_micros;
+  std::vector<uint8_t> machine_code;
+  std::vector<X64Relocation> relocations;
+  std::vector<SourceMapEntry> source_map;
+};
+
+// Persists translated code for a single guest module across runs.
+// Files are keyed on the module content hash and stamped with an environment
+// hash covering everything else the generated code depends on (codegen
+// version, CPU features, host image, etc). Any mismatch discards the whole
+// file. Individual functions are validated against a hash of their guest
+// instruction words so that patched code is retranslated.
+//
+// The existing file is memory mapped on open and every entry is checked
+// against the mapping before any of them is used. Loaded entries are copied
+// out of it under the same lock Save takes to replace the file. New entries
+// are kept in memory and the file is rewritten on Save.
+class X64CodeCacheFile {
+ public:
+  // On-disk index record. The index is sorted by guest address and the data
+  // for each entry is the machine code followed by its relocations and source
+  // map.
+  struct Entry {
+    uint32_t guest_address;
+    uint32_t guest_end_address;
+    uint64_t guest_hash;
+    uint32_t data_offset;
+    uint32_t code_size;
+    uint32_t stack_size;
+    uint32_t compile_micros;
+    uint32_t relocation_count;
+    uint32_t source_map_count;
+  };
+
+  ~X64CodeCacheFile();
+
+  static std::unique_ptr<X64CodeCacheFile> Open(X64Backend* backend,
+                                                const std::wstring& root_path,
+                                                uint64_t module_hash,
+                                                uint64_t environment_hash);
+
+  // Hashes everything outside of the guest code that generated code depends
+  // on. Computed once by the backend.
+  static uint64_t ComputeEnvironmentHash(X64Backend* backend,
+                                         uint32_t feature_flags);
+
+  // Looks up a function, verifying its guest bytes still match, and copies
+  // it out with relocations applied. Returns false if not found or stale.
+  bool Load(uint32_t guest_address, const uint8_t* guest_base,
+            X64CachedFunction* out_function);
+
+  // Adds a newly translated function. Written out on Save.
+  void Add(X64CachedFunction function);
+
+  // Records the time spent loading a cached function, for stats.
+  void RecordHit(const X64CachedFunction& function, uint64_t load_micros);
+  void RecordMiss() { ++miss_count_; }
+
+  bool Save();
+  void DumpStats();
+
+  // Offset of a host address from a fixed point in the executable image.
+  static uint64_t ImageOffset(const void* address);
+  static uint64_t HashGuestCode(const uint8_t* guest_base,
+                                uint32_t guest_address,
+                                uint32_t guest_end_address);
+
+ private:
+  X64CodeCacheFile(X64Backend* backend, std::wstring path,
+                   uint64_t module_hash, uint64_t environment_hash);
+
+  // Finds a current entry in the mapping. Requires lock_.
+  const Entry* Lookup(uint32_t guest_address, const uint8_t* guest_base);
+  uint64_t ResolveRelocation(const X64Relocation& relocation);
+
+  X64Backend* backend_ = nullptr;
+  std::wstring path_;
+  uint64_t module_hash_ = 0;
+  uint64_t environment_hash_ = 0;
+
+  // Guards the mapping, which Save replaces, and new_functions_.
+  xe::mutex lock_;
+  std::unique_ptr<MappedMemory> mapping_;
+  const Entry* entries_ = nullptr;
+  uint32_t entry_count_ = 0;
+  std::vector<X64CachedFunction> new_functions_;
+
+  std::atomic<uint32_t> hit_count_ = {0};
+  std::atomic<uint32_t> miss_count_ = {0};
+  std::atomic<uint32_t> stale_count_ = {0};
+  std::atomic<uint64_t> saved_micros_ = {0};
+};
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_BACKEND_X64_X64_CODE_CACHE_FILE_H_
@@ -88,15 +88,23 @@ X64Emitter::X64Emitter(X64Backend* backend, XbyakAllocator* allocator)
 X64Emitter::~X64Emitter() = default;
 
 bool X64Emitter::Emit(FunctionInfo* function_info, HIRBuilder* builder,
-                      uint32_t debug_info_flags, DebugInfo* debug_info,
-                      void*& out_code_address, size_t& out_code_size,
+                      uint32_t debug_info_flags, CompileTier tier,
+                      DebugInfo* debug_info, void*& out_code_address,
+                      size_t& out_code_size,
                       std::vector<SourceMapEntry>& out_source_map) {
   SCOPE_profile_cpu_f("cpu");
 
   // Reset.
   debug_info_ = debug_info;
   debug_info_flags_ = debug_info_flags;
+  function_info_ = function_info;
+  tier_ = tier;
   source_map_arena_.Reset();
+  cacheable_ = !debug_info_flags;
+  relocations_.clear();
+  call_stubs_.clear();
+  call_sites_.clear();
+  inline_call_caches_.clear();
 
   // Fill the generator with code.
   size_t stack_size = 0;
@@ -108,6 +116,13 @@ bool X64Emitter::Emit(FunctionInfo* function_info, HIRBuilder* builder,
   out_code_size = getSize();
   out_code_address = Emplace(stack_size, function_info);
 
+  // Now that the call sites have a final address they can be patched.
+  for (auto& call_site : call_sites_) {
+    code_cache_->AddCallSite(call_site.guest_address,
+                             reinterpret_cast<uint8_t*>(out_code_address) +
+                                 call_site.displacement_offset);
+  }
+
   // Stash source map.
   source_map_arena_.CloneContents(out_source_map);
 
@@ -137,22 +152,13 @@ void* X64Emitter::Emplace(size_t stack_size, FunctionInfo* function_info) {
 bool X64Emitter::Emit(HIRBuilder* builder, size_t& out_stack_size) {
   Xbyak::Label epilog_label;
   epilog_label_ = &epilog_label;
+  Xbyak::Label tier_up_label;
+  Xbyak::Label tier_up_resume_label;
+  tier_up_label_ = &tier_up_label;
+  tier_up_resume_label_ = &tier_up_resume_label;
 
-  // Calculate stack size. We need to align things to their natural sizes.
-  // This could be much better (sort by type/etc).
-  auto locals = builder->locals();
-  size_t stack_offset = StackLayout::GUEST_STACK_SIZE;
-  for (auto it = locals.begin(); it != locals.end(); ++it) {
-    auto slot = *it;
-    size_t type_size = GetTypeSize(slot->type);
-    // Align to natural size.
-    stack_offset = xe::align(stack_offset, type_size);
-    slot->set_constant((uint32_t)stack_offset);
-    stack_offset += type_size;
-  }
-  // Ensure 16b alignment.
-  stack_offset -= StackLayout::GUEST_STACK_SIZE;
-  stack_offset = xe::align(stack_offset, static_cast<size_t>(16));
+  // Place locals and spill slots after the fixed part of the frame.
+  size_t stack_offset = StackLayout::LayoutLocals(builder);
 
   // Function prolog.
   // Must be 16b aligned.
@@ -174,6 +180,8 @@ bool X64Emitter::Emit(HIRBuilder* builder, size_t& out_stack_size) {
   mov(qword[rsp + StackLayout::GUEST_RET_ADDR], rdx);
   mov(qword[rsp + StackLayout::GUEST_CALL_RET_ADDR], 0);
 
+  EmitTierUpCounter();
+
   // Safe now to do some tracing.
   if (debug_info_flags_ & DebugInfoFlags::kDebugInfoTraceFunctions) {
     // We require 32-bit addresses.
@@ -247,6 +255,21 @@ bool X64Emitter::Emit(HIRBuilder* builder, size_t& out_stack_size) {
     nop();
   }
 
+  // Stubs for direct calls. These do what an unpatched call used to do
+  // inline: the target dword will either contain the address of the
+  // generated code or a thunk to ResolveAddress.
+  for (auto& call_stub : call_stubs_) {
+    L(call_stub.label);
+    mov(ebx, call_stub.guest_address);
+    mov(eax, dword[ebx]);
+    jmp(rax);
+  }
+  call_stubs_.clear();
+  EmitInlineCallCacheMisses();
+  EmitTierUpRequest();
+  tier_up_label_ = nullptr;
+  tier_up_resume_label_ = nullptr;
+
   return true;
 }
 
@@ -350,13 +373,59 @@ extern "C" uint64_t ResolveFunction(void* raw_context,
   return addr;
 }
 
+Xbyak::Label& X64Emitter::GetCallStub(uint32_t guest_address) {
+  for (auto& call_stub : call_stubs_) {
+    if (call_stub.guest_address == guest_address) {
+      return call_stub.label;
+    }
+  }
+  call_stubs_.emplace_back();
+  call_stubs_.back().guest_address = guest_address;
+  return call_stubs_.back().label;
+}
+
 void X64Emitter::Call(const hir::Instr* instr, FunctionInfo* symbol_info) {
   assert_not_null(symbol_info);
+
+  // Persisted code can't contain patched calls as the displacement is only
+  // valid for this run.
+  if (FLAGS_jit_patch_calls && !backend_->code_cache_file_enabled()) {
+    auto& call_stub = GetCallStub(symbol_info->address());
+    if (instr->flags & CALL_TAIL) {
+      // Since we skip the prolog we need to mark the return here.
+      EmitTraceUserCallReturn();
+
+      // Pass the callers return address over.
+      mov(rdx, qword[rsp + StackLayout::GUEST_RET_ADDR]);
+
+      add(rsp, static_cast<uint32_t>(stack_size()));
+    } else {
+      // Return address is from the previous SET_RETURN_ADDRESS.
+      mov(rdx, qword[rsp + StackLayout::GUEST_CALL_RET_ADDR]);
+    }
+
+    // The rel32 is rewritten while other threads may be executing it, so it
+    // must be 4b aligned for the store to be atomic.
+    while ((getSize() + 1) & 3) {
+      nop();
+    }
+    if (instr->flags & CALL_TAIL) {
+      jmp(call_stub, T_NEAR);
+    } else {
+      call(call_stub);
+    }
+    call_sites_.push_back({symbol_info->address(), getSize() - 4});
+    return;
+  }
+
+  code_cache_->RecordIndirectCallSite();
   auto fn = reinterpret_cast<X64Function*>(symbol_info->function());
   // Resolve address to the function to call and store in rax.
-  if (fn) {
+  if (fn && !backend_->code_cache_file_enabled()) {
     // TODO(benvanik): is it worth it to do this? It removes the need for
     // a ResolveFunction call, but makes the table less useful.
+    // Not done when persisting code, as the target address is only valid
+    // for this run.
     assert_zero(uint64_t(fn->machine_code()) & 0xFFFFFFFF00000000);
     mov(eax, uint32_t(uint64_t(fn->machine_code())));
   } else {
@@ -395,10 +464,17 @@ void X64Emitter::CallIndirect(const hir::Instr* instr, const Reg64& reg) {
   // Load the pointer to the indirection table maintained in X64CodeCache.
   // The target dword will either contain the address of the generated code
   // or a thunk to ResolveAddress.
-  if (reg.cvt32() != ebx) {
+  code_cache_->RecordIndirectCallSite();
+  if (FLAGS_jit_inline_call_cache) {
+    // Cache entries are compared against rbx, so the high bits must be clear.
     mov(ebx, reg.cvt32());
+    EmitInlineCallCacheLookup();
+  } else {
+    if (reg.cvt32() != ebx) {
+      mov(ebx, reg.cvt32());
+    }
+    mov(eax, dword[ebx]);
   }
-  mov(eax, dword[ebx]);
 
   // Actually jump/call to rax.
   if (instr->flags & CALL_TAIL) {
@@ -418,6 +494,116 @@ void X64Emitter::CallIndirect(const hir::Instr* instr, const Reg64& reg) {
   }
 }
 
+void X64Emitter::EmitInlineCallCacheLookup() {
+  // Entries are {guest address, host address} pairs packed into a qword so
+  // that they can be read and written atomically. Zero is empty.
+  // They live in the code cache, which isn't persisted.
+  MarkUncacheable();
+  inline_call_caches_.emplace_back();
+  auto& cache = inline_call_caches_.back();
+  cache.entries_address =
+      code_cache_->PlaceInlineCallCache(kInlineCallCacheSize);
+
+  // Only the first entry is checked inline, the rest happens out of line in
+  // EmitInlineCallCacheMisses. rdx gets clobbered by the call anyway.
+  mov(edx, cache.entries_address);
+  mov(rax, qword[rdx]);
+  cmp(eax, ebx);
+  jne(cache.miss_label, T_NEAR);
+  shr(rax, 32);
+  L(cache.resume_label);
+}
+
+void X64Emitter::EmitInlineCallCacheMisses() {
+  // rbx = guest target
+  // rdx = cache entries
+  // Must leave the host target in rax.
+  uint32_t resolve_thunk =
+      uint32_t(uint64_t(backend_->resolve_function_thunk()));
+  for (auto& cache : inline_call_caches_) {
+    L(cache.miss_label);
+    for (size_t n = 1; n < kInlineCallCacheSize; ++n) {
+      Xbyak::Label next;
+      mov(rax, qword[rdx + n * 8]);
+      cmp(eax, ebx);
+      jne(next);
+      shr(rax, 32);
+      jmp(cache.resume_label, T_NEAR);
+      L(next);
+    }
+
+    // Miss - go to the indirection table. Targets that have not been compiled
+    // yet point at the resolve thunk and must not be cached.
+    mov(eax, dword[ebx]);
+    cmp(eax, resolve_thunk);
+    je(cache.resume_label, T_NEAR);
+    for (size_t n = 0; n < kInlineCallCacheSize; ++n) {
+      Xbyak::Label next;
+      cmp(dword[rdx + n * 8], 0);
+      jne(next);
+      // r8 is volatile, so it is free around the call.
+      mov(r8, rax);
+      shl(r8, 32);
+      or_(r8, rbx);
+      // xchg is locked, so the table is read again only after the entry is
+      // visible to X64CodeCache::RedirectInlineCallCaches. If the target was
+      // placed again in between, the redirect may have missed the entry, so
+      // drop it to be refilled on the next miss.
+      xchg(qword[rdx + n * 8], r8);
+      cmp(eax, dword[ebx]);
+      je(cache.resume_label, T_NEAR);
+      mov(qword[rdx + n * 8], 0);
+      mov(eax, dword[ebx]);
+      jmp(cache.resume_label, T_NEAR);
+      L(next);
+    }
+    // All entries are taken (megamorphic site), so keep using the table.
+    jmp(cache.resume_label, T_NEAR);
+  }
+  inline_call_caches_.clear();
+}
+
+bool X64Emitter::tier_up_enabled() const {
+  return tier_ == CompileTier::kBaseline && function_info_ &&
+         FLAGS_jit_tier_up_threshold > 0;
+}
+
+void X64Emitter::EmitTierUpCounter() {
+  if (!tier_up_enabled()) {
+    return;
+  }
+  // The counter lives in the code cache next to the function. Baseline code
+  // is replaced on the next run anyway, so it isn't worth persisting.
+  MarkUncacheable();
+  uint32_t counter = uint32_t(FLAGS_jit_tier_up_threshold);
+  uint32_t counter_address = code_cache_->PlaceData(&counter, sizeof(counter));
+
+  mov(eax, counter_address);
+  dec(dword[rax]);
+  jz(*tier_up_label_, T_NEAR);
+  L(*tier_up_resume_label_);
+}
+
+uint64_t RequestTierUp(void* raw_context, uint64_t guest_address) {
+  auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
+  thread_state->processor()->compile_scheduler()->EnqueueRecompile(
+      static_cast<uint32_t>(guest_address));
+  return 0;
+}
+
+void X64Emitter::EmitTierUpRequest() {
+  if (!tier_up_enabled()) {
+    return;
+  }
+  // Only reached once: the counter keeps going negative afterwards and the
+  // scheduler drops duplicate requests anyway.
+  L(*tier_up_label_);
+  CallNative(RequestTierUp, function_info_->address());
+  // The prolog expects the return address in rdx.
+  mov(rdx, qword[rsp + StackLayout::GUEST_RET_ADDR]);
+  jmp(*tier_up_resume_label_, T_NEAR);
+}
+
 uint64_t UndefinedCallExtern(void* raw_context, uint64_t symbol_info_ptr) {
   auto symbol_info = reinterpret_cast<FunctionInfo*>(symbol_info_ptr);
   XELOGW("undefined extern call to %.8X %s", symbol_info->address(),
@@ -432,6 +618,8 @@ void X64Emitter::CallExtern(const hir::Instr* instr,
     // rdx = target host function
     // r8  = arg0
     // r9  = arg1
+    // Builtin args point at host heap objects.
+    MarkUncacheable();
     mov(rdx, reinterpret_cast<uint64_t>(symbol_info->builtin_handler()));
     mov(r8, reinterpret_cast<uint64_t>(symbol_info->builtin_arg0()));
     mov(r9, reinterpret_cast<uint64_t>(symbol_info->builtin_arg1()));
@@ -445,35 +633,36 @@ void X64Emitter::CallExtern(const hir::Instr* instr,
              symbol_info->extern_handler()) {
     // rcx = context
     // rdx = target host function
-    mov(rdx, reinterpret_cast<uint64_t>(symbol_info->extern_handler()));
+    MovHostAddress(rdx,
+                   reinterpret_cast<void*>(symbol_info->extern_handler()));
     mov(r8, qword[rcx + offsetof(cpu::frontend::PPCContext, kernel_state)]);
-    auto thunk = backend()->guest_to_host_thunk();
-    mov(rax, reinterpret_cast<uint64_t>(thunk));
+    MovThunkAddress(rax, X64ThunkId::kGuestToHost);
     call(rax);
     ReloadECX();
     ReloadEDX();
     // rax = host return
   } else {
+    MarkUncacheable();
     CallNative(UndefinedCallExtern, reinterpret_cast<uint64_t>(symbol_info));
   }
 }
 
 void X64Emitter::CallNative(void* fn) {
-  mov(rax, reinterpret_cast<uint64_t>(fn));
+  MovHostAddress(rax, fn);
   call(rax);
   ReloadECX();
   ReloadEDX();
 }
 
 void X64Emitter::CallNative(uint64_t (*fn)(void* raw_context)) {
-  mov(rax, reinterpret_cast<uint64_t>(fn));
+  MovHostAddress(rax, reinterpret_cast<void*>(fn));
   call(rax);
   ReloadECX();
   ReloadEDX();
 }
 
 void X64Emitter::CallNative(uint64_t (*fn)(void* raw_context, uint64_t arg0)) {
-  mov(rax, reinterpret_cast<uint64_t>(fn));
+  MovHostAddress(rax, reinterpret_cast<void*>(fn));
   call(rax);
   ReloadECX();
   ReloadEDX();
@@ -482,7 +671,7 @@ void X64Emitter::CallNative(uint64_t (*fn)(void* raw_context, uint64_t arg0)) {
 void X64Emitter::CallNative(uint64_t (*fn)(void* raw_context, uint64_t arg0),
                             uint64_t arg0) {
   mov(rdx, arg0);
-  mov(rax, reinterpret_cast<uint64_t>(fn));
+  MovHostAddress(rax, reinterpret_cast<void*>(fn));
   call(rax);
   ReloadECX();
   ReloadEDX();
@@ -494,15 +683,47 @@ void X64Emitter::CallNativeSafe(void* fn) {
   // r8  = arg0
   // r9  = arg1
   // r10 = arg2
-  mov(rdx, reinterpret_cast<uint64_t>(fn));
-  auto thunk = backend()->guest_to_host_thunk();
-  mov(rax, reinterpret_cast<uint64_t>(thunk));
+  MovHostAddress(rdx, fn);
+  MovThunkAddress(rax, X64ThunkId::kGuestToHost);
   call(rax);
   ReloadECX();
   ReloadEDX();
   // rax = host return
 }
 
+void X64Emitter::MovHostAddress(const Reg64& dest, const void* address) {
+  EmitMovImm64(dest, reinterpret_cast<uint64_t>(address));
+  relocations_.push_back({uint32_t(getSize() - 8),
+                          X64RelocationType::kImageAddress,
+                          X64CodeCacheFile::ImageOffset(address)});
+}
+
+void X64Emitter::MovThunkAddress(const Reg64& dest, X64ThunkId thunk_id) {
+  void* thunk = nullptr;
+  switch (thunk_id) {
+    case X64ThunkId::kHostToGuest:
+      thunk = reinterpret_cast<void*>(backend_->host_to_guest_thunk());
+      break;
+    case X64ThunkId::kGuestToHost:
+      thunk = reinterpret_cast<void*>(backend_->guest_to_host_thunk());
+      break;
+    case X64ThunkId::kResolveFunction:
+      thunk = reinterpret_cast<void*>(backend_->resolve_function_thunk());
+      break;
+  }
+  EmitMovImm64(dest, reinterpret_cast<uint64_t>(thunk));
+  relocations_.push_back({uint32_t(getSize() - 8), X64RelocationType::kThunk,
+                          static_cast<uint64_t>(thunk_id)});
+}
+
+void X64Emitter::EmitMovImm64(const Reg64& dest, uint64_t value) {
+  // Always use the full 10 byte movabs (REX.W B8+r imm64) so that the
+  // immediate is at a known position and any value can be patched in.
+  db(0x48 | (dest.getIdx() >= 8 ? 0x01 : 0x00));
+  db(0xB8 | (dest.getIdx() & 7));
+  dq(value);
+}
+
 void X64Emitter::SetReturnAddress(uint64_t value) {
   mov(qword[rsp + StackLayout::GUEST_CALL_RET_ADDR], value);
 }
@@ -638,6 +859,42 @@ uint32_t X64Emitter::PlaceData(Memory* memory) {
                                            0x80000000u, 0x80000000u),
       /* XMMShortMinPS          */ vec128f(SHRT_MIN),
       /* XMMShortMaxPS          */ vec128f(SHRT_MAX),
+      /* XMMByteMask0F          */ vec128b(0x0F),
+      /* XMMByteMask3F          */ vec128b(0x3F),
+      /* XMMByteMask7F          */ vec128b(0x7F),
+      /* XMMByteMaskF0          */ vec128b(0xF0),
+      /* XMMByteMaskFC          */ vec128b(0xFC),
+      /* XMMByteMaskFE          */ vec128b(0xFE),
+      /* XMMExponentBiasI32     */ vec128i(127),
+      /* XMMMantissaMaskPS      */ vec128i(0x007FFFFFu),
+      /* XMMFltMaxPS            */ vec128i(0x7F7FFFFFu),
+      /* XMMQNaNPS              */ vec128i(0x7FC00000u),
+      /* XMMNegInfinityPS       */ vec128i(0xFF800000u),
+      // Minimax fits of exp2 on [0, 1), keeping 2^0 exact, and of
+      // log2(x) / (x - 1) on [1, 2). See
+      // http://jrfonseca.blogspot.com/2008/09/fast-sse2-pow-tables-or-polynomials.html
+      /* XMMPow2Min             */ vec128f(-127.0f),
+      /* XMMPow2Max             */ vec128f(128.0f),
+      /* XMMPow2C0              */ vec128f(1.0f),
+      /* XMMPow2C1              */ vec128f(6.9315130e-1f),
+      /* XMMPow2C2              */ vec128f(2.4016450e-1f),
+      /* XMMPow2C3              */ vec128f(5.5799704e-2f),
+      /* XMMPow2C4              */ vec128f(9.0173250e-3f),
+      /* XMMPow2C5              */ vec128f(1.8669906e-3f),
+      /* XMMLog2C0              */ vec128f(3.1157899f),
+      /* XMMLog2C1              */ vec128f(-3.3241990f),
+      /* XMMLog2C2              */ vec128f(2.5988452f),
+      /* XMMLog2C3              */ vec128f(-1.2315303f),
+      /* XMMLog2C4              */ vec128f(3.1821337e-1f),
+      /* XMMLog2C5              */ vec128f(-3.4436006e-2f),
+      /* XMMPackUINT_2101010Min */ vec128i(0x403FFE01u, 0x403FFE01u,
+                                           0x403FFE01u, 0x40400000u),
+      /* XMMPackUINT_2101010Max */ vec128i(0x404001FFu, 0x404001FFu,
+                                           0x404001FFu, 0x40400003u),
+      /* XMMPackUINT_2101010Mask */ vec128i(0x3FFu, 0x3FFu, 0x3FFu, 0x3u),
+      /* XMMPackUINT_2101010NaN */ vec128i(0x200u, 0x200u, 0x200u, 0x0u),
+      /* XMMPackUINT_2101010Shift */ vec128i(1u, 1u << 10, 1u << 20,
+                                             1u << 30),
   };
   uint32_t ptr = memory->SystemHeapAlloc(sizeof(xmm_consts));
   std::memcpy(memory->TranslateVirtual(ptr), xmm_consts, sizeof(xmm_consts));
@@ -10,9 +10,11 @@
 #ifndef XENIA_BACKEND_X64_X64_EMITTER_H_
 #define XENIA_BACKEND_X64_X64_EMITTER_H_
 
+#include <list>
 #include <vector>
 
 #include "xenia/base/arena.h"
+#include "xenia/cpu/backend/x64/x64_code_cache_file.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/hir/hir_builder.h"
 #include "xenia/cpu/hir/instr.h"
@@ -93,6 +95,36 @@ enum XmmConst {
   XMMSignMaskF32,
   XMMShortMinPS,
   XMMShortMaxPS,
+  XMMByteMask0F,
+  XMMByteMask3F,
+  XMMByteMask7F,
+  XMMByteMaskF0,
+  XMMByteMaskFC,
+  XMMByteMaskFE,
+  XMMExponentBiasI32,
+  XMMMantissaMaskPS,
+  XMMFltMaxPS,
+  XMMQNaNPS,
+  XMMNegInfinityPS,
+  XMMPow2Min,
+  XMMPow2Max,
+  XMMPow2C0,
+  XMMPow2C1,
+  XMMPow2C2,
+  XMMPow2C3,
+  XMMPow2C4,
+  XMMPow2C5,
+  XMMLog2C0,
+  XMMLog2C1,
+  XMMLog2C2,
+  XMMLog2C3,
+  XMMLog2C4,
+  XMMLog2C5,
+  XMMPackUINT_2101010Min,
+  XMMPackUINT_2101010Max,
+  XMMPackUINT_2101010Mask,
+  XMMPackUINT_2101010NaN,
+  XMMPackUINT_2101010Shift,
 };
 
 // Unfortunately due to the design of xbyak we have to pass this to the ctor.
@@ -112,6 +144,10 @@ enum X64EmitterFeatureFlags {
 
 class X64Emitter : public Xbyak::CodeGenerator {
  public:
+  // Bump when changes to the compiler or emitter would produce different code
+  // for the same guest input. Invalidates persisted code caches.
+  static const uint32_t kCodegenVersion = 2;
+
   X64Emitter(X64Backend* backend, XbyakAllocator* allocator);
   virtual ~X64Emitter();
 
@@ -119,8 +155,9 @@ class X64Emitter : public Xbyak::CodeGenerator {
   X64Backend* backend() const { return backend_; }
 
   bool Emit(FunctionInfo* function_info, hir::HIRBuilder* builder,
-            uint32_t debug_info_flags, DebugInfo* debug_info,
-            void*& out_code_address, size_t& out_code_size,
+            uint32_t debug_info_flags, CompileTier tier,
+            DebugInfo* debug_info, void*& out_code_address,
+            size_t& out_code_size,
             std::vector<SourceMapEntry>& out_source_map);
 
   static uint32_t PlaceData(Memory* memory);
@@ -163,6 +200,9 @@ class X64Emitter : public Xbyak::CodeGenerator {
   void Trap(uint16_t trap_type = 0);
   void UnimplementedInstr(const hir::Instr* i);
 
+  // Calls a guest function. When possible this is a direct call that starts
+  // out routed through the indirection table and is patched to point at the
+  // target once it has been compiled.
   void Call(const hir::Instr* instr, FunctionInfo* symbol_info);
   void CallIndirect(const hir::Instr* instr, const Xbyak::Reg64& reg);
   void CallExtern(const hir::Instr* instr, const FunctionInfo* symbol_info);
@@ -172,6 +212,13 @@ class X64Emitter : public Xbyak::CodeGenerator {
   void CallNative(uint64_t (*fn)(void* raw_context, uint64_t arg0),
                   uint64_t arg0);
   void CallNativeSafe(void* fn);
+  // Loads the address of something in the host image (functions/static data)
+  // or a thunk such that it can be relocated if the function is persisted.
+  void MovHostAddress(const Xbyak::Reg64& dest, const void* address);
+  void MovThunkAddress(const Xbyak::Reg64& dest, X64ThunkId thunk_id);
+  // Marks the current function as depending on process-specific state (heap
+  // pointers/etc) so that it is never persisted.
+  void MarkUncacheable() { cacheable_ = false; }
   void SetReturnAddress(uint64_t value);
   void ReloadECX();
   void ReloadEDX();
@@ -190,6 +237,7 @@ class X64Emitter : public Xbyak::CodeGenerator {
   void LoadConstantXmm(Xbyak::Xmm dest, const vec128_t& v);
   Xbyak::Address StashXmm(int index, const Xbyak::Xmm& r);
 
+  uint32_t feature_flags() const { return feature_flags_; }
   bool IsFeatureEnabled(uint32_t feature_flag) const {
     return (feature_flags_ & feature_flag) != 0;
   }
@@ -198,13 +246,48 @@ class X64Emitter : public Xbyak::CodeGenerator {
 
   size_t stack_size() const { return stack_size_; }
 
+  // Relocations and cacheability of the last emitted function.
+  bool cacheable() const { return cacheable_; }
+  const std::vector<X64Relocation>& relocations() const { return relocations_; }
+
  protected:
   void* Emplace(size_t stack_size, FunctionInfo* function_info = nullptr);
   bool Emit(hir::HIRBuilder* builder, size_t& out_stack_size);
+  void EmitMovImm64(const Xbyak::Reg64& dest, uint64_t value);
   void EmitGetCurrentThreadId();
   void EmitTraceUserCallReturn();
+  Xbyak::Label& GetCallStub(uint32_t guest_address);
+  // Looks up the guest address in ebx in a per call site cache of targets,
+  // leaving the host address in rax.
+  void EmitInlineCallCacheLookup();
+  void EmitInlineCallCacheMisses();
+  // Counts down entries to baseline functions and requests a recompile at
+  // the optimized tier when it reaches zero.
+  bool tier_up_enabled() const;
+  void EmitTierUpCounter();
+  void EmitTierUpRequest();
 
  protected:
+  // Out-of-line indirection table lookup used by unpatched direct calls.
+  struct CallStub {
+    uint32_t guest_address;
+    Xbyak::Label label;
+  };
+  // Targets remembered by an indirect call site. The first entry is checked
+  // inline, the others and the fill on a miss are out of line.
+  static const size_t kInlineCallCacheSize = 4;
+  struct InlineCallCache {
+    uint32_t entries_address;
+    Xbyak::Label miss_label;
+    Xbyak::Label resume_label;
+  };
+  // Direct call emitted into the current function, registered with the code
+  // cache for patching once the function is placed.
+  struct CallSite {
+    uint32_t guest_address;
+    size_t displacement_offset;
+  };
+
   Processor* processor_ = nullptr;
   X64Backend* backend_ = nullptr;
   X64CodeCache* code_cache_ = nullptr;
@@ -218,10 +301,21 @@ class X64Emitter : public Xbyak::CodeGenerator {
 
   DebugInfo* debug_info_ = nullptr;
   uint32_t debug_info_flags_ = 0;
+  FunctionInfo* function_info_ = nullptr;
+  CompileTier tier_ = CompileTier::kOptimized;
   Arena source_map_arena_;
 
   size_t stack_size_ = 0;
 
+  bool cacheable_ = true;
+  std::vector<X64Relocation> relocations_;
+
+  std::list<CallStub> call_stubs_;
+  std::list<InlineCallCache> inline_call_caches_;
+  std::vector<CallSite> call_sites_;
+  Xbyak::Label* tier_up_label_ = nullptr;
+  Xbyak::Label* tier_up_resume_label_ = nullptr;
+
   static const uint32_t gpr_reg_map_[GPR_COUNT];
   static const uint32_t xmm_reg_map_[XMM_COUNT];
 };
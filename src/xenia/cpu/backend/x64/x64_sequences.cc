@@ -25,7 +25,7 @@
 #include "xenia/cpu/backend/x64/x64_sequences.h"
 
 #include <cstring>
-#include <unordered_map>
+#include <utility>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/clock.h"
@@ -51,7 +51,6 @@ using namespace xe::cpu::hir;
 using namespace xe::cpu;
 
 typedef bool (*SequenceSelectFn)(X64Emitter&, const Instr*);
-std::unordered_map<uint32_t, SequenceSelectFn> sequence_table;
 
 // Selects the right byte/word/etc from a vector. We need to flip logical
 // indices (0,1,2,3,4,5,6,7,...) = (3,2,1,0,7,6,5,4,...)
@@ -645,17 +644,84 @@ const Reg64 GetTempReg<Reg64>(X64Emitter& e) {
   return e.rax;
 }
 
-template <typename T>
-void Register() {
-  sequence_table.insert({T::head_key(), T::Select});
+// Returns the register holding a vector operand, loading it into temp first
+// if it's a constant.
+Xmm LoadVectorOperand(X64Emitter& e, const V128Op& op, const Xmm& temp) {
+  if (op.is_constant) {
+    e.LoadConstantXmm(temp, op.constant());
+    return temp;
+  }
+  return op;
 }
-template <typename T, typename Tn, typename... Ts>
-void Register() {
-  Register<T>();
-  Register<Tn, Ts...>();
+
+// Sequences are found through a table built entirely at compile time. Each
+// opcode has a dense array of slots indexed by the key types of its dest and
+// one of its sources, picked so that no two of its sequences share a slot.
+// The slot gives the sequence to try, which must then match the whole key.
+struct SequenceEntry {
+  uint32_t key;
+  SequenceSelectFn select;
 };
-#define EMITTER_OPCODE_TABLE(name, ...) \
-  void Register_##name() { Register<__VA_ARGS__>(); }
+
+const uint32_t kKeyTypeCount = KEY_TYPE_V_V128 + 1;
+const uint32_t kSequenceSlotCount = kKeyTypeCount * kKeyTypeCount;
+
+// source_shift is the InstrKey bit offset of src1, src2 or src3.
+constexpr uint32_t GetSequenceSlot(uint32_t key, uint32_t source_shift) {
+  return ((key >> 8) & 0x1F) * kKeyTypeCount + ((key >> source_shift) & 0x1F);
+}
+
+constexpr bool SequencesHaveOpcode(Opcode) { return true; }
+template <typename... Ts>
+constexpr bool SequencesHaveOpcode(Opcode opcode, Opcode first, Ts... rest) {
+  return first == opcode && SequencesHaveOpcode(opcode, rest...);
+}
+
+template <typename... Ts>
+struct SequenceList {
+  static const size_t count = sizeof...(Ts);
+  static constexpr SequenceEntry entries[count ? count : 1] = {
+      {Ts::head_key(), Ts::Select}...};
+
+  static constexpr bool HaveOpcode(Opcode opcode) {
+    return SequencesHaveOpcode(opcode, Ts::EmitArgType::opcode...);
+  }
+  static constexpr bool HaveUniqueSlots(uint32_t source_shift, size_t i = 0,
+                                        size_t j = 1) {
+    return i >= count
+               ? true
+               : j >= count
+                     ? HaveUniqueSlots(source_shift, i + 1, i + 2)
+                     : GetSequenceSlot(entries[i].key, source_shift) !=
+                               GetSequenceSlot(entries[j].key,
+                                               source_shift) &&
+                           HaveUniqueSlots(source_shift, i, j + 1);
+  }
+  static constexpr uint32_t SourceShift() {
+    return HaveUniqueSlots(13) ? 13 : HaveUniqueSlots(18) ? 18 : 23;
+  }
+  // 1 + the index of the sequence in the slot, or 0 if there's none.
+  static constexpr uint8_t FindSlot(uint32_t slot, uint32_t source_shift,
+                                    size_t n = 0) {
+    return n >= count
+               ? 0
+               : GetSequenceSlot(entries[n].key, source_shift) == slot
+                     ? uint8_t(n + 1)
+                     : FindSlot(slot, source_shift, n + 1);
+  }
+};
+template <typename... Ts>
+constexpr SequenceEntry SequenceList<Ts...>::entries[];
+
+template <Opcode OPCODE>
+struct OpcodeSequences : SequenceList<> {};
+#define EMITTER_OPCODE_TABLE(name, ...)                                  \
+  template <>                                                            \
+  struct OpcodeSequences<name> : SequenceList<__VA_ARGS__> {             \
+    static_assert(HaveOpcode(name), "Sequences must be for " #name);     \
+    static_assert(HaveUniqueSlots(SourceShift()),                        \
+                  "Sequences for " #name " need a wider dispatch slot"); \
+  }
 
 // ============================================================================
 // OPCODE_COMMENT
@@ -667,6 +733,7 @@ struct COMMENT : Sequence<COMMENT, I<OPCODE_COMMENT, VoidOp, OffsetOp>> {
       // TODO(benvanik): pass through.
       // TODO(benvanik): don't just leak this memory.
       auto str_copy = strdup(str);
+      e.MarkUncacheable();
       e.mov(e.rdx, reinterpret_cast<uint64_t>(str_copy));
       e.CallNative(reinterpret_cast<void*>(TraceString));
     }
@@ -3009,10 +3076,7 @@ EMITTER_OPCODE_TABLE(OPCODE_COMPARE_NE, COMPARE_NE_I8, COMPARE_NE_I16,
   EMITTER_ASSOCIATIVE_COMPARE_INT(op, instr, inverse_instr, I8Op, Reg8);   \
   EMITTER_ASSOCIATIVE_COMPARE_INT(op, instr, inverse_instr, I16Op, Reg16); \
   EMITTER_ASSOCIATIVE_COMPARE_INT(op, instr, inverse_instr, I32Op, Reg32); \
-  EMITTER_ASSOCIATIVE_COMPARE_INT(op, instr, inverse_instr, I64Op, Reg64); \
-  EMITTER_OPCODE_TABLE(OPCODE_COMPARE_##op, COMPARE_##op##_I8Op,           \
-                       COMPARE_##op##_I16Op, COMPARE_##op##_I32Op,         \
-                       COMPARE_##op##_I64Op);
+  EMITTER_ASSOCIATIVE_COMPARE_INT(op, instr, inverse_instr, I64Op, Reg64);
 EMITTER_ASSOCIATIVE_COMPARE_XX(SLT, setl, setg);
 EMITTER_ASSOCIATIVE_COMPARE_XX(SLE, setle, setge);
 EMITTER_ASSOCIATIVE_COMPARE_XX(SGT, setg, setl);
@@ -3048,7 +3112,9 @@ EMITTER_ASSOCIATIVE_COMPARE_XX(UGE, setae, setbe);
       e.instr(i.dest);                                                \
     }                                                                 \
   };                                                                  \
-  EMITTER_OPCODE_TABLE(OPCODE_COMPARE_##op##_FLT, COMPARE_##op##_F32, \
+  EMITTER_OPCODE_TABLE(OPCODE_COMPARE_##op, COMPARE_##op##_I8Op,      \
+                       COMPARE_##op##_I16Op, COMPARE_##op##_I32Op,    \
+                       COMPARE_##op##_I64Op, COMPARE_##op##_F32,      \
                        COMPARE_##op##_F64);
 EMITTER_ASSOCIATIVE_COMPARE_FLT_XX(SLT, setb);
 EMITTER_ASSOCIATIVE_COMPARE_FLT_XX(SLE, setbe);
@@ -3388,42 +3454,29 @@ EMITTER_OPCODE_TABLE(OPCODE_ADD_CARRY, ADD_CARRY_I8, ADD_CARRY_I16,
 // ============================================================================
 // OPCODE_VECTOR_ADD
 // ============================================================================
+// Signed saturating dword add or subtract. Overflow happened where the result
+// has a different sign from both addends (or from src1 and the negated src2),
+// and saturates towards the sign of src1.
+void EmitAddSubSignedSatI32(X64Emitter& e, bool subtract, const Xmm& dest,
+                            const Xmm& src1, const Xmm& src2) {
+  if (subtract) {
+    e.vpsubd(e.xmm1, src1, src2);
+    e.vpxor(e.xmm2, src1, src2);
+    e.vpxor(e.xmm3, src1, e.xmm1);
+  } else {
+    e.vpaddd(e.xmm1, src1, src2);
+    e.vpxor(e.xmm2, e.xmm1, src1);
+    e.vpxor(e.xmm3, e.xmm1, src2);
+  }
+  e.vpand(e.xmm2, e.xmm2, e.xmm3);
+  // 0x7FFFFFFF, or 0x80000000 if src1 is negative.
+  e.vpsrad(e.xmm3, src1, 31);
+  e.vpxor(e.xmm3, e.xmm3, e.GetXmmConstPtr(XMMAbsMaskPS));
+  e.vblendvps(dest, e.xmm1, e.xmm3, e.xmm2);
+}
+
 struct VECTOR_ADD
     : Sequence<VECTOR_ADD, I<OPCODE_VECTOR_ADD, V128Op, V128Op, V128Op>> {
-  static __m128i EmulateVectorAddUnsignedSatI32(void*, __m128i src1,
-                                                __m128i src2) {
-    alignas(16) uint32_t a[4];
-    alignas(16) uint32_t b[4];
-    _mm_store_si128(reinterpret_cast<__m128i*>(a), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(b), src2);
-    for (size_t i = 0; i < 4; ++i) {
-      uint64_t v = (uint64_t)a[i] + (uint64_t)b[i];
-      if (v > 0xFFFFFFFF) {
-        a[i] = 0xFFFFFFFF;
-      } else {
-        a[i] = (uint32_t)v;
-      }
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(a));
-  }
-  static __m128i EmulateVectorAddSignedSatI32(void*, __m128i src1,
-                                              __m128i src2) {
-    alignas(16) int32_t a[4];
-    alignas(16) int32_t b[4];
-    _mm_store_si128(reinterpret_cast<__m128i*>(a), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(b), src2);
-    for (size_t i = 0; i < 4; ++i) {
-      int64_t v = (int64_t)a[i] + (int64_t)b[i];
-      if (v > 0x7FFFFFFF) {
-        a[i] = 0x7FFFFFFF;
-      } else if (v < -0x80000000ll) {
-        a[i] = 0x80000000;
-      } else {
-        a[i] = (uint32_t)v;
-      }
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(a));
-  }
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     EmitCommutativeBinaryXmmOp(e, i, [&i](X64Emitter& e, const Xmm& dest,
                                           const Xmm& src1, const Xmm& src2) {
@@ -3459,71 +3512,15 @@ struct VECTOR_ADD
         case INT32_TYPE:
           if (saturate) {
             if (is_unsigned) {
-              // TODO(benvanik): broken with UINT32MAX+1
-              //// We reuse all these temps...
-              // assert_true(src1 != e.xmm0 && src1 != e.xmm1 && src1 !=
-              // e.xmm2);
-              // assert_true(src2 != e.xmm0 && src2 != e.xmm1 && src2 !=
-              // e.xmm2);
-              //// Clamp to 0xFFFFFFFF.
-              //// Wish there was a vpaddusd...
-              //// | A | B | C | D |
-              //// |     B |     D |
-              // e.vpsllq(e.xmm0, src1, 32);
-              // e.vpsllq(e.xmm1, src2, 32);
-              // e.vpsrlq(e.xmm0, 32);
-              // e.vpsrlq(e.xmm1, 32);
-              // e.vpaddq(e.xmm0, e.xmm1);
-              // e.vpcmpgtq(e.xmm0, e.GetXmmConstPtr(XMMUnsignedDwordMax));
-              // e.vpsllq(e.xmm0, 32);
-              // e.vpsrlq(e.xmm0, 32);
-              //// |     A |     C |
-              // e.vpsrlq(e.xmm1, src1, 32);
-              // e.vpsrlq(e.xmm2, src2, 32);
-              // e.vpaddq(e.xmm1, e.xmm2);
-              // e.vpcmpgtq(e.xmm1, e.GetXmmConstPtr(XMMUnsignedDwordMax));
-              // e.vpsllq(e.xmm1, 32);
-              //// xmm0 = mask for with saturated dwords == 111...
-              // e.vpor(e.xmm0, e.xmm1);
-              // e.vpaddd(dest, src1, src2);
-              //// dest.f[n] = xmm1.f[n] ? xmm1.f[n] : dest.f[n];
-              // e.vblendvps(dest, dest, e.xmm1, e.xmm1);
-              if (i.src2.is_constant) {
-                e.LoadConstantXmm(e.xmm0, i.src2.constant());
-                e.lea(e.r9, e.StashXmm(1, e.xmm0));
-              } else {
-                e.lea(e.r9, e.StashXmm(1, i.src2));
-              }
-              e.lea(e.r8, e.StashXmm(0, i.src1));
-              e.CallNativeSafe(
-                  reinterpret_cast<void*>(EmulateVectorAddUnsignedSatI32));
-              e.vmovaps(i.dest, e.xmm0);
+              // Overflowed where the sum is below src1, compared unsigned
+              // by flipping the signs. Those saturate to 0xFFFFFFFF.
+              e.vpaddd(e.xmm1, src1, src2);
+              e.vpxor(e.xmm2, e.xmm1, e.GetXmmConstPtr(XMMSignMaskI32));
+              e.vpxor(e.xmm3, src1, e.GetXmmConstPtr(XMMSignMaskI32));
+              e.vpcmpgtd(e.xmm3, e.xmm3, e.xmm2);
+              e.vpor(dest, e.xmm1, e.xmm3);
             } else {
-              // https://software.intel.com/en-us/forums/topic/285219
-              // TODO(benvanik): this is broken with INTMAX+1.
-              // We reuse all these temps...
-              // assert_true(src1 != e.xmm0 && src1 != e.xmm1 && src1 !=
-              // e.xmm2);
-              // assert_true(src2 != e.xmm0 && src2 != e.xmm1 && src2 !=
-              // e.xmm2);
-              // e.vpaddd(e.xmm0, src1, src2);  // res
-              // e.vpand(e.xmm1, src1, src2);  // sign_and
-              // e.vpandn(e.xmm2, e.xmm0, e.xmm1);  // min_sat_mask
-              // e.vblendvps(dest, e.xmm0, e.GetXmmConstPtr(XMMSignMaskPS),
-              // e.xmm2);
-              // e.vpor(e.xmm1, src1, src2);  // sign_or
-              // e.vpandn(e.xmm1, e.xmm0);  // max_sat_mask
-              // e.vblendvps(dest, e.GetXmmConstPtr(XMMAbsMaskPS), e.xmm1);
-              if (i.src2.is_constant) {
-                e.LoadConstantXmm(e.xmm0, i.src2.constant());
-                e.lea(e.r9, e.StashXmm(1, e.xmm0));
-              } else {
-                e.lea(e.r9, e.StashXmm(1, i.src2));
-              }
-              e.lea(e.r8, e.StashXmm(0, i.src1));
-              e.CallNativeSafe(
-                  reinterpret_cast<void*>(EmulateVectorAddSignedSatI32));
-              e.vmovaps(i.dest, e.xmm0);
+              EmitAddSubSignedSatI32(e, false, dest, src1, src2);
             }
           } else {
             e.vpaddd(dest, src1, src2);
@@ -3602,19 +3599,6 @@ EMITTER_OPCODE_TABLE(OPCODE_SUB, SUB_I8, SUB_I16, SUB_I32, SUB_I64, SUB_F32,
 // ============================================================================
 struct VECTOR_SUB
     : Sequence<VECTOR_SUB, I<OPCODE_VECTOR_SUB, V128Op, V128Op, V128Op>> {
-  static __m128i EmulateVectorSubSignedSatI32(void*, __m128i src1,
-                                              __m128i src2) {
-    alignas(16) int32_t src1v[4];
-    alignas(16) int32_t src2v[4];
-    alignas(16) int32_t value[4];
-    _mm_store_si128(reinterpret_cast<__m128i*>(src1v), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(src2v), src2);
-    for (size_t i = 0; i < 4; ++i) {
-      auto t = int64_t(src1v[i]) - int64_t(src2v[i]);
-      value[i] = t < INT_MIN ? INT_MIN : (t > INT_MAX ? INT_MAX : int32_t(t));
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
-  }
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     EmitCommutativeBinaryXmmOp(e, i, [&i](X64Emitter& e, const Xmm& dest,
                                           const Xmm& src1, const Xmm& src2) {
@@ -3652,11 +3636,7 @@ struct VECTOR_SUB
             if (is_unsigned) {
               assert_always();
             } else {
-              e.lea(e.r8, e.StashXmm(0, i.src1));
-              e.lea(e.r9, e.StashXmm(1, i.src2));
-              e.CallNativeSafe(
-                  reinterpret_cast<void*>(EmulateVectorSubSignedSatI32));
-              e.vmovaps(i.dest, e.xmm0);
+              EmitAddSubSignedSatI32(e, true, dest, src1, src2);
             }
           } else {
             e.vpsubd(dest, src1, src2);
@@ -4671,11 +4651,20 @@ struct RSQRT_V128 : Sequence<RSQRT_V128, I<OPCODE_RSQRT, V128Op, V128Op>> {
 };
 EMITTER_OPCODE_TABLE(OPCODE_RSQRT, RSQRT_F32, RSQRT_F64, RSQRT_V128);
 
+// dest = dest * src + constant, fused if the host can.
+void EmitMulAddConstant(X64Emitter& e, const Xmm& dest, const Xmm& src,
+                        XmmConst constant) {
+  if (e.IsFeatureEnabled(kX64EmitFMA)) {
+    e.vfmadd213ps(dest, src, e.GetXmmConstPtr(constant));
+  } else {
+    e.vmulps(dest, dest, src);
+    e.vaddps(dest, dest, e.GetXmmConstPtr(constant));
+  }
+}
+
 // ============================================================================
 // OPCODE_POW2
 // ============================================================================
-// TODO(benvanik): use approx here:
-//     http://jrfonseca.blogspot.com/2008/09/fast-sse2-pow-tables-or-polynomials.html
 struct POW2_F32 : Sequence<POW2_F32, I<OPCODE_POW2, F32Op, F32Op>> {
   static __m128 EmulatePow2(void*, __m128 src) {
     float src_value;
@@ -4705,18 +4694,30 @@ struct POW2_F64 : Sequence<POW2_F64, I<OPCODE_POW2, F64Op, F64Op>> {
   }
 };
 struct POW2_V128 : Sequence<POW2_V128, I<OPCODE_POW2, V128Op, V128Op>> {
-  static __m128 EmulatePow2(void*, __m128 src) {
-    alignas(16) float values[4];
-    _mm_store_ps(values, src);
-    for (size_t i = 0; i < 4; ++i) {
-      values[i] = std::exp2(values[i]);
-    }
-    return _mm_load_ps(values);
-  }
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.lea(e.r8, e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulatePow2));
-    e.vmovaps(i.dest, e.xmm0);
+    // vexptefp is an estimate, good to 1 part in 16. 2^x is built as
+    // 2^floor(x), directly as a float, times 2^fract(x) from a polynomial.
+    // Clamping first gives 0 below 2^-127, as denormals are flushed, and
+    // infinity from 2^128.
+    Xmm src = LoadVectorOperand(e, i.src1, e.xmm0);
+    e.vmaxps(e.xmm1, src, e.GetXmmConstPtr(XMMPow2Min));
+    e.vminps(e.xmm1, e.xmm1, e.GetXmmConstPtr(XMMPow2Max));
+    e.vroundps(e.xmm2, e.xmm1, B00000001);
+    e.vsubps(e.xmm1, e.xmm1, e.xmm2);
+    e.vcvttps2dq(e.xmm2, e.xmm2);
+    e.vpaddd(e.xmm2, e.xmm2, e.GetXmmConstPtr(XMMExponentBiasI32));
+    e.vpslld(e.xmm2, e.xmm2, 23);
+    e.vmovaps(e.xmm3, e.GetXmmConstPtr(XMMPow2C5));
+    EmitMulAddConstant(e, e.xmm3, e.xmm1, XMMPow2C4);
+    EmitMulAddConstant(e, e.xmm3, e.xmm1, XMMPow2C3);
+    EmitMulAddConstant(e, e.xmm3, e.xmm1, XMMPow2C2);
+    EmitMulAddConstant(e, e.xmm3, e.xmm1, XMMPow2C1);
+    EmitMulAddConstant(e, e.xmm3, e.xmm1, XMMPow2C0);
+    e.vmulps(e.xmm3, e.xmm3, e.xmm2);
+    // The clamps lost NaNs; x + x quiets them.
+    e.vcmpunordps(e.xmm1, src, src);
+    e.vaddps(e.xmm2, src, src);
+    e.vblendvps(i.dest, e.xmm3, e.xmm2, e.xmm1);
   }
 };
 EMITTER_OPCODE_TABLE(OPCODE_POW2, POW2_F32, POW2_F64, POW2_V128);
@@ -4724,9 +4725,6 @@ EMITTER_OPCODE_TABLE(OPCODE_POW2, POW2_F32, POW2_F64, POW2_V128);
 // ============================================================================
 // OPCODE_LOG2
 // ============================================================================
-// TODO(benvanik): use approx here:
-//     http://jrfonseca.blogspot.com/2008/09/fast-sse2-pow-tables-or-polynomials.html
-// TODO(benvanik): this emulated fn destroys all xmm registers! don't do it!
 struct LOG2_F32 : Sequence<LOG2_F32, I<OPCODE_LOG2, F32Op, F32Op>> {
   static __m128 EmulateLog2(void*, __m128 src) {
     float src_value;
@@ -4756,18 +4754,37 @@ struct LOG2_F64 : Sequence<LOG2_F64, I<OPCODE_LOG2, F64Op, F64Op>> {
   }
 };
 struct LOG2_V128 : Sequence<LOG2_V128, I<OPCODE_LOG2, V128Op, V128Op>> {
-  static __m128 EmulateLog2(void*, __m128 src) {
-    alignas(16) float values[4];
-    _mm_store_ps(values, src);
-    for (size_t i = 0; i < 4; ++i) {
-      values[i] = std::log2(values[i]);
-    }
-    return _mm_load_ps(values);
-  }
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.lea(e.r8, e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateLog2));
-    e.vmovaps(i.dest, e.xmm0);
+    // vlogefp is an estimate, good to 1/32. log2(x) is the exponent of x plus
+    // log2 of its mantissa in [1, 2), from a polynomial times (mantissa - 1)
+    // so that log2(1) is exactly 0.
+    Xmm src = LoadVectorOperand(e, i.src1, e.xmm0);
+    e.vandps(e.xmm1, src, e.GetXmmConstPtr(XMMAbsMaskPS));
+    e.vpsrld(e.xmm2, e.xmm1, 23);
+    // Zeros and (flushed) denormals.
+    e.vpcmpeqd(e.xmm4, e.xmm2, e.GetXmmConstPtr(XMMZero));
+    e.vpsubd(e.xmm2, e.xmm2, e.GetXmmConstPtr(XMMExponentBiasI32));
+    e.vcvtdq2ps(e.xmm2, e.xmm2);
+    e.vandps(e.xmm3, src, e.GetXmmConstPtr(XMMMantissaMaskPS));
+    e.vorps(e.xmm3, e.xmm3, e.GetXmmConstPtr(XMMOne));
+    e.vmovaps(e.xmm5, e.GetXmmConstPtr(XMMLog2C5));
+    EmitMulAddConstant(e, e.xmm5, e.xmm3, XMMLog2C4);
+    EmitMulAddConstant(e, e.xmm5, e.xmm3, XMMLog2C3);
+    EmitMulAddConstant(e, e.xmm5, e.xmm3, XMMLog2C2);
+    EmitMulAddConstant(e, e.xmm5, e.xmm3, XMMLog2C1);
+    EmitMulAddConstant(e, e.xmm5, e.xmm3, XMMLog2C0);
+    e.vsubps(e.xmm3, e.xmm3, e.GetXmmConstPtr(XMMOne));
+    e.vmulps(e.xmm5, e.xmm5, e.xmm3);
+    e.vaddps(e.xmm5, e.xmm5, e.xmm2);
+    // Infinities and NaNs give themselves, NaNs quieted by x + x.
+    e.vpcmpgtd(e.xmm1, e.xmm1, e.GetXmmConstPtr(XMMFltMaxPS));
+    e.vaddps(e.xmm2, src, src);
+    e.vblendvps(e.xmm5, e.xmm5, e.xmm2, e.xmm1);
+    // Negative numbers (including -infinity) give NaN.
+    e.vcmpltps(e.xmm1, src, e.GetXmmConstPtr(XMMZero));
+    e.vblendvps(e.xmm5, e.xmm5, e.GetXmmConstPtr(XMMQNaNPS), e.xmm1);
+    // Zeros of either sign give -infinity.
+    e.vblendvps(i.dest, e.xmm5, e.GetXmmConstPtr(XMMNegInfinityPS), e.xmm4);
   }
 };
 EMITTER_OPCODE_TABLE(OPCODE_LOG2, LOG2_F32, LOG2_F64, LOG2_V128);
@@ -5178,279 +5195,323 @@ struct SHA_I64 : Sequence<SHA_I64, I<OPCODE_SHA, I64Op, I64Op, I8Op>> {
 EMITTER_OPCODE_TABLE(OPCODE_SHA, SHA_I8, SHA_I16, SHA_I32, SHA_I64);
 
 // ============================================================================
-// OPCODE_VECTOR_SHL
+// Vector shift helpers
 // ============================================================================
-struct VECTOR_SHL_V128
-    : Sequence<VECTOR_SHL_V128, I<OPCODE_VECTOR_SHL, V128Op, V128Op, V128Op>> {
-  static void Emit(X64Emitter& e, const EmitArgType& i) {
-    switch (i.instr->flags) {
-      case INT8_TYPE:
-        EmitInt8(e, i);
+enum VectorShiftOp {
+  kVectorShl,
+  kVectorShr,
+  kVectorSha,
+  kVectorRotateLeft,
+};
+
+// Whether a constant count vector shifts every word or dword by the same
+// amount, once the counts are masked to the element size like the guest does.
+bool GetUniformShiftCount(const vec128_t& counts, TypeName part_type,
+                          uint8_t* count) {
+  switch (part_type) {
+    case INT16_TYPE:
+      for (size_t n = 1; n < 8; ++n) {
+        if ((counts.u16[n] & 0xF) != (counts.u16[0] & 0xF)) {
+          return false;
+        }
+      }
+      *count = counts.u16[0] & 0xF;
+      return true;
+    case INT32_TYPE:
+      for (size_t n = 1; n < 4; ++n) {
+        if ((counts.u32[n] & 0x1F) != (counts.u32[0] & 0x1F)) {
+          return false;
+        }
+      }
+      *count = counts.u32[0] & 0x1F;
+      return true;
+    default:
+      return false;
+  }
+}
+
+// x64 has no byte shifts, so the counts are applied a bit at a time: every
+// byte is shifted by 4, then 2, then 1, and vpblendvb keeps the shifted value
+// in the bytes whose count has that bit set. vpblendvb tests the top bit of
+// each byte, so that's where the count bit being applied is kept. The word
+// shifts used move bits between the bytes of each word, which the masks
+// clear.
+void EmitVectorShiftSteppedI8(X64Emitter& e, VectorShiftOp op,
+                              const Xmm& dest, const Xmm& src1,
+                              const Xmm& src2) {
+  // Bit 2 of each count to the top of its byte. Bits carried in from the byte
+  // below only reach the bits beneath it.
+  e.vpsllw(e.xmm2, src2, 5);
+  if (op == kVectorSha) {
+    // Shifting the complement of negative values brings in ones.
+    e.vpxor(e.xmm3, e.xmm3, e.xmm3);
+    e.vpcmpgtb(e.xmm3, e.xmm3, src1);
+    e.vpxor(e.xmm1, src1, e.xmm3);
+  } else {
+    e.vmovaps(e.xmm1, src1);
+  }
+  for (int shift = 4; shift; shift >>= 1) {
+    // The bits a byte keeps when shifted left or right by shift.
+    XmmConst shl_mask = shift == 4 ? XMMByteMaskF0
+                                   : shift == 2 ? XMMByteMaskFC : XMMByteMaskFE;
+    XmmConst shr_mask = shift == 4 ? XMMByteMask0F
+                                   : shift == 2 ? XMMByteMask3F : XMMByteMask7F;
+    switch (op) {
+      case kVectorShl:
+        e.vpsllw(e.xmm0, e.xmm1, shift);
+        e.vpand(e.xmm0, e.xmm0, e.GetXmmConstPtr(shl_mask));
         break;
-      case INT16_TYPE:
-        EmitInt16(e, i);
+      case kVectorShr:
+      case kVectorSha:
+        e.vpsrlw(e.xmm0, e.xmm1, shift);
+        e.vpand(e.xmm0, e.xmm0, e.GetXmmConstPtr(shr_mask));
         break;
-      case INT32_TYPE:
-        EmitInt32(e, i);
-        break;
-      default:
-        assert_always();
+      case kVectorRotateLeft:
+        // (xmm0 & shl_mask) | (xmm4 & ~shl_mask), where xmm4 has the bits
+        // shifted out of the top of each byte at the bottom.
+        e.vpsllw(e.xmm0, e.xmm1, shift);
+        e.vpsrlw(e.xmm4, e.xmm1, 8 - shift);
+        e.vpxor(e.xmm0, e.xmm0, e.xmm4);
+        e.vpand(e.xmm0, e.xmm0, e.GetXmmConstPtr(shl_mask));
+        e.vpxor(e.xmm0, e.xmm0, e.xmm4);
         break;
     }
-  }
-  static __m128i EmulateVectorShlI8(void*, __m128i src1, __m128i src2) {
-    alignas(16) uint8_t value[16];
-    alignas(16) uint8_t shamt[16];
-    _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
-    for (size_t i = 0; i < 16; ++i) {
-      value[i] = value[i] << (shamt[i] & 0x7);
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
-  }
-  static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): native version (with shift magic).
-    if (i.src2.is_constant) {
-      e.LoadConstantXmm(e.xmm0, i.src2.constant());
-      e.lea(e.r9, e.StashXmm(1, e.xmm0));
+    if (shift == 1) {
+      if (op == kVectorSha) {
+        e.vpblendvb(e.xmm1, e.xmm1, e.xmm0, e.xmm2);
+        e.vpxor(dest, e.xmm1, e.xmm3);
+      } else {
+        e.vpblendvb(dest, e.xmm1, e.xmm0, e.xmm2);
+      }
     } else {
-      e.lea(e.r9, e.StashXmm(1, i.src2));
-    }
-    e.lea(e.r8, e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShlI8));
-    e.vmovaps(i.dest, e.xmm0);
-  }
-  static __m128i EmulateVectorShlI16(void*, __m128i src1, __m128i src2) {
-    alignas(16) uint16_t value[8];
-    alignas(16) uint16_t shamt[8];
-    _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
-    for (size_t i = 0; i < 8; ++i) {
-      value[i] = value[i] << (shamt[i] & 0xF);
+      e.vpblendvb(e.xmm1, e.xmm1, e.xmm0, e.xmm2);
+      e.vpaddb(e.xmm2, e.xmm2, e.xmm2);
     }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
   }
-  static void EmitInt16(X64Emitter& e, const EmitArgType& i) {
-    if (i.src2.is_constant) {
-      const auto& shamt = i.src2.constant();
-      bool all_same = true;
-      for (size_t n = 0; n < 8 - n; ++n) {
-        if (shamt.u16[n] != shamt.u16[n + 1]) {
-          all_same = false;
-          break;
-        }
-      }
-      if (all_same) {
-        // Every count is the same, so we can use vpsllw.
-        e.vpsllw(i.dest, i.src1, shamt.u16[0] & 0xF);
-        return;
-      }
-    }
-    // TODO(benvanik): native version (with shift magic).
-    if (i.src2.is_constant) {
-      e.LoadConstantXmm(e.xmm0, i.src2.constant());
-      e.lea(e.r9, e.StashXmm(1, e.xmm0));
+}
+
+// The same for words, or dwords without AVX2. Shifts of these are exact, so
+// only the counts need moving, and there are one or two more steps.
+void EmitVectorShiftStepped(X64Emitter& e, VectorShiftOp op,
+                            TypeName part_type, const Xmm& dest,
+                            const Xmm& src1, const Xmm& src2) {
+  bool is_word = part_type == INT16_TYPE;
+  int bits = is_word ? 16 : 32;
+  auto shift_left = [&e, is_word](const Xmm& d, const Xmm& s, int n) {
+    if (is_word) {
+      e.vpsllw(d, s, n);
     } else {
-      e.lea(e.r9, e.StashXmm(1, i.src2));
+      e.vpslld(d, s, n);
     }
-    e.lea(e.r8, e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShlI16));
-    e.vmovaps(i.dest, e.xmm0);
-  }
-  static __m128i EmulateVectorShlI32(void*, __m128i src1, __m128i src2) {
-    alignas(16) uint32_t value[4];
-    alignas(16) uint32_t shamt[4];
-    _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
-    for (size_t i = 0; i < 4; ++i) {
-      value[i] = value[i] << (shamt[i] & 0x1F);
+  };
+  auto shift_right = [&e, is_word](const Xmm& d, const Xmm& s, int n) {
+    if (is_word) {
+      e.vpsrlw(d, s, n);
+    } else {
+      e.vpsrld(d, s, n);
     }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
-  }
-  static void EmitInt32(X64Emitter& e, const EmitArgType& i) {
-    if (e.IsFeatureEnabled(kX64EmitAVX2)) {
-      if (i.src2.is_constant) {
-        const auto& shamt = i.src2.constant();
-        bool all_same = true;
-        for (size_t n = 0; n < 4 - n; ++n) {
-          if (shamt.u32[n] != shamt.u32[n + 1]) {
-            all_same = false;
-            break;
-          }
-        }
-        if (all_same) {
-          // Every count is the same, so we can use vpslld.
-          e.vpslld(i.dest, i.src1, shamt.u8[0] & 0x1F);
-        } else {
-          // Counts differ, so pre-mask and load constant.
-          vec128_t masked = i.src2.constant();
-          for (size_t n = 0; n < 4; ++n) {
-            masked.u32[n] &= 0x1F;
-          }
-          e.LoadConstantXmm(e.xmm0, masked);
-          e.vpsllvd(i.dest, i.src1, e.xmm0);
-        }
-      } else {
-        // Fully variable shift.
-        // src shift mask may have values >31, and x86 sets to zero when
-        // that happens so we mask.
-        e.vandps(e.xmm0, i.src2, e.GetXmmConstPtr(XMMShiftMaskPS));
-        e.vpsllvd(i.dest, i.src1, e.xmm0);
-      }
+  };
+  auto shift_right_arithmetic = [&e, is_word](const Xmm& d, const Xmm& s,
+                                              int n) {
+    if (is_word) {
+      e.vpsraw(d, s, n);
     } else {
-      // TODO(benvanik): native version (with shift magic).
-      if (i.src2.is_constant) {
-        e.LoadConstantXmm(e.xmm0, i.src2.constant());
-        e.lea(e.r9, e.StashXmm(1, e.xmm0));
-      } else {
-        e.lea(e.r9, e.StashXmm(1, i.src2));
-      }
-      e.lea(e.r8, e.StashXmm(0, i.src1));
-      e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShlI32));
-      e.vmovaps(i.dest, e.xmm0);
+      e.vpsrad(d, s, n);
     }
-  }
-};
-EMITTER_OPCODE_TABLE(OPCODE_VECTOR_SHL, VECTOR_SHL_V128);
-
-// ============================================================================
-// OPCODE_VECTOR_SHR
-// ============================================================================
-struct VECTOR_SHR_V128
-    : Sequence<VECTOR_SHR_V128, I<OPCODE_VECTOR_SHR, V128Op, V128Op, V128Op>> {
-  static void Emit(X64Emitter& e, const EmitArgType& i) {
-    switch (i.instr->flags) {
-      case INT8_TYPE:
-        EmitInt8(e, i);
+  };
+  // The top bit of each count to the sign bit of its element.
+  shift_left(e.xmm2, src2, is_word ? 12 : 27);
+  e.vmovaps(e.xmm1, src1);
+  for (int shift = bits / 2; shift; shift >>= 1) {
+    switch (op) {
+      case kVectorShl:
+        shift_left(e.xmm0, e.xmm1, shift);
         break;
-      case INT16_TYPE:
-        EmitInt16(e, i);
+      case kVectorShr:
+        shift_right(e.xmm0, e.xmm1, shift);
         break;
-      case INT32_TYPE:
-        EmitInt32(e, i);
+      case kVectorSha:
+        shift_right_arithmetic(e.xmm0, e.xmm1, shift);
         break;
-      default:
-        assert_always();
+      case kVectorRotateLeft:
+        shift_left(e.xmm0, e.xmm1, shift);
+        shift_right(e.xmm4, e.xmm1, bits - shift);
+        e.vpor(e.xmm0, e.xmm0, e.xmm4);
         break;
     }
-  }
-  static __m128i EmulateVectorShrI8(void*, __m128i src1, __m128i src2) {
-    alignas(16) uint8_t value[16];
-    alignas(16) uint8_t shamt[16];
-    _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
-    for (size_t i = 0; i < 16; ++i) {
-      value[i] = value[i] >> (shamt[i] & 0x7);
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
-  }
-  static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): native version (with shift magic).
-    if (i.src2.is_constant) {
-      e.LoadConstantXmm(e.xmm0, i.src2.constant());
-      e.lea(e.r9, e.StashXmm(1, e.xmm0));
+    const Xmm& target = shift == 1 ? dest : e.xmm1;
+    if (is_word) {
+      // vpblendvb tests bytes, so spread the sign of each word over both.
+      e.vpsraw(e.xmm3, e.xmm2, 15);
+      e.vpblendvb(target, e.xmm1, e.xmm0, e.xmm3);
+      e.vpaddw(e.xmm2, e.xmm2, e.xmm2);
     } else {
-      e.lea(e.r9, e.StashXmm(1, i.src2));
+      e.vblendvps(target, e.xmm1, e.xmm0, e.xmm2);
+      e.vpaddd(e.xmm2, e.xmm2, e.xmm2);
     }
-    e.lea(e.r8, e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShrI8));
-    e.vmovaps(i.dest, e.xmm0);
   }
-  static __m128i EmulateVectorShrI16(void*, __m128i src1, __m128i src2) {
-    alignas(16) uint16_t value[8];
-    alignas(16) uint16_t shamt[8];
-    _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
-    for (size_t i = 0; i < 8; ++i) {
-      value[i] = value[i] >> (shamt[i] & 0xF);
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
+}
+
+// With AVX2, words are shifted as dwords: the low word of each dword with
+// one vp*vd and the high word with another, then blended back together.
+void EmitVectorShiftI16AVX2(X64Emitter& e, VectorShiftOp op, const Xmm& dest,
+                            const Xmm& src1, const Xmm& src2) {
+  // Counts of the low and high words.
+  e.vpand(e.xmm2, src2, e.GetXmmConstPtr(XMMShiftMaskEvenPI16));
+  e.vpsrld(e.xmm3, src2, 16);
+  e.vpand(e.xmm3, e.xmm3, e.GetXmmConstPtr(XMMShiftMaskEvenPI16));
+  switch (op) {
+    case kVectorShl:
+      e.vpsllvd(e.xmm4, src1, e.xmm2);
+      e.vpsrld(e.xmm1, src1, 16);
+      e.vpsllvd(e.xmm1, e.xmm1, e.xmm3);
+      e.vpslld(e.xmm1, e.xmm1, 16);
+      break;
+    case kVectorShr:
+      e.vpand(e.xmm4, src1, e.GetXmmConstPtr(XMMMaskEvenPI16));
+      e.vpsrlvd(e.xmm4, e.xmm4, e.xmm2);
+      e.vpsrlvd(e.xmm1, src1, e.xmm3);
+      break;
+    case kVectorSha:
+      e.vpslld(e.xmm4, src1, 16);
+      e.vpsravd(e.xmm4, e.xmm4, e.xmm2);
+      e.vpsrld(e.xmm4, e.xmm4, 16);
+      e.vpsravd(e.xmm1, src1, e.xmm3);
+      break;
+    case kVectorRotateLeft:
+      // A word repeated in both halves of a dword rotates as it shifts.
+      e.vpslld(e.xmm4, src1, 16);
+      e.vpblendw(e.xmm4, e.xmm4, src1, B01010101);
+      e.vpsllvd(e.xmm4, e.xmm4, e.xmm2);
+      e.vpsrld(e.xmm4, e.xmm4, 16);
+      e.vpsrld(e.xmm1, src1, 16);
+      e.vpblendw(e.xmm1, e.xmm1, src1, B10101010);
+      e.vpsllvd(e.xmm1, e.xmm1, e.xmm3);
+      break;
+  }
+  e.vpblendw(dest, e.xmm4, e.xmm1, B10101010);
+}
+
+void EmitVectorShiftI32AVX2(X64Emitter& e, VectorShiftOp op, const Xmm& dest,
+                            const Xmm& src1, const Xmm& src2) {
+  // The guest masks the counts, where x86 would shift everything out.
+  e.vpand(e.xmm2, src2, e.GetXmmConstPtr(XMMShiftMaskPS));
+  switch (op) {
+    case kVectorShl:
+      e.vpsllvd(dest, src1, e.xmm2);
+      break;
+    case kVectorShr:
+      e.vpsrlvd(dest, src1, e.xmm2);
+      break;
+    case kVectorSha:
+      e.vpsravd(dest, src1, e.xmm2);
+      break;
+    case kVectorRotateLeft:
+      // A count of 0 shifts right by 32, which does give 0.
+      e.vmovaps(e.xmm3, e.GetXmmConstPtr(XMMPI32));
+      e.vpsubd(e.xmm3, e.xmm3, e.xmm2);
+      e.vpsrlvd(e.xmm3, src1, e.xmm3);
+      e.vpsllvd(e.xmm1, src1, e.xmm2);
+      e.vpor(dest, e.xmm1, e.xmm3);
+      break;
   }
-  static void EmitInt16(X64Emitter& e, const EmitArgType& i) {
-    if (i.src2.is_constant) {
-      const auto& shamt = i.src2.constant();
-      bool all_same = true;
-      for (size_t n = 0; n < 8 - n; ++n) {
-        if (shamt.u16[n] != shamt.u16[n + 1]) {
-          all_same = false;
-          break;
-        }
+}
+
+// Shifts of every element by the same count have immediate forms.
+void EmitVectorShiftUniform(X64Emitter& e, VectorShiftOp op,
+                            TypeName part_type, const Xmm& dest,
+                            const Xmm& src1, uint8_t count) {
+  bool is_word = part_type == INT16_TYPE;
+  switch (op) {
+    case kVectorShl:
+      if (is_word) {
+        e.vpsllw(dest, src1, count);
+      } else {
+        e.vpslld(dest, src1, count);
       }
-      if (all_same) {
-        // Every count is the same, so we can use vpsllw.
-        e.vpsrlw(i.dest, i.src1, shamt.u16[0] & 0xF);
-        return;
+      break;
+    case kVectorShr:
+      if (is_word) {
+        e.vpsrlw(dest, src1, count);
+      } else {
+        e.vpsrld(dest, src1, count);
       }
-    }
-    // TODO(benvanik): native version (with shift magic).
-    if (i.src2.is_constant) {
-      e.LoadConstantXmm(e.xmm0, i.src2.constant());
-      e.lea(e.r9, e.StashXmm(1, e.xmm0));
-    } else {
-      e.lea(e.r9, e.StashXmm(1, i.src2));
-    }
-    e.lea(e.r8, e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShrI16));
-    e.vmovaps(i.dest, e.xmm0);
-  }
-  static __m128i EmulateVectorShrI32(void*, __m128i src1, __m128i src2) {
-    alignas(16) uint32_t value[4];
-    alignas(16) uint32_t shamt[4];
-    _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
-    for (size_t i = 0; i < 4; ++i) {
-      value[i] = value[i] >> (shamt[i] & 0x1F);
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
-  }
-  static void EmitInt32(X64Emitter& e, const EmitArgType& i) {
-    if (i.src2.is_constant) {
-      const auto& shamt = i.src2.constant();
-      bool all_same = true;
-      for (size_t n = 0; n < 4 - n; ++n) {
-        if (shamt.u32[n] != shamt.u32[n + 1]) {
-          all_same = false;
-          break;
-        }
+      break;
+    case kVectorSha:
+      if (is_word) {
+        e.vpsraw(dest, src1, count);
+      } else {
+        e.vpsrad(dest, src1, count);
       }
-      if (all_same) {
-        // Every count is the same, so we can use vpslld.
-        e.vpsrld(i.dest, i.src1, shamt.u8[0] & 0x1F);
-        return;
+      break;
+    case kVectorRotateLeft:
+      if (is_word) {
+        e.vpsllw(e.xmm1, src1, count);
+        e.vpsrlw(e.xmm2, src1, 16 - count);
       } else {
-        if (e.IsFeatureEnabled(kX64EmitAVX2)) {
-          // Counts differ, so pre-mask and load constant.
-          vec128_t masked = i.src2.constant();
-          for (size_t n = 0; n < 4; ++n) {
-            masked.u32[n] &= 0x1F;
-          }
-          e.LoadConstantXmm(e.xmm0, masked);
-          e.vpsrlvd(i.dest, i.src1, e.xmm0);
-          return;
-        }
+        e.vpslld(e.xmm1, src1, count);
+        e.vpsrld(e.xmm2, src1, 32 - count);
       }
-    } else {
+      e.vpor(dest, e.xmm1, e.xmm2);
+      break;
+  }
+}
+
+template <typename ARGS>
+void EmitVectorShift(X64Emitter& e, const ARGS& i, VectorShiftOp op) {
+  auto part_type = static_cast<TypeName>(i.instr->flags);
+  assert_true(part_type == INT8_TYPE || part_type == INT16_TYPE ||
+              part_type == INT32_TYPE);
+  Xmm src1 = LoadVectorOperand(e, i.src1, e.xmm0);
+  uint8_t count;
+  if (i.src2.is_constant &&
+      GetUniformShiftCount(i.src2.constant(), part_type, &count)) {
+    EmitVectorShiftUniform(e, op, part_type, i.dest, src1, count);
+    return;
+  }
+  Xmm src2 = LoadVectorOperand(e, i.src2, e.xmm5);
+  switch (part_type) {
+    case INT8_TYPE:
+      EmitVectorShiftSteppedI8(e, op, i.dest, src1, src2);
+      break;
+    case INT16_TYPE:
       if (e.IsFeatureEnabled(kX64EmitAVX2)) {
-        // Fully variable shift.
-        // src shift mask may have values >31, and x86 sets to zero when
-        // that happens so we mask.
-        e.vandps(e.xmm0, i.src2, e.GetXmmConstPtr(XMMShiftMaskPS));
-        e.vpsrlvd(i.dest, i.src1, e.xmm0);
-        return;
+        EmitVectorShiftI16AVX2(e, op, i.dest, src1, src2);
+      } else {
+        EmitVectorShiftStepped(e, op, part_type, i.dest, src1, src2);
       }
-    }
+      break;
+    case INT32_TYPE:
+      if (e.IsFeatureEnabled(kX64EmitAVX2)) {
+        EmitVectorShiftI32AVX2(e, op, i.dest, src1, src2);
+      } else {
+        EmitVectorShiftStepped(e, op, part_type, i.dest, src1, src2);
+      }
+      break;
+    default:
+      assert_unhandled_case(part_type);
+      break;
+  }
+}
 
-    // We've reached here if we don't have AVX2 and it's a variable shift
-    // TODO: native version
-    if (i.src2.is_constant) {
-      e.LoadConstantXmm(e.xmm0, i.src2.constant());
-      e.lea(e.r9, e.StashXmm(1, e.xmm0));
-    } else {
-      e.lea(e.r9, e.StashXmm(1, i.src2));
-    }
-    e.lea(e.r8, e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShrI32));
-    e.vmovaps(i.dest, e.xmm0);
+// ============================================================================
+// OPCODE_VECTOR_SHL
+// ============================================================================
+struct VECTOR_SHL_V128
+    : Sequence<VECTOR_SHL_V128, I<OPCODE_VECTOR_SHL, V128Op, V128Op, V128Op>> {
+  static void Emit(X64Emitter& e, const EmitArgType& i) {
+    EmitVectorShift(e, i, kVectorShl);
+  }
+};
+EMITTER_OPCODE_TABLE(OPCODE_VECTOR_SHL, VECTOR_SHL_V128);
+
+// ============================================================================
+// OPCODE_VECTOR_SHR
+// ============================================================================
+struct VECTOR_SHR_V128
+    : Sequence<VECTOR_SHR_V128, I<OPCODE_VECTOR_SHR, V128Op, V128Op, V128Op>> {
+  static void Emit(X64Emitter& e, const EmitArgType& i) {
+    EmitVectorShift(e, i, kVectorShr);
   }
 };
 EMITTER_OPCODE_TABLE(OPCODE_VECTOR_SHR, VECTOR_SHR_V128);
@@ -5460,91 +5521,8 @@ EMITTER_OPCODE_TABLE(OPCODE_VECTOR_SHR, VECTOR_SHR_V128);
 // ============================================================================
 struct VECTOR_SHA_V128
     : Sequence<VECTOR_SHA_V128, I<OPCODE_VECTOR_SHA, V128Op, V128Op, V128Op>> {
-  static __m128i EmulateVectorShaI8(void*, __m128i src1, __m128i src2) {
-    alignas(16) int8_t value[16];
-    alignas(16) int8_t shamt[16];
-    _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
-    for (size_t i = 0; i < 16; ++i) {
-      value[i] = value[i] >> (shamt[i] & 0x7);
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
-  }
-  static __m128i EmulateVectorShaI16(void*, __m128i src1, __m128i src2) {
-    alignas(16) int16_t value[8];
-    alignas(16) int16_t shamt[8];
-    _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
-    for (size_t i = 0; i < 8; ++i) {
-      value[i] = value[i] >> (shamt[i] & 0xF);
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
-  }
-  static __m128i EmulateVectorShaI32(void*, __m128i src1, __m128i src2) {
-    alignas(16) int32_t value[4];
-    alignas(16) int32_t shamt[4];
-    _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
-    for (size_t i = 0; i < 4; ++i) {
-      value[i] = value[i] >> (shamt[i] & 0x1F);
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
-  }
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    switch (i.instr->flags) {
-      case INT8_TYPE:
-        // TODO(benvanik): native version (with shift magic).
-        if (i.src2.is_constant) {
-          e.LoadConstantXmm(e.xmm0, i.src2.constant());
-          e.lea(e.r9, e.StashXmm(1, e.xmm0));
-        } else {
-          e.lea(e.r9, e.StashXmm(1, i.src2));
-        }
-        e.lea(e.r8, e.StashXmm(0, i.src1));
-        e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShaI8));
-        e.vmovaps(i.dest, e.xmm0);
-        break;
-      case INT16_TYPE:
-        // TODO(benvanik): native version (with shift magic).
-        if (i.src2.is_constant) {
-          e.LoadConstantXmm(e.xmm0, i.src2.constant());
-          e.lea(e.r9, e.StashXmm(1, e.xmm0));
-        } else {
-          e.lea(e.r9, e.StashXmm(1, i.src2));
-        }
-        e.lea(e.r8, e.StashXmm(0, i.src1));
-        e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShaI16));
-        e.vmovaps(i.dest, e.xmm0);
-        break;
-      case INT32_TYPE:
-        if (e.IsFeatureEnabled(kX64EmitAVX2)) {
-          // src shift mask may have values >31, and x86 sets to zero when
-          // that happens so we mask.
-          if (i.src2.is_constant) {
-            e.LoadConstantXmm(e.xmm0, i.src2.constant());
-            e.vandps(e.xmm0, e.GetXmmConstPtr(XMMShiftMaskPS));
-          } else {
-            e.vandps(e.xmm0, i.src2, e.GetXmmConstPtr(XMMShiftMaskPS));
-          }
-          e.vpsravd(i.dest, i.src1, e.xmm0);
-        } else {
-          // Emulated for now...
-          // TODO: Native version
-          if (i.src2.is_constant) {
-            e.LoadConstantXmm(e.xmm0, i.src2.constant());
-            e.lea(e.r9, e.StashXmm(1, e.xmm0));
-          } else {
-            e.lea(e.r9, e.StashXmm(1, i.src2));
-          }
-          e.lea(e.r8, e.StashXmm(0, i.src1));
-          e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShaI32));
-          e.vmovaps(i.dest, e.xmm0);
-        }
-        break;
-      default:
-        assert_always();
-        break;
-    }
+    EmitVectorShift(e, i, kVectorSha);
   }
 };
 EMITTER_OPCODE_TABLE(OPCODE_VECTOR_SHA, VECTOR_SHA_V128);
@@ -5611,84 +5589,11 @@ EMITTER_OPCODE_TABLE(OPCODE_ROTATE_LEFT, ROTATE_LEFT_I8, ROTATE_LEFT_I16,
 // ============================================================================
 // OPCODE_VECTOR_ROTATE_LEFT
 // ============================================================================
-// TODO(benvanik): AVX512 has a native variable rotate (rolv).
 struct VECTOR_ROTATE_LEFT_V128
     : Sequence<VECTOR_ROTATE_LEFT_V128,
                I<OPCODE_VECTOR_ROTATE_LEFT, V128Op, V128Op, V128Op>> {
-  static __m128i EmulateVectorRotateLeftI8(void*, __m128i src1, __m128i src2) {
-    alignas(16) uint8_t value[16];
-    alignas(16) uint8_t shamt[16];
-    _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
-    for (size_t i = 0; i < 16; ++i) {
-      value[i] = xe::rotate_left<uint8_t>(value[i], shamt[i] & 0x7);
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
-  }
-  static __m128i EmulateVectorRotateLeftI16(void*, __m128i src1, __m128i src2) {
-    alignas(16) uint16_t value[8];
-    alignas(16) uint16_t shamt[8];
-    _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
-    for (size_t i = 0; i < 8; ++i) {
-      value[i] = xe::rotate_left<uint16_t>(value[i], shamt[i] & 0xF);
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
-  }
-  static __m128i EmulateVectorRotateLeftI32(void*, __m128i src1, __m128i src2) {
-    alignas(16) uint32_t value[4];
-    alignas(16) uint32_t shamt[4];
-    _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
-    for (size_t i = 0; i < 4; ++i) {
-      value[i] = xe::rotate_left<uint32_t>(value[i], shamt[i] & 0x1F);
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
-  }
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    switch (i.instr->flags) {
-      case INT8_TYPE:
-        // TODO(benvanik): native version (with shift magic).
-        e.lea(e.r8, e.StashXmm(0, i.src1));
-        e.lea(e.r9, e.StashXmm(1, i.src2));
-        e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorRotateLeftI8));
-        e.vmovaps(i.dest, e.xmm0);
-        break;
-      case INT16_TYPE:
-        // TODO(benvanik): native version (with shift magic).
-        e.lea(e.r8, e.StashXmm(0, i.src1));
-        e.lea(e.r9, e.StashXmm(1, i.src2));
-        e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorRotateLeftI16));
-        e.vmovaps(i.dest, e.xmm0);
-        break;
-      case INT32_TYPE: {
-        if (e.IsFeatureEnabled(kX64EmitAVX2)) {
-          Xmm temp = i.dest;
-          if (i.dest == i.src1 || i.dest == i.src2) {
-            temp = e.xmm2;
-          }
-          // Shift left (to get high bits):
-          e.vpand(e.xmm0, i.src2, e.GetXmmConstPtr(XMMShiftMaskPS));
-          e.vpsllvd(e.xmm1, i.src1, e.xmm0);
-          // Shift right (to get low bits):
-          e.vmovaps(temp, e.GetXmmConstPtr(XMMPI32));
-          e.vpsubd(temp, e.xmm0);
-          e.vpsrlvd(i.dest, i.src1, temp);
-          // Merge:
-          e.vpor(i.dest, e.xmm1);
-        } else {
-          // TODO: Non-AVX2 native version
-          e.lea(e.r8, e.StashXmm(0, i.src1));
-          e.lea(e.r9, e.StashXmm(1, i.src2));
-          e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorRotateLeftI32));
-          e.vmovaps(i.dest, e.xmm0);
-        }
-        break;
-      }
-      default:
-        assert_always();
-        break;
-    }
+    EmitVectorShift(e, i, kVectorRotateLeft);
   }
 };
 EMITTER_OPCODE_TABLE(OPCODE_VECTOR_ROTATE_LEFT, VECTOR_ROTATE_LEFT_V128);
@@ -6042,7 +5947,7 @@ struct EXTRACT_I32
       e.mov(e.al, i.src2);
       e.and_(e.al, 0x03);
       e.shl(e.al, 4);
-      e.mov(e.rdx, reinterpret_cast<uint64_t>(extract_table_32));
+      e.MovHostAddress(e.rdx, extract_table_32);
       e.vmovaps(e.xmm0, e.ptr[e.rdx + e.rax]);
       e.vpshufb(e.xmm0, i.src1, e.xmm0);
       e.vpextrd(i.dest, e.xmm0, 0);
@@ -6447,7 +6352,7 @@ struct PACK : Sequence<PACK, I<OPCODE_PACK, V128Op, V128Op, V128Op>> {
 
     if (e.IsFeatureEnabled(kX64EmitF16C)) {
       // 0|0|0|0|W|Z|Y|X
-      e.vcvtps2ph(i.dest, i.dest, B00000011);
+      e.vcvtps2ph(i.dest, i.src1, B00000011);
       // Shuffle to X|Y|0|0|0|0|0|0
       e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMPackFLOAT16_2));
     } else {
@@ -6491,59 +6396,27 @@ struct PACK : Sequence<PACK, I<OPCODE_PACK, V128Op, V128Op, V128Op>> {
     // Pack.
     e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMPackSHORT_2));
   }
-  static __m128i EmulatePackUINT_2101010(void*, __m128i src1) {
-    // https://www.opengl.org/registry/specs/ARB/vertex_type_2_10_10_10_rev.txt
-    union {
-      alignas(16) int32_t a_i[4];
-      alignas(16) uint32_t a_u[4];
-      alignas(16) float a_f[4];
-    };
-    alignas(16) uint32_t b[4];
-    alignas(16) uint32_t c[4];
-    _mm_store_si128(reinterpret_cast<__m128i*>(a_u), src1);
-    // XYZ are 10 bits, signed and saturated.
-    for (int i = 0; i < 3; ++i) {
-      static const int32_t kMinValueXYZ = 0x403FFE01;  // 3 - 1FF / (1 << 22)
-      static const int32_t kMaxValueXYZ = 0x404001FF;  // 3 + 1FF / (1 << 22)
-      uint32_t exponent = (a_u[i] >> 23) & 0xFF;
-      uint32_t fractional = a_u[i] & 0x007FFFFF;
-      if ((exponent == 0xFF) && fractional) {
-        b[i] = 0x200;
-      } else if (a_i[i] > kMaxValueXYZ) {
-        b[i] = 0x1FF;  // INT_MAX
-      } else if (a_i[i] < kMinValueXYZ) {
-        b[i] = 0x201;  // -INT_MAX
-      } else {
-        b[i] = a_u[i] & 0x3FF;
-      }
-    }
-    // W is 2 bits, unsigned and saturated.
-    static const int32_t kMinValueW = 0x40400000;  // 3
-    static const int32_t kMaxValueW = 0x40400003;  // 3 + 3 / (1 << 22)
-    uint32_t w_exponent = (a_u[3] >> 23) & 0xFF;
-    uint32_t w_fractional = a_u[3] & 0x007FFFFF;
-    if ((w_exponent == 0xFF) && w_fractional) {
-      b[3] = 0x0;
-    } else if (a_i[3] > kMaxValueW) {
-      b[3] = 0x3;
-    } else if (a_i[3] < kMinValueW) {
-      b[3] = 0x0;
-    } else {
-      b[3] = a_u[3] & 0x3;
-    }
-    // Combine in 2101010 WZYX.
-    c[0] = c[1] = c[2] = 0;
-    c[3] = ((b[3] & 0x3) << 30) | ((b[2] & 0x3FF) << 20) |
-           ((b[1] & 0x3FF) << 10) | ((b[0] & 0x3FF));
-    return _mm_load_si128(reinterpret_cast<__m128i*>(c));
-  }
   static void EmitUINT_2101010(X64Emitter& e, const EmitArgType& i) {
     assert_true(i.src2.value->IsConstantZero());
     // dest = [(b2(src1.w), b10(src1.z), b10(src1.y), b10(src1.x)), 0, 0, 0]
-    // TODO(benvanik): optimized version.
-    e.lea(e.r8, e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulatePackUINT_2101010));
-    e.vmovaps(i.dest, e.xmm0);
+    // https://www.opengl.org/registry/specs/ARB/vertex_type_2_10_10_10_rev.txt
+    Xmm src = LoadVectorOperand(e, i.src1, e.xmm0);
+    // The inputs are 3.0 + n / (1 << 22), so saturating is a clamp of their
+    // bits. XYZ are 10 bits, signed, and W 2 bits, unsigned. NaNs give 0x200
+    // and 0.
+    e.vpmaxsd(e.xmm1, src, e.GetXmmConstPtr(XMMPackUINT_2101010Min));
+    e.vpminsd(e.xmm1, e.xmm1, e.GetXmmConstPtr(XMMPackUINT_2101010Max));
+    e.vcmpunordps(e.xmm2, src, src);
+    e.vblendvps(e.xmm1, e.xmm1, e.GetXmmConstPtr(XMMPackUINT_2101010NaN),
+                e.xmm2);
+    e.vpand(e.xmm1, e.xmm1, e.GetXmmConstPtr(XMMPackUINT_2101010Mask));
+    // Shift each into place and combine them in w.
+    e.vpmulld(e.xmm1, e.xmm1, e.GetXmmConstPtr(XMMPackUINT_2101010Shift));
+    e.vpshufd(e.xmm2, e.xmm1, B00001110);
+    e.vpor(e.xmm1, e.xmm1, e.xmm2);
+    e.vpshufd(e.xmm2, e.xmm1, B00000001);
+    e.vpor(e.xmm1, e.xmm1, e.xmm2);
+    e.vpslldq(i.dest, e.xmm1, 12);
   }
   static __m128i EmulatePack8_IN_16_UN_UN_SAT(void*, __m128i src1,
                                               __m128i src2) {
@@ -7003,126 +6876,39 @@ EMITTER_OPCODE_TABLE(OPCODE_ATOMIC_EXCHANGE, ATOMIC_EXCHANGE_I8,
                      ATOMIC_EXCHANGE_I16, ATOMIC_EXCHANGE_I32,
                      ATOMIC_EXCHANGE_I64);
 
-void RegisterSequences() {
-  Register_OPCODE_COMMENT();
-  Register_OPCODE_NOP();
-  Register_OPCODE_SOURCE_OFFSET();
-  Register_OPCODE_DEBUG_BREAK();
-  Register_OPCODE_DEBUG_BREAK_TRUE();
-  Register_OPCODE_TRAP();
-  Register_OPCODE_TRAP_TRUE();
-  Register_OPCODE_CALL();
-  Register_OPCODE_CALL_TRUE();
-  Register_OPCODE_CALL_INDIRECT();
-  Register_OPCODE_CALL_INDIRECT_TRUE();
-  Register_OPCODE_CALL_EXTERN();
-  Register_OPCODE_RETURN();
-  Register_OPCODE_RETURN_TRUE();
-  Register_OPCODE_SET_RETURN_ADDRESS();
-  Register_OPCODE_BRANCH();
-  Register_OPCODE_BRANCH_TRUE();
-  Register_OPCODE_BRANCH_FALSE();
-  Register_OPCODE_ASSIGN();
-  Register_OPCODE_CAST();
-  Register_OPCODE_ZERO_EXTEND();
-  Register_OPCODE_SIGN_EXTEND();
-  Register_OPCODE_TRUNCATE();
-  Register_OPCODE_CONVERT();
-  Register_OPCODE_ROUND();
-  Register_OPCODE_VECTOR_CONVERT_I2F();
-  Register_OPCODE_VECTOR_CONVERT_F2I();
-  Register_OPCODE_LOAD_VECTOR_SHL();
-  Register_OPCODE_LOAD_VECTOR_SHR();
-  Register_OPCODE_LOAD_CLOCK();
-  Register_OPCODE_LOAD_LOCAL();
-  Register_OPCODE_STORE_LOCAL();
-  Register_OPCODE_LOAD_CONTEXT();
-  Register_OPCODE_STORE_CONTEXT();
-  Register_OPCODE_LOAD_MMIO();
-  Register_OPCODE_STORE_MMIO();
-  Register_OPCODE_LOAD();
-  Register_OPCODE_STORE();
-  Register_OPCODE_MEMSET();
-  Register_OPCODE_PREFETCH();
-  Register_OPCODE_MAX();
-  Register_OPCODE_VECTOR_MAX();
-  Register_OPCODE_MIN();
-  Register_OPCODE_VECTOR_MIN();
-  Register_OPCODE_SELECT();
-  Register_OPCODE_IS_TRUE();
-  Register_OPCODE_IS_FALSE();
-  Register_OPCODE_COMPARE_EQ();
-  Register_OPCODE_COMPARE_NE();
-  Register_OPCODE_COMPARE_SLT();
-  Register_OPCODE_COMPARE_SLE();
-  Register_OPCODE_COMPARE_SGT();
-  Register_OPCODE_COMPARE_SGE();
-  Register_OPCODE_COMPARE_ULT();
-  Register_OPCODE_COMPARE_ULE();
-  Register_OPCODE_COMPARE_UGT();
-  Register_OPCODE_COMPARE_UGE();
-  Register_OPCODE_COMPARE_SLT_FLT();
-  Register_OPCODE_COMPARE_SLE_FLT();
-  Register_OPCODE_COMPARE_SGT_FLT();
-  Register_OPCODE_COMPARE_SGE_FLT();
-  Register_OPCODE_COMPARE_ULT_FLT();
-  Register_OPCODE_COMPARE_ULE_FLT();
-  Register_OPCODE_COMPARE_UGT_FLT();
-  Register_OPCODE_COMPARE_UGE_FLT();
-  Register_OPCODE_DID_SATURATE();
-  Register_OPCODE_VECTOR_COMPARE_EQ();
-  Register_OPCODE_VECTOR_COMPARE_SGT();
-  Register_OPCODE_VECTOR_COMPARE_SGE();
-  Register_OPCODE_VECTOR_COMPARE_UGT();
-  Register_OPCODE_VECTOR_COMPARE_UGE();
-  Register_OPCODE_ADD();
-  Register_OPCODE_ADD_CARRY();
-  Register_OPCODE_VECTOR_ADD();
-  Register_OPCODE_SUB();
-  Register_OPCODE_VECTOR_SUB();
-  Register_OPCODE_MUL();
-  Register_OPCODE_MUL_HI();
-  Register_OPCODE_DIV();
-  Register_OPCODE_MUL_ADD();
-  Register_OPCODE_MUL_SUB();
-  Register_OPCODE_NEG();
-  Register_OPCODE_ABS();
-  Register_OPCODE_SQRT();
-  Register_OPCODE_RSQRT();
-  Register_OPCODE_POW2();
-  Register_OPCODE_LOG2();
-  Register_OPCODE_DOT_PRODUCT_3();
-  Register_OPCODE_DOT_PRODUCT_4();
-  Register_OPCODE_AND();
-  Register_OPCODE_OR();
-  Register_OPCODE_XOR();
-  Register_OPCODE_NOT();
-  Register_OPCODE_SHL();
-  Register_OPCODE_SHR();
-  Register_OPCODE_SHA();
-  Register_OPCODE_VECTOR_SHL();
-  Register_OPCODE_VECTOR_SHR();
-  Register_OPCODE_VECTOR_SHA();
-  Register_OPCODE_ROTATE_LEFT();
-  Register_OPCODE_VECTOR_ROTATE_LEFT();
-  Register_OPCODE_VECTOR_AVERAGE();
-  Register_OPCODE_BYTE_SWAP();
-  Register_OPCODE_CNTLZ();
-  Register_OPCODE_INSERT();
-  Register_OPCODE_EXTRACT();
-  Register_OPCODE_SPLAT();
-  Register_OPCODE_PERMUTE();
-  Register_OPCODE_SWIZZLE();
-  Register_OPCODE_PACK();
-  Register_OPCODE_UNPACK();
-  Register_OPCODE_ATOMIC_EXCHANGE();
+struct OpcodeSequenceTable {
+  const SequenceEntry* entries;
+  uint32_t source_shift;
+  uint8_t slots[kSequenceSlotCount];
+};
+template <typename LIST, uint32_t SOURCE_SHIFT, size_t... SLOTS>
+constexpr OpcodeSequenceTable MakeOpcodeSequenceTable(
+    std::index_sequence<SLOTS...>) {
+  return {LIST::entries, SOURCE_SHIFT,
+          {LIST::FindSlot(SLOTS, SOURCE_SHIFT)...}};
 }
+template <typename OPCODES>
+struct SequenceTable;
+template <size_t... OPCODES>
+struct SequenceTable<std::index_sequence<OPCODES...>> {
+  static constexpr OpcodeSequenceTable opcodes[] = {
+      MakeOpcodeSequenceTable<OpcodeSequences<Opcode(OPCODES)>,
+                              OpcodeSequences<Opcode(OPCODES)>::SourceShift()>(
+          std::make_index_sequence<kSequenceSlotCount>())...};
+};
+template <size_t... OPCODES>
+constexpr OpcodeSequenceTable
+    SequenceTable<std::index_sequence<OPCODES...>>::opcodes[];
+typedef SequenceTable<std::make_index_sequence<__OPCODE_MAX_VALUE>>
+    OpcodeSequenceTables;
 
 bool SelectSequence(X64Emitter& e, const Instr* i, const Instr** new_tail) {
   const InstrKey key(i);
-  auto it = sequence_table.find(key);
-  if (it != sequence_table.end()) {
-    if (it->second(e, i)) {
+  const OpcodeSequenceTable& table = OpcodeSequenceTables::opcodes[key.opcode];
+  uint8_t slot = table.slots[GetSequenceSlot(key, table.source_shift)];
+  if (slot) {
+    const SequenceEntry& entry = table.entries[slot - 1];
+    if (entry.key == key && entry.select(e, i)) {
       *new_tail = i->next;
       return true;
     }
@@ -0,0 +1,49 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/x64/x64_stack_layout.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "xenia/base/math.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Value;
+
+size_t StackLayout::LayoutLocals(HIRBuilder* builder) {
+  // Locals are aligned to their natural sizes. Placing the largest ones first
+  // leaves padding only in front of the first one, no matter how the spill
+  // slots of the register allocator were mixed in with the other locals.
+  std::vector<Value*> locals = builder->locals();
+  std::stable_sort(locals.begin(), locals.end(),
+                   [](const Value* a, const Value* b) {
+                     return hir::GetTypeSize(a->type) >
+                            hir::GetTypeSize(b->type);
+                   });
+  size_t stack_offset = GUEST_STACK_SIZE;
+  for (auto slot : locals) {
+    size_t type_size = hir::GetTypeSize(slot->type);
+    stack_offset = xe::align(stack_offset, type_size);
+    slot->set_constant(static_cast<uint32_t>(stack_offset));
+    stack_offset += type_size;
+  }
+  // GUEST_STACK_SIZE plus the return address is already 16b aligned.
+  return xe::align(stack_offset - GUEST_STACK_SIZE, static_cast<size_t>(16));
+}
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
@@ -106,7 +106,10 @@ namespace x64 {
  *  +------------------+
  *  | call ret addr    | rsp + 96
  *  +------------------+
- *    ... locals ...
+ *  | locals           | rsp + 104
+ *  |  (HIR locals and |
+ *  |   spill slots,   |
+ *  |   LayoutLocals)  |
  *  +------------------+
  *  | (return address) |
  *  +------------------+
@@ -121,6 +124,11 @@ class StackLayout {
   const static size_t GUEST_RCX_HOME = 80;
   const static size_t GUEST_RET_ADDR = 88;
   const static size_t GUEST_CALL_RET_ADDR = 96;
+
+  // Assigns each HIR local (including the spill slots of the register
+  // allocator) its offset from rsp, past GUEST_STACK_SIZE. Returns the size
+  // of the locals area, a multiple of 16 to keep the stack aligned.
+  static size_t LayoutLocals(hir::HIRBuilder* builder);
 };
 
 }  // namespace x64
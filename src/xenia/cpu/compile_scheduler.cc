@@ -0,0 +1,195 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compile_scheduler.h"
+
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+#include "xenia/cpu/module.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/profiling.h"
+
+namespace xe {
+namespace cpu {
+
+CompileScheduler::CompileScheduler(Processor* processor)
+    : processor_(processor),
+      worker_running_(false),
+      sync_compile_count_(0),
+      sync_compile_ticks_(0),
+      background_compile_count_(0),
+      background_compile_ticks_(0),
+      baseline_compile_count_(0),
+      baseline_compile_ticks_(0),
+      recompile_count_(0),
+      recompile_ticks_(0) {}
+
+CompileScheduler::~CompileScheduler() { Shutdown(); }
+
+bool CompileScheduler::Setup(size_t worker_count) {
+  worker_running_ = true;
+  for (size_t i = 0; i < worker_count; ++i) {
+    xe::threading::Thread::CreationParameters params;
+    params.initial_priority = xe::threading::ThreadPriority::kBelowNormal;
+    auto thread = xe::threading::Thread::Create(
+        params, [this]() { WorkerThreadMain(); });
+    if (!thread) {
+      XELOGE("Unable to create JIT worker thread");
+      Shutdown();
+      return false;
+    }
+    thread->set_name("JIT Worker");
+    worker_threads_.push_back(std::move(thread));
+  }
+  return true;
+}
+
+void CompileScheduler::Shutdown() {
+  if (!worker_running_) {
+    return;
+  }
+  {
+    std::lock_guard<xe::mutex> guard(queue_lock_);
+    worker_running_ = false;
+    high_queue_.clear();
+    low_queue_.clear();
+    recompile_queue_.clear();
+  }
+  queue_cond_.notify_all();
+  for (auto& thread : worker_threads_) {
+    xe::threading::Wait(thread.get(), false);
+  }
+  worker_threads_.clear();
+}
+
+void CompileScheduler::Enqueue(uint32_t address, CompilePriority priority) {
+  if (worker_threads_.empty()) {
+    return;
+  }
+  {
+    std::lock_guard<xe::mutex> guard(queue_lock_);
+    if (!worker_running_ || !queued_addresses_.insert(address).second) {
+      return;
+    }
+    if (priority == CompilePriority::kHigh) {
+      high_queue_.push_back(address);
+    } else {
+      low_queue_.push_back(address);
+    }
+  }
+  queue_cond_.notify_one();
+}
+
+void CompileScheduler::EnqueueModule(Module* module) {
+  if (worker_threads_.empty()) {
+    return;
+  }
+  module->ForEachFunction([this](FunctionInfo* symbol_info) {
+    if (symbol_info->behavior() == FunctionBehavior::kBuiltin) {
+      return;
+    }
+    Enqueue(symbol_info->address(), CompilePriority::kLow);
+  });
+}
+
+void CompileScheduler::EnqueueRecompile(uint32_t address) {
+  if (worker_threads_.empty()) {
+    return;
+  }
+  {
+    std::lock_guard<xe::mutex> guard(queue_lock_);
+    if (!worker_running_ || !recompile_addresses_.insert(address).second) {
+      return;
+    }
+    recompile_queue_.push_back(address);
+  }
+  queue_cond_.notify_one();
+}
+
+void CompileScheduler::RecordCompile(bool background, CompileTier tier,
+                                     uint64_t host_ticks) {
+  if (tier == CompileTier::kBaseline) {
+    ++baseline_compile_count_;
+    baseline_compile_ticks_ += host_ticks;
+  }
+  if (background) {
+    ++background_compile_count_;
+    background_compile_ticks_ += host_ticks;
+  } else {
+    ++sync_compile_count_;
+    sync_compile_ticks_ += host_ticks;
+  }
+}
+
+void CompileScheduler::DumpStats() {
+  double frequency = static_cast<double>(Clock::host_tick_frequency());
+  XELOGI("JIT: %llu functions compiled on guest threads in %.3fms",
+         uint64_t(sync_compile_count_), sync_compile_ticks_ / frequency * 1000);
+  XELOGI("JIT: %llu functions compiled on %d workers in %.3fms",
+         uint64_t(background_compile_count_), int(worker_threads_.size()),
+         background_compile_ticks_ / frequency * 1000);
+  if (baseline_compile_count_) {
+    XELOGI("JIT: %llu functions compiled at the baseline tier in %.3fms",
+           uint64_t(baseline_compile_count_),
+           baseline_compile_ticks_ / frequency * 1000);
+    XELOGI("JIT: %llu functions recompiled at the optimized tier in %.3fms",
+           uint64_t(recompile_count_), recompile_ticks_ / frequency * 1000);
+  }
+}
+
+void CompileScheduler::WorkerThreadMain() {
+  while (true) {
+    uint32_t address;
+    bool recompile = false;
+    {
+      std::unique_lock<xe::mutex> lock(queue_lock_);
+      queue_cond_.wait(lock, [this]() {
+        return !worker_running_ || !high_queue_.empty() ||
+               !recompile_queue_.empty() || !low_queue_.empty();
+      });
+      if (!worker_running_) {
+        break;
+      }
+      std::deque<uint32_t>* queue;
+      if (!high_queue_.empty()) {
+        queue = &high_queue_;
+      } else if (!recompile_queue_.empty()) {
+        queue = &recompile_queue_;
+        recompile = true;
+      } else {
+        queue = &low_queue_;
+      }
+      address = queue->front();
+      queue->pop_front();
+    }
+
+    if (recompile) {
+      Recompile(address);
+      continue;
+    }
+
+    // If a guest thread (or another worker) already got to it this is just a
+    // lookup, otherwise we own the entry and compile it here.
+    SCOPE_profile_cpu_f("cpu");
+    Function* function = nullptr;
+    processor_->ResolveEntry(address, true, &function);
+  }
+}
+
+void CompileScheduler::Recompile(uint32_t address) {
+  SCOPE_profile_cpu_f("cpu");
+  uint64_t start_ticks = Clock::QueryHostTickCount();
+  if (processor_->RecompileFunction(address)) {
+    ++recompile_count_;
+    recompile_ticks_ += Clock::QueryHostTickCount() - start_ticks;
+  }
+}
+
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,99 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILE_SCHEDULER_H_
+#define XENIA_CPU_COMPILE_SCHEDULER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "xenia/base/mutex.h"
+#include "xenia/base/threading.h"
+#include "xenia/cpu/function.h"
+
+namespace xe {
+namespace cpu {
+
+class Module;
+class Processor;
+
+enum class CompilePriority {
+  // Likely to be demanded soon, such as the call targets of a function that
+  // a guest thread just had to wait on.
+  kHigh,
+  // Speculative, such as everything a module declared when it was loaded.
+  kLow,
+};
+
+// Translates guest functions ahead of demand on a set of worker threads.
+// Workers resolve functions through the processor just like guest threads
+// do, so the entry table decides who gets to compile each function: if a guest
+// thread gets to an address first it compiles synchronously as before, and if
+// a worker is already compiling it the guest thread waits for it to finish.
+class CompileScheduler {
+ public:
+  explicit CompileScheduler(Processor* processor);
+  ~CompileScheduler();
+
+  bool Setup(size_t worker_count);
+  void Shutdown();
+
+  size_t worker_count() const { return worker_threads_.size(); }
+
+  // Queues a function for background compilation. Ignored if the pool is
+  // disabled or the address has already been queued.
+  void Enqueue(uint32_t address, CompilePriority priority);
+  // Queues all functions currently declared in the module.
+  void EnqueueModule(Module* module);
+  // Queues a baseline function for recompilation at the optimized tier.
+  // Scheduled after high priority compiles but ahead of speculative ones.
+  // Each address is only ever recompiled once.
+  void EnqueueRecompile(uint32_t address);
+
+  // Records time spent compiling a function, either on a guest thread
+  // (synchronously) or on a worker.
+  void RecordCompile(bool background, CompileTier tier, uint64_t host_ticks);
+
+  void DumpStats();
+
+ private:
+  void WorkerThreadMain();
+  void Recompile(uint32_t address);
+
+  Processor* processor_ = nullptr;
+
+  std::vector<std::unique_ptr<xe::threading::Thread>> worker_threads_;
+  std::atomic<bool> worker_running_;
+
+  xe::mutex queue_lock_;
+  std::condition_variable_any queue_cond_;
+  std::deque<uint32_t> high_queue_;
+  std::deque<uint32_t> low_queue_;
+  std::deque<uint32_t> recompile_queue_;
+  std::unordered_set<uint32_t> queued_addresses_;
+  std::unordered_set<uint32_t> recompile_addresses_;
+
+  std::atomic<uint64_t> sync_compile_count_;
+  std::atomic<uint64_t> sync_compile_ticks_;
+  std::atomic<uint64_t> background_compile_count_;
+  std::atomic<uint64_t> background_compile_ticks_;
+  std::atomic<uint64_t> baseline_compile_count_;
+  std::atomic<uint64_t> baseline_compile_ticks_;
+  std::atomic<uint64_t> recompile_count_;
+  std::atomic<uint64_t> recompile_ticks_;
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILE_SCHEDULER_H_
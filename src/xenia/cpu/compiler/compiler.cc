@@ -9,7 +9,12 @@
 
 #include "xenia/cpu/compiler/compiler.h"
 
+#include <algorithm>
+
+#include "xenia/base/clock.h"
 #include "xenia/cpu/compiler/compiler_pass.h"
+#include "xenia/cpu/compiler/compiler_stats.h"
+#include "xenia/cpu/processor.h"
 #include "xenia/profiling.h"
 
 namespace xe {
@@ -22,6 +27,10 @@ Compiler::~Compiler() { Reset(); }
 
 void Compiler::AddPass(std::unique_ptr<CompilerPass> pass) {
   pass->Initialize(this);
+  auto stats = processor_ ? processor_->compiler_stats() : nullptr;
+  if (stats) {
+    pass_stats_.push_back(stats->LookupPass(pass->name()));
+  }
   passes_.push_back(std::move(pass));
 }
 
@@ -30,13 +39,45 @@ void Compiler::Reset() {}
 bool Compiler::Compile(xe::cpu::hir::HIRBuilder* builder) {
   // TODO(benvanik): sophisticated stuff. Run passes in parallel, run until they
   //                 stop changing things, etc.
+  SCOPE_profile_cpu_f("cpu");
+
+  if (!pass_stats_.empty()) {
+    return CompileWithStats(builder);
+  }
+
+  for (size_t i = 0; i < passes_.size(); ++i) {
+    auto& pass = passes_[i];
+    scratch_arena_.Reset();
+    if (!pass->Run(builder)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool Compiler::CompileWithStats(xe::cpu::hir::HIRBuilder* builder) {
+  HIRSize size = HIRSize::Measure(builder);
+  COUNT_profile_cpu("hir_instrs_in", size.instr_count);
+  size_t scratch_high_water = 0;
   for (size_t i = 0; i < passes_.size(); ++i) {
     auto& pass = passes_[i];
     scratch_arena_.Reset();
+    uint64_t start_ticks = Clock::QueryHostTickCount();
     if (!pass->Run(builder)) {
       return false;
     }
+    uint64_t ticks = Clock::QueryHostTickCount() - start_ticks;
+    HIRSize new_size = HIRSize::Measure(builder);
+    size_t scratch_size = scratch_arena_.CalculateSize();
+    scratch_high_water = std::max(scratch_high_water, scratch_size);
+    pass_stats_[i]->Record(ticks, size, new_size, scratch_size,
+                           builder->arena()->CalculateSize());
+    size = new_size;
   }
+  COUNT_profile_cpu("hir_instrs_out", size.instr_count);
+  COUNT_profile_cpu("hir_arena_bytes", int(builder->arena()->CalculateSize()));
+  COUNT_profile_cpu("compiler_scratch_bytes", int(scratch_high_water));
 
   return true;
 }
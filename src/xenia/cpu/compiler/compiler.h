@@ -27,6 +27,7 @@ namespace cpu {
 namespace compiler {
 
 class CompilerPass;
+struct CompilerPassStats;
 
 class Compiler {
  public:
@@ -43,10 +44,15 @@ class Compiler {
   bool Compile(hir::HIRBuilder* builder);
 
  private:
+  // Compile, recording per-pass timings and IR sizes.
+  bool CompileWithStats(hir::HIRBuilder* builder);
+
   Processor* processor_;
   Arena scratch_arena_;
 
   std::vector<std::unique_ptr<CompilerPass>> passes_;
+  // Parallel to passes_ when --jit_pass_stats is set, otherwise empty.
+  std::vector<CompilerPassStats*> pass_stats_;
 };
 
 }  // namespace compiler
@@ -15,7 +15,8 @@ namespace xe {
 namespace cpu {
 namespace compiler {
 
-CompilerPass::CompilerPass() : processor_(nullptr), compiler_(nullptr) {}
+CompilerPass::CompilerPass(const char* name)
+    : name_(name), processor_(nullptr), compiler_(nullptr) {}
 
 CompilerPass::~CompilerPass() = default;
 
@@ -27,9 +27,12 @@ class Compiler;
 
 class CompilerPass {
  public:
-  CompilerPass();
+  explicit CompilerPass(const char* name);
   virtual ~CompilerPass();
 
+  // Used to identify the pass in stats.
+  const char* name() const { return name_; }
+
   virtual bool Initialize(Compiler* compiler);
 
   virtual bool Run(hir::HIRBuilder* builder) = 0;
@@ -38,6 +41,7 @@ class CompilerPass {
   Arena* scratch_arena() const;
 
  protected:
+  const char* name_;
   Processor* processor_;
   Compiler* compiler_;
 };
@@ -0,0 +1,141 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/compiler_stats.h"
+
+#include <cstdio>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/string.h"
+#include "xenia/cpu/cpu_flags.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::Instr;
+
+HIRSize HIRSize::Measure(hir::HIRBuilder* builder) {
+  HIRSize size;
+  for (Block* block = builder->first_block(); block; block = block->next) {
+    ++size.block_count;
+    for (Instr* instr = block->instr_head; instr; instr = instr->next) {
+      ++size.instr_count;
+      if (instr->dest) {
+        ++size.value_count;
+      }
+    }
+  }
+  return size;
+}
+
+namespace {
+void AtomicMax(std::atomic<uint64_t>* target, uint64_t value) {
+  uint64_t current = *target;
+  while (current < value && !target->compare_exchange_weak(current, value)) {
+  }
+}
+}  // namespace
+
+void CompilerPassStats::Record(uint64_t ticks, const HIRSize& before,
+                               const HIRSize& after, size_t scratch_size,
+                               size_t hir_arena_size) {
+  ++invocation_count;
+  host_ticks += ticks;
+  blocks_before += before.block_count;
+  blocks_after += after.block_count;
+  instrs_before += before.instr_count;
+  instrs_after += after.instr_count;
+  values_before += before.value_count;
+  values_after += after.value_count;
+  AtomicMax(&scratch_high_water, scratch_size);
+  AtomicMax(&hir_arena_high_water, hir_arena_size);
+}
+
+CompilerStats::CompilerStats() = default;
+
+CompilerStats::~CompilerStats() = default;
+
+CompilerPassStats* CompilerStats::LookupPass(const char* name) {
+  std::lock_guard<xe::mutex> guard(lock_);
+  for (auto& pass : passes_) {
+    if (pass.name == name) {
+      return &pass;
+    }
+  }
+  passes_.emplace_back();
+  passes_.back().name = name;
+  return &passes_.back();
+}
+
+void CompilerStats::Dump() {
+  std::lock_guard<xe::mutex> guard(lock_);
+  double frequency = static_cast<double>(Clock::host_tick_frequency());
+  for (auto& pass : passes_) {
+    uint64_t count = pass.invocation_count;
+    if (!count) {
+      continue;
+    }
+    XELOGI(
+        "JIT pass %-28s %8llu runs %10.3fms, instrs %llu -> %llu, values "
+        "%llu -> %llu, blocks %llu -> %llu",
+        pass.name.c_str(), count, pass.host_ticks / frequency * 1000,
+        uint64_t(pass.instrs_before), uint64_t(pass.instrs_after),
+        uint64_t(pass.values_before), uint64_t(pass.values_after),
+        uint64_t(pass.blocks_before), uint64_t(pass.blocks_after));
+  }
+  if (!FLAGS_jit_pass_stats_path.empty()) {
+    auto path = xe::to_wstring(FLAGS_jit_pass_stats_path);
+    if (!WriteJson(path)) {
+      XELOGE("Unable to write JIT pass stats to %s",
+             FLAGS_jit_pass_stats_path.c_str());
+    }
+  }
+}
+
+bool CompilerStats::WriteJson(const std::wstring& path) {
+  // lock_ must be held.
+  auto file = xe::filesystem::OpenFile(path, "wb");
+  if (!file) {
+    return false;
+  }
+  double frequency = static_cast<double>(Clock::host_tick_frequency());
+  std::fprintf(file, "{\n  \"passes\": [");
+  bool first = true;
+  for (auto& pass : passes_) {
+    std::fprintf(file, "%s\n    {", first ? "" : ",");
+    first = false;
+    // Pass names are C++ identifiers, so no escaping is needed.
+    std::fprintf(file, "\"name\": \"%s\", ", pass.name.c_str());
+    std::fprintf(file, "\"invocations\": %llu, ",
+                 uint64_t(pass.invocation_count));
+    std::fprintf(file, "\"micros\": %.0f, ",
+                 pass.host_ticks / frequency * 1000000);
+    std::fprintf(file, "\"blocks_before\": %llu, \"blocks_after\": %llu, ",
+                 uint64_t(pass.blocks_before), uint64_t(pass.blocks_after));
+    std::fprintf(file, "\"instrs_before\": %llu, \"instrs_after\": %llu, ",
+                 uint64_t(pass.instrs_before), uint64_t(pass.instrs_after));
+    std::fprintf(file, "\"values_before\": %llu, \"values_after\": %llu, ",
+                 uint64_t(pass.values_before), uint64_t(pass.values_after));
+    std::fprintf(file, "\"scratch_high_water\": %llu, ",
+                 uint64_t(pass.scratch_high_water));
+    std::fprintf(file, "\"hir_arena_high_water\": %llu}",
+                 uint64_t(pass.hir_arena_high_water));
+  }
+  std::fprintf(file, "\n  ]\n}\n");
+  fclose(file);
+  return true;
+}
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
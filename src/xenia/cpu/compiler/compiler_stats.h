@@ -0,0 +1,81 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_COMPILER_COMPILER_STATS_H_
+#define XENIA_COMPILER_COMPILER_STATS_H_
+
+#include <atomic>
+#include <list>
+#include <string>
+
+#include "xenia/base/mutex.h"
+#include "xenia/cpu/hir/hir_builder.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+// Size of the HIR at some point during compilation.
+struct HIRSize {
+  uint32_t block_count = 0;
+  uint32_t instr_count = 0;
+  // Values defined by live instructions.
+  uint32_t value_count = 0;
+
+  static HIRSize Measure(hir::HIRBuilder* builder);
+};
+
+// Cumulative cost of one compiler pass across every function and every
+// Compiler instance of a processor. Passes that appear more than once in a
+// pipeline (Simplification, etc) share a record.
+struct CompilerPassStats {
+  std::string name;
+  std::atomic<uint64_t> invocation_count = {0};
+  std::atomic<uint64_t> host_ticks = {0};
+  std::atomic<uint64_t> blocks_before = {0};
+  std::atomic<uint64_t> blocks_after = {0};
+  std::atomic<uint64_t> instrs_before = {0};
+  std::atomic<uint64_t> instrs_after = {0};
+  std::atomic<uint64_t> values_before = {0};
+  std::atomic<uint64_t> values_after = {0};
+  // Largest amount of the compiler scratch arena used by one invocation.
+  std::atomic<uint64_t> scratch_high_water = {0};
+  // Largest HIR builder arena seen after the pass ran.
+  std::atomic<uint64_t> hir_arena_high_water = {0};
+
+  void Record(uint64_t ticks, const HIRSize& before, const HIRSize& after,
+              size_t scratch_size, size_t hir_arena_size);
+};
+
+// Per-pass timing and IR size instrumentation, enabled with --jit_pass_stats.
+class CompilerStats {
+ public:
+  CompilerStats();
+  ~CompilerStats();
+
+  // Returns the record for the named pass, creating it on first use. The
+  // pointer stays valid for the lifetime of this object.
+  CompilerPassStats* LookupPass(const char* name);
+
+  // Logs a summary and, if --jit_pass_stats_path is set, writes the records
+  // out as JSON.
+  void Dump();
+
+ private:
+  bool WriteJson(const std::wstring& path);
+
+  xe::mutex lock_;
+  std::list<CompilerPassStats> passes_;
+};
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_COMPILER_COMPILER_STATS_H_
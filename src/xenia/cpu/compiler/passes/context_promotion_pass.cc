@@ -32,7 +32,8 @@ using xe::cpu::hir::HIRBuilder;
 using xe::cpu::hir::Instr;
 using xe::cpu::hir::Value;
 
-ContextPromotionPass::ContextPromotionPass() : CompilerPass() {}
+ContextPromotionPass::ContextPromotionPass()
+    : CompilerPass("ContextPromotion") {}
 
 ContextPromotionPass::~ContextPromotionPass() {}
 
@@ -50,6 +51,8 @@ bool ContextPromotionPass::Initialize(Compiler* compiler) {
 }
 
 bool ContextPromotionPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
   // Like mem2reg, but because context memory is unaliasable it's easier to
   // check and convert LoadContext/StoreContext into value operations.
   // Example of load->value promotion:
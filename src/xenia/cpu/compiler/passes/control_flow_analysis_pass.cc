@@ -25,11 +25,14 @@ using namespace xe::cpu::hir;
 using xe::cpu::hir::Edge;
 using xe::cpu::hir::HIRBuilder;
 
-ControlFlowAnalysisPass::ControlFlowAnalysisPass() : CompilerPass() {}
+ControlFlowAnalysisPass::ControlFlowAnalysisPass()
+    : CompilerPass("ControlFlowAnalysis") {}
 
 ControlFlowAnalysisPass::~ControlFlowAnalysisPass() {}
 
 bool ControlFlowAnalysisPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
   // Reset edges for all blocks. Needed to be re-runnable.
   // Note that this wastes a bunch of arena memory, so we shouldn't
   // re-run too often.
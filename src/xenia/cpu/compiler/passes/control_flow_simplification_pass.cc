@@ -26,11 +26,13 @@ using xe::cpu::hir::Edge;
 using xe::cpu::hir::HIRBuilder;
 
 ControlFlowSimplificationPass::ControlFlowSimplificationPass()
-    : CompilerPass() {}
+    : CompilerPass("ControlFlowSimplification") {}
 
 ControlFlowSimplificationPass::~ControlFlowSimplificationPass() {}
 
 bool ControlFlowSimplificationPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
   // Walk forwards and kill any unreachable blocks.
   // Do this before merging.
   auto block = builder->first_block();
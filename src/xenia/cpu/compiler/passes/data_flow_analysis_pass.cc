@@ -34,15 +34,20 @@ namespace passes {
 // TODO(benvanik): remove when enums redefined.
 using namespace xe::cpu::hir;
 
+using xe::cpu::hir::Block;
 using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
 using xe::cpu::hir::OpcodeSignatureType;
 using xe::cpu::hir::Value;
 
-DataFlowAnalysisPass::DataFlowAnalysisPass() : CompilerPass() {}
+DataFlowAnalysisPass::DataFlowAnalysisPass()
+    : CompilerPass("DataFlowAnalysis") {}
 
 DataFlowAnalysisPass::~DataFlowAnalysisPass() {}
 
 bool DataFlowAnalysisPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
   // Linearize blocks so that we can detect cycles and propagate dependencies.
   uint32_t block_count = LinearizeBlocks(builder);
 
@@ -64,6 +69,95 @@ uint32_t DataFlowAnalysisPass::LinearizeBlocks(HIRBuilder* builder) {
   return block_ordinal;
 }
 
+void DataFlowAnalysisPass::ComputeLiveness(
+    HIRBuilder* builder, std::vector<llvm::BitVector>* live_in,
+    std::vector<llvm::BitVector>* live_out) {
+  uint32_t block_count = LinearizeBlocks(builder);
+  uint32_t value_count = builder->max_value_ordinal();
+  live_in->assign(block_count, llvm::BitVector(value_count));
+  live_out->assign(block_count, llvm::BitVector(value_count));
+
+  // Values each block uses before defining (all of them are defined in other
+  // blocks, as values are SSA) and values it defines.
+  std::vector<llvm::BitVector> uses(block_count, llvm::BitVector(value_count));
+  std::vector<llvm::BitVector> defs(block_count, llvm::BitVector(value_count));
+  std::vector<std::vector<Block*>> successors(block_count);
+  auto block = builder->first_block();
+  while (block) {
+    auto& block_uses = uses[block->ordinal];
+    auto& block_successors = successors[block->ordinal];
+    auto instr = block->instr_head;
+    while (instr) {
+      uint32_t signature = instr->opcode->signature;
+#define SET_USED_VALUE(v)                                          \
+  if (!v->IsConstant() && v->def && v->def->block != block) {      \
+    block_uses.set(v->ordinal);                                    \
+  }
+      if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
+        SET_USED_VALUE(instr->src1.value);
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
+        SET_USED_VALUE(instr->src2.value);
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
+        SET_USED_VALUE(instr->src3.value);
+      }
+#undef SET_USED_VALUE
+      if (GET_OPCODE_SIG_TYPE_DEST(signature) == OPCODE_SIG_TYPE_V) {
+        defs[block->ordinal].set(instr->dest->ordinal);
+      }
+      if (instr->opcode == &OPCODE_BRANCH_info) {
+        block_successors.push_back(instr->src1.label->block);
+      } else if (instr->opcode == &OPCODE_BRANCH_TRUE_info ||
+                 instr->opcode == &OPCODE_BRANCH_FALSE_info) {
+        block_successors.push_back(instr->src2.label->block);
+      }
+      instr = instr->next;
+    }
+    // Everything but unconditional branches, returns and tail calls falls
+    // through.
+    auto tail = block->instr_tail;
+    bool falls_through = true;
+    if (tail) {
+      if (tail->opcode == &OPCODE_BRANCH_info ||
+          tail->opcode == &OPCODE_RETURN_info) {
+        falls_through = false;
+      } else if (tail->opcode == &OPCODE_CALL_info ||
+                 tail->opcode == &OPCODE_CALL_INDIRECT_info) {
+        falls_through = (tail->flags & CALL_TAIL) == 0;
+      }
+    }
+    if (falls_through && block->next) {
+      block_successors.push_back(block->next);
+    }
+    block = block->next;
+  }
+
+  // Iterate until nothing changes. Walking backwards, code without loops
+  // settles in one pass.
+  llvm::BitVector new_in(value_count);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    block = builder->last_block();
+    while (block) {
+      auto& block_out = (*live_out)[block->ordinal];
+      for (auto successor : successors[block->ordinal]) {
+        block_out |= (*live_in)[successor->ordinal];
+      }
+      new_in = block_out;
+      new_in.reset(defs[block->ordinal]);
+      new_in |= uses[block->ordinal];
+      auto& block_in = (*live_in)[block->ordinal];
+      if (!(new_in == block_in)) {
+        block_in = new_in;
+        changed = true;
+      }
+      block = block->prev;
+    }
+  }
+}
+
 void DataFlowAnalysisPass::AnalyzeFlow(HIRBuilder* builder,
                                        uint32_t block_count) {
   uint32_t max_value_estimate =
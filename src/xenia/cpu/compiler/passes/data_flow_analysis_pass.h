@@ -10,8 +10,14 @@
 #ifndef XENIA_COMPILER_PASSES_DATA_FLOW_ANALYSIS_PASS_H_
 #define XENIA_COMPILER_PASSES_DATA_FLOW_ANALYSIS_PASS_H_
 
+#include <vector>
+
 #include "xenia/cpu/compiler/compiler_pass.h"
 
+namespace llvm {
+class BitVector;
+}  // namespace llvm
+
 namespace xe {
 namespace cpu {
 namespace compiler {
@@ -24,8 +30,17 @@ class DataFlowAnalysisPass : public CompilerPass {
 
   bool Run(hir::HIRBuilder* builder) override;
 
+  // Computes the values live into and out of each block, indexed by block
+  // ordinal and then by value ordinal. Blocks are given sequential ordinals.
+  // Successors are read from the branches in each block and the fall through
+  // to the next one, as the CFG edges are not kept up to date by later
+  // passes (and the baseline pipeline never builds them).
+  static void ComputeLiveness(hir::HIRBuilder* builder,
+                              std::vector<llvm::BitVector>* live_in,
+                              std::vector<llvm::BitVector>* live_out);
+
  private:
-  uint32_t LinearizeBlocks(hir::HIRBuilder* builder);
+  static uint32_t LinearizeBlocks(hir::HIRBuilder* builder);
   void AnalyzeFlow(hir::HIRBuilder* builder, uint32_t block_count);
 };
 
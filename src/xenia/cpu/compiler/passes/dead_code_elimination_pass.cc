@@ -23,11 +23,14 @@ using xe::cpu::hir::HIRBuilder;
 using xe::cpu::hir::Instr;
 using xe::cpu::hir::Value;
 
-DeadCodeEliminationPass::DeadCodeEliminationPass() : CompilerPass() {}
+DeadCodeEliminationPass::DeadCodeEliminationPass()
+    : CompilerPass("DeadCodeElimination") {}
 
 DeadCodeEliminationPass::~DeadCodeEliminationPass() {}
 
 bool DeadCodeEliminationPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
   // ContextPromotion/DSE will likely leave around a lot of dead statements.
   // Code generated for comparison/testing produces many unused statements and
   // with proper use analysis it should be possible to remove most of them:
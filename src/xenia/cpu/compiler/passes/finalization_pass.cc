@@ -24,11 +24,13 @@ using namespace xe::cpu::hir;
 
 using xe::cpu::hir::HIRBuilder;
 
-FinalizationPass::FinalizationPass() : CompilerPass() {}
+FinalizationPass::FinalizationPass() : CompilerPass("Finalization") {}
 
 FinalizationPass::~FinalizationPass() {}
 
 bool FinalizationPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
   // Process the HIR and prepare it for lowering.
   // After this is done the HIR should be ready for emitting.
 
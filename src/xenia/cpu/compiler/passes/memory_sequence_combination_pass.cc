@@ -24,11 +24,13 @@ using xe::cpu::hir::Instr;
 using xe::cpu::hir::Value;
 
 MemorySequenceCombinationPass::MemorySequenceCombinationPass()
-    : CompilerPass() {}
+    : CompilerPass("MemorySequenceCombination") {}
 
 MemorySequenceCombinationPass::~MemorySequenceCombinationPass() = default;
 
 bool MemorySequenceCombinationPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
   // Run over all loads and stores and see if we can collapse sequences into the
   // fat opcodes. See the respective utility functions for examples.
   auto block = builder->first_block();
@@ -10,13 +10,25 @@
 #include "xenia/cpu/compiler/passes/register_allocation_pass.h"
 
 #include <algorithm>
-#include <cstring>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/platform.h"
+#include "xenia/cpu/compiler/passes/data_flow_analysis_pass.h"
+#include "xenia/cpu/cpu_flags.h"
 #include "xenia/profiling.h"
 
+#if XE_COMPILER_MSVC
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4267)
+#include <llvm/ADT/BitVector.h>
+#pragma warning(pop)
+#else
+#include <llvm/ADT/BitVector.h>
+#endif  // XE_COMPILER_MSVC
+
 namespace xe {
 namespace cpu {
 namespace compiler {
@@ -26,6 +38,7 @@ namespace passes {
 using namespace xe::cpu::hir;
 
 using xe::cpu::backend::MachineInfo;
+using xe::cpu::hir::Block;
 using xe::cpu::hir::HIRBuilder;
 using xe::cpu::hir::Instr;
 using xe::cpu::hir::OpcodeSignatureType;
@@ -33,135 +46,130 @@ using xe::cpu::hir::RegAssignment;
 using xe::cpu::hir::TypeName;
 using xe::cpu::hir::Value;
 
-#define ASSERT_NO_CYCLES 0
+namespace {
+
+// Instructions flagged PAIRED_PREV must directly follow their predecessor, so
+// nothing can be inserted in between.
+Instr* InsertionPointBefore(Instr* instr) {
+  while (instr->opcode->flags & OPCODE_FLAG_PAIRED_PREV) {
+    assert_not_null(instr->prev);
+    instr = instr->prev;
+  }
+  return instr;
+}
+
+// Moves instr right after def (and anything paired with it).
+void MoveAfterDef(Instr* instr, Instr* def) {
+  Instr* after = def;
+  while (after->next &&
+         after->next->opcode->flags & OPCODE_FLAG_PAIRED_PREV) {
+    after = after->next;
+  }
+  if (after->next == instr) {
+    // Freshly appended right after it already.
+    instr->ordinal = after->ordinal + 1;
+  } else if (after->next) {
+    Instr* next = after->next;
+    instr->MoveBefore(next);
+    instr->ordinal = next->ordinal - 1;
+  } else {
+    // Block tail; there's no MoveAfter so swap the two around.
+    instr->MoveBefore(after);
+    after->MoveBefore(instr);
+    instr->ordinal = after->ordinal + 1;
+  }
+}
+
+// Moves instr to right before the given use (and anything it is paired with).
+void MoveBeforeUse(Instr* instr, Instr* use_instr) {
+  Instr* before = InsertionPointBefore(use_instr);
+  instr->MoveBefore(before);
+  instr->ordinal = before->ordinal - 1;
+}
+
+bool IsCall(const Instr* instr) {
+  return instr->opcode == &OPCODE_CALL_info ||
+         instr->opcode == &OPCODE_CALL_TRUE_info ||
+         instr->opcode == &OPCODE_CALL_INDIRECT_info ||
+         instr->opcode == &OPCODE_CALL_INDIRECT_TRUE_info ||
+         instr->opcode == &OPCODE_CALL_EXTERN_info;
+}
+
+bool UsesValue(const Instr* instr, const Value* value) {
+  uint32_t signature = instr->opcode->signature;
+  return (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
+          instr->src1.value == value) ||
+         (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V &&
+          instr->src2.value == value) ||
+         (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V &&
+          instr->src3.value == value);
+}
+
+}  // namespace
 
 RegisterAllocationPass::RegisterAllocationPass(const MachineInfo* machine_info)
-    : CompilerPass() {
-  // Initialize register sets.
-  // TODO(benvanik): rewrite in a way that makes sense - this is terrible.
+    : CompilerPass("RegisterAllocation") {
   auto mi_sets = machine_info->register_sets;
-  std::memset(&usage_sets_, 0, sizeof(usage_sets_));
-  uint32_t n = 0;
-  while (mi_sets[n].count) {
+  size_t set_count = 0;
+  while (mi_sets[set_count].count) {
+    ++set_count;
+  }
+  // Reserved up front as the type lookups point into it.
+  states_.resize(set_count);
+  for (size_t n = 0; n < set_count; ++n) {
     auto& mi_set = mi_sets[n];
-    auto usage_set = new RegisterSetUsage();
-    usage_sets_.all_sets[n] = usage_set;
-    usage_set->count = mi_set.count;
-    usage_set->set = &mi_set;
+    assert_true(mi_set.count <= kMaxRegisterCount);
+    auto state = &states_[n];
+    state->set = &mi_set;
+    state->count = mi_set.count;
     if (mi_set.types & MachineInfo::RegisterSet::INT_TYPES) {
-      usage_sets_.int_set = usage_set;
+      int_state_ = state;
     }
     if (mi_set.types & MachineInfo::RegisterSet::FLOAT_TYPES) {
-      usage_sets_.float_set = usage_set;
+      float_state_ = state;
     }
     if (mi_set.types & MachineInfo::RegisterSet::VEC_TYPES) {
-      usage_sets_.vec_set = usage_set;
+      vec_state_ = state;
     }
-    n++;
   }
 }
 
-RegisterAllocationPass::~RegisterAllocationPass() {
-  for (size_t n = 0; n < xe::countof(usage_sets_.all_sets); n++) {
-    if (!usage_sets_.all_sets[n]) {
-      break;
+RegisterAllocationPass::~RegisterAllocationPass() = default;
+
+bool RegisterAllocationPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  for (auto& state : states_) {
+    state.cross_block_count = 0;
+    state.free.reset();
+    for (uint32_t n = 0; n < state.count; ++n) {
+      state.free.set(n);
+      state.active[n] = ActiveInterval();
     }
-    delete usage_sets_.all_sets[n];
   }
-}
+  spill_slots_.clear();
 
-bool RegisterAllocationPass::Run(HIRBuilder* builder) {
-  // Simple per-block allocator that operates on SSA form.
-  // Registers do not move across blocks, though this could be
-  // optimized with some intra-block analysis (dominators/etc).
-  // Really, it'd just be nice to have someone who knew what they
-  // were doing lower SSA and do this right.
+  NumberInstructions(builder);
+  FindCrossBlockIntervals(builder);
 
-  uint16_t block_ordinal = 0;
-  uint32_t instr_ordinal = 0;
+  // Walk intervals in order of their start. Loads inserted by splits are
+  // placed ahead of the walk and picked up when we get to them.
   auto block = builder->first_block();
   while (block) {
-    // Sequential block ordinals.
-    block->ordinal = block_ordinal++;
-
-    // Reset all state.
-    PrepareBlockState();
-
-    // Renumber all instructions in the block. This is required so that
-    // we can sort the usage pointers below.
     auto instr = block->instr_head;
     while (instr) {
-      // Sequential global instruction ordinals.
-      instr->ordinal = instr_ordinal++;
-      instr = instr->next;
-    }
-
-    instr = block->instr_head;
-    while (instr) {
-      const auto info = instr->opcode;
-      uint32_t signature = info->signature;
-
-      // Update the register use heaps.
-      AdvanceUses(instr);
-
-      // Check sources for retirement. If any are unused after this instruction
-      // we can eagerly evict them to speed up register allocation.
-      // Since X64 (and other platforms) can often take advantage of dest==src1
-      // register mappings we track retired src1 so that we can attempt to
-      // reuse it.
-      // NOTE: these checks require that the usage list be sorted!
-      bool has_preferred_reg = false;
-      RegAssignment preferred_reg = {0};
-      if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
-          !instr->src1.value->IsConstant()) {
-        if (!instr->src1_use->next) {
-          // Pull off preferred register. We will try to reuse this for the
-          // dest.
-          // NOTE: set may be null if this is a store local.
-          if (preferred_reg.set) {
-            has_preferred_reg = true;
-            preferred_reg = instr->src1.value->reg;
-          }
-        }
-      }
+      // Free registers of values whose last use is this instruction. They can
+      // be reused for its dest, which helps x86 two operand forms.
+      ExpireIntervals(instr->ordinal);
 
-      if (GET_OPCODE_SIG_TYPE_DEST(signature) == OPCODE_SIG_TYPE_V) {
+      if (GET_OPCODE_SIG_TYPE_DEST(instr->opcode->signature) ==
+          OPCODE_SIG_TYPE_V) {
         // Must not have been set already.
         assert_null(instr->dest->reg.set);
-
-        // Sort the usage list. We depend on this in future uses of this
-        // variable.
-        SortUsageList(instr->dest);
-
-        // If we have a preferred register, use that.
-        // This way we can help along the stupid X86 two opcode instructions.
-        bool allocated;
-        if (has_preferred_reg) {
-          // Allocate with the given preferred register. If the register is in
-          // the wrong set it will not be reused.
-          allocated = TryAllocateRegister(instr->dest, preferred_reg);
-        } else {
-          // Allocate a register. This will either reserve a free one or
-          // spill and reuse an active one.
-          allocated = TryAllocateRegister(instr->dest);
-        }
-        if (!allocated) {
-          // Failed to allocate register -- need to spill and try again.
-          // We spill only those registers we aren't using.
-          if (!SpillOneRegister(builder, block, instr->dest->type)) {
-            // Unable to spill anything - this shouldn't happen.
-            XELOGE("Unable to spill any registers");
-            assert_always();
-            return false;
-          }
-
-          // Demand allocation.
-          if (!TryAllocateRegister(instr->dest)) {
-            // Boned.
-            XELOGE("Register allocation failed");
-            assert_always();
-            return false;
-          }
+        if (!AllocateRegister(builder, instr)) {
+          XELOGE("Register allocation failed");
+          assert_always();
+          return false;
         }
       }
 
@@ -173,312 +181,370 @@ bool RegisterAllocationPass::Run(HIRBuilder* builder) {
   return true;
 }
 
-void RegisterAllocationPass::DumpUsage(const char* name) {
-#if 0
-  fprintf(stdout, "\n%s:\n", name);
-  for (size_t i = 0; i < xe::countof(usage_sets_.all_sets); ++i) {
-    auto usage_set = usage_sets_.all_sets[i];
-    if (usage_set) {
-      fprintf(stdout, "set %s:\n", usage_set->set->name);
-      fprintf(stdout, "  avail: %s\n", usage_set->availability.to_string().c_str());
-      fprintf(stdout, "  upcoming uses:\n");
-      for (auto it = usage_set->upcoming_uses.begin();
-           it != usage_set->upcoming_uses.end(); ++it) {
-        fprintf(stdout, "    v%d, used at %d\n",
-                it->value->ordinal,
-                it->use->instr->ordinal);
+void RegisterAllocationPass::NumberInstructions(HIRBuilder* builder) {
+  // Original instructions get even ordinals so that spill code inserted
+  // between two of them can take the odd one in between.
+  call_ordinals_.clear();
+  uint16_t block_ordinal = 0;
+  uint32_t instr_ordinal = 0;
+  auto block = builder->first_block();
+  while (block) {
+    block->ordinal = block_ordinal++;
+    auto instr = block->instr_head;
+    while (instr) {
+      instr_ordinal += 2;
+      instr->ordinal = instr_ordinal;
+      if (IsCall(instr)) {
+        call_ordinals_.push_back(instr_ordinal);
       }
+      instr = instr->next;
     }
+    block = block->next;
   }
-  fflush(stdout);
-#endif
 }
 
-void RegisterAllocationPass::PrepareBlockState() {
-  for (size_t i = 0; i < xe::countof(usage_sets_.all_sets); ++i) {
-    auto usage_set = usage_sets_.all_sets[i];
-    if (usage_set) {
-      usage_set->availability.set();
-      usage_set->upcoming_uses.clear();
-    }
-  }
-  DumpUsage("PrepareBlockState");
-}
+void RegisterAllocationPass::FindCrossBlockIntervals(HIRBuilder* builder) {
+  std::vector<llvm::BitVector> live_in;
+  std::vector<llvm::BitVector> live_out;
+  DataFlowAnalysisPass::ComputeLiveness(builder, &live_in, &live_out);
+  cross_block_ends_.assign(builder->max_value_ordinal(), 0);
 
-void RegisterAllocationPass::AdvanceUses(Instr* instr) {
-  for (size_t i = 0; i < xe::countof(usage_sets_.all_sets); ++i) {
-    auto usage_set = usage_sets_.all_sets[i];
-    if (!usage_set) {
-      break;
-    }
-    auto& upcoming_uses = usage_set->upcoming_uses;
-    for (size_t j = 0; j < upcoming_uses.size();) {
-      auto& upcoming_use = upcoming_uses.at(j);
-      if (!upcoming_use.use) {
-        // No uses at all - we can remove right away.
-        // This comes up from instructions where the dest is never used,
-        // like the ATOMIC ops.
-        MarkRegAvailable(upcoming_use.value->reg);
-        upcoming_uses.erase(upcoming_uses.begin() + j);
-        // i remains the same.
+  auto block = builder->first_block();
+  while (block) {
+    auto instr = block->instr_head;
+    while (instr) {
+      auto next_instr = instr->next;
+      Value* value = instr->dest;
+      if (!value || !value->use_head ||
+          GET_OPCODE_SIG_TYPE_DEST(instr->opcode->signature) !=
+              OPCODE_SIG_TYPE_V) {
+        instr = next_instr;
         continue;
       }
-      if (upcoming_use.use->instr != instr) {
-        // Not yet at this instruction.
-        ++j;
-        continue;
+      SortUsageList(value);
+      bool used_elsewhere = false;
+      for (auto use = value->use_head; use; use = use->next) {
+        if (use->instr->block != block) {
+          used_elsewhere = true;
+          break;
+        }
       }
-      // The use is from this instruction.
-      if (!upcoming_use.use->next) {
-        // Last use of the value. We can retire it now.
-        MarkRegAvailable(upcoming_use.value->reg);
-        upcoming_uses.erase(upcoming_uses.begin() + j);
-        // i remains the same.
+      if (!used_elsewhere) {
+        instr = next_instr;
         continue;
-      } else {
-        // Used again. Push back the next use.
-        // Note that we may be used multiple times this instruction, so
-        // eat those.
-        auto next_use = upcoming_use.use->next;
-        while (next_use->next && next_use->instr == instr) {
-          next_use = next_use->next;
+      }
+
+      // The interval runs to the end of the last block the value is live out
+      // of. Linear order only covers every point it is live at if all blocks
+      // it is live into come after the definition.
+      bool keep_register = FLAGS_regalloc_cross_block_registers &&
+                           live_out[block->ordinal].test(value->ordinal);
+      uint32_t end_ordinal = value->last_use->ordinal;
+      for (auto live_block = builder->first_block();
+           live_block && keep_register; live_block = live_block->next) {
+        if (!live_block->instr_head) {
+          continue;
         }
-        // Remove the iterator.
-        auto value = upcoming_use.value;
-        upcoming_uses.erase(upcoming_uses.begin() + j);
-        assert_true(next_use->instr->block == instr->block);
-        assert_true(value->def->block == instr->block);
-        upcoming_uses.emplace_back(value, next_use);
-        // i remains the same.
-        continue;
+        if (live_in[live_block->ordinal].test(value->ordinal) &&
+            live_block->instr_head->ordinal < instr->ordinal) {
+          keep_register = false;
+        }
+        if (live_out[live_block->ordinal].test(value->ordinal)) {
+          end_ordinal =
+              std::max(end_ordinal, live_block->instr_tail->ordinal);
+        }
+      }
+      // Calls clobber every register we hand out.
+      auto call = std::upper_bound(call_ordinals_.begin(),
+                                   call_ordinals_.end(), instr->ordinal);
+      if (call != call_ordinals_.end() && *call < end_ordinal) {
+        keep_register = false;
       }
+
+      if (keep_register) {
+        cross_block_ends_[value->ordinal] = end_ordinal;
+      } else {
+        RouteCrossBlockValue(builder, value);
+      }
+      instr = next_instr;
     }
+    block = block->next;
   }
-  DumpUsage("AdvanceUses");
 }
 
-bool RegisterAllocationPass::IsRegInUse(const RegAssignment& reg) {
-  RegisterSetUsage* usage_set;
-  if (reg.set == usage_sets_.int_set->set) {
-    usage_set = usage_sets_.int_set;
-  } else if (reg.set == usage_sets_.float_set->set) {
-    usage_set = usage_sets_.float_set;
-  } else {
-    usage_set = usage_sets_.vec_set;
+void RegisterAllocationPass::RouteCrossBlockValue(HIRBuilder* builder,
+                                                  Value* value) {
+  // Store once after the definition and reload at the top of the uses in
+  // each other block. The definition dominates all uses, so the store is
+  // always performed before any of the loads. What remains is block-local.
+  if (value->ordinal < cross_block_ends_.size()) {
+    cross_block_ends_[value->ordinal] = 0;
+  }
+  auto block = value->def->block;
+  if (!value->local_slot) {
+    value->local_slot = builder->AllocLocal(value->type);
+    builder->StoreLocal(value->local_slot, value);
+    MoveAfterDef(builder->last_instr(), value->def);
+  }
+  std::vector<std::pair<Block*, Value*>> reloads;
+  auto use = value->use_head;
+  while (use) {
+    auto next_use = use->next;
+    auto use_block = use->instr->block;
+    if (use_block != block) {
+      Value* new_value = nullptr;
+      for (auto& reload : reloads) {
+        if (reload.first == use_block) {
+          new_value = reload.second;
+          break;
+        }
+      }
+      if (!new_value) {
+        // Uses are sorted, so this is the first one in the block.
+        new_value = builder->LoadLocal(value->local_slot);
+        new_value->local_slot = value->local_slot;
+        MoveBeforeUse(builder->last_instr(), use->instr);
+        reloads.emplace_back(use_block, new_value);
+      }
+      RenameUses(value, use, new_value);
+      // Renaming may have dropped more than one use of this instruction, so
+      // start over from the remaining ones.
+      next_use = value->use_head;
+      while (next_use && next_use->instr->block == block) {
+        next_use = next_use->next;
+      }
+    }
+    use = next_use;
   }
-  return !usage_set->availability.test(reg.index);
+  SortUsageList(value);
 }
 
-RegisterAllocationPass::RegisterSetUsage* RegisterAllocationPass::MarkRegUsed(
-    const RegAssignment& reg, Value* value, Value::Use* use) {
-  auto usage_set = RegisterSetForValue(value);
-  usage_set->availability.set(reg.index, false);
-  usage_set->upcoming_uses.emplace_back(value, use);
-  DumpUsage("MarkRegUsed");
-  return usage_set;
+uint32_t RegisterAllocationPass::CrossBlockEnd(const Value* value) const {
+  return value->ordinal < cross_block_ends_.size()
+             ? cross_block_ends_[value->ordinal]
+             : 0;
 }
 
-RegisterAllocationPass::RegisterSetUsage*
-RegisterAllocationPass::MarkRegAvailable(const hir::RegAssignment& reg) {
-  RegisterSetUsage* usage_set;
-  if (reg.set == usage_sets_.int_set->set) {
-    usage_set = usage_sets_.int_set;
-  } else if (reg.set == usage_sets_.float_set->set) {
-    usage_set = usage_sets_.float_set;
-  } else {
-    usage_set = usage_sets_.vec_set;
+void RegisterAllocationPass::ExpireIntervals(uint32_t ordinal) {
+  for (auto& state : states_) {
+    for (uint32_t n = 0; n < state.count; ++n) {
+      auto& active = state.active[n];
+      if (active.value && active.end_ordinal <= ordinal) {
+        if (active.cross_block) {
+          --state.cross_block_count;
+        }
+        active = ActiveInterval();
+        state.free.set(n);
+      }
+    }
   }
-  usage_set->availability.set(reg.index, true);
-  return usage_set;
 }
 
-bool RegisterAllocationPass::TryAllocateRegister(
-    Value* value, const RegAssignment& preferred_reg) {
-  // If the preferred register matches type and is available, use it.
-  auto usage_set = RegisterSetForValue(value);
-  if (usage_set->set == preferred_reg.set) {
-    // Check if available.
-    if (!IsRegInUse(preferred_reg)) {
-      // Mark as in-use and return. Best case.
-      MarkRegUsed(preferred_reg, value, value->use_head);
-      value->reg = preferred_reg;
-      return true;
+bool RegisterAllocationPass::AllocateRegister(HIRBuilder* builder,
+                                              Instr* instr) {
+  Value* value = instr->dest;
+  auto state = StateForType(value->type);
+
+  // Sort the usage list. Both the interval end and spilling depend on it.
+  SortUsageList(value);
+
+  // Intervals live across blocks can't be split, so they only get a register
+  // if one is free and enough are left over for block-local intervals.
+  bool cross_block = CrossBlockEnd(value) != 0;
+  if (cross_block &&
+      (state->cross_block_count + kBlockLocalRegisterCount >= state->count ||
+       state->free.none())) {
+    RouteCrossBlockValue(builder, value);
+    cross_block = false;
+  }
+
+  // Prefer the register of src1 if it was just retired by this instruction.
+  int32_t index = -1;
+  if (GET_OPCODE_SIG_TYPE_SRC1(instr->opcode->signature) ==
+      OPCODE_SIG_TYPE_V) {
+    Value* src1 = instr->src1.value;
+    if (!src1->IsConstant() && src1->reg.set == state->set &&
+        src1->last_use == instr && state->free.test(src1->reg.index)) {
+      index = src1->reg.index;
+    }
+  }
+  if (index == -1) {
+    uint32_t first_free = 0;
+    if (xe::bit_scan_forward(static_cast<uint32_t>(state->free.to_ulong()),
+                             &first_free)) {
+      index = first_free;
     }
   }
+  if (index == -1) {
+    // Nothing free - make room by splitting another interval.
+    Value* victim = SelectSpillCandidate(state, instr);
+    if (!victim) {
+      XELOGE("Unable to spill any registers");
+      return false;
+    }
+    index = victim->reg.index;
+    SplitInterval(builder, victim, instr);
+    state->active[index] = ActiveInterval();
+  }
 
-  // Otherwise, fallback to allocating like normal.
-  return TryAllocateRegister(value);
+  value->reg.set = state->set;
+  value->reg.index = index;
+  state->free.reset(index);
+  state->active[index].value = value;
+  state->active[index].end_ordinal = EndOrdinal(value);
+  state->active[index].cross_block = cross_block;
+  if (cross_block) {
+    ++state->cross_block_count;
+  }
+  return true;
 }
 
-bool RegisterAllocationPass::TryAllocateRegister(Value* value) {
-  // Get the set this register is in.
-  RegisterSetUsage* usage_set = RegisterSetForValue(value);
-
-  // Find the first free register, if any.
-  // We have to ensure it's a valid one (in our count).
-  uint32_t first_unused = 0;
-  bool none_used = xe::bit_scan_forward(
-      static_cast<uint32_t>(usage_set->availability.to_ulong()), &first_unused);
-  if (none_used && first_unused < usage_set->count) {
-    // Available! Use it!
-    value->reg.set = usage_set->set;
-    value->reg.index = first_unused;
-    MarkRegUsed(value->reg, value, value->use_head);
-    return true;
+Value* RegisterAllocationPass::SelectSpillCandidate(RegisterSetState* state,
+                                                    Instr* instr) {
+  // Pick the interval whose next use is furthest away, preferring ones that
+  // are already in a spill slot (no store needed).
+  Value* best_value = nullptr;
+  uint32_t best_next_ordinal = 0;
+  for (uint32_t n = 0; n < state->count; ++n) {
+    Value* value = state->active[n].value;
+    if (!value || state->active[n].cross_block || UsesValue(instr, value)) {
+      continue;
+    }
+    auto use = value->use_head;
+    while (use && use->instr->ordinal <= instr->ordinal) {
+      use = use->next;
+    }
+    if (!use) {
+      continue;
+    }
+    // The reload must land after this instruction.
+    uint32_t next_ordinal = InsertionPointBefore(use->instr)->ordinal;
+    if (next_ordinal <= instr->ordinal) {
+      continue;
+    }
+    if (!best_value || next_ordinal > best_next_ordinal ||
+        (next_ordinal == best_next_ordinal && value->local_slot &&
+         !best_value->local_slot)) {
+      best_value = value;
+      best_next_ordinal = next_ordinal;
+    }
+  }
+  return best_value;
+}
+
+void RegisterAllocationPass::SplitInterval(HIRBuilder* builder, Value* value,
+                                           Instr* instr) {
+  auto next_use = value->use_head;
+  while (next_use->instr->ordinal <= instr->ordinal) {
+    next_use = next_use->next;
   }
 
-  // None available! Spill required.
-  return false;
+  if (!value->local_slot) {
+    // Store right after the definition. Values are SSA, so whatever is in
+    // the slot stays valid for every later reload (including reloads of
+    // reloads, which inherit the slot).
+    value->local_slot =
+        AllocSpillSlot(builder, value->type, value->def->ordinal);
+    builder->StoreLocal(value->local_slot, value);
+    MoveAfterDef(builder->last_instr(), value->def);
+  }
+
+  // Reload before the next use. The new value starts a new interval that is
+  // allocated when the walk reaches the load.
+  auto new_value = builder->LoadLocal(value->local_slot);
+  new_value->local_slot = value->local_slot;
+  MoveBeforeUse(builder->last_instr(), next_use->instr);
+  uint32_t last_ordinal = value->last_use->ordinal;
+  RenameUses(value, next_use, new_value);
+  ExtendSpillSlot(value->local_slot, last_ordinal);
+
+  // Only uses before this instruction remain.
+  value->last_use = nullptr;
+  for (auto use = value->use_head; use; use = use->next) {
+    value->last_use = use->instr;
+  }
 }
 
-bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
-                                              TypeName required_type) {
-  // Get the set that we will be picking from.
-  RegisterSetUsage* usage_set;
-  if (required_type <= INT64_TYPE) {
-    usage_set = usage_sets_.int_set;
-  } else if (required_type <= FLOAT64_TYPE) {
-    usage_set = usage_sets_.float_set;
-  } else {
-    usage_set = usage_sets_.vec_set;
+Value* RegisterAllocationPass::AllocSpillSlot(HIRBuilder* builder,
+                                              TypeName type,
+                                              uint32_t start_ordinal) {
+  // Split intervals are block-local, so once the last reload from a slot has
+  // run nothing reads it again until it is stored to anew. Reusing slots
+  // keeps the stack frame from growing with every spill. The store goes right
+  // after the definition, so that is where the slot starts being used, not
+  // where the interval gets split.
+  for (auto& spill_slot : spill_slots_) {
+    if (spill_slot.slot->type == type &&
+        spill_slot.end_ordinal < start_ordinal) {
+      spill_slot.end_ordinal = start_ordinal;
+      return spill_slot.slot;
+    }
   }
+  auto slot = builder->AllocLocal(type);
+  spill_slots_.push_back({slot, start_ordinal});
+  return slot;
+}
 
-  DumpUsage("SpillOneRegister (pre)");
-  // Pick the one with the furthest next use.
-  assert_true(!usage_set->upcoming_uses.empty());
-  auto furthest_usage = std::max_element(usage_set->upcoming_uses.begin(),
-                                         usage_set->upcoming_uses.end(),
-                                         RegisterUsage::Comparer());
-  assert_true(furthest_usage->value->def->block == block);
-  assert_true(furthest_usage->use->instr->block == block);
-  auto spill_value = furthest_usage->value;
-  Value::Use* prev_use = furthest_usage->use->prev;
-  Value::Use* next_use = furthest_usage->use;
-  assert_not_null(next_use);
-  usage_set->upcoming_uses.erase(furthest_usage);
-  DumpUsage("SpillOneRegister (post)");
-  const auto reg = spill_value->reg;
-
-  // We know the spill_value use list is sorted, so we can cut it right now.
-  // This makes it easier down below.
-  auto new_head_use = next_use;
-
-  // Allocate local.
-  if (spill_value->local_slot) {
-    // Value is already assigned a slot. Since we allocate in order and this is
-    // all SSA we know the stored value will be exactly what we want. Yay,
-    // we can prevent the redundant store!
-    // In fact, we may even want to pin this spilled value so that we always
-    // use the spilled value and prevent the need for more locals.
-  } else {
-    // Allocate a local slot.
-    spill_value->local_slot = builder->AllocLocal(spill_value->type);
-
-    // Add store.
-    builder->StoreLocal(spill_value->local_slot, spill_value);
-    auto spill_store = builder->last_instr();
-    auto spill_store_use = spill_store->src2_use;
-    assert_null(spill_store_use->prev);
-    if (prev_use && prev_use->instr->opcode->flags & OPCODE_FLAG_PAIRED_PREV) {
-      // Instruction is paired. This is bad. We will insert the spill after the
-      // paired instruction.
-      assert_not_null(prev_use->instr->next);
-      spill_store->MoveBefore(prev_use->instr->next);
-
-      // Update last use.
-      spill_value->last_use = spill_store;
-    } else if (prev_use) {
-      // We insert the store immediately before the previous use.
-      // If we were smarter we could then re-run allocation and reuse the
-      // register
-      // once dropped.
-      spill_store->MoveBefore(prev_use->instr);
-
-      // Update last use.
-      spill_value->last_use = prev_use->instr;
-    } else {
-      // This is the first use, so the only thing we have is the define.
-      // Move the store to right after that.
-      spill_store->MoveBefore(spill_value->def->next);
-
-      // Update last use.
-      spill_value->last_use = spill_store;
+void RegisterAllocationPass::ExtendSpillSlot(Value* slot,
+                                             uint32_t end_ordinal) {
+  // Slots of values routed across blocks are never shared and aren't tracked.
+  for (auto& spill_slot : spill_slots_) {
+    if (spill_slot.slot == slot) {
+      spill_slot.end_ordinal = std::max(spill_slot.end_ordinal, end_ordinal);
+      return;
     }
   }
+}
 
-#if ASSERT_NO_CYCLES
-  builder->AssertNoCycles();
-  spill_value->def->block->AssertNoCycles();
-#endif  // ASSERT_NO_CYCLES
-
-  // Add load.
-  // Inserted immediately before the next use. Since by definition the next
-  // use is after the instruction requesting the spill we know we haven't
-  // done allocation for that code yet and can let that be handled
-  // automatically when we get to it.
-  auto new_value = builder->LoadLocal(spill_value->local_slot);
-  auto spill_load = builder->last_instr();
-  spill_load->MoveBefore(next_use->instr);
-// Note: implicit first use added.
-
-#if ASSERT_NO_CYCLES
-  builder->AssertNoCycles();
-  spill_value->def->block->AssertNoCycles();
-#endif  // ASSERT_NO_CYCLES
-
-  // Set the local slot of the new value to our existing one. This way we will
-  // reuse that same memory if needed.
-  new_value->local_slot = spill_value->local_slot;
-
-  // Rename all future uses of the SSA value to the new value as loaded
-  // from the local.
-  // We can quickly do this by walking the use list. Because the list is
-  // already sorted we know we are going to end up with a sorted list.
-  auto walk_use = new_head_use;
-  auto new_use_tail = walk_use;
-  while (walk_use) {
-    auto next_walk_use = walk_use->next;
-    auto instr = walk_use->instr;
+RegisterAllocationPass::RegisterSetState* RegisterAllocationPass::StateForType(
+    TypeName type) {
+  if (type <= INT64_TYPE) {
+    return int_state_;
+  } else if (type <= FLOAT64_TYPE) {
+    return float_state_;
+  } else {
+    return vec_state_;
+  }
+}
 
-    uint32_t signature = instr->opcode->signature;
-    if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src1.value == spill_value) {
-        instr->set_src1(new_value);
-      }
+void RegisterAllocationPass::RenameUses(Value* value, Value::Use* first_use,
+                                        Value* new_value) {
+  // Renames first_use and everything after it that is in the same block.
+  auto block = first_use->instr->block;
+  auto use = first_use;
+  while (use && use->instr->block == block) {
+    auto next_use = use->next;
+    // set_srcN unlinks the use, so skip any other use of the same instruction
+    // that is about to go away with it.
+    while (next_use && next_use->instr == use->instr) {
+      next_use = next_use->next;
     }
-    if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src2.value == spill_value) {
-        instr->set_src2(new_value);
-      }
+    auto instr = use->instr;
+    uint32_t signature = instr->opcode->signature;
+    if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
+        instr->src1.value == value) {
+      instr->set_src1(new_value);
     }
-    if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src3.value == spill_value) {
-        instr->set_src3(new_value);
-      }
+    if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V &&
+        instr->src2.value == value) {
+      instr->set_src2(new_value);
     }
-
-    walk_use = next_walk_use;
-    if (walk_use) {
-      new_use_tail = walk_use;
+    if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V &&
+        instr->src3.value == value) {
+      instr->set_src3(new_value);
     }
+    use = next_use;
   }
-  new_value->last_use = new_use_tail->instr;
-
-  // Update tracking.
-  MarkRegAvailable(reg);
-
-  return true;
 }
 
-RegisterAllocationPass::RegisterSetUsage*
-RegisterAllocationPass::RegisterSetForValue(const Value* value) {
-  if (value->type <= INT64_TYPE) {
-    return usage_sets_.int_set;
-  } else if (value->type <= FLOAT64_TYPE) {
-    return usage_sets_.float_set;
-  } else {
-    return usage_sets_.vec_set;
+uint32_t RegisterAllocationPass::EndOrdinal(const Value* value) const {
+  uint32_t cross_block_end = CrossBlockEnd(value);
+  if (cross_block_end) {
+    return cross_block_end;
   }
+  // Values without uses (results of atomics, etc) only need their register at
+  // the definition.
+  return value->last_use ? value->last_use->ordinal : value->def->ordinal;
 }
 
 namespace {
@@ -490,6 +556,7 @@ void RegisterAllocationPass::SortUsageList(Value* value) {
   // Modified in-place linked list sort from:
   // http://www.chiark.greenend.org.uk/~sgtatham/algorithms/listsort.c
   if (!value->use_head) {
+    value->last_use = nullptr;
     return;
   }
   Value::Use* head = value->use_head;
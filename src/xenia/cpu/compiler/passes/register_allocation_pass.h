@@ -10,7 +10,6 @@
 #ifndef XENIA_COMPILER_PASSES_REGISTER_ALLOCATION_PASS_H_
 #define XENIA_COMPILER_PASSES_REGISTER_ALLOCATION_PASS_H_
 
-#include <algorithm>
 #include <bitset>
 #include <vector>
 
@@ -22,6 +21,22 @@ namespace cpu {
 namespace compiler {
 namespace passes {
 
+// Linear scan register allocator.
+// Instructions are numbered in block order and every value gets a live
+// interval from its definition to its last use. Intervals are assigned
+// registers in order of their start. When a register set runs out, the active
+// interval with the furthest next use is split: it is stored to a spill slot
+// after its definition and reloaded into a new value right before its next
+// use. Spill slots are shared between intervals that don't overlap.
+//
+// Values live out of the block that defines them (per
+// DataFlowAnalysisPass::ComputeLiveness) keep one register up to the end of
+// the last block they are live out of, and are never split. They may only
+// take registers beyond those any single instruction could need, so that
+// splitting block-local intervals always succeeds. Those that don't get a
+// register, or that would be live across a call, are routed through a
+// dedicated slot instead (a store after the definition and one reload per
+// using block).
 class RegisterAllocationPass : public CompilerPass {
  public:
   RegisterAllocationPass(const backend::MachineInfo* machine_info);
@@ -30,53 +45,62 @@ class RegisterAllocationPass : public CompilerPass {
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
-  // TODO(benvanik): rewrite all this set shit -- too much indirection, the
-  // complexity is not needed.
-  struct RegisterUsage {
-    hir::Value* value;
-    hir::Value::Use* use;
-    RegisterUsage() : value(nullptr), use(nullptr) {}
-    RegisterUsage(hir::Value* value_, hir::Value::Use* use_)
-        : value(value_), use(use_) {}
-    struct Comparer : std::binary_function<RegisterUsage, RegisterUsage, bool> {
-      bool operator()(const RegisterUsage& a, const RegisterUsage& b) const {
-        return a.use->instr->ordinal < b.use->instr->ordinal;
-      }
-    };
+  static const size_t kMaxRegisterCount = 32;
+  // Registers left to block-local intervals: the three sources and the dest
+  // of one instruction.
+  static const uint32_t kBlockLocalRegisterCount = 4;
+
+  // An allocated register and the live interval occupying it.
+  struct ActiveInterval {
+    hir::Value* value = nullptr;
+    uint32_t end_ordinal = 0;
+    bool cross_block = false;
   };
-  struct RegisterSetUsage {
+  struct RegisterSetState {
     const backend::MachineInfo::RegisterSet* set = nullptr;
     uint32_t count = 0;
-    std::bitset<32> availability = 0;
-    // TODO(benvanik): another data type.
-    std::vector<RegisterUsage> upcoming_uses;
+    uint32_t cross_block_count = 0;
+    std::bitset<kMaxRegisterCount> free;
+    ActiveInterval active[kMaxRegisterCount];
+  };
+  // Spill slot that can be handed out again once end_ordinal has passed.
+  struct SpillSlot {
+    hir::Value* slot;
+    uint32_t end_ordinal;
   };
 
-  void DumpUsage(const char* name);
-  void PrepareBlockState();
-  void AdvanceUses(hir::Instr* instr);
-  bool IsRegInUse(const hir::RegAssignment& reg);
-  RegisterSetUsage* MarkRegUsed(const hir::RegAssignment& reg,
-                                hir::Value* value, hir::Value::Use* use);
-  RegisterSetUsage* MarkRegAvailable(const hir::RegAssignment& reg);
-
-  bool TryAllocateRegister(hir::Value* value,
-                           const hir::RegAssignment& preferred_reg);
-  bool TryAllocateRegister(hir::Value* value);
-  bool SpillOneRegister(hir::HIRBuilder* builder, hir::Block* block,
-                        hir::TypeName required_type);
+  void NumberInstructions(hir::HIRBuilder* builder);
+  void FindCrossBlockIntervals(hir::HIRBuilder* builder);
+  void RouteCrossBlockValue(hir::HIRBuilder* builder, hir::Value* value);
+  uint32_t CrossBlockEnd(const hir::Value* value) const;
+  void ExpireIntervals(uint32_t ordinal);
+  bool AllocateRegister(hir::HIRBuilder* builder, hir::Instr* instr);
+  hir::Value* SelectSpillCandidate(RegisterSetState* state, hir::Instr* instr);
+  void SplitInterval(hir::HIRBuilder* builder, hir::Value* value,
+                     hir::Instr* instr);
+  hir::Value* AllocSpillSlot(hir::HIRBuilder* builder, hir::TypeName type,
+                             uint32_t start_ordinal);
+  void ExtendSpillSlot(hir::Value* slot, uint32_t end_ordinal);
 
-  RegisterSetUsage* RegisterSetForValue(const hir::Value* value);
+  RegisterSetState* StateForType(hir::TypeName type);
 
-  void SortUsageList(hir::Value* value);
+  static void RenameUses(hir::Value* value, hir::Value::Use* first_use,
+                         hir::Value* new_value);
+  uint32_t EndOrdinal(const hir::Value* value) const;
+  static void SortUsageList(hir::Value* value);
 
  private:
-  struct {
-    RegisterSetUsage* int_set = nullptr;
-    RegisterSetUsage* float_set = nullptr;
-    RegisterSetUsage* vec_set = nullptr;
-    RegisterSetUsage* all_sets[3];
-  } usage_sets_;
+  std::vector<RegisterSetState> states_;
+  RegisterSetState* int_state_ = nullptr;
+  RegisterSetState* float_state_ = nullptr;
+  RegisterSetState* vec_state_ = nullptr;
+
+  std::vector<SpillSlot> spill_slots_;
+  // End ordinal of each value kept in a register across blocks, by value
+  // ordinal. 0 for all others.
+  std::vector<uint32_t> cross_block_ends_;
+  // Ordinals of calls, which clobber every allocatable register.
+  std::vector<uint32_t> call_ordinals_;
 };
 
 }  // namespace passes
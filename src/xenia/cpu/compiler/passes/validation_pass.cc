@@ -29,11 +29,13 @@ using xe::cpu::hir::Instr;
 using xe::cpu::hir::OpcodeSignatureType;
 using xe::cpu::hir::Value;
 
-ValidationPass::ValidationPass() : CompilerPass() {}
+ValidationPass::ValidationPass() : CompilerPass("Validation") {}
 
 ValidationPass::~ValidationPass() {}
 
 bool ValidationPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
 #if 0
   StringBuffer str;
   builder->Dump(&str);
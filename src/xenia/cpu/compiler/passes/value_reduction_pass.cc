@@ -37,7 +37,7 @@ using xe::cpu::hir::HIRBuilder;
 using xe::cpu::hir::OpcodeInfo;
 using xe::cpu::hir::Value;
 
-ValueReductionPass::ValueReductionPass() : CompilerPass() {}
+ValueReductionPass::ValueReductionPass() : CompilerPass("ValueReduction") {}
 
 ValueReductionPass::~ValueReductionPass() {}
 
@@ -59,6 +59,8 @@ void ValueReductionPass::ComputeLastUse(Value* value) {
 }
 
 bool ValueReductionPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
   // Walk each block and reuse variable ordinals as much as possible.
 
   llvm::BitVector ordinals(builder->max_value_ordinal());
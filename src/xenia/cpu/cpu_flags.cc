@@ -16,6 +16,26 @@ DEFINE_string(
     "Loads a .map for symbol names and to diff with the generated symbol "
     "database.");
 
+DEFINE_int32(jit_worker_count, 2,
+             "Number of threads translating functions ahead of demand. 0 "
+             "compiles only on the guest thread that first calls a function.");
+DEFINE_int32(jit_tier_up_threshold, 0,
+             "Compile functions with a minimal pass pipeline first and "
+             "recompile them fully in the background after this many calls. "
+             "0 always uses the full pipeline. Requires JIT workers.");
+DEFINE_bool(jit_pass_stats, false,
+            "Record time and HIR size changes of each compiler pass and log "
+            "them at shutdown.");
+DEFINE_string(jit_pass_stats_path, "",
+              "Also write the compiler pass stats to this file as JSON.");
+DEFINE_bool(regalloc_cross_block_registers, true,
+            "Keep values used across blocks in registers where possible "
+            "instead of always passing them through the stack.");
+
+DEFINE_bool(mmio_decode_cache, true,
+            "Remember decoded MMIO access instructions by host address instead "
+            "of disassembling them on every access.");
+
 DEFINE_bool(disassemble_functions, false,
             "Disassemble functions during generation.");
 
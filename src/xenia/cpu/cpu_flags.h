@@ -16,6 +16,14 @@ DECLARE_string(cpu);
 
 DECLARE_string(load_module_map);
 
+DECLARE_int32(jit_worker_count);
+DECLARE_int32(jit_tier_up_threshold);
+DECLARE_bool(jit_pass_stats);
+DECLARE_string(jit_pass_stats_path);
+DECLARE_bool(regalloc_cross_block_registers);
+
+DECLARE_bool(mmio_decode_cache);
+
 DECLARE_bool(disassemble_functions);
 
 DECLARE_bool(trace_functions);
@@ -15,20 +15,52 @@
 namespace xe {
 namespace cpu {
 
-EntryTable::EntryTable() = default;
+EntryTable::EntryTable() {
+  for (auto& page : pages_) {
+    page.store(nullptr, std::memory_order_relaxed);
+  }
+}
 
 EntryTable::~EntryTable() {
   std::lock_guard<xe::mutex> guard(lock_);
-  for (auto it : map_) {
-    Entry* entry = it.second;
+  for (auto entry : entries_) {
     delete entry;
   }
+  for (auto& page : pages_) {
+    delete[] page.load();
+  }
+}
+
+EntryTable::Slot* EntryTable::LookupSlot(uint32_t address, bool create) {
+  uint32_t offset = address - kFlatBaseAddress;
+  auto& page_ptr = pages_[offset >> kPageShift];
+  Slot* page = page_ptr.load(std::memory_order_acquire);
+  if (!page) {
+    if (!create) {
+      return nullptr;
+    }
+    // Race to install the page. Losers throw theirs away.
+    Slot* new_page = new Slot[kPageSlotCount]();
+    if (page_ptr.compare_exchange_strong(page, new_page,
+                                         std::memory_order_acq_rel)) {
+      page = new_page;
+    } else {
+      delete[] new_page;
+    }
+  }
+  return &page[(offset & ((1 << kPageShift) - 1)) >> 2];
 }
 
 Entry* EntryTable::Get(uint32_t address) {
-  std::lock_guard<xe::mutex> guard(lock_);
-  const auto& it = map_.find(address);
-  Entry* entry = it != map_.end() ? it->second : nullptr;
+  Entry* entry;
+  if (IsFlatAddress(address)) {
+    Slot* slot = LookupSlot(address, false);
+    entry = slot ? slot->load(std::memory_order_acquire) : nullptr;
+  } else {
+    std::lock_guard<xe::mutex> guard(lock_);
+    const auto& it = map_.find(address);
+    entry = it != map_.end() ? it->second : nullptr;
+  }
   if (entry) {
     // TODO(benvanik): wait if needed?
     if (entry->status != Entry::STATUS_READY) {
@@ -38,46 +70,75 @@ Entry* EntryTable::Get(uint32_t address) {
   return entry;
 }
 
-Entry::Status EntryTable::GetOrCreate(uint32_t address, Entry** out_entry) {
-  // TODO(benvanik): replace with a map with wait-free for find.
-  // https://github.com/facebook/folly/blob/master/folly/AtomicHashMap.h
-
-  lock_.lock();
-  const auto& it = map_.find(address);
-  Entry* entry = it != map_.end() ? it->second : nullptr;
+Entry::Status EntryTable::WaitForEntry(Entry* entry) {
+  // Most functions compile quickly, so spin for a bit before backing off to
+  // sleeping so that waiters don't burn a core on a slow compile.
+  uint32_t spin_count = 0;
   Entry::Status status;
-  if (entry) {
-    // If we aren't ready yet spin and wait.
-    if (entry->status == Entry::STATUS_COMPILING) {
-      // Still compiling, so spin.
-      do {
-        lock_.unlock();
-        // TODO(benvanik): sleep for less time?
-        xe::threading::Sleep(std::chrono::microseconds(10));
-        lock_.lock();
-      } while (entry->status == Entry::STATUS_COMPILING);
+  while ((status = entry->status) == Entry::STATUS_COMPILING) {
+    if (spin_count < kWaitSpinCount) {
+      ++spin_count;
+      xe::threading::MaybeYield();
+    } else {
+      xe::threading::Sleep(std::chrono::microseconds(10));
     }
-    status = entry->status;
+  }
+  return status;
+}
+
+Entry::Status EntryTable::GetOrCreate(uint32_t address, Entry** out_entry) {
+  Entry* entry = nullptr;
+  Slot* slot = nullptr;
+  if (IsFlatAddress(address)) {
+    slot = LookupSlot(address, true);
+    entry = slot->load(std::memory_order_acquire);
   } else {
-    // Create and return for initialization.
-    entry = new Entry();
-    entry->address = address;
-    entry->end_address = 0;
-    entry->status = Entry::STATUS_COMPILING;
-    entry->function = 0;
-    map_[address] = entry;
-    status = Entry::STATUS_NEW;
+    std::lock_guard<xe::mutex> guard(lock_);
+    const auto& it = map_.find(address);
+    if (it != map_.end()) {
+      entry = it->second;
+    } else {
+      // Create and return for initialization.
+      entry = new Entry();
+      entry->address = address;
+      entry->end_address = 0;
+      entry->status = Entry::STATUS_COMPILING;
+      entry->function = nullptr;
+      map_[address] = entry;
+      entries_.push_back(entry);
+      *out_entry = entry;
+      return Entry::STATUS_NEW;
+    }
   }
-  lock_.unlock();
+
+  if (!entry) {
+    // Try to claim the slot. Whoever wins the CAS owns compilation.
+    Entry* new_entry = new Entry();
+    new_entry->address = address;
+    new_entry->end_address = 0;
+    new_entry->status = Entry::STATUS_COMPILING;
+    new_entry->function = nullptr;
+    if (slot->compare_exchange_strong(entry, new_entry,
+                                      std::memory_order_acq_rel)) {
+      {
+        std::lock_guard<xe::mutex> guard(lock_);
+        entries_.push_back(new_entry);
+      }
+      *out_entry = new_entry;
+      return Entry::STATUS_NEW;
+    }
+    // Lost the race - entry now holds the winner.
+    delete new_entry;
+  }
+
   *out_entry = entry;
-  return status;
+  return WaitForEntry(entry);
 }
 
 std::vector<Function*> EntryTable::FindWithAddress(uint32_t address) {
   std::lock_guard<xe::mutex> guard(lock_);
   std::vector<Function*> fns;
-  for (auto& it : map_) {
-    Entry* entry = it.second;
+  for (auto entry : entries_) {
     if (address >= entry->address && address <= entry->end_address) {
       if (entry->status == Entry::STATUS_READY) {
         fns.push_back(entry->function);
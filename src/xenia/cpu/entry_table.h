@@ -10,6 +10,7 @@
 #ifndef XENIA_CPU_ENTRY_TABLE_H_
 #define XENIA_CPU_ENTRY_TABLE_H_
 
+#include <atomic>
 #include <mutex>
 #include <unordered_map>
 #include <vector>
@@ -31,10 +32,20 @@ typedef struct Entry_t {
 
   uint32_t address;
   uint32_t end_address;
-  Status status;
-  Function* function;
+  // Written by the thread that received STATUS_NEW and read by everyone else.
+  // function/end_address must be set before this transitions to READY.
+  std::atomic<Status> status;
+  // Replaced when the function is recompiled at a higher tier, while other
+  // threads may be reading it.
+  std::atomic<Function*> function;
 } Entry;
 
+// Maps guest function addresses to their compiled functions.
+// Guest code is always 4b aligned and lives in 0x80000000-0x9FFFFFFF, so those
+// addresses are stored in a two-level flat table that can be read without
+// taking any locks. Entries are installed with a CAS and the thread that wins
+// is responsible for moving them from COMPILING to READY/FAILED. Addresses
+// outside of that range (builtins, etc) fall back to a locked map.
 class EntryTable {
  public:
   EntryTable();
@@ -46,9 +57,32 @@ class EntryTable {
   std::vector<Function*> FindWithAddress(uint32_t address);
 
  private:
-  // TODO(benvanik): replace with a better data structure.
+  static const uint32_t kFlatBaseAddress = 0x80000000;
+  static const uint32_t kFlatEndAddress = 0xA0000000;
+  // Each page covers 64KB of guest code (16384 slots).
+  static const uint32_t kPageShift = 16;
+  static const uint32_t kPageSlotCount = (1 << kPageShift) >> 2;
+  static const uint32_t kPageCount =
+      (kFlatEndAddress - kFlatBaseAddress) >> kPageShift;
+  // Number of yielding spins before a waiter falls back to sleeping.
+  static const uint32_t kWaitSpinCount = 1000;
+
+  typedef std::atomic<Entry*> Slot;
+
+  static bool IsFlatAddress(uint32_t address) {
+    return address >= kFlatBaseAddress && address < kFlatEndAddress &&
+           !(address & 0x3);
+  }
+  Slot* LookupSlot(uint32_t address, bool create);
+  Entry::Status WaitForEntry(Entry* entry);
+
+  std::atomic<Slot*> pages_[kPageCount];
+
+  // Guards the fallback map and the list of all entries. Only taken when
+  // an entry is first created or for the slow queries.
   xe::mutex lock_;
   std::unordered_map<uint32_t, Entry*> map_;
+  std::vector<Entry*> entries_;
 };
 
 }  // namespace cpu
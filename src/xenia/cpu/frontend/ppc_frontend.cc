@@ -96,11 +96,11 @@ bool PPCFrontend::DeclareFunction(FunctionInfo* symbol_info) {
 }
 
 bool PPCFrontend::DefineFunction(FunctionInfo* symbol_info,
-                                 uint32_t debug_info_flags,
+                                 uint32_t debug_info_flags, CompileTier tier,
                                  Function** out_function) {
   PPCTranslator* translator = translator_pool_.Allocate(this);
   bool result =
-      translator->Translate(symbol_info, debug_info_flags, out_function);
+      translator->Translate(symbol_info, debug_info_flags, tier, out_function);
   translator_pool_.Release(translator);
   return result;
 }
@@ -53,7 +53,7 @@ class PPCFrontend {
 
   bool DeclareFunction(FunctionInfo* symbol_info);
   bool DefineFunction(FunctionInfo* symbol_info, uint32_t debug_info_flags,
-                      Function** out_function);
+                      CompileTier tier, Function** out_function);
 
  private:
   Processor* processor_;
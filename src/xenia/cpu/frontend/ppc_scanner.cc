@@ -137,8 +137,14 @@ bool PPCScanner::Scan(FunctionInfo* symbol_info, DebugInfo* debug_info) {
 
       if (i.I.LK) {
         LOGPPC("bl %.8X -> %.8X", address, target);
-        // Queue call target if needed.
-        // GetOrInsertFunction(target);
+        // Queue call target for translation, as it's likely to be demanded
+        // soon after this function runs. bl $+4 is used to get the PC and
+        // isn't a real call.
+        if (target != address + 4 &&
+            symbol_info->module()->ContainsAddress(target)) {
+          frontend_->processor()->compile_scheduler()->Enqueue(
+              target, CompilePriority::kHigh);
+        }
       } else {
         LOGPPC("b %.8X -> %.8X", address, target);
 
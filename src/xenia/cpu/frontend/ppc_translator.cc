@@ -13,6 +13,7 @@
 
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/reset_scope.h"
 #include "xenia/cpu/compiler/compiler_passes.h"
@@ -46,6 +47,7 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
   scanner_.reset(new PPCScanner(frontend));
   builder_.reset(new PPCHIRBuilder(frontend));
   compiler_.reset(new Compiler(frontend->processor()));
+  baseline_compiler_.reset(new Compiler(frontend->processor()));
   assembler_ = backend->CreateAssembler();
   assembler_->Initialize();
 
@@ -95,18 +97,33 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
 
   // Must come last. The HIR is not really HIR after this.
   compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
+
+  // Baseline code only does what is required to emit anything at all.
+  // Functions that turn out to be hot get recompiled with the above.
+  if (validate) {
+    baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  baseline_compiler_->AddPass(std::make_unique<passes::RegisterAllocationPass>(
+      backend->machine_info()));
+  if (validate) {
+    baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  baseline_compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
 }
 
 PPCTranslator::~PPCTranslator() = default;
 
 bool PPCTranslator::Translate(FunctionInfo* symbol_info,
-                              uint32_t debug_info_flags,
+                              uint32_t debug_info_flags, CompileTier tier,
                               Function** out_function) {
   SCOPE_profile_cpu_f("cpu");
 
+  auto& compiler =
+      tier == CompileTier::kBaseline ? baseline_compiler_ : compiler_;
+
   // Reset() all caching when we leave.
   xe::make_reset_scope(builder_);
-  xe::make_reset_scope(compiler_);
+  xe::make_reset_scope(compiler);
   xe::make_reset_scope(assembler_);
   xe::make_reset_scope(&string_buffer_);
 
@@ -136,6 +153,14 @@ bool PPCTranslator::Translate(FunctionInfo* symbol_info,
     debug_info.reset(new DebugInfo());
   }
 
+  // Reuse code from a previous run if we can. Debug info isn't persisted so
+  // anything requesting it must be translated from scratch.
+  uint64_t start_ticks = Clock::QueryHostTickCount();
+  if (!debug_info_flags &&
+      assembler_->LoadCachedFunction(symbol_info, out_function)) {
+    return true;
+  }
+
   // Scan the function to find its extents and gather debug data.
   if (!scanner_->Scan(symbol_info, debug_info.get())) {
     return false;
@@ -191,7 +216,7 @@ bool PPCTranslator::Translate(FunctionInfo* symbol_info,
   }
 
   // Compile/optimize/etc.
-  if (!compiler_->Compile(builder_.get())) {
+  if (!compiler->Compile(builder_.get())) {
     return false;
   }
 
@@ -204,9 +229,12 @@ bool PPCTranslator::Translate(FunctionInfo* symbol_info,
 
   // Assemble to backend machine code.
   if (!assembler_->Assemble(symbol_info, builder_.get(), debug_info_flags,
-                            std::move(debug_info), out_function)) {
+                            tier, std::move(debug_info), out_function)) {
     return false;
   }
+  uint64_t compile_micros = (Clock::QueryHostTickCount() - start_ticks) *
+                            1000000 / Clock::host_tick_frequency();
+  assembler_->StoreCachedFunction(symbol_info, *out_function, compile_micros);
 
   return true;
 };
@@ -31,7 +31,7 @@ class PPCTranslator {
   ~PPCTranslator();
 
   bool Translate(FunctionInfo* symbol_info, uint32_t debug_info_flags,
-                 Function** out_function);
+                 CompileTier tier, Function** out_function);
 
  private:
   void DumpSource(FunctionInfo* symbol_info, StringBuffer* string_buffer);
@@ -41,6 +41,8 @@ class PPCTranslator {
   std::unique_ptr<PPCScanner> scanner_;
   std::unique_ptr<PPCHIRBuilder> builder_;
   std::unique_ptr<compiler::Compiler> compiler_;
+  // Minimal pipeline for CompileTier::kBaseline.
+  std::unique_ptr<compiler::Compiler> baseline_compiler_;
   std::unique_ptr<backend::Assembler> assembler_;
 
   StringBuffer string_buffer_;
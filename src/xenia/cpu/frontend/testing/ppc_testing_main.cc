@@ -9,12 +9,14 @@
 
 #include <gflags/gflags.h>
 
+#include "xenia/base/clock.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/main.h"
 #include "xenia/base/math.h"
 #include "xenia/base/platform.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/frontend/ppc_context.h"
 #include "xenia/cpu/frontend/ppc_frontend.h"
 #include "xenia/cpu/processor.h"
@@ -28,6 +30,10 @@ DEFINE_string(test_path, "src/xenia/cpu/frontend/testing/",
               "Directory scanned for test files.");
 DEFINE_string(test_bin_path, "src/xenia/cpu/frontend/testing/bin/",
               "Directory with binary outputs of the test files.");
+DEFINE_bool(benchmark_register_allocation, false,
+            "Run the tests twice, first passing every value used across "
+            "blocks through the stack and then keeping them in registers, and "
+            "compare register allocation time and spill counts.");
 
 namespace xe {
 namespace cpu {
@@ -332,6 +338,40 @@ class TestRunner {
   std::unique_ptr<ThreadState> thread_state;
 };
 
+// Register allocator cost summed over all tests, for
+// --benchmark_register_allocation.
+struct AllocationStats {
+  uint64_t function_count = 0;
+  uint64_t host_ticks = 0;
+  uint64_t spill_count = 0;
+
+  double micros_per_function() const {
+    if (!function_count) {
+      return 0;
+    }
+    return host_ticks / static_cast<double>(Clock::host_tick_frequency()) *
+           1000000 / function_count;
+  }
+};
+
+void AccumulateAllocationStats(Processor* processor, AllocationStats* stats) {
+  auto compiler_stats = processor->compiler_stats();
+  if (!compiler_stats) {
+    return;
+  }
+  auto pass = compiler_stats->LookupPass("RegisterAllocation");
+  stats->function_count += pass->invocation_count;
+  stats->host_ticks += pass->host_ticks;
+  // The allocator only ever adds spill loads and stores.
+  stats->spill_count += pass->instrs_after - pass->instrs_before;
+}
+
+void LogAllocationStats(const char* name, const AllocationStats& stats) {
+  XELOGI("%s: %llu functions, %.2fus/function, %llu spill loads/stores", name,
+         stats.function_count, stats.micros_per_function(),
+         stats.spill_count);
+}
+
 bool DiscoverTests(std::wstring& test_path,
                    std::vector<std::wstring>& test_files) {
   auto file_infos = xe::filesystem::ListFiles(test_path);
@@ -414,17 +454,45 @@ bool RunTests(const std::wstring& test_name) {
     return false;
   }
 
-  for (auto& test_suite : test_suites) {
-    XELOGI("%ls.s:", test_suite.name.c_str());
+  auto run_all = [&](AllocationStats* allocation_stats) {
+    for (auto& test_suite : test_suites) {
+      XELOGI("%ls.s:", test_suite.name.c_str());
+
+      for (auto& test_case : test_suite.test_cases) {
+        XELOGI("  - %s", test_case.name.c_str());
+        TestRunner runner;
+        ProtectedRunTest(test_suite, runner, test_case, failed_count,
+                         passed_count);
+        if (allocation_stats) {
+          AccumulateAllocationStats(runner.processor.get(), allocation_stats);
+        }
+      }
 
-    for (auto& test_case : test_suite.test_cases) {
-      XELOGI("  - %s", test_case.name.c_str());
-      TestRunner runner;
-      ProtectedRunTest(test_suite, runner, test_case, failed_count,
-                       passed_count);
+      XELOGI("");
     }
+  };
+
+  if (FLAGS_benchmark_register_allocation) {
+    // Every test case gets its own processor, so each run compiles
+    // everything again.
+    FLAGS_jit_pass_stats = true;
+    AllocationStats stack_stats;
+    FLAGS_regalloc_cross_block_registers = false;
+    run_all(&stack_stats);
+    AllocationStats register_stats;
+    FLAGS_regalloc_cross_block_registers = true;
+    run_all(&register_stats);
 
     XELOGI("");
+    LogAllocationStats("Cross-block values on the stack", stack_stats);
+    LogAllocationStats("Cross-block values in registers", register_stats);
+    if (stack_stats.spill_count) {
+      double ratio = static_cast<double>(register_stats.spill_count) /
+                     stack_stats.spill_count;
+      XELOGI("Spill loads/stores: %+.1f%%", (ratio - 1) * 100);
+    }
+  } else {
+    run_all(nullptr);
   }
 
   XELOGI("");
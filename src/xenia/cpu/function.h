@@ -24,6 +24,14 @@ namespace cpu {
 
 class FunctionInfo;
 
+enum class CompileTier {
+  // Minimal optimization. Counts entries so that hot functions can be
+  // recompiled at a higher tier.
+  kBaseline,
+  // The full optimization pipeline.
+  kOptimized,
+};
+
 struct SourceMapEntry {
   uint32_t source_offset;  // Original source address/offset.
   uint32_t hir_offset;     // Block ordinal (16b) | Instr ordinal (16b)
@@ -37,6 +45,8 @@ class Function {
 
   uint32_t address() const { return address_; }
   FunctionInfo* symbol_info() const { return symbol_info_; }
+  CompileTier tier() const { return tier_; }
+  void set_tier(CompileTier tier) { tier_ = tier; }
 
   virtual uint8_t* machine_code() const = 0;
   virtual size_t machine_code_length() const = 0;
@@ -65,6 +75,7 @@ class Function {
  protected:
   uint32_t address_;
   FunctionInfo* symbol_info_;
+  CompileTier tier_ = CompileTier::kOptimized;
   std::unique_ptr<DebugInfo> debug_info_;
   std::vector<SourceMapEntry> source_map_;
 
@@ -9,10 +9,13 @@
 
 #include "xenia/cpu/mmio_handler.h"
 
+#include <algorithm>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
+#include "xenia/cpu/cpu_flags.h"
 
 namespace BE {
 #include <beaengine/BeaEngine.h>
@@ -97,74 +100,115 @@ uintptr_t MMIOHandler::AddPhysicalWriteWatch(uint32_t guest_address,
                                              WriteWatchCallback callback,
                                              void* callback_context,
                                              void* callback_data) {
-  uint32_t base_address = guest_address;
-  assert_true(base_address < 0x1FFFFFFF);
+  assert_true(guest_address < 0x1FFFFFFF);
+  assert_true(xe::memory::page_size() == 1 << kWatchPageShift);
 
-  // Can only protect sizes matching system page size.
-  // This means we need to round up, which will cause spurious access
+  // Can only protect whole pages, which will cause spurious access
   // violations and invalidations.
   // TODO(benvanik): only invalidate if actually within the region?
-  length = xe::round_up(length + (base_address % xe::memory::page_size()),
-                        xe::memory::page_size());
-  base_address = base_address - (base_address % xe::memory::page_size());
-
-  // Add to table. The slot reservation may evict a previous watch, which
-  // could include our target, so we do it first.
-  auto entry = new WriteWatchEntry();
-  entry->address = base_address;
-  entry->length = uint32_t(length);
-  entry->callback = callback;
-  entry->callback_context = callback_context;
-  entry->callback_data = callback_data;
-  write_watch_mutex_.lock();
-  write_watches_.push_back(entry);
-  write_watch_mutex_.unlock();
+  WriteWatchEntry entry;
+  entry.first_page = guest_address >> kWatchPageShift;
+  size_t end_address = std::min(guest_address + std::max(length, size_t(1)),
+                                size_t(0x20000000));
+  uint32_t end_page = uint32_t(
+      xe::round_up(end_address, size_t(1) << kWatchPageShift) >>
+      kWatchPageShift);
+  entry.page_count = end_page - entry.first_page;
+  entry.generation = 0;
+  entry.callback = callback;
+  entry.callback_context = callback_context;
+  entry.callback_data = callback_data;
+
+  std::lock_guard<xe::mutex> lock(write_watch_mutex_);
+  uint32_t index;
+  if (!free_write_watches_.empty()) {
+    index = free_write_watches_.back();
+    free_write_watches_.pop_back();
+    entry.generation = write_watches_[index].generation;
+    write_watches_[index] = entry;
+  } else {
+    index = uint32_t(write_watches_.size());
+    write_watches_.push_back(entry);
+  }
 
-  // Make the desired range read only under all address spaces.
-  xe::memory::Protect(physical_membase_ + entry->address, entry->length,
-                      xe::memory::PageAccess::kReadOnly, nullptr);
-  xe::memory::Protect(virtual_membase_ + 0xA0000000 + entry->address,
-                      entry->length, xe::memory::PageAccess::kReadOnly,
-                      nullptr);
-  xe::memory::Protect(virtual_membase_ + 0xC0000000 + entry->address,
-                      entry->length, xe::memory::PageAccess::kReadOnly,
-                      nullptr);
-  xe::memory::Protect(virtual_membase_ + 0xE0000000 + entry->address,
-                      entry->length, xe::memory::PageAccess::kReadOnly,
-                      nullptr);
-
-  return reinterpret_cast<uintptr_t>(entry);
-}
+  // Only pages that weren't watched yet need protecting.
+  std::vector<uint32_t> new_pages;
+  for (uint32_t page = entry.first_page;
+       page < entry.first_page + entry.page_count; ++page) {
+    auto& watches = page_watches_[page];
+    if (watches.empty()) {
+      watched_pages_[page / 64] |= 1ull << (page % 64);
+      new_pages.push_back(page);
+    }
+    watches.push_back(index);
+  }
+  ProtectPhysicalPages(&new_pages, xe::memory::PageAccess::kReadOnly);
 
-void MMIOHandler::ClearWriteWatch(WriteWatchEntry* entry) {
-  xe::memory::Protect(physical_membase_ + entry->address, entry->length,
-                      xe::memory::PageAccess::kReadWrite, nullptr);
-  xe::memory::Protect(virtual_membase_ + 0xA0000000 + entry->address,
-                      entry->length, xe::memory::PageAccess::kReadWrite,
-                      nullptr);
-  xe::memory::Protect(virtual_membase_ + 0xC0000000 + entry->address,
-                      entry->length, xe::memory::PageAccess::kReadWrite,
-                      nullptr);
-  xe::memory::Protect(virtual_membase_ + 0xE0000000 + entry->address,
-                      entry->length, xe::memory::PageAccess::kReadWrite,
-                      nullptr);
+  return uintptr_t(entry.generation) << 32 | (uintptr_t(index) + 1);
 }
 
-void MMIOHandler::CancelWriteWatch(uintptr_t watch_handle) {
-  auto entry = reinterpret_cast<WriteWatchEntry*>(watch_handle);
+void MMIOHandler::RemoveWriteWatch(uint32_t index,
+                                   std::vector<uint32_t>* unwatched_pages) {
+  auto& entry = write_watches_[index];
+  for (uint32_t page = entry.first_page;
+       page < entry.first_page + entry.page_count; ++page) {
+    auto it = page_watches_.find(page);
+    assert_true(it != page_watches_.end());
+    auto& watches = it->second;
+    auto watch_it = std::find(watches.begin(), watches.end(), index);
+    assert_true(watch_it != watches.end());
+    *watch_it = watches.back();
+    watches.pop_back();
+    if (watches.empty()) {
+      page_watches_.erase(it);
+      watched_pages_[page / 64] &= ~(1ull << (page % 64));
+      unwatched_pages->push_back(page);
+    }
+  }
+  entry.callback = nullptr;
+  ++entry.generation;
+  free_write_watches_.push_back(index);
+}
 
-  // Allow access to the range again.
-  ClearWriteWatch(entry);
+void MMIOHandler::ProtectPhysicalPages(std::vector<uint32_t>* pages,
+                                       xe::memory::PageAccess access) {
+  std::sort(pages->begin(), pages->end());
+  for (size_t i = 0; i < pages->size();) {
+    // Extend the run while pages are adjacent.
+    size_t run_end = i + 1;
+    while (run_end < pages->size() &&
+           (*pages)[run_end] == (*pages)[run_end - 1] + 1) {
+      ++run_end;
+    }
+    uint32_t address = (*pages)[i] << kWatchPageShift;
+    size_t length = (run_end - i) << kWatchPageShift;
+    xe::memory::Protect(physical_membase_ + address, length, access, nullptr);
+    xe::memory::Protect(virtual_membase_ + 0xA0000000 + address, length,
+                        access, nullptr);
+    xe::memory::Protect(virtual_membase_ + 0xC0000000 + address, length,
+                        access, nullptr);
+    xe::memory::Protect(virtual_membase_ + 0xE0000000 + address, length,
+                        access, nullptr);
+    i = run_end;
+  }
+}
 
-  // Remove from table.
-  write_watch_mutex_.lock();
-  auto it = std::find(write_watches_.begin(), write_watches_.end(), entry);
-  if (it != write_watches_.end()) {
-    write_watches_.erase(it);
+void MMIOHandler::CancelWriteWatch(uintptr_t watch_handle) {
+  uint32_t index = uint32_t(watch_handle) - 1;
+  uint32_t generation = uint32_t(uint64_t(watch_handle) >> 32);
+
+  std::lock_guard<xe::mutex> lock(write_watch_mutex_);
+  assert_true(index < write_watches_.size());
+  auto& entry = write_watches_[index];
+  if (!entry.callback || entry.generation != generation) {
+    // Already fired or canceled.
+    return;
   }
-  write_watch_mutex_.unlock();
 
-  delete entry;
+  // Allow access to pages no other watch needs.
+  std::vector<uint32_t> unwatched_pages;
+  RemoveWriteWatch(index, &unwatched_pages);
+  ProtectPhysicalPages(&unwatched_pages, xe::memory::PageAccess::kReadWrite);
 }
 
 bool MMIOHandler::CheckWriteWatch(void* thread_state, uint64_t fault_address) {
@@ -172,67 +216,59 @@ bool MMIOHandler::CheckWriteWatch(void* thread_state, uint64_t fault_address) {
   if (physical_address > 0x1FFFFFFF) {
     physical_address &= 0x1FFFFFFF;
   }
-  std::list<WriteWatchEntry*> pending_invalidates;
+  uint32_t page = physical_address >> kWatchPageShift;
+
+  std::vector<WriteWatchEntry> pending_invalidates;
   write_watch_mutex_.lock();
-  for (auto it = write_watches_.begin(); it != write_watches_.end();) {
-    auto entry = *it;
-    if (entry->address <= physical_address &&
-        entry->address + entry->length > physical_address) {
-      // Hit!
-      pending_invalidates.push_back(entry);
-      // TODO(benvanik): outside of lock?
-      ClearWriteWatch(entry);
-      auto erase_it = it;
-      ++it;
-      write_watches_.erase(erase_it);
-      continue;
-    }
-    ++it;
-  }
-  write_watch_mutex_.unlock();
-  if (pending_invalidates.empty()) {
+  if (!(watched_pages_[page / 64] & (1ull << (page % 64)))) {
+    write_watch_mutex_.unlock();
     // Rethrow access violation - range was not being watched.
     return false;
   }
-  while (!pending_invalidates.empty()) {
-    auto entry = pending_invalidates.back();
-    pending_invalidates.pop_back();
-    entry->callback(entry->callback_context, entry->callback_data,
-                    physical_address);
-    delete entry;
+  // Fire every watch on the page and unprotect whatever they leave unwatched
+  // in one go. The faulting page always ends up unwatched.
+  auto hits = page_watches_[page];
+  std::vector<uint32_t> unwatched_pages;
+  for (uint32_t index : hits) {
+    pending_invalidates.push_back(write_watches_[index]);
+    RemoveWriteWatch(index, &unwatched_pages);
+  }
+  ProtectPhysicalPages(&unwatched_pages, xe::memory::PageAccess::kReadWrite);
+  write_watch_mutex_.unlock();
+
+  for (auto& entry : pending_invalidates) {
+    entry.callback(entry.callback_context, entry.callback_data,
+                   physical_address);
   }
   // Range was watched, so lets eat this access violation.
   return true;
 }
 
-bool MMIOHandler::HandleAccessFault(void* thread_state,
-                                    uint64_t fault_address) {
-  if (fault_address < uint64_t(virtual_membase_)) {
-    // Quick kill anything below our mapping base.
-    return false;
+bool MMIOHandler::LookupDecodedMov(uint64_t rip, DecodedMov* out_mov) {
+  if (!FLAGS_mmio_decode_cache) {
+    return DecodeMov(rip, out_mov);
   }
-
-  // Access violations are pretty rare, so we can do a linear search here.
-  // Only check if in the virtual range, as we only support virtual ranges.
-  const MMIORange* range = nullptr;
-  if (fault_address < uint64_t(physical_membase_)) {
-    for (const auto& test_range : mapped_ranges_) {
-      if ((uint32_t(fault_address) & test_range.mask) == test_range.address) {
-        // Address is within the range of this mapping.
-        range = &test_range;
-        break;
-      }
+  {
+    std::lock_guard<xe::mutex> lock(decoded_movs_mutex_);
+    auto it = decoded_movs_.find(rip);
+    if (it != decoded_movs_.end()) {
+      *out_mov = it->second;
+      return true;
     }
   }
-  if (!range) {
-    // Access is not found within any range, so fail and let the caller handle
-    // it (likely by aborting).
-    return CheckWriteWatch(thread_state, fault_address);
+  // Decode outside of the lock. If two threads race here they both produce
+  // the same result.
+  if (!DecodeMov(rip, out_mov)) {
+    return false;
   }
+  std::lock_guard<xe::mutex> lock(decoded_movs_mutex_);
+  decoded_movs_.insert({rip, *out_mov});
+  return true;
+}
 
+bool MMIOHandler::DecodeMov(uint64_t rip, DecodedMov* out_mov) {
   // TODO(benvanik): replace with simple check of mov (that's all
   //     we care about).
-  auto rip = GetThreadStateRip(thread_state);
   BE::DISASM disasm = {0};
   disasm.Archi = 64;
   disasm.Options = BE::MasmSyntax + BE::PrefixedNumeral;
@@ -255,17 +291,73 @@ bool MMIOHandler::HandleAccessFault(void* thread_state,
                     (arg2_type & BE::GENERAL_REG) == BE::GENERAL_REG) ||
                    (arg2_type & BE::CONSTANT_TYPE) == BE::CONSTANT_TYPE) &&
                   (disasm.Argument1.AccessMode & BE::WRITE) == BE::WRITE;
+  out_mov->length = instr_length;
+  out_mov->is_load = is_load;
+  out_mov->value_reg = -1;
+  out_mov->immediate = 0;
   if (is_load) {
-    // Load of a memory value - read from range, swap, and store in the
-    // register.
-    uint64_t value = range->read(nullptr, range->callback_context,
-                                 fault_address & 0xFFFFFFFF);
     uint32_t be_reg_index;
     if (!xe::bit_scan_forward(arg1_type & 0xFFFF, &be_reg_index)) {
       be_reg_index = 0;
     }
-    uint64_t* reg_ptr = GetThreadStateRegPtr(thread_state, be_reg_index);
-    switch (disasm.Argument1.ArgSize) {
+    out_mov->bit_size = disasm.Argument1.ArgSize;
+    out_mov->value_reg = int32_t(be_reg_index);
+  } else if (is_store) {
+    if ((arg2_type & BE::REGISTER_TYPE) == BE::REGISTER_TYPE) {
+      uint32_t be_reg_index;
+      if (!xe::bit_scan_forward(arg2_type & 0xFFFF, &be_reg_index)) {
+        be_reg_index = 0;
+      }
+      out_mov->value_reg = int32_t(be_reg_index);
+    } else {
+      out_mov->immediate = disasm.Instruction.Immediat;
+    }
+    out_mov->bit_size = disasm.Argument2.ArgSize;
+  } else {
+    assert_always("Unknown MMIO instruction type");
+    return false;
+  }
+  return true;
+}
+
+bool MMIOHandler::HandleAccessFault(void* thread_state,
+                                    uint64_t fault_address) {
+  if (fault_address < uint64_t(virtual_membase_)) {
+    // Quick kill anything below our mapping base.
+    return false;
+  }
+
+  // Access violations are pretty rare, so we can do a linear search here.
+  // Only check if in the virtual range, as we only support virtual ranges.
+  const MMIORange* range = nullptr;
+  if (fault_address < uint64_t(physical_membase_)) {
+    for (const auto& test_range : mapped_ranges_) {
+      if ((uint32_t(fault_address) & test_range.mask) == test_range.address) {
+        // Address is within the range of this mapping.
+        range = &test_range;
+        break;
+      }
+    }
+  }
+  if (!range) {
+    // Access is not found within any range, so fail and let the caller handle
+    // it (likely by aborting).
+    return CheckWriteWatch(thread_state, fault_address);
+  }
+
+  auto rip = GetThreadStateRip(thread_state);
+  DecodedMov mov;
+  if (!LookupDecodedMov(rip, &mov)) {
+    return false;
+  }
+
+  if (mov.is_load) {
+    // Load of a memory value - read from range, swap, and store in the
+    // register.
+    uint64_t value = range->read(nullptr, range->callback_context,
+                                 fault_address & 0xFFFFFFFF);
+    uint64_t* reg_ptr = GetThreadStateRegPtr(thread_state, mov.value_reg);
+    switch (mov.bit_size) {
       case 8:
         *reg_ptr = static_cast<uint8_t>(value);
         break;
@@ -279,23 +371,15 @@ bool MMIOHandler::HandleAccessFault(void* thread_state,
         *reg_ptr = xe::byte_swap(static_cast<uint64_t>(value));
         break;
     }
-  } else if (is_store) {
+  } else {
     // Store of a register value - read register, swap, write to range.
-    uint64_t value = 0;
-    if ((arg2_type & BE::REGISTER_TYPE) == BE::REGISTER_TYPE) {
-      uint32_t be_reg_index;
-      if (!xe::bit_scan_forward(arg2_type & 0xFFFF, &be_reg_index)) {
-        be_reg_index = 0;
-      }
-      uint64_t* reg_ptr = GetThreadStateRegPtr(thread_state, be_reg_index);
-      value = *reg_ptr;
-    } else if ((arg2_type & BE::CONSTANT_TYPE) == BE::CONSTANT_TYPE) {
-      value = disasm.Instruction.Immediat;
+    uint64_t value;
+    if (mov.value_reg >= 0) {
+      value = *GetThreadStateRegPtr(thread_state, mov.value_reg);
     } else {
-      // Unknown destination type in mov.
-      assert_always();
+      value = mov.immediate;
     }
-    switch (disasm.Argument2.ArgSize) {
+    switch (mov.bit_size) {
       case 8:
         value = static_cast<uint8_t>(value);
         break;
@@ -311,13 +395,10 @@ bool MMIOHandler::HandleAccessFault(void* thread_state,
     }
     range->write(nullptr, range->callback_context, fault_address & 0xFFFFFFFF,
                  value);
-  } else {
-    assert_always("Unknown MMIO instruction type");
-    return false;
   }
 
   // Advance RIP to the next instruction so that we resume properly.
-  SetThreadStateRip(thread_state, rip + instr_length);
+  SetThreadStateRip(thread_state, rip + mov.length);
 
   return true;
 }
@@ -10,11 +10,12 @@
 #ifndef XENIA_CPU_MMIO_HANDLER_H_
 #define XENIA_CPU_MMIO_HANDLER_H_
 
-#include <list>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
 #include <vector>
 
+#include "xenia/base/memory.h"
 #include "xenia/base/mutex.h"
 
 namespace xe {
@@ -54,31 +55,70 @@ class MMIOHandler {
   bool CheckLoad(uint32_t virtual_address, uint64_t* out_value);
   bool CheckStore(uint32_t virtual_address, uint64_t value);
 
+  // Watches the pages covering the given physical range for writes through
+  // any of the physical views. The first write calls the callback (from the
+  // faulting thread) and removes the watch. Every watch on the faulting page
+  // fires at once.
   uintptr_t AddPhysicalWriteWatch(uint32_t guest_address, size_t length,
                                   WriteWatchCallback callback,
                                   void* callback_context, void* callback_data);
+  // Removes a watch that hasn't fired yet. Handles of watches that fired or
+  // were canceled are ignored, even once their slot holds another watch.
   void CancelWriteWatch(uintptr_t watch_handle);
 
  public:
   bool HandleAccessFault(void* thread_state, uint64_t fault_address);
 
  protected:
+  // Write watches work on 4KiB pages of the 512MiB physical space.
+  static const uint32_t kWatchPageShift = 12;
+  static const uint32_t kWatchPageCount = 0x20000000 >> kWatchPageShift;
+
   struct WriteWatchEntry {
-    uint32_t address;
-    uint32_t length;
+    uint32_t first_page;
+    uint32_t page_count;
+    // Bumped each time the slot is freed, so that stale handles can be told
+    // apart from the watch reusing it.
+    uint32_t generation;
+    // nullptr when the slot is free.
     WriteWatchCallback callback;
     void* callback_context;
     void* callback_data;
   };
 
+  // A faulting mov, decoded once per host instruction address. JIT code is
+  // never freed, so an address always holds the same instruction.
+  struct DecodedMov {
+    // Instruction length in bytes, to skip past it when done.
+    size_t length;
+    // Loads go from the range into value_reg; stores go from value_reg (or
+    // the immediate) to the range.
+    bool is_load;
+    // Access size in bits.
+    uint32_t bit_size;
+    // BeaEngine register index of the value, or -1 for an immediate store.
+    int32_t value_reg;
+    uint64_t immediate;
+  };
+
   MMIOHandler(uint8_t* virtual_membase, uint8_t* physical_membase)
       : virtual_membase_(virtual_membase),
-        physical_membase_(physical_membase) {}
+        physical_membase_(physical_membase),
+        watched_pages_(kWatchPageCount / 64) {}
 
   virtual bool Initialize() = 0;
 
-  void ClearWriteWatch(WriteWatchEntry* entry);
+  // Removes a watch from its pages, appending pages left with no watches to
+  // unwatched_pages. Requires write_watch_mutex_.
+  void RemoveWriteWatch(uint32_t index, std::vector<uint32_t>* unwatched_pages);
+  // Protects the given pages in all physical views, one call per view for
+  // each run of adjacent pages.
+  void ProtectPhysicalPages(std::vector<uint32_t>* pages,
+                            xe::memory::PageAccess access);
   bool CheckWriteWatch(void* thread_state, uint64_t fault_address);
+  // Decodes the mov at rip, from the cache if it has been seen before.
+  bool LookupDecodedMov(uint64_t rip, DecodedMov* out_mov);
+  static bool DecodeMov(uint64_t rip, DecodedMov* out_mov);
 
   virtual uint64_t GetThreadStateRip(void* thread_state_ptr) = 0;
   virtual void SetThreadStateRip(void* thread_state_ptr, uint64_t rip) = 0;
@@ -90,9 +130,20 @@ class MMIOHandler {
 
   std::vector<MMIORange> mapped_ranges_;
 
-  // TODO(benvanik): data structure magic.
+  xe::mutex decoded_movs_mutex_;
+  std::unordered_map<uint64_t, DecodedMov> decoded_movs_;
+
   xe::mutex write_watch_mutex_;
-  std::list<WriteWatchEntry*> write_watches_;
+  // Watches by index. Handles hold the index + 1 in the low 32 bits and the
+  // slot generation in the high 32 bits. Free slots are reused.
+  std::vector<WriteWatchEntry> write_watches_;
+  std::vector<uint32_t> free_write_watches_;
+  // One bit per physical page with at least one watch, so faults on unwatched
+  // pages are rejected without a lookup.
+  std::vector<uint64_t> watched_pages_;
+  // Watches on each watched page. The list size is the page's reference
+  // count; the page is protected while it is nonzero.
+  std::unordered_map<uint32_t, std::vector<uint32_t>> page_watches_;
 
   static MMIOHandler* global_handler_;
 };
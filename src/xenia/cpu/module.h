@@ -34,6 +34,8 @@ class Module {
   Memory* memory() const { return memory_; }
 
   virtual const std::string& name() const = 0;
+  // Hash identifying the module contents across runs, or 0 if unknown.
+  virtual uint64_t content_hash() const { return 0; }
 
   virtual bool ContainsAddress(uint32_t address);
 
@@ -9,6 +9,7 @@ project("xenia-cpu")
   links({
     "beaengine",
     "xenia-base",
+    "xxhash",
   })
   defines({
     "BEA_ENGINE_STATIC=1",
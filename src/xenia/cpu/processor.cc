@@ -9,11 +9,14 @@
 
 #include "xenia/cpu/processor.h"
 
+#include <algorithm>
+
 #include <gflags/gflags.h>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/atomic.h"
 #include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/memory.h"
 #include "xenia/cpu/cpu_flags.h"
@@ -51,6 +54,15 @@ Processor::Processor(xe::Memory* memory, ExportResolver* export_resolver,
     : memory_(memory), debugger_(debugger), export_resolver_(export_resolver) {}
 
 Processor::~Processor() {
+  if (compile_scheduler_) {
+    compile_scheduler_->Shutdown();
+    compile_scheduler_->DumpStats();
+    compile_scheduler_.reset();
+  }
+  if (compiler_stats_) {
+    compiler_stats_->Dump();
+  }
+
   {
     std::lock_guard<xe::mutex> guard(modules_lock_);
     modules_.clear();
@@ -64,6 +76,11 @@ bool Processor::Setup() {
   // TODO(benvanik): query mode from debugger?
   debug_info_flags_ = 0;
 
+  // Must exist before any compiler is created so that passes are tracked.
+  if (FLAGS_jit_pass_stats) {
+    compiler_stats_ = std::make_unique<compiler::CompilerStats>();
+  }
+
   auto frontend = std::make_unique<xe::cpu::frontend::PPCFrontend>(this);
   // TODO(benvanik): set options/etc.
 
@@ -114,12 +131,29 @@ bool Processor::Setup() {
     return false;
   }
 
+  // Background compilation of functions ahead of demand. Guest threads still
+  // compile synchronously if they get to a function first.
+  compile_scheduler_ = std::make_unique<CompileScheduler>(this);
+  if (!compile_scheduler_->Setup(std::max(FLAGS_jit_worker_count, 0))) {
+    XELOGE("Unable to setup JIT compile scheduler");
+    return false;
+  }
+
   return true;
 }
 
 bool Processor::AddModule(std::unique_ptr<Module> module) {
-  std::lock_guard<xe::mutex> guard(modules_lock_);
-  modules_.push_back(std::move(module));
+  Module* module_ptr = module.get();
+  {
+    std::lock_guard<xe::mutex> guard(modules_lock_);
+    modules_.push_back(std::move(module));
+  }
+
+  // Start translating everything the module declared at load (imports,
+  // save/restore helpers, etc) now that lookups can find it.
+  if (compile_scheduler_) {
+    compile_scheduler_->EnqueueModule(module_ptr);
+  }
   return true;
 }
 
@@ -171,24 +205,40 @@ std::vector<Function*> Processor::FindFunctionsWithAddress(uint32_t address) {
 }
 
 bool Processor::ResolveFunction(uint32_t address, Function** out_function) {
+  return ResolveEntry(address, false, out_function);
+}
+
+bool Processor::ResolveEntry(uint32_t address, bool background,
+                             Function** out_function) {
   *out_function = nullptr;
   Entry* entry;
   Entry::Status status = entry_table_.GetOrCreate(address, &entry);
   if (status == Entry::STATUS_NEW) {
     // Needs to be generated. We have the 'lock' on it and must do so now.
+    uint64_t start_ticks = Clock::QueryHostTickCount();
 
     // Grab symbol declaration.
     FunctionInfo* symbol_info;
     if (!LookupFunctionInfo(address, &symbol_info)) {
+      // Release anyone waiting on us.
+      entry->status = Entry::STATUS_FAILED;
       return false;
     }
 
-    if (!DemandFunction(symbol_info, &entry->function)) {
+    Function* function;
+    if (!DemandFunction(symbol_info, &function)) {
       entry->status = Entry::STATUS_FAILED;
       return false;
     }
+    entry->function = function;
     entry->end_address = symbol_info->end_address();
     status = entry->status = Entry::STATUS_READY;
+
+    if (compile_scheduler_) {
+      compile_scheduler_->RecordCompile(
+          background, entry->function.load()->tier(),
+          Clock::QueryHostTickCount() - start_ticks);
+    }
   }
   if (status == Entry::STATUS_READY) {
     // Ready to use.
@@ -256,8 +306,15 @@ bool Processor::DemandFunction(FunctionInfo* symbol_info,
   SymbolStatus symbol_status = module->DefineFunction(symbol_info);
   if (symbol_status == SymbolStatus::kNew) {
     // Symbol is undefined, so define now.
+    // Start out with cheap code if something will be around to replace it.
+    CompileTier tier = CompileTier::kOptimized;
+    if (FLAGS_jit_tier_up_threshold > 0 && !debug_info_flags_ &&
+        compile_scheduler_ && compile_scheduler_->worker_count()) {
+      tier = CompileTier::kBaseline;
+    }
     Function* function = nullptr;
-    if (!frontend_->DefineFunction(symbol_info, debug_info_flags_, &function)) {
+    if (!frontend_->DefineFunction(symbol_info, debug_info_flags_, tier,
+                                   &function)) {
       symbol_info->set_status(SymbolStatus::kFailed);
       return false;
     }
@@ -282,6 +339,32 @@ bool Processor::DemandFunction(FunctionInfo* symbol_info,
   return true;
 }
 
+bool Processor::RecompileFunction(uint32_t address) {
+  Entry* entry = entry_table_.Get(address);
+  if (!entry || entry->status != Entry::STATUS_READY ||
+      entry->function.load()->tier() != CompileTier::kBaseline) {
+    return false;
+  }
+  FunctionInfo* symbol_info = entry->function.load()->symbol_info();
+
+  Function* function = nullptr;
+  if (!frontend_->DefineFunction(symbol_info, debug_info_flags_,
+                                 CompileTier::kOptimized, &function)) {
+    XELOGE("Unable to recompile function %.8X", address);
+    return false;
+  }
+  // Placing the new code already redirected the indirection table and any
+  // patched call sites. Threads still running the old code finish there, so
+  // it is never released.
+  symbol_info->set_function(function);
+  entry->function.store(function, std::memory_order_release);
+
+  if (debugger_) {
+    debugger_->OnFunctionDefined(symbol_info, function);
+  }
+  return true;
+}
+
 bool Processor::Execute(ThreadState* thread_state, uint32_t address) {
   SCOPE_profile_cpu_f("cpu");
 
@@ -16,6 +16,8 @@
 
 #include "xenia/base/mutex.h"
 #include "xenia/cpu/backend/backend.h"
+#include "xenia/cpu/compile_scheduler.h"
+#include "xenia/cpu/compiler/compiler_stats.h"
 #include "xenia/cpu/entry_table.h"
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/frontend/ppc_frontend.h"
@@ -56,6 +58,13 @@ class Processor {
   frontend::PPCFrontend* frontend() const { return frontend_.get(); }
   backend::Backend* backend() const { return backend_.get(); }
   ExportResolver* export_resolver() const { return export_resolver_; }
+  CompileScheduler* compile_scheduler() const {
+    return compile_scheduler_.get();
+  }
+  // Only set with --jit_pass_stats.
+  compiler::CompilerStats* compiler_stats() const {
+    return compiler_stats_.get();
+  }
 
   bool Setup();
 
@@ -89,7 +98,13 @@ class Processor {
   void LowerIrql(Irql old_value);
 
  private:
+  friend class CompileScheduler;
+
+  bool ResolveEntry(uint32_t address, bool background, Function** out_function);
   bool DemandFunction(FunctionInfo* symbol_info, Function** out_function);
+  // Retranslates a baseline function with the full pass pipeline and swaps
+  // it in. Called on JIT workers once the function has tiered up.
+  bool RecompileFunction(uint32_t address);
 
   Memory* memory_ = nullptr;
   debug::Debugger* debugger_ = nullptr;
@@ -99,6 +114,8 @@ class Processor {
 
   std::unique_ptr<frontend::PPCFrontend> frontend_;
   std::unique_ptr<backend::Backend> backend_;
+  std::unique_ptr<CompileScheduler> compile_scheduler_;
+  std::unique_ptr<compiler::CompilerStats> compiler_stats_;
   ExportResolver* export_resolver_ = nullptr;
 
   EntryTable entry_table_;
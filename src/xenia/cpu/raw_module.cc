@@ -9,6 +9,8 @@
 
 #include "xenia/cpu/raw_module.h"
 
+#include <cstring>
+
 #include "xenia/base/filesystem.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/string.h"
@@ -56,6 +58,22 @@ bool RawModule::LoadFile(uint32_t base_address, const std::wstring& path) {
   return true;
 }
 
+bool RawModule::LoadData(uint32_t base_address, const void* data,
+                         size_t length, const std::string& name) {
+  base_address_ = base_address;
+  memory_->LookupHeap(base_address_)
+      ->AllocFixed(base_address_, static_cast<uint32_t>(length), 0,
+                   kMemoryAllocationReserve | kMemoryAllocationCommit,
+                   kMemoryProtectRead | kMemoryProtectWrite);
+  std::memcpy(memory_->TranslateVirtual(base_address_), data, length);
+
+  name_ = name;
+
+  low_address_ = base_address;
+  high_address_ = base_address + static_cast<uint32_t>(length);
+  return true;
+}
+
 bool RawModule::ContainsAddress(uint32_t address) {
   return address >= low_address_ && address < high_address_;
 }
@@ -23,6 +23,9 @@ class RawModule : public Module {
   ~RawModule() override;
 
   bool LoadFile(uint32_t base_address, const std::wstring& path);
+  // Loads a copy of the given (big-endian) code.
+  bool LoadData(uint32_t base_address, const void* data, size_t length,
+                const std::string& name);
 
   const std::string& name() const override { return name_; }
 
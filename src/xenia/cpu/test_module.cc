@@ -89,7 +89,8 @@ SymbolStatus TestModule::DeclareFunction(uint32_t address,
     compiler_->Compile(builder_.get());
 
     Function* fn = nullptr;
-    assembler_->Assemble(symbol_info, builder_.get(), 0, nullptr, &fn);
+    assembler_->Assemble(symbol_info, builder_.get(), 0,
+                         CompileTier::kOptimized, nullptr, &fn);
 
     symbol_info->set_function(fn);
     status = SymbolStatus::kDefined;
@@ -0,0 +1,236 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+#include <chrono>
+#include <cstdio>
+
+#include "xenia/base/threading.h"
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
+
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::backend::x64::X64Backend;
+using xe::cpu::backend::x64::X64CodeCache;
+
+namespace {
+
+const uint32_t kCodeAddress = TestGuestCode::kCodeAddress;
+
+// Calls a tiny function r3 times, counting calls in r4.
+const uint32_t kCallLoopCode[] = {
+    0x7D8802A6,  // 00 mflr   r12
+    0x38800000,  // 04 li     r4, 0
+    0x7C6903A6,  // 08 mtctr  r3
+    0x48000015,  // 0C bl     20
+    0x4200FFFC,  // 10 bdnz   0C
+    0x7D8803A6,  // 14 mtlr   r12
+    0x4E800020,  // 18 blr
+    0x60000000,  // 1C nop
+    0x38840001,  // 20 addi   r4, r4, 1
+    0x4E800020,  // 24 blr
+};
+
+// Calls through a table of 8 function pointers (at 80) r3 times, picking
+// table[r3 & r7] each time. Function n adds n + 1 to r4.
+const uint32_t kIndirectCallTableAddress = kCodeAddress + 0x80;
+const uint32_t kIndirectCallLoopCode[] = {
+    0x7D8802A6,  // 00 mflr   r12
+    0x38800000,  // 04 li     r4, 0
+    0x7C663838,  // 08 and    r6, r3, r7
+    0x54C6103A,  // 0C slwi   r6, r6, 2
+    0x7D05302E,  // 10 lwzx   r8, r5, r6
+    0x7D0903A6,  // 14 mtctr  r8
+    0x4E800421,  // 18 bctrl
+    0x3863FFFF,  // 1C addi   r3, r3, -1
+    0x2C030000,  // 20 cmpwi  r3, 0
+    0x4082FFE4,  // 24 bne    08
+    0x7D8803A6,  // 28 mtlr   r12
+    0x4E800020,  // 2C blr
+    0x38840001,  // 30 addi   r4, r4, 1
+    0x4E800020,  // 34 blr
+    0x38840002,  // 38 addi   r4, r4, 2
+    0x4E800020,  // 3C blr
+    0x38840003,  // 40 addi   r4, r4, 3
+    0x4E800020,  // 44 blr
+    0x38840004,  // 48 addi   r4, r4, 4
+    0x4E800020,  // 4C blr
+    0x38840005,  // 50 addi   r4, r4, 5
+    0x4E800020,  // 54 blr
+    0x38840006,  // 58 addi   r4, r4, 6
+    0x4E800020,  // 5C blr
+    0x38840007,  // 60 addi   r4, r4, 7
+    0x4E800020,  // 64 blr
+    0x38840008,  // 68 addi   r4, r4, 8
+    0x4E800020,  // 6C blr
+    0x60000000,  // 70 nop
+    0x60000000,  // 74 nop
+    0x60000000,  // 78 nop
+    0x60000000,  // 7C nop
+    0x82000030,  // 80 table
+    0x82000038,  // 84
+    0x82000040,  // 88
+    0x82000048,  // 8C
+    0x82000050,  // 90
+    0x82000058,  // 94
+    0x82000060,  // 98
+    0x82000068,  // 9C
+};
+
+// Sum of what kIndirectCallLoopCode should leave in r4.
+uint64_t ExpectedIndirectCallSum(uint32_t iterations, uint32_t mask) {
+  uint64_t sum = 0;
+  for (uint32_t n = iterations; n > 0; --n) {
+    sum += (n & mask) + 1;
+  }
+  return sum;
+}
+
+struct CallOptions {
+  bool patch_calls;
+  bool inline_call_cache;
+};
+
+class CallTestRunner {
+ public:
+  template <size_t N>
+  CallTestRunner(const uint32_t (&code)[N], CallOptions options)
+      : patch_calls_(&FLAGS_jit_patch_calls, options.patch_calls),
+        inline_call_cache_(&FLAGS_jit_inline_call_cache,
+                           options.inline_call_cache),
+        code_(code) {}
+
+  // Runs the code from the start with the given registers, returning r4.
+  uint64_t Run(uint32_t r3, uint32_t r5 = 0, uint32_t r7 = 0) {
+    uint64_t result = 0;
+    code_.Run(
+        [&](PPCContext* ctx) {
+          ctx->r[3] = r3;
+          ctx->r[5] = r5;
+          ctx->r[7] = r7;
+        },
+        [&](PPCContext* ctx) { result = ctx->r[4]; });
+    return result;
+  }
+
+  X64CodeCache::CallSiteStats QueryCallSiteStats() {
+    auto backend = static_cast<X64Backend*>(code_.processor->backend());
+    return backend->code_cache()->QueryCallSiteStats();
+  }
+
+ private:
+  ScopedFlag<bool> patch_calls_;
+  ScopedFlag<bool> inline_call_cache_;
+  TestGuestCode code_;
+};
+
+double MeasureCallRate(bool patch_calls, uint32_t iterations) {
+  CallTestRunner runner(kCallLoopCode, {patch_calls, false});
+  // Warm up so that everything is compiled (and patched).
+  REQUIRE(runner.Run(16) == 16);
+  auto start = std::chrono::high_resolution_clock::now();
+  REQUIRE(runner.Run(iterations) == iterations);
+  auto end = std::chrono::high_resolution_clock::now();
+  return iterations / std::chrono::duration<double>(end - start).count();
+}
+
+double MeasureIndirectCallRate(bool inline_call_cache, uint32_t mask,
+                               uint32_t iterations) {
+  CallTestRunner runner(kIndirectCallLoopCode, {true, inline_call_cache});
+  // Warm up so that every target is compiled and cached.
+  REQUIRE(runner.Run(16, kIndirectCallTableAddress, mask) ==
+          ExpectedIndirectCallSum(16, mask));
+  auto start = std::chrono::high_resolution_clock::now();
+  REQUIRE(runner.Run(iterations, kIndirectCallTableAddress, mask) ==
+          ExpectedIndirectCallSum(iterations, mask));
+  auto end = std::chrono::high_resolution_clock::now();
+  return iterations / std::chrono::duration<double>(end - start).count();
+}
+
+}  // namespace
+
+TEST_CASE("CALL_PATCHING", "[call]") {
+  CallTestRunner runner(kCallLoopCode, {true, false});
+  REQUIRE(runner.Run(1000) == 1000);
+  auto stats = runner.QueryCallSiteStats();
+  REQUIRE(stats.direct_count == 1);
+  REQUIRE(stats.patched_count == 1);
+  // Patched sites must keep working.
+  REQUIRE(runner.Run(1000) == 1000);
+}
+
+TEST_CASE("CALL_PATCHING_DISABLED", "[call]") {
+  CallTestRunner runner(kCallLoopCode, {false, false});
+  REQUIRE(runner.Run(1000) == 1000);
+  auto stats = runner.QueryCallSiteStats();
+  REQUIRE(stats.direct_count == 0);
+  REQUIRE(stats.patched_count == 0);
+  REQUIRE(stats.indirect_count >= 1);
+}
+
+TEST_CASE("CALL_INDIRECT_INLINE_CACHE", "[call]") {
+  for (bool inline_call_cache : {false, true}) {
+    CallTestRunner runner(kIndirectCallLoopCode, {true, inline_call_cache});
+    // Monomorphic, polymorphic (fits in the cache) and megamorphic.
+    for (uint32_t mask : {0, 1, 3, 7}) {
+      for (int pass = 0; pass < 2; ++pass) {
+        REQUIRE(runner.Run(100, kIndirectCallTableAddress, mask) ==
+                ExpectedIndirectCallSum(100, mask));
+      }
+    }
+  }
+}
+
+TEST_CASE("CALL_INDIRECT_INLINE_CACHE_TIER_UP", "[call]") {
+  // The callee is recompiled while the site has it cached, and the entry must
+  // follow it to the new code.
+  ScopedFlag<int32_t> threshold(&FLAGS_jit_tier_up_threshold, 100);
+  CallTestRunner runner(kIndirectCallLoopCode, {true, true});
+  bool redirected = false;
+  for (int n = 0; n < 1000 && !redirected; ++n) {
+    REQUIRE(runner.Run(100, kIndirectCallTableAddress, 0) ==
+            ExpectedIndirectCallSum(100, 0));
+    redirected = runner.QueryCallSiteStats().redirected_count >= 1;
+    if (!redirected) {
+      xe::threading::Sleep(std::chrono::milliseconds(5));
+    }
+  }
+  REQUIRE(redirected);
+  REQUIRE(runner.Run(100, kIndirectCallTableAddress, 0) ==
+          ExpectedIndirectCallSum(100, 0));
+}
+
+TEST_CASE("CALL_PATCHING_BENCHMARK", "[.][benchmark]") {
+  const uint32_t iterations = 50 * 1000 * 1000;
+  double indirect_rate = MeasureCallRate(false, iterations);
+  double patched_rate = MeasureCallRate(true, iterations);
+  std::printf(
+      "indirect %8.2f Mcalls/s, patched %8.2f Mcalls/s (%.2fx)\n",
+      indirect_rate / 1e6, patched_rate / 1e6, patched_rate / indirect_rate);
+}
+
+TEST_CASE("CALL_INDIRECT_INLINE_CACHE_BENCHMARK", "[.][benchmark]") {
+  const uint32_t iterations = 50 * 1000 * 1000;
+  struct {
+    const char* name;
+    uint32_t mask;
+  } patterns[] = {
+      {"monomorphic", 0}, {"polymorphic", 3}, {"megamorphic", 7},
+  };
+  for (auto& pattern : patterns) {
+    double table_rate =
+        MeasureIndirectCallRate(false, pattern.mask, iterations);
+    double cache_rate = MeasureIndirectCallRate(true, pattern.mask, iterations);
+    std::printf(
+        "%-12s table %8.2f Mcalls/s, inline cache %8.2f Mcalls/s (%.2fx)\n",
+        pattern.name, table_rate / 1e6, cache_rate / 1e6,
+        cache_rate / table_rate);
+  }
+}
@@ -0,0 +1,217 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/mutex.h"
+#include "xenia/cpu/entry_table.h"
+
+#include "third_party/catch/single_include/catch.hpp"
+
+using namespace xe::cpu;
+
+namespace {
+
+// The previous mutex + unordered_map implementation, kept here so the
+// benchmark has something to compare against.
+class LockedMapEntryTable {
+ public:
+  ~LockedMapEntryTable() {
+    for (auto it : map_) {
+      delete it.second;
+    }
+  }
+
+  Entry* Get(uint32_t address) {
+    std::lock_guard<xe::mutex> guard(lock_);
+    const auto& it = map_.find(address);
+    Entry* entry = it != map_.end() ? it->second : nullptr;
+    if (entry && entry->status != Entry::STATUS_READY) {
+      entry = nullptr;
+    }
+    return entry;
+  }
+
+  Entry::Status GetOrCreate(uint32_t address, Entry** out_entry) {
+    std::lock_guard<xe::mutex> guard(lock_);
+    const auto& it = map_.find(address);
+    Entry* entry = it != map_.end() ? it->second : nullptr;
+    Entry::Status status;
+    if (entry) {
+      status = entry->status;
+    } else {
+      entry = new Entry();
+      entry->address = address;
+      entry->end_address = 0;
+      entry->status = Entry::STATUS_COMPILING;
+      entry->function = nullptr;
+      map_[address] = entry;
+      status = Entry::STATUS_NEW;
+    }
+    *out_entry = entry;
+    return status;
+  }
+
+ private:
+  xe::mutex lock_;
+  std::unordered_map<uint32_t, Entry*> map_;
+};
+
+const uint32_t kFunctionCount = 4096;
+
+uint32_t FunctionAddress(uint32_t i) { return 0x82000000 + i * 0x40; }
+
+// Resolves a spread of addresses from many threads at once, the same way
+// Processor::ResolveFunction does for indirect calls.
+template <typename T>
+double RunResolveBenchmark(T& table, size_t thread_count,
+                           size_t lookups_per_thread) {
+  for (uint32_t i = 0; i < kFunctionCount; ++i) {
+    Entry* entry;
+    if (table.GetOrCreate(FunctionAddress(i), &entry) == Entry::STATUS_NEW) {
+      entry->end_address = FunctionAddress(i) + 0x3C;
+      entry->status = Entry::STATUS_READY;
+    }
+  }
+  std::atomic<bool> go(false);
+  std::atomic<uint64_t> checksum(0);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&, t]() {
+      while (!go) {
+      }
+      uint64_t sum = 0;
+      uint32_t index = static_cast<uint32_t>(t * 7919);
+      for (size_t i = 0; i < lookups_per_thread; ++i) {
+        index = index * 1664525 + 1013904223;
+        Entry* entry = table.Get(FunctionAddress(index % kFunctionCount));
+        sum += entry ? entry->address : 0;
+      }
+      checksum += sum;
+    });
+  }
+  auto start = std::chrono::high_resolution_clock::now();
+  go = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  REQUIRE(checksum != 0);
+  double seconds = std::chrono::duration<double>(end - start).count();
+  return (thread_count * lookups_per_thread) / seconds;
+}
+
+}  // namespace
+
+TEST_CASE("ENTRY_TABLE_CREATE", "[entry_table]") {
+  EntryTable table;
+  REQUIRE(table.Get(0x82000000) == nullptr);
+
+  Entry* entry = nullptr;
+  REQUIRE(table.GetOrCreate(0x82000000, &entry) == Entry::STATUS_NEW);
+  REQUIRE(entry != nullptr);
+  REQUIRE(entry->address == 0x82000000);
+  // Not visible to lookups until ready.
+  REQUIRE(table.Get(0x82000000) == nullptr);
+
+  entry->end_address = 0x82000010;
+  entry->status = Entry::STATUS_READY;
+  REQUIRE(table.Get(0x82000000) == entry);
+
+  Entry* other_entry = nullptr;
+  REQUIRE(table.GetOrCreate(0x82000000, &other_entry) == Entry::STATUS_READY);
+  REQUIRE(other_entry == entry);
+}
+
+TEST_CASE("ENTRY_TABLE_FALLBACK", "[entry_table]") {
+  // Builtins live outside of the flat range and must still resolve.
+  EntryTable table;
+  Entry* entry = nullptr;
+  REQUIRE(table.GetOrCreate(0xFFFF0000, &entry) == Entry::STATUS_NEW);
+  entry->status = Entry::STATUS_READY;
+  REQUIRE(table.Get(0xFFFF0000) == entry);
+
+  REQUIRE(table.GetOrCreate(0x9FFFFFFC, &entry) == Entry::STATUS_NEW);
+  entry->status = Entry::STATUS_FAILED;
+  REQUIRE(table.Get(0x9FFFFFFC) == nullptr);
+  REQUIRE(table.GetOrCreate(0x9FFFFFFC, &entry) == Entry::STATUS_FAILED);
+}
+
+TEST_CASE("ENTRY_TABLE_FIND_WITH_ADDRESS", "[entry_table]") {
+  EntryTable table;
+  Entry* entry = nullptr;
+  table.GetOrCreate(0x82000000, &entry);
+  entry->end_address = 0x82000100;
+  entry->function = reinterpret_cast<Function*>(0x1234);
+  entry->status = Entry::STATUS_READY;
+  table.GetOrCreate(0x82000200, &entry);
+  entry->end_address = 0x82000300;
+  entry->function = reinterpret_cast<Function*>(0x5678);
+  entry->status = Entry::STATUS_READY;
+
+  auto fns = table.FindWithAddress(0x82000080);
+  REQUIRE(fns.size() == 1);
+  REQUIRE(fns[0] == reinterpret_cast<Function*>(0x1234));
+  REQUIRE(table.FindWithAddress(0x82000180).empty());
+}
+
+TEST_CASE("ENTRY_TABLE_RACE", "[entry_table]") {
+  // Many threads racing on the same set of addresses: exactly one of them
+  // must be handed each entry as NEW and everyone else must wait for it.
+  EntryTable table;
+  const size_t thread_count = 8;
+  const uint32_t address_count = 512;
+  std::atomic<uint32_t> new_count(0);
+  std::atomic<uint32_t> bad_count(0);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&]() {
+      for (uint32_t i = 0; i < address_count; ++i) {
+        uint32_t address = FunctionAddress(i);
+        Entry* entry;
+        auto status = table.GetOrCreate(address, &entry);
+        if (status == Entry::STATUS_NEW) {
+          ++new_count;
+          entry->function = reinterpret_cast<Function*>(uintptr_t(address));
+          entry->end_address = address + 4;
+          entry->status = Entry::STATUS_READY;
+        } else if (status != Entry::STATUS_READY ||
+                   entry->function !=
+                       reinterpret_cast<Function*>(uintptr_t(address))) {
+          ++bad_count;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  REQUIRE(new_count == address_count);
+  REQUIRE(bad_count == 0);
+}
+
+TEST_CASE("ENTRY_TABLE_BENCHMARK", "[.][benchmark]") {
+  const size_t lookups_per_thread = 4 * 1000 * 1000;
+  for (size_t thread_count = 1; thread_count <= 16; thread_count *= 2) {
+    LockedMapEntryTable map_table;
+    double map_rate =
+        RunResolveBenchmark(map_table, thread_count, lookups_per_thread);
+    EntryTable flat_table;
+    double flat_rate =
+        RunResolveBenchmark(flat_table, thread_count, lookups_per_thread);
+    std::printf(
+        "%2zu threads: map %8.2f Mlookups/s, flat %8.2f Mlookups/s (%.1fx)\n",
+        thread_count, map_rate / 1e6, flat_rate / 1e6, flat_rate / map_rate);
+  }
+}
@@ -0,0 +1,69 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <chrono>
+#include <cstdio>
+
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::frontend::PPCContext;
+
+namespace {
+
+// HIR instructions in each group generated by GenerateMixedCode.
+const int kGroupInstrCount = 10;
+
+// A long function mixing integer, float and vector ops, each group depending
+// on the last so none of it can be optimized away.
+void GenerateMixedCode(HIRBuilder& b, int group_count) {
+  auto x = LoadGPR(b, 4);
+  auto y = LoadGPR(b, 5);
+  auto f = LoadFPR(b, 4);
+  auto v = LoadVR(b, 4);
+  auto w = LoadVR(b, 5);
+  for (int n = 0; n < group_count; ++n) {
+    x = b.Add(x, y);
+    y = b.Xor(y, b.Shl(x, int8_t(3)));
+    auto low = b.ZeroExtend(b.Truncate(x, INT32_TYPE), INT64_TYPE);
+    x = b.Select(b.CompareSLT(x, y), low, x);
+    f = b.Add(f, f);
+    v = b.VectorAdd(v, w, INT32_TYPE);
+    w = b.VectorShl(w, v, INT16_TYPE);
+  }
+  StoreGPR(b, 3, x);
+  StoreFPR(b, 3, f);
+  StoreVR(b, 3, w);
+  b.Return();
+}
+
+}  // namespace
+
+TEST_CASE("JIT_BENCHMARK", "[.][benchmark]") {
+  const int kGroupCount = 1000;
+  const int kFunctionCount = 20;
+  std::chrono::high_resolution_clock::duration elapsed(0);
+  for (int n = 0; n < kFunctionCount; ++n) {
+    TestFunction test(
+        [](HIRBuilder& b) { GenerateMixedCode(b, kGroupCount); });
+    auto start = std::chrono::high_resolution_clock::now();
+    xe::cpu::Function* fn = nullptr;
+    test.processors[0]->ResolveFunction(0x80000000, &fn);
+    elapsed += std::chrono::high_resolution_clock::now() - start;
+    REQUIRE(fn != nullptr);
+  }
+  double instr_thousands =
+      kFunctionCount * kGroupCount * kGroupInstrCount / 1000.0;
+  std::printf("x64 JIT: %.3f ms per 1k HIR instructions\n",
+              std::chrono::duration<double, std::milli>(elapsed).count() /
+                  instr_thousands);
+}
@@ -0,0 +1,44 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <cmath>
+
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::frontend::PPCContext;
+
+TEST_CASE("LOG2_V128", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.Log2(LoadVR(b, 4)));
+    b.Return();
+  });
+  test.Run([](PPCContext* ctx) { ctx->v[4] = vec128f(1, 8, 0.75f, 1.0e-30f); },
+           [](PPCContext* ctx) {
+             auto result = ctx->v[3];
+             // Powers of two are exact.
+             REQUIRE(result.f32[0] == 0.0f);
+             REQUIRE(result.f32[1] == 3.0f);
+             for (int n = 2; n < 4; ++n) {
+               float expected = std::log2(ctx->v[4].f32[n]);
+               REQUIRE(std::abs(result.f32[n] - expected) <= 1.0e-4f);
+             }
+           });
+  test.Run([](PPCContext* ctx) { ctx->v[4] = vec128f(0, -1, INFINITY, -0.0f); },
+           [](PPCContext* ctx) {
+             auto result = ctx->v[3];
+             REQUIRE(result.f32[0] == -INFINITY);
+             REQUIRE(std::isnan(result.f32[1]));
+             REQUIRE(result.f32[2] == INFINITY);
+             REQUIRE(result.f32[3] == -INFINITY);
+           });
+}
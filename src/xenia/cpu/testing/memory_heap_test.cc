@@ -0,0 +1,204 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "xenia/memory.h"
+
+#include "third_party/catch/single_include/catch.hpp"
+
+using namespace xe;
+
+namespace {
+
+// A window of the 4k page heap at 0, away from the page reserved at 0.
+const uint32_t kWindowBase = 0x10000000;
+const uint32_t kWindowPageCount = 1024;
+const uint32_t kPageSize = 4096;
+
+std::unique_ptr<Memory> CreateMemory() {
+  auto memory = std::make_unique<Memory>();
+  REQUIRE(memory->Initialize() == 0);
+  return memory;
+}
+
+bool AllocInWindow(BaseHeap* heap, uint32_t size, uint32_t alignment,
+                   bool top_down, uint32_t* out_address) {
+  return heap->AllocRange(kWindowBase,
+                          kWindowBase + kWindowPageCount * kPageSize, size,
+                          alignment, kMemoryAllocationReserve,
+                          kMemoryProtectRead | kMemoryProtectWrite, top_down,
+                          out_address);
+}
+
+// Finds where the old page-by-page scan would place an allocation: the
+// lowest (or highest) aligned base with enough free pages after it.
+uint32_t FindReferencePage(const std::vector<bool>& used, uint32_t page_count,
+                           uint32_t stride, bool top_down) {
+  uint32_t high_page = (kWindowPageCount - kWindowPageCount % stride);
+  auto fits = [&](uint32_t base) {
+    for (uint32_t i = base; i < base + page_count; ++i) {
+      if (used[i]) {
+        return false;
+      }
+    }
+    return true;
+  };
+  if (top_down) {
+    for (int64_t base = (high_page - page_count) / stride * stride; base >= 0;
+         base -= stride) {
+      if (fits(uint32_t(base))) {
+        return uint32_t(base);
+      }
+    }
+  } else {
+    for (uint32_t base = 0; base + page_count <= high_page; base += stride) {
+      if (fits(base)) {
+        return base;
+      }
+    }
+  }
+  return UINT32_MAX;
+}
+
+}  // namespace
+
+TEST_CASE("HEAP_ALLOC_ORDER", "[memory]") {
+  auto memory = CreateMemory();
+  auto heap = memory->LookupHeap(kWindowBase);
+  REQUIRE(heap->page_size() == kPageSize);
+
+  uint32_t a, b, c;
+  REQUIRE(AllocInWindow(heap, 0x3000, 0, false, &a));
+  REQUIRE(AllocInWindow(heap, 0x1000, 0, false, &b));
+  REQUIRE(a == kWindowBase);
+  REQUIRE(b == kWindowBase + 0x3000);
+
+  REQUIRE(AllocInWindow(heap, 0x2000, 0, true, &c));
+  REQUIRE(c == kWindowBase + (kWindowPageCount - 2) * kPageSize);
+
+  // Freed space is reused first, and neighbours coalesce.
+  REQUIRE(heap->Release(a));
+  REQUIRE(heap->Release(b));
+  uint32_t d;
+  REQUIRE(AllocInWindow(heap, 0x4000, 0, false, &d));
+  REQUIRE(d == kWindowBase);
+}
+
+TEST_CASE("HEAP_ALLOC_ALIGNMENT", "[memory]") {
+  auto memory = CreateMemory();
+  auto heap = memory->LookupHeap(kWindowBase);
+
+  uint32_t a, b, c;
+  REQUIRE(AllocInWindow(heap, 0x1000, 0, false, &a));
+  REQUIRE(AllocInWindow(heap, 0x1000, 0x10000, false, &b));
+  REQUIRE(b == kWindowBase + 0x10000);
+  REQUIRE(AllocInWindow(heap, 0x3000, 0x10000, true, &c));
+  REQUIRE(c % 0x10000 == 0);
+  REQUIRE(c + 0x3000 < kWindowBase + kWindowPageCount * kPageSize);
+}
+
+TEST_CASE("HEAP_QUERY_FREE_REGION", "[memory]") {
+  auto memory = CreateMemory();
+  auto heap = memory->LookupHeap(kWindowBase);
+
+  uint32_t a, b;
+  REQUIRE(AllocInWindow(heap, 0x1000, 0, false, &a));
+  REQUIRE(AllocInWindow(heap, 0x1000, 0, false, &b));
+  REQUIRE(heap->Release(a));
+
+  HeapAllocationInfo info;
+  REQUIRE(heap->QueryRegionInfo(a, &info));
+  REQUIRE(info.state == 0);
+  REQUIRE(info.region_size == 0x1000);
+  REQUIRE(heap->QueryRegionInfo(b, &info));
+  REQUIRE(info.state != 0);
+  REQUIRE(info.region_size == 0x1000);
+}
+
+TEST_CASE("HEAP_MATCHES_PAGE_SCAN", "[memory]") {
+  auto memory = CreateMemory();
+  auto heap = memory->LookupHeap(kWindowBase);
+
+  std::mt19937 rng(1234);
+  std::vector<bool> used(kWindowPageCount, false);
+  std::vector<std::pair<uint32_t, uint32_t>> allocations;
+  for (int step = 0; step < 4000; ++step) {
+    if (allocations.empty() || rng() % 3) {
+      uint32_t page_count = 1 + rng() % 24;
+      uint32_t stride = 1u << (rng() % 5);
+      bool top_down = (rng() & 1) != 0;
+      uint32_t expected =
+          FindReferencePage(used, page_count, stride, top_down);
+      if (expected == UINT32_MAX) {
+        continue;
+      }
+      uint32_t address;
+      REQUIRE(AllocInWindow(heap, page_count * kPageSize, stride * kPageSize,
+                            top_down, &address));
+      uint32_t page = (address - kWindowBase) / kPageSize;
+      INFO("step " << step << " pages " << page_count << " stride " << stride
+                   << " top_down " << top_down);
+      REQUIRE(page == expected);
+      for (uint32_t i = page; i < page + page_count; ++i) {
+        used[i] = true;
+      }
+      allocations.emplace_back(address, page_count);
+    } else {
+      size_t index = rng() % allocations.size();
+      auto allocation = allocations[index];
+      allocations[index] = allocations.back();
+      allocations.pop_back();
+      REQUIRE(heap->Release(allocation.first));
+      uint32_t page = (allocation.first - kWindowBase) / kPageSize;
+      for (uint32_t i = page; i < page + allocation.second; ++i) {
+        used[i] = false;
+      }
+    }
+  }
+}
+
+TEST_CASE("HEAP_CHURN_BENCHMARK", "[.][benchmark]") {
+  auto memory = CreateMemory();
+  auto heap = memory->LookupHeap(kWindowBase);
+
+  // Many small allocations with a steady trickle of frees, as titles do
+  // with NtAllocateVirtualMemory.
+  std::mt19937 rng(1234);
+  std::vector<uint32_t> live;
+  const uint32_t iterations = 200000;
+  const size_t live_limit = 20000;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (uint32_t i = 0; i < iterations; ++i) {
+    if (live.size() < live_limit && (live.empty() || rng() % 4)) {
+      uint32_t address;
+      if (heap->Alloc((1 + rng() % 4) * kPageSize, 0, kMemoryAllocationReserve,
+                      kMemoryProtectRead | kMemoryProtectWrite,
+                      (rng() & 1) != 0, &address)) {
+        live.push_back(address);
+      }
+    } else {
+      size_t index = rng() % live.size();
+      heap->Release(live[index]);
+      live[index] = live.back();
+      live.pop_back();
+    }
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  double seconds = std::chrono::duration<double>(end - start).count();
+  std::printf("heap churn: %.0f ops/s with up to %zu live allocations\n",
+              iterations / seconds, live_limit);
+  for (auto address : live) {
+    heap->Release(address);
+  }
+}
@@ -111,3 +111,27 @@ TEST_CASE("PACK_SHORT_2", "[instr]") {
         REQUIRE(result == vec128i(0, 0, 0, 0x80018001));
       });
 }
+
+TEST_CASE("PACK_UINT_2101010", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.Pack(LoadVR(b, 4), PACK_TYPE_UINT_2101010));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128i(0x40400001, 0x403FFFFF, 0x40500000, 0x40400002);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128i(0, 0, 0, 0x9FFFFC01));
+      });
+  // NaNs, and saturation of the negative XYZ.
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128i(0x7FC00000, 0x40400000, 0x3F800000, 0xFFC00000);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128i(0, 0, 0, 0x20100200));
+      });
+}
@@ -0,0 +1,48 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <cmath>
+
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::frontend::PPCContext;
+
+TEST_CASE("POW2_V128", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.Pow2(LoadVR(b, 4)));
+    b.Return();
+  });
+  test.Run([](PPCContext* ctx) { ctx->v[4] = vec128f(0, 3, -2.5f, 10.3f); },
+           [](PPCContext* ctx) {
+             auto result = ctx->v[3];
+             // Integer powers are exact.
+             REQUIRE(result.f32[0] == 1.0f);
+             REQUIRE(result.f32[1] == 8.0f);
+             for (int n = 2; n < 4; ++n) {
+               float expected = std::exp2(ctx->v[4].f32[n]);
+               REQUIRE(std::abs(result.f32[n] - expected) <=
+                       expected * 1.0e-6f);
+             }
+           });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128f(-200.0f, 200.0f, INFINITY, NAN);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result.f32[0] == 0.0f);
+        REQUIRE(result.f32[1] == INFINITY);
+        REQUIRE(result.f32[2] == INFINITY);
+        REQUIRE(std::isnan(result.f32[3]));
+      });
+}
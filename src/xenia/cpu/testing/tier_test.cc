@@ -0,0 +1,146 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+#include <chrono>
+#include <climits>
+#include <cstdio>
+
+#include "xenia/base/threading.h"
+#include "xenia/cpu/cpu_flags.h"
+
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+
+namespace {
+
+const uint32_t kCodeAddress = TestGuestCode::kCodeAddress;
+
+// Some dependent ALU work repeated r3 times, leaving the result in r4.
+const uint32_t kAluLoopCode[] = {
+    0x38800000,  // 00 li     r4, 0
+    0x7C6903A6,  // 04 mtctr  r3
+    0x7C841A14,  // 08 add    r4, r4, r3
+    0x7C851A78,  // 0C xor    r5, r4, r3
+    0x7C842A14,  // 10 add    r4, r4, r5
+    0x4200FFF4,  // 14 bdnz   08
+    0x4E800020,  // 18 blr
+};
+
+uint64_t ExpectedAluLoopResult(uint64_t iterations) {
+  uint64_t r4 = 0;
+  for (uint64_t n = 0; n < iterations; ++n) {
+    r4 += iterations;
+    r4 += r4 ^ iterations;
+  }
+  return r4;
+}
+
+// Calls a tiny function r3 times, counting calls in r4.
+const uint32_t kCalleeAddress = kCodeAddress + 0x20;
+const uint32_t kCallLoopCode[] = {
+    0x7D8802A6,  // 00 mflr   r12
+    0x38800000,  // 04 li     r4, 0
+    0x7C6903A6,  // 08 mtctr  r3
+    0x48000015,  // 0C bl     20
+    0x4200FFFC,  // 10 bdnz   0C
+    0x7D8803A6,  // 14 mtlr   r12
+    0x4E800020,  // 18 blr
+    0x60000000,  // 1C nop
+    0x38840001,  // 20 addi   r4, r4, 1
+    0x4E800020,  // 24 blr
+};
+
+class TierTestRunner {
+ public:
+  template <size_t N>
+  TierTestRunner(const uint32_t (&code)[N], int32_t threshold)
+      : worker_count_(&FLAGS_jit_worker_count, 2),
+        threshold_(&FLAGS_jit_tier_up_threshold, threshold),
+        code_(code) {}
+
+  uint64_t Run(uint32_t r3) {
+    uint64_t result = 0;
+    code_.Run([&](PPCContext* ctx) { ctx->r[3] = r3; },
+              [&](PPCContext* ctx) { result = ctx->r[4]; });
+    return result;
+  }
+
+  CompileTier QueryTier(uint32_t address) {
+    auto function = code_.processor->QueryFunction(address);
+    REQUIRE(function != nullptr);
+    return function->tier();
+  }
+
+  // Recompiles happen on the JIT workers, so give them a moment.
+  bool WaitForTier(uint32_t address, CompileTier tier) {
+    for (int n = 0; n < 1000; ++n) {
+      if (QueryTier(address) == tier) {
+        return true;
+      }
+      xe::threading::Sleep(std::chrono::milliseconds(5));
+    }
+    return false;
+  }
+
+ private:
+  ScopedFlag<int32_t> worker_count_;
+  ScopedFlag<int32_t> threshold_;
+  TestGuestCode code_;
+};
+
+double MeasureAluLoopRate(int32_t threshold, uint32_t iterations) {
+  TierTestRunner runner(kAluLoopCode, threshold);
+  REQUIRE(runner.Run(16) == ExpectedAluLoopResult(16));
+  auto start = std::chrono::high_resolution_clock::now();
+  REQUIRE(runner.Run(iterations) == ExpectedAluLoopResult(iterations));
+  auto end = std::chrono::high_resolution_clock::now();
+  return iterations / std::chrono::duration<double>(end - start).count();
+}
+
+}  // namespace
+
+TEST_CASE("TIER_UP", "[tier]") {
+  TierTestRunner runner(kAluLoopCode, 8);
+  REQUIRE(runner.Run(100) == ExpectedAluLoopResult(100));
+  REQUIRE(runner.QueryTier(kCodeAddress) == CompileTier::kBaseline);
+  for (uint32_t n = 0; n < 8; ++n) {
+    REQUIRE(runner.Run(100 + n) == ExpectedAluLoopResult(100 + n));
+  }
+  REQUIRE(runner.WaitForTier(kCodeAddress, CompileTier::kOptimized));
+  REQUIRE(runner.Run(1000) == ExpectedAluLoopResult(1000));
+}
+
+TEST_CASE("TIER_UP_PATCHED_CALLEE", "[tier]") {
+  // The callee crosses the threshold while the caller keeps calling it
+  // through a patched call site, which must follow it to the new code.
+  TierTestRunner runner(kCallLoopCode, 100);
+  REQUIRE(runner.Run(1000) == 1000);
+  REQUIRE(runner.WaitForTier(kCalleeAddress, CompileTier::kOptimized));
+  REQUIRE(runner.QueryTier(kCodeAddress) == CompileTier::kBaseline);
+  REQUIRE(runner.Run(1000) == 1000);
+}
+
+TEST_CASE("TIER_UP_DISABLED", "[tier]") {
+  TierTestRunner runner(kAluLoopCode, 0);
+  REQUIRE(runner.Run(100) == ExpectedAluLoopResult(100));
+  REQUIRE(runner.QueryTier(kCodeAddress) == CompileTier::kOptimized);
+}
+
+TEST_CASE("TIER_BENCHMARK", "[.][benchmark]") {
+  const uint32_t iterations = 200 * 1000 * 1000;
+  // A threshold that is never reached keeps the function at the baseline.
+  double baseline_rate = MeasureAluLoopRate(INT_MAX, iterations);
+  double optimized_rate = MeasureAluLoopRate(0, iterations);
+  std::printf(
+      "baseline %8.2f Miter/s, optimized %8.2f Miter/s (%.2fx)\n",
+      baseline_rate / 1e6, optimized_rate / 1e6,
+      optimized_rate / baseline_rate);
+}
@@ -10,12 +10,16 @@
 #ifndef XENIA_TESTING_UTIL_H_
 #define XENIA_TESTING_UTIL_H_
 
+#include <vector>
+
 #include "xenia/base/main.h"
+#include "xenia/base/memory.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
 #include "xenia/cpu/frontend/ppc_context.h"
 #include "xenia/cpu/frontend/ppc_frontend.h"
 #include "xenia/cpu/hir/hir_builder.h"
 #include "xenia/cpu/processor.h"
+#include "xenia/cpu/raw_module.h"
 #include "xenia/cpu/test_module.h"
 
 #include "third_party/catch/single_include/catch.hpp"
@@ -90,6 +94,75 @@ class TestFunction {
   std::vector<std::unique_ptr<Processor>> processors;
 };
 
+// Loads raw PPC code at kCodeAddress and runs it through the full
+// frontend/backend, as opposed to TestFunction which skips the frontend.
+class TestGuestCode {
+ public:
+  static const uint32_t kCodeAddress = 0x82000000;
+
+  template <size_t N>
+  explicit TestGuestCode(const uint32_t (&code)[N]) {
+    memory.reset(new Memory());
+    memory->Initialize();
+    processor.reset(new Processor(memory.get(), nullptr, nullptr));
+    processor->Setup();
+
+    std::vector<uint32_t> swapped_code(N);
+    xe::copy_and_swap(swapped_code.data(), code, N);
+    auto module = std::make_unique<RawModule>(processor.get());
+    module->LoadData(kCodeAddress, swapped_code.data(), N * 4, "test");
+    processor->AddModule(std::move(module));
+    processor->backend()->CommitExecutableRange(kCodeAddress,
+                                                kCodeAddress + 0x10000);
+
+    uint32_t stack_size = 64 * 1024;
+    uint32_t stack_address = kCodeAddress - stack_size;
+    uint32_t pcr_address = stack_address - 0x1000;
+    thread_state.reset(new ThreadState(processor.get(), 0x100,
+                                       ThreadStackType::kUserStack,
+                                       stack_address, stack_size,
+                                       pcr_address));
+  }
+
+  ~TestGuestCode() {
+    thread_state.reset();
+    processor.reset();
+    memory.reset();
+  }
+
+  // Calls the function at address (the start of the code by default).
+  void Run(std::function<void(PPCContext*)> pre_call,
+           std::function<void(PPCContext*)> post_call,
+           uint32_t address = kCodeAddress) {
+    xe::cpu::Function* fn = nullptr;
+    processor->ResolveFunction(address, &fn);
+    REQUIRE(fn != nullptr);
+    auto ctx = thread_state->context();
+    ctx->lr = 0xBCBCBCBC;
+    pre_call(ctx);
+    fn->Call(thread_state.get(), uint32_t(ctx->lr));
+    post_call(ctx);
+  }
+
+  std::unique_ptr<Memory> memory;
+  std::unique_ptr<Processor> processor;
+  std::unique_ptr<ThreadState> thread_state;
+};
+
+// Overrides a flag for the lifetime of the scope.
+template <typename T>
+class ScopedFlag {
+ public:
+  ScopedFlag(T* flag, T value) : flag_(flag), old_value_(*flag) {
+    *flag_ = value;
+  }
+  ~ScopedFlag() { *flag_ = old_value_; }
+
+ private:
+  T* flag_;
+  T old_value_;
+};
+
 inline hir::Value* LoadGPR(hir::HIRBuilder& b, int reg) {
   return b.LoadContext(offsetof(PPCContext, r) + reg * 8, hir::INT64_TYPE);
 }
@@ -232,6 +232,15 @@ TEST_CASE("VECTOR_ADD_I32_SAT_SIGNED", "[instr]") {
         auto result = ctx->v[3];
         REQUIRE(result == vec128i(INT32_MIN));
       });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128i(INT32_MAX, INT32_MIN, 0x40000000, -5);
+        ctx->v[5] = vec128i(INT32_MAX, INT32_MIN, 0x40000000, 3);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128i(INT32_MAX, INT32_MIN, INT32_MAX, -2));
+      });
 }
 
 TEST_CASE("VECTOR_ADD_I32_SAT_UNSIGNED", "[instr]") {
@@ -258,6 +267,15 @@ TEST_CASE("VECTOR_ADD_I32_SAT_UNSIGNED", "[instr]") {
         auto result = ctx->v[3];
         REQUIRE(result == vec128i(UINT32_MAX));
       });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128i(UINT32_MAX, 0x80000000, 0x7FFFFFFF, 0);
+        ctx->v[5] = vec128i(UINT32_MAX, 0x80000000, 1, 5);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128i(UINT32_MAX, UINT32_MAX, 0x80000000, 5));
+      });
 }
 
 TEST_CASE("VECTOR_ADD_F32", "[instr]") {
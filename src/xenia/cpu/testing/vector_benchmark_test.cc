@@ -0,0 +1,133 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <chrono>
+#include <cstdio>
+
+#include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::frontend::PPCContext;
+
+namespace {
+
+typedef std::function<Value*(HIRBuilder& b, Value* value, Value* operand)>
+    VectorOp;
+
+const int kChainLength = 1000;
+const int kRunCount = 200;
+
+// Times a chain of dependent ops, so the result is latency per op in ns.
+double TimeVectorOp(VectorOp op) {
+  TestFunction test([op](HIRBuilder& b) {
+    auto value = LoadVR(b, 4);
+    auto operand = LoadVR(b, 5);
+    for (int n = 0; n < kChainLength; ++n) {
+      value = op(b, value, operand);
+    }
+    StoreVR(b, 3, value);
+    b.Return();
+  });
+  std::chrono::high_resolution_clock::time_point start;
+  std::chrono::high_resolution_clock::duration elapsed(0);
+  for (int run = 0; run < kRunCount; ++run) {
+    test.Run(
+        [&start](PPCContext* ctx) {
+          ctx->v[4] = vec128f(1.5f, -2.25f, 3.0f, 0.5f);
+          ctx->v[5] =
+              vec128b(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+          start = std::chrono::high_resolution_clock::now();
+        },
+        [&start, &elapsed](PPCContext* ctx) {
+          elapsed += std::chrono::high_resolution_clock::now() - start;
+        });
+  }
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         (double(kRunCount) * kChainLength);
+}
+
+}  // namespace
+
+TEST_CASE("VECTOR_SEQUENCE_BENCHMARK", "[.][benchmark]") {
+  struct {
+    const char* name;
+    VectorOp op;
+  } ops[] = {
+      {"VECTOR_SHL_I8",
+       [](HIRBuilder& b, Value* v, Value* o) {
+         return b.VectorShl(v, o, INT8_TYPE);
+       }},
+      {"VECTOR_SHL_I16",
+       [](HIRBuilder& b, Value* v, Value* o) {
+         return b.VectorShl(v, o, INT16_TYPE);
+       }},
+      {"VECTOR_SHL_I32",
+       [](HIRBuilder& b, Value* v, Value* o) {
+         return b.VectorShl(v, o, INT32_TYPE);
+       }},
+      {"VECTOR_SHA_I8",
+       [](HIRBuilder& b, Value* v, Value* o) {
+         return b.VectorSha(v, o, INT8_TYPE);
+       }},
+      {"VECTOR_SHA_I16",
+       [](HIRBuilder& b, Value* v, Value* o) {
+         return b.VectorSha(v, o, INT16_TYPE);
+       }},
+      {"VECTOR_SHA_I32",
+       [](HIRBuilder& b, Value* v, Value* o) {
+         return b.VectorSha(v, o, INT32_TYPE);
+       }},
+      {"VECTOR_ROTATE_LEFT_I8",
+       [](HIRBuilder& b, Value* v, Value* o) {
+         return b.VectorRotateLeft(v, o, INT8_TYPE);
+       }},
+      {"VECTOR_ROTATE_LEFT_I16",
+       [](HIRBuilder& b, Value* v, Value* o) {
+         return b.VectorRotateLeft(v, o, INT16_TYPE);
+       }},
+      {"VECTOR_ROTATE_LEFT_I32",
+       [](HIRBuilder& b, Value* v, Value* o) {
+         return b.VectorRotateLeft(v, o, INT32_TYPE);
+       }},
+      {"VECTOR_ADD_I32_SAT_SIGNED",
+       [](HIRBuilder& b, Value* v, Value* o) {
+         return b.VectorAdd(v, o, INT32_TYPE, ARITHMETIC_SATURATE);
+       }},
+      {"VECTOR_SUB_I32_SAT_SIGNED",
+       [](HIRBuilder& b, Value* v, Value* o) {
+         return b.VectorSub(v, o, INT32_TYPE, ARITHMETIC_SATURATE);
+       }},
+      {"POW2_V128",
+       [](HIRBuilder& b, Value* v, Value* o) { return b.Pow2(v); }},
+      {"LOG2_V128",
+       [](HIRBuilder& b, Value* v, Value* o) { return b.Log2(v); }},
+      {"PACK_FLOAT16_4",
+       [](HIRBuilder& b, Value* v, Value* o) {
+         return b.Pack(v, PACK_TYPE_FLOAT16_4);
+       }},
+      {"PACK_UINT_2101010",
+       [](HIRBuilder& b, Value* v, Value* o) {
+         return b.Pack(v, PACK_TYPE_UINT_2101010);
+       }},
+  };
+  for (auto& entry : ops) {
+    double haswell_ns = TimeVectorOp(entry.op);
+    double baseline_ns;
+    {
+      ScopedFlag<bool> no_haswell(&FLAGS_enable_haswell_instructions, false);
+      baseline_ns = TimeVectorOp(entry.op);
+    }
+    std::printf("%-26s %6.2f ns/op, %6.2f ns/op without AVX2/FMA/F16C\n",
+                entry.name, haswell_ns, baseline_ns);
+  }
+}
@@ -8,6 +8,7 @@
  */
 
 #include "third_party/xbyak/xbyak/xbyak_bin2hex.h"
+#include "xenia/cpu/backend/x64/x64_backend.h"
 #include "xenia/cpu/testing/util.h"
 
 using namespace xe;
@@ -70,3 +71,29 @@ TEST_CASE("VECTOR_ROTATE_LEFT_I32", "[instr]") {
                 vec128i(0x00000001, 0x00000002, 0x00000001, 0x00000002));
       });
 }
+
+TEST_CASE("VECTOR_ROTATE_LEFT_NO_AVX2", "[instr]") {
+  // Words and dwords take the stepped path without variable dword shifts.
+  ScopedFlag<bool> no_avx2(&FLAGS_enable_haswell_instructions, false);
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.VectorRotateLeft(LoadVR(b, 4), LoadVR(b, 5), INT16_TYPE));
+    StoreVR(b, 6, b.VectorRotateLeft(LoadVR(b, 7), LoadVR(b, 8), INT32_TYPE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128s(0x0001, 0x0001, 0x0001, 0x0001, 0x1000, 0x1000,
+                            0x1000, 0x1234);
+        ctx->v[5] = vec128s(0, 1, 2, 3, 14, 15, 16, 20);
+        ctx->v[7] = vec128i(0x00000001, 0x80000000, 0x80000000, 0x12345678);
+        ctx->v[8] = vec128i(0, 1, 2, 36);
+      },
+      [](PPCContext* ctx) {
+        auto result1 = ctx->v[3];
+        REQUIRE(result1 == vec128s(0x0001, 0x0002, 0x0004, 0x0008, 0x0400,
+                                   0x0800, 0x1000, 0x2341));
+        auto result2 = ctx->v[6];
+        REQUIRE(result2 ==
+                vec128i(0x00000001, 0x00000001, 0x00000002, 0x23456781));
+      });
+}
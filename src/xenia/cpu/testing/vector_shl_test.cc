@@ -7,6 +7,7 @@
  ******************************************************************************
  */
 
+#include "xenia/cpu/backend/x64/x64_backend.h"
 #include "xenia/cpu/testing/util.h"
 
 using namespace xe;
@@ -144,3 +145,29 @@ TEST_CASE("VECTOR_SHL_I32_CONSTANT", "[instr]") {
                 vec128i(0x00000000, 0xFFFF0000, 0x00000002, 0x12345678));
       });
 }
+
+TEST_CASE("VECTOR_SHL_NO_AVX2", "[instr]") {
+  // Words and dwords take the stepped path without variable dword shifts.
+  ScopedFlag<bool> no_avx2(&FLAGS_enable_haswell_instructions, false);
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.VectorShl(LoadVR(b, 4), LoadVR(b, 5), INT16_TYPE));
+    StoreVR(b, 6, b.VectorShl(LoadVR(b, 7), LoadVR(b, 8), INT32_TYPE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128s(0x7FFE, 0x7FFE, 0x7FFE, 0x7FFF, 0x8000, 0xFFFF,
+                            0x0001, 0x1234);
+        ctx->v[5] = vec128s(0, 1, 8, 15, 15, 8, 1, 16);
+        ctx->v[7] = vec128i(0x80000000, 0xFFFFFFFF, 0x00000001, 0x12345678);
+        ctx->v[8] = vec128i(31, 16, 1, 32);
+      },
+      [](PPCContext* ctx) {
+        auto result1 = ctx->v[3];
+        REQUIRE(result1 == vec128s(0x7FFE, 0xFFFC, 0xFE00, 0x8000, 0x0000,
+                                   0xFF00, 0x0002, 0x1234));
+        auto result2 = ctx->v[6];
+        REQUIRE(result2 ==
+                vec128i(0x00000000, 0xFFFF0000, 0x00000002, 0x12345678));
+      });
+}
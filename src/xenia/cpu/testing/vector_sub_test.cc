@@ -0,0 +1,58 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::frontend::PPCContext;
+
+TEST_CASE("VECTOR_SUB_I32", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.VectorSub(LoadVR(b, 4), LoadVR(b, 5), INT32_TYPE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128i(10, 0, INT32_MIN, 5);
+        ctx->v[5] = vec128i(3, 1, 1, 5);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128i(7, UINT32_MAX, INT32_MAX, 0));
+      });
+}
+
+TEST_CASE("VECTOR_SUB_I32_SAT_SIGNED", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.VectorSub(LoadVR(b, 4), LoadVR(b, 5), INT32_TYPE,
+                              ARITHMETIC_SATURATE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128i(INT32_MIN, INT32_MAX, 5, 0);
+        ctx->v[5] = vec128i(1, -1, 10, INT32_MIN);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128i(INT32_MIN, INT32_MAX, -5, INT32_MAX));
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128i(-1, 1, INT32_MIN, INT32_MAX);
+        ctx->v[5] = vec128i(INT32_MAX, INT32_MIN, INT32_MIN, INT32_MAX);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128i(INT32_MIN, INT32_MAX, 0, 0));
+      });
+}
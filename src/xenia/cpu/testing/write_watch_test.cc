@@ -0,0 +1,172 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "xenia/base/clock.h"
+#include "xenia/memory.h"
+
+#include "third_party/catch/single_include/catch.hpp"
+
+using namespace xe;
+
+namespace {
+
+struct WatchRecord {
+  uint32_t fire_count = 0;
+  uint32_t address = 0;
+  uint64_t fire_ticks = 0;
+};
+
+void RecordWatch(void* context_ptr, void* data_ptr, uint32_t address) {
+  auto record = reinterpret_cast<WatchRecord*>(data_ptr);
+  ++record->fire_count;
+  record->address = address;
+  record->fire_ticks = Clock::QueryHostTickCount();
+}
+
+std::unique_ptr<Memory> CreateMemory() {
+  auto memory = std::make_unique<Memory>();
+  REQUIRE(memory->Initialize() == 0);
+  return memory;
+}
+
+// Writes through the physical view, tripping any watch on the page.
+void Touch(Memory* memory, uint32_t physical_address) {
+  *memory->TranslatePhysical<volatile uint32_t*>(physical_address) = 1;
+}
+
+}  // namespace
+
+TEST_CASE("WRITE_WATCH_FIRES_ONCE", "[write_watch]") {
+  auto memory = CreateMemory();
+  WatchRecord record;
+  memory->AddPhysicalWriteWatch(0x00100000, 0x2000, RecordWatch, nullptr,
+                                &record);
+  Touch(memory.get(), 0x00101010);
+  REQUIRE(record.fire_count == 1);
+  REQUIRE(record.address == 0x00101010);
+  // The watch is gone, so the range is writable again.
+  Touch(memory.get(), 0x00100000);
+  Touch(memory.get(), 0x00101000);
+  REQUIRE(record.fire_count == 1);
+}
+
+TEST_CASE("WRITE_WATCH_OVERLAPPING", "[write_watch]") {
+  auto memory = CreateMemory();
+  WatchRecord a, b, c;
+  // a and b share the page at 0x00201000; c covers the page after it.
+  memory->AddPhysicalWriteWatch(0x00200000, 0x1800, RecordWatch, nullptr, &a);
+  memory->AddPhysicalWriteWatch(0x00201800, 0x1000, RecordWatch, nullptr, &b);
+  memory->AddPhysicalWriteWatch(0x00203000, 0x100, RecordWatch, nullptr, &c);
+
+  // Both watches on the shared page fire together.
+  Touch(memory.get(), 0x00201004);
+  REQUIRE(a.fire_count == 1);
+  REQUIRE(b.fire_count == 1);
+  REQUIRE(c.fire_count == 0);
+
+  // c is still protected.
+  Touch(memory.get(), 0x00203000);
+  REQUIRE(c.fire_count == 1);
+}
+
+TEST_CASE("WRITE_WATCH_SHARED_PAGE_STAYS_PROTECTED", "[write_watch]") {
+  auto memory = CreateMemory();
+  WatchRecord a, b;
+  memory->AddPhysicalWriteWatch(0x00300000, 0x2000, RecordWatch, nullptr, &a);
+  memory->AddPhysicalWriteWatch(0x00301000, 0x2000, RecordWatch, nullptr, &b);
+
+  // Firing a through its first page must not expose b's pages.
+  Touch(memory.get(), 0x00300000);
+  REQUIRE(a.fire_count == 1);
+  REQUIRE(b.fire_count == 0);
+  Touch(memory.get(), 0x00302000);
+  REQUIRE(a.fire_count == 1);
+  REQUIRE(b.fire_count == 1);
+}
+
+TEST_CASE("WRITE_WATCH_CANCEL", "[write_watch]") {
+  auto memory = CreateMemory();
+  WatchRecord a, b;
+  auto handle_a = memory->AddPhysicalWriteWatch(0x00400000, 0x1000,
+                                                RecordWatch, nullptr, &a);
+  memory->AddPhysicalWriteWatch(0x00400800, 0x100, RecordWatch, nullptr, &b);
+  REQUIRE(handle_a != 0);
+
+  // The page is still watched by b.
+  memory->CancelWriteWatch(handle_a);
+  Touch(memory.get(), 0x00400000);
+  REQUIRE(a.fire_count == 0);
+  REQUIRE(b.fire_count == 1);
+
+  // Canceling a fired watch is harmless, and its slot gets reused.
+  memory->CancelWriteWatch(handle_a);
+  auto handle_c = memory->AddPhysicalWriteWatch(0x00500000, 0x1000,
+                                                RecordWatch, nullptr, &a);
+  memory->CancelWriteWatch(handle_c);
+  Touch(memory.get(), 0x00500000);
+  REQUIRE(a.fire_count == 0);
+
+  // Nor does canceling a fired watch remove the one that reused its slot.
+  auto handle_b = memory->AddPhysicalWriteWatch(0x00600000, 0x1000,
+                                                RecordWatch, nullptr, &b);
+  Touch(memory.get(), 0x00600000);
+  REQUIRE(b.fire_count == 2);
+  auto handle_d = memory->AddPhysicalWriteWatch(0x00700000, 0x1000,
+                                                RecordWatch, nullptr, &a);
+  REQUIRE(handle_d != handle_b);
+  memory->CancelWriteWatch(handle_b);
+  Touch(memory.get(), 0x00700000);
+  REQUIRE(a.fire_count == 1);
+}
+
+TEST_CASE("WRITE_WATCH_BENCHMARK", "[.][benchmark]") {
+  auto memory = CreateMemory();
+  const uint32_t watch_count = 10000;
+  const uint32_t base_address = 0x01000000;
+  std::vector<WatchRecord> records(watch_count);
+  std::vector<uintptr_t> handles(watch_count);
+
+  // Like textures, most watches cover a few adjacent pages.
+  uint64_t start = Clock::QueryHostTickCount();
+  for (uint32_t i = 0; i < watch_count; ++i) {
+    handles[i] = memory->AddPhysicalWriteWatch(
+        base_address + i * 0x3000, 0x2000 + (i & 7) * 0x100, RecordWatch,
+        nullptr, &records[i]);
+  }
+  uint64_t end = Clock::QueryHostTickCount();
+  double frequency = double(Clock::host_tick_frequency());
+  std::printf("register %u watches: %.3f ms\n", watch_count,
+              (end - start) * 1000.0 / frequency);
+
+  // Fault latency is measured from just before the store to the callback.
+  double total_latency = 0;
+  uint32_t fault_count = 0;
+  for (uint32_t i = 0; i < watch_count; i += 2) {
+    uint64_t fault_start = Clock::QueryHostTickCount();
+    Touch(memory.get(), base_address + i * 0x3000 + 0x1000);
+    REQUIRE(records[i].fire_count == 1);
+    total_latency += records[i].fire_ticks - fault_start;
+    ++fault_count;
+  }
+  std::printf("fault to callback: %.2f us average over %u faults\n",
+              total_latency * 1000000.0 / frequency / fault_count,
+              fault_count);
+
+  start = Clock::QueryHostTickCount();
+  for (uint32_t i = 1; i < watch_count; i += 2) {
+    memory->CancelWriteWatch(handles[i]);
+  }
+  end = Clock::QueryHostTickCount();
+  std::printf("cancel %u watches: %.3f ms\n", watch_count / 2,
+              (end - start) * 1000.0 / frequency);
+}
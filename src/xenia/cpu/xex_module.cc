@@ -22,6 +22,7 @@
 #include "xenia/kernel/objects/xmodule.h"
 
 #include "third_party/crypto/rijndael-alg-fst.h"
+#include "third_party/xxhash/xxhash.h"
 
 namespace xe {
 namespace cpu {
@@ -192,6 +193,9 @@ bool XexModule::Load(const std::string& name, const std::string& path,
 
   std::memcpy(xex_header_mem_.data(), src_header, src_header->header_size);
 
+  // The header carries the image digest, so its hash identifies the code.
+  content_hash_ = XXH64(xex_header_mem_.data(), xex_header_mem_.size(), 0);
+
   return Load(name, path, xex_);
 }
 
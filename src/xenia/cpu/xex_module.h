@@ -74,6 +74,7 @@ class XexModule : public xe::cpu::Module {
   bool Unload();
 
   const std::string& name() const override { return name_; }
+  uint64_t content_hash() const override { return content_hash_; }
 
   bool ContainsAddress(uint32_t address) override;
 
@@ -90,6 +91,7 @@ class XexModule : public xe::cpu::Module {
   xe_xex2_ref xex_ = nullptr;
   std::vector<uint8_t> xex_header_mem_;  // Holds the xex header
   bool loaded_ = false;                  // Loaded into memory?
+  uint64_t content_hash_ = 0;            // Hash of the xex header
 
   uint32_t base_address_ = 0;
   uint32_t low_address_ = 0;
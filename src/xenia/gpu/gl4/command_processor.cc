@@ -13,8 +13,10 @@
 
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/string.h"
 #include "xenia/gpu/gl4/gl4_gpu_flags.h"
 #include "xenia/gpu/gl4/gl4_graphics_system.h"
+#include "xenia/gpu/glsl_shader_translator.h"
 #include "xenia/gpu/gpu_flags.h"
 #include "xenia/gpu/sampler_info.h"
 #include "xenia/gpu/texture_info.h"
@@ -67,6 +69,8 @@ CommandProcessor::CommandProcessor(GL4GraphicsSystem* graphics_system)
       write_ptr_index_(0),
       bin_select_(0xFFFFFFFFull),
       bin_mask_(0xFFFFFFFFull),
+      translation_cache_(
+          []() { return std::make_unique<GlslShaderTranslator>(); }),
       active_vertex_shader_(nullptr),
       active_pixel_shader_(nullptr),
       active_framebuffer_(nullptr),
@@ -84,6 +88,8 @@ bool CommandProcessor::Initialize(
     std::unique_ptr<xe::ui::GraphicsContext> context) {
   context_ = std::move(context);
 
+  StartShaderTranslation();
+
   worker_running_ = true;
   worker_thread_ = kernel::object_ref<kernel::XHostThread>(
       new kernel::XHostThread(graphics_system_->emulator()->kernel_state(),
@@ -104,6 +110,8 @@ void CommandProcessor::Shutdown() {
   write_ptr_index_event_->Set();
   worker_thread_->Wait(0, 0, 0, nullptr);
   worker_thread_.reset();
+
+  translation_cache_.Close();
 }
 
 void CommandProcessor::RequestFrameTrace(const std::wstring& root_path) {
@@ -130,7 +138,7 @@ void CommandProcessor::BeginTracing(const std::wstring& root_path) {
   }
   std::wstring path = root_path + L"stream";
   trace_state_ = TraceState::kStreaming;
-  trace_writer_.Open(path);
+  trace_writer_.Open(path, FLAGS_trace_gpu_compress);
 }
 
 void CommandProcessor::EndTracing() {
@@ -169,6 +177,34 @@ void CommandProcessor::ClearCaches() {
   cached_depth_render_targets_.clear();
 }
 
+void CommandProcessor::StartShaderTranslation() {
+  if (!FLAGS_shader_cache_path.empty()) {
+    translation_cache_.Open(
+        xe::to_absolute_path(xe::to_wstring(FLAGS_shader_cache_path)));
+  }
+  if (FLAGS_shader_translation_threads <= 0) {
+    return;
+  }
+
+  // Translations from another translator version are redone along with the
+  // shaders of the trace, ahead of the draws that need them.
+  std::vector<ShaderCache::Source> sources;
+  if (!FLAGS_shader_pretranslate_trace.empty()) {
+    TraceReader trace_reader;
+    if (trace_reader.Open(xe::to_absolute_path(
+            xe::to_wstring(FLAGS_shader_pretranslate_trace)))) {
+      sources = ShaderCache::GatherTraceSources(trace_reader);
+      XELOGI("Pretranslating %zu shaders from %s", sources.size(),
+             FLAGS_shader_pretranslate_trace.c_str());
+    } else {
+      XELOGE("Unable to open trace %s to pretranslate shaders",
+             FLAGS_shader_pretranslate_trace.c_str());
+    }
+  }
+  translation_cache_.Pretranslate(
+      std::move(sources), uint32_t(FLAGS_shader_translation_threads));
+}
+
 void CommandProcessor::WorkerThreadMain() {
   context_->MakeCurrent();
   if (!SetupGL()) {
@@ -498,7 +534,7 @@ void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
     return;
   }
 
-  regs->values[index].u32 = value;
+  dirty_state_blocks_.WriteRegister(regs, index, value);
 
   // If this is a COHER register, set the dirty flag.
   // This will block the command processor the next time it WAIT_MEM_REGs and
@@ -1024,7 +1060,7 @@ bool CommandProcessor::ExecutePacketType3_XE_SWAP(RingbufferReader* reader,
     // New trace request - we only start tracing at the beginning of a frame.
     auto frame_number = L"frame_" + std::to_wstring(counter_);
     auto path = trace_frame_path_ + frame_number;
-    trace_writer_.Open(path);
+    trace_writer_.Open(path, FLAGS_trace_gpu_compress);
   }
   ++counter_;
   return true;
@@ -1578,6 +1614,9 @@ bool CommandProcessor::IssueDraw() {
 
   status = UpdateState();
   CHECK_ISSUE_UPDATE_STATUS(status, mismatch, "Unable to setup render state");
+  // Evict everything invalidated by write watches since the last draw in one
+  // pass, rather than one texture at a time as lookups trip over them.
+  texture_cache_.Scavenge();
   status = PopulateSamplers();
   CHECK_ISSUE_UPDATE_STATUS(status, mismatch,
                             "Unable to prepare draw samplers");
@@ -1628,9 +1667,13 @@ CommandProcessor::UpdateStatus CommandProcessor::UpdateShaders(
               register_file_->values[XE_GPU_REG_SQ_PS_CONST].u32 == 0x00000000);
 
   bool dirty = false;
-  dirty |=
-      SetShadowRegister(regs.pa_su_sc_mode_cntl, XE_GPU_REG_PA_SU_SC_MODE_CNTL);
-  dirty |= SetShadowRegister(regs.sq_program_cntl, XE_GPU_REG_SQ_PROGRAM_CNTL);
+  if (dirty_state_blocks_.ConsumeDirty(kStateBlockShaders)) {
+    dirty |= SetShadowRegister(regs.pa_su_sc_mode_cntl,
+                               XE_GPU_REG_PA_SU_SC_MODE_CNTL);
+    dirty |=
+        SetShadowRegister(regs.sq_program_cntl, XE_GPU_REG_SQ_PROGRAM_CNTL);
+  }
+  // The active shaders are set by packets rather than registers.
   dirty |= regs.vertex_shader != active_vertex_shader_;
   dirty |= regs.pixel_shader != active_pixel_shader_;
   dirty |= regs.prim_type != prim_type;
@@ -1648,8 +1691,9 @@ CommandProcessor::UpdateStatus CommandProcessor::UpdateShaders(
   xe_gpu_program_cntl_t program_cntl;
   program_cntl.dword_0 = regs.sq_program_cntl;
   if (!active_vertex_shader_->has_prepared()) {
-    if (!active_vertex_shader_->PrepareVertexShader(&shader_translator_,
-                                                    program_cntl)) {
+    auto source =
+        translation_cache_.Translate(active_vertex_shader_, program_cntl);
+    if (!active_vertex_shader_->Prepare(source)) {
       XELOGE("Unable to prepare vertex shader");
       return UpdateStatus::kError;
     }
@@ -1659,8 +1703,9 @@ CommandProcessor::UpdateStatus CommandProcessor::UpdateShaders(
   }
 
   if (!active_pixel_shader_->has_prepared()) {
-    if (!active_pixel_shader_->PreparePixelShader(&shader_translator_,
-                                                  program_cntl)) {
+    auto source =
+        translation_cache_.Translate(active_pixel_shader_, program_cntl);
+    if (!active_pixel_shader_->Prepare(source)) {
       XELOGE("Unable to prepare pixel shader");
       return UpdateStatus::kError;
     }
@@ -1768,6 +1813,9 @@ CommandProcessor::UpdateStatus CommandProcessor::UpdateShaders(
 CommandProcessor::UpdateStatus CommandProcessor::UpdateRenderTargets() {
   auto& regs = update_render_targets_regs_;
 
+  if (!dirty_state_blocks_.ConsumeDirty(kStateBlockRenderTargets)) {
+    return UpdateStatus::kCompatible;
+  }
   bool dirty = false;
   dirty |= SetShadowRegister(regs.rb_modecontrol, XE_GPU_REG_RB_MODECONTROL);
   dirty |= SetShadowRegister(regs.rb_surface_info, XE_GPU_REG_RB_SURFACE_INFO);
@@ -1892,31 +1940,36 @@ CommandProcessor::UpdateStatus CommandProcessor::UpdateState() {
 CommandProcessor::UpdateStatus CommandProcessor::UpdateViewportState() {
   auto& regs = update_viewport_state_regs_;
 
+  // The draw batcher takes the vertex format with every draw, so only the
+  // shadow copies are skipped while clean.
   bool dirty = false;
-  // dirty |= SetShadowRegister(state_regs.pa_cl_clip_cntl,
-  //     XE_GPU_REG_PA_CL_CLIP_CNTL);
-  dirty |= SetShadowRegister(regs.rb_surface_info, XE_GPU_REG_RB_SURFACE_INFO);
-  dirty |= SetShadowRegister(regs.pa_cl_vte_cntl, XE_GPU_REG_PA_CL_VTE_CNTL);
-  dirty |=
-      SetShadowRegister(regs.pa_su_sc_mode_cntl, XE_GPU_REG_PA_SU_SC_MODE_CNTL);
-  dirty |= SetShadowRegister(regs.pa_sc_window_offset,
-                             XE_GPU_REG_PA_SC_WINDOW_OFFSET);
-  dirty |= SetShadowRegister(regs.pa_sc_window_scissor_tl,
-                             XE_GPU_REG_PA_SC_WINDOW_SCISSOR_TL);
-  dirty |= SetShadowRegister(regs.pa_sc_window_scissor_br,
-                             XE_GPU_REG_PA_SC_WINDOW_SCISSOR_BR);
-  dirty |= SetShadowRegister(regs.pa_cl_vport_xoffset,
-                             XE_GPU_REG_PA_CL_VPORT_XOFFSET);
-  dirty |= SetShadowRegister(regs.pa_cl_vport_yoffset,
-                             XE_GPU_REG_PA_CL_VPORT_YOFFSET);
-  dirty |= SetShadowRegister(regs.pa_cl_vport_zoffset,
-                             XE_GPU_REG_PA_CL_VPORT_ZOFFSET);
-  dirty |=
-      SetShadowRegister(regs.pa_cl_vport_xscale, XE_GPU_REG_PA_CL_VPORT_XSCALE);
-  dirty |=
-      SetShadowRegister(regs.pa_cl_vport_yscale, XE_GPU_REG_PA_CL_VPORT_YSCALE);
-  dirty |=
-      SetShadowRegister(regs.pa_cl_vport_zscale, XE_GPU_REG_PA_CL_VPORT_ZSCALE);
+  if (dirty_state_blocks_.ConsumeDirty(kStateBlockViewport)) {
+    // dirty |= SetShadowRegister(state_regs.pa_cl_clip_cntl,
+    //     XE_GPU_REG_PA_CL_CLIP_CNTL);
+    dirty |=
+        SetShadowRegister(regs.rb_surface_info, XE_GPU_REG_RB_SURFACE_INFO);
+    dirty |= SetShadowRegister(regs.pa_cl_vte_cntl, XE_GPU_REG_PA_CL_VTE_CNTL);
+    dirty |= SetShadowRegister(regs.pa_su_sc_mode_cntl,
+                               XE_GPU_REG_PA_SU_SC_MODE_CNTL);
+    dirty |= SetShadowRegister(regs.pa_sc_window_offset,
+                               XE_GPU_REG_PA_SC_WINDOW_OFFSET);
+    dirty |= SetShadowRegister(regs.pa_sc_window_scissor_tl,
+                               XE_GPU_REG_PA_SC_WINDOW_SCISSOR_TL);
+    dirty |= SetShadowRegister(regs.pa_sc_window_scissor_br,
+                               XE_GPU_REG_PA_SC_WINDOW_SCISSOR_BR);
+    dirty |= SetShadowRegister(regs.pa_cl_vport_xoffset,
+                               XE_GPU_REG_PA_CL_VPORT_XOFFSET);
+    dirty |= SetShadowRegister(regs.pa_cl_vport_yoffset,
+                               XE_GPU_REG_PA_CL_VPORT_YOFFSET);
+    dirty |= SetShadowRegister(regs.pa_cl_vport_zoffset,
+                               XE_GPU_REG_PA_CL_VPORT_ZOFFSET);
+    dirty |= SetShadowRegister(regs.pa_cl_vport_xscale,
+                               XE_GPU_REG_PA_CL_VPORT_XSCALE);
+    dirty |= SetShadowRegister(regs.pa_cl_vport_yscale,
+                               XE_GPU_REG_PA_CL_VPORT_YSCALE);
+    dirty |= SetShadowRegister(regs.pa_cl_vport_zscale,
+                               XE_GPU_REG_PA_CL_VPORT_ZSCALE);
+  }
 
   // Much of this state machine is extracted from:
   // https://github.com/freedreno/mesa/blob/master/src/mesa/drivers/dri/r200/r200_state.c
@@ -2050,6 +2103,9 @@ CommandProcessor::UpdateStatus CommandProcessor::UpdateViewportState() {
 CommandProcessor::UpdateStatus CommandProcessor::UpdateRasterizerState() {
   auto& regs = update_rasterizer_state_regs_;
 
+  if (!dirty_state_blocks_.ConsumeDirty(kStateBlockRasterizer)) {
+    return UpdateStatus::kCompatible;
+  }
   bool dirty = false;
   dirty |=
       SetShadowRegister(regs.pa_su_sc_mode_cntl, XE_GPU_REG_PA_SU_SC_MODE_CNTL);
@@ -2147,6 +2203,9 @@ CommandProcessor::UpdateStatus CommandProcessor::UpdateBlendState() {
                                color_control & 0x7,         // ALPHAFUNC
                                reg_file[XE_GPU_REG_RB_ALPHA_REF].f32);
 
+  if (!dirty_state_blocks_.ConsumeDirty(kStateBlockBlend)) {
+    return UpdateStatus::kCompatible;
+  }
   bool dirty = false;
   dirty |=
       SetShadowRegister(regs.rb_blendcontrol[0], XE_GPU_REG_RB_BLENDCONTROL_0);
@@ -2233,6 +2292,9 @@ CommandProcessor::UpdateStatus CommandProcessor::UpdateBlendState() {
 CommandProcessor::UpdateStatus CommandProcessor::UpdateDepthStencilState() {
   auto& regs = update_depth_stencil_state_regs_;
 
+  if (!dirty_state_blocks_.ConsumeDirty(kStateBlockDepthStencil)) {
+    return UpdateStatus::kCompatible;
+  }
   bool dirty = false;
   dirty |= SetShadowRegister(regs.rb_depthcontrol, XE_GPU_REG_RB_DEPTHCONTROL);
   dirty |=
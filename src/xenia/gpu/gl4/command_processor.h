@@ -21,9 +21,10 @@
 #include "xenia/base/threading.h"
 #include "xenia/gpu/gl4/draw_batcher.h"
 #include "xenia/gpu/gl4/gl4_shader.h"
-#include "xenia/gpu/gl4/gl4_shader_translator.h"
 #include "xenia/gpu/gl4/texture_cache.h"
 #include "xenia/gpu/register_file.h"
+#include "xenia/gpu/shader_cache.h"
+#include "xenia/gpu/state_block_tracker.h"
 #include "xenia/gpu/tracing.h"
 #include "xenia/gpu/xenos.h"
 #include "xenia/kernel/objects/xthread.h"
@@ -151,6 +152,7 @@ class CommandProcessor {
     } handles;
   };
 
+  void StartShaderTranslation();
   void WorkerThreadMain();
   bool SetupGL();
   void ShutdownGL();
@@ -267,7 +269,7 @@ class CommandProcessor {
   uint64_t bin_select_;
   uint64_t bin_mask_;
 
-  GL4ShaderTranslator shader_translator_;
+  ShaderCache translation_cache_;
   std::vector<std::unique_ptr<GL4Shader>> all_shaders_;
   std::unordered_map<uint64_t, GL4Shader*> shader_cache_;
   GL4Shader* active_vertex_shader_;
@@ -301,6 +303,8 @@ class CommandProcessor {
  private:
   bool SetShadowRegister(uint32_t& dest, uint32_t register_name);
   bool SetShadowRegister(float& dest, uint32_t register_name);
+  // Which Update* steps have had registers change since they last ran.
+  StateBlockTracker dirty_state_blocks_;
   struct UpdateRenderTargetsRegisters {
     uint32_t rb_modecontrol;
     uint32_t rb_surface_info;
@@ -224,6 +224,15 @@ void GL4GraphicsSystem::PlayTrace(const uint8_t* trace_data, size_t trace_size,
           pending_packet = cmd;
           break;
         }
+        case TraceCommandType::kPacketStartRef: {
+          auto cmd = reinterpret_cast<const PacketStartRefCommand*>(trace_ptr);
+          std::memcpy(memory()->TranslatePhysical(cmd->base_ptr),
+                      GetTracePacketData(trace_ptr), cmd->count * 4);
+          trace_ptr += sizeof(*cmd);
+          // Only base_ptr and count are used, which both layouts share.
+          pending_packet = reinterpret_cast<const PacketStartCommand*>(cmd);
+          break;
+        }
         case TraceCommandType::kPacketEnd: {
           auto cmd = reinterpret_cast<const PacketEndCommand*>(trace_ptr);
           trace_ptr += sizeof(*cmd);
@@ -245,6 +254,13 @@ void GL4GraphicsSystem::PlayTrace(const uint8_t* trace_data, size_t trace_size,
           trace_ptr += cmd->length;
           break;
         }
+        case TraceCommandType::kMemoryReadRef: {
+          auto cmd = reinterpret_cast<const MemoryReadRefCommand*>(trace_ptr);
+          std::memcpy(memory()->TranslatePhysical(cmd->base_ptr),
+                      trace_ptr - cmd->payload_distance, cmd->length);
+          trace_ptr += sizeof(*cmd);
+          break;
+        }
         case TraceCommandType::kMemoryWrite: {
           auto cmd = reinterpret_cast<const MemoryWriteCommand*>(trace_ptr);
           trace_ptr += sizeof(*cmd);
@@ -252,6 +268,12 @@ void GL4GraphicsSystem::PlayTrace(const uint8_t* trace_data, size_t trace_size,
           trace_ptr += cmd->length;
           break;
         }
+        case TraceCommandType::kMemoryWriteRef: {
+          auto cmd = reinterpret_cast<const MemoryWriteRefCommand*>(trace_ptr);
+          // ?
+          trace_ptr += sizeof(*cmd);
+          break;
+        }
         case TraceCommandType::kEvent: {
           auto cmd = reinterpret_cast<const EventCommand*>(trace_ptr);
           trace_ptr += sizeof(*cmd);
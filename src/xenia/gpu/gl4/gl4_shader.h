@@ -19,8 +19,6 @@ namespace xe {
 namespace gpu {
 namespace gl4 {
 
-class GL4ShaderTranslator;
-
 class GL4Shader : public Shader {
  public:
   GL4Shader(ShaderType shader_type, uint64_t data_hash,
@@ -30,14 +28,10 @@ class GL4Shader : public Shader {
   GLuint program() const { return program_; }
   GLuint vao() const { return vao_; }
 
-  bool PrepareVertexShader(GL4ShaderTranslator* shader_translator,
-                           const xenos::xe_gpu_program_cntl_t& program_cntl);
-  bool PreparePixelShader(GL4ShaderTranslator* shader_translator,
-                          const xenos::xe_gpu_program_cntl_t& program_cntl);
+  // Builds the program from source, as made by GlslShaderTranslator.
+  bool Prepare(const std::string& source);
 
  protected:
-  std::string GetHeader();
-  std::string GetFooter();
   bool PrepareVertexArrayObject();
   bool CompileProgram(std::string source);
 
@@ -21,6 +21,7 @@
 #include "xenia/emulator.h"
 #include "xenia/gpu/graphics_system.h"
 #include "xenia/gpu/register_file.h"
+#include "xenia/gpu/trace_reader.h"
 #include "xenia/gpu/tracing.h"
 #include "xenia/gpu/xenos.h"
 #include "xenia/profiling.h"
@@ -534,240 +535,6 @@ bool DisasmPacket(const uint8_t* base_ptr, PacketInfo* out_info) {
   }
 }
 
-PacketCategory GetPacketCategory(const uint8_t* base_ptr) {
-  const uint32_t packet = xe::load_and_swap<uint32_t>(base_ptr);
-  const uint32_t packet_type = packet >> 30;
-  switch (packet_type) {
-    case 0x00:
-    case 0x01:
-    case 0x02: {
-      return PacketCategory::kGeneric;
-    }
-    case 0x03: {
-      uint32_t opcode = (packet >> 8) & 0x7F;
-      switch (opcode) {
-        case PM4_DRAW_INDX:
-        case PM4_DRAW_INDX_2:
-          return PacketCategory::kDraw;
-        case PM4_XE_SWAP:
-          return PacketCategory::kSwap;
-        default:
-          return PacketCategory::kGeneric;
-      }
-    }
-    default: {
-      assert_unhandled_case(packet_type);
-      return PacketCategory::kGeneric;
-    }
-  }
-}
-
-// TODO(benvanik): move to tracing.h/cc
-
-class TraceReader {
- public:
-  struct Frame {
-    struct Command {
-      enum class Type {
-        kDraw,
-        kSwap,
-      };
-      const uint8_t* head_ptr;
-      const uint8_t* start_ptr;
-      const uint8_t* end_ptr;
-      Type type;
-      union {
-        struct {
-          //
-        } draw;
-        struct {
-          //
-        } swap;
-      };
-    };
-
-    const uint8_t* start_ptr;
-    const uint8_t* end_ptr;
-    int command_count;
-    std::vector<Command> commands;
-  };
-
-  TraceReader() : trace_data_(nullptr), trace_size_(0) {}
-  ~TraceReader() = default;
-
-  const Frame* frame(int n) const { return &frames_[n]; }
-  int frame_count() const { return int(frames_.size()); }
-
-  bool Open(const std::wstring& path) {
-    Close();
-
-    mmap_ = MappedMemory::Open(path, MappedMemory::Mode::kRead);
-    if (!mmap_) {
-      return false;
-    }
-
-    trace_data_ = reinterpret_cast<const uint8_t*>(mmap_->data());
-    trace_size_ = mmap_->size();
-
-    ParseTrace();
-
-    return true;
-  }
-
-  void Close() {
-    mmap_.reset();
-    trace_data_ = nullptr;
-    trace_size_ = 0;
-  }
-
-  // void Foo() {
-  //  auto trace_ptr = trace_data;
-  //  while (trace_ptr < trace_data + trace_size) {
-  //    auto cmd_type = *reinterpret_cast<const TraceCommandType*>(trace_ptr);
-  //    switch (cmd_type) {
-  //      case TraceCommandType::kPrimaryBufferStart:
-  //        break;
-  //      case TraceCommandType::kPrimaryBufferEnd:
-  //        break;
-  //      case TraceCommandType::kIndirectBufferStart:
-  //        break;
-  //      case TraceCommandType::kIndirectBufferEnd:
-  //        break;
-  //      case TraceCommandType::kPacketStart:
-  //        break;
-  //      case TraceCommandType::kPacketEnd:
-  //        break;
-  //      case TraceCommandType::kMemoryRead:
-  //        break;
-  //      case TraceCommandType::kMemoryWrite:
-  //        break;
-  //      case TraceCommandType::kEvent:
-  //        break;
-  //    }
-  //    /*trace_ptr = graphics_system->PlayTrace(
-  //    trace_ptr, trace_size - (trace_ptr - trace_data),
-  //    GraphicsSystem::TracePlaybackMode::kBreakOnSwap);*/
-  //  }
-  //}
-
- protected:
-  void ParseTrace() {
-    auto trace_ptr = trace_data_;
-    Frame current_frame = {
-        trace_ptr, nullptr, 0,
-    };
-    const PacketStartCommand* packet_start = nullptr;
-    const uint8_t* packet_start_ptr = nullptr;
-    const uint8_t* last_ptr = trace_ptr;
-    bool pending_break = false;
-    while (trace_ptr < trace_data_ + trace_size_) {
-      ++current_frame.command_count;
-      auto type = static_cast<TraceCommandType>(xe::load<uint32_t>(trace_ptr));
-      switch (type) {
-        case TraceCommandType::kPrimaryBufferStart: {
-          auto cmd =
-              reinterpret_cast<const PrimaryBufferStartCommand*>(trace_ptr);
-          trace_ptr += sizeof(*cmd) + cmd->count * 4;
-          break;
-        }
-        case TraceCommandType::kPrimaryBufferEnd: {
-          auto cmd =
-              reinterpret_cast<const PrimaryBufferEndCommand*>(trace_ptr);
-          trace_ptr += sizeof(*cmd);
-          break;
-        }
-        case TraceCommandType::kIndirectBufferStart: {
-          auto cmd =
-              reinterpret_cast<const IndirectBufferStartCommand*>(trace_ptr);
-          trace_ptr += sizeof(*cmd) + cmd->count * 4;
-          break;
-        }
-        case TraceCommandType::kIndirectBufferEnd: {
-          auto cmd =
-              reinterpret_cast<const IndirectBufferEndCommand*>(trace_ptr);
-          trace_ptr += sizeof(*cmd);
-          break;
-        }
-        case TraceCommandType::kPacketStart: {
-          auto cmd = reinterpret_cast<const PacketStartCommand*>(trace_ptr);
-          packet_start_ptr = trace_ptr;
-          packet_start = cmd;
-          trace_ptr += sizeof(*cmd) + cmd->count * 4;
-          break;
-        }
-        case TraceCommandType::kPacketEnd: {
-          auto cmd = reinterpret_cast<const PacketEndCommand*>(trace_ptr);
-          trace_ptr += sizeof(*cmd);
-          if (!packet_start_ptr) {
-            continue;
-          }
-          auto packet_category =
-              GetPacketCategory(packet_start_ptr + sizeof(*packet_start));
-          switch (packet_category) {
-            case PacketCategory::kDraw: {
-              Frame::Command command;
-              command.type = Frame::Command::Type::kDraw;
-              command.head_ptr = packet_start_ptr;
-              command.start_ptr = last_ptr;
-              command.end_ptr = trace_ptr;
-              current_frame.commands.push_back(std::move(command));
-              last_ptr = trace_ptr;
-              break;
-            }
-            case PacketCategory::kSwap: {
-              //
-              break;
-            }
-          }
-          if (pending_break) {
-            current_frame.end_ptr = trace_ptr;
-            frames_.push_back(std::move(current_frame));
-            current_frame.start_ptr = trace_ptr;
-            current_frame.end_ptr = nullptr;
-            current_frame.command_count = 0;
-            pending_break = false;
-          }
-          break;
-        }
-        case TraceCommandType::kMemoryRead: {
-          auto cmd = reinterpret_cast<const MemoryReadCommand*>(trace_ptr);
-          trace_ptr += sizeof(*cmd) + cmd->length;
-          break;
-        }
-        case TraceCommandType::kMemoryWrite: {
-          auto cmd = reinterpret_cast<const MemoryWriteCommand*>(trace_ptr);
-          trace_ptr += sizeof(*cmd) + cmd->length;
-          break;
-        }
-        case TraceCommandType::kEvent: {
-          auto cmd = reinterpret_cast<const EventCommand*>(trace_ptr);
-          trace_ptr += sizeof(*cmd);
-          switch (cmd->event_type) {
-            case EventType::kSwap: {
-              pending_break = true;
-              break;
-            }
-          }
-          break;
-        }
-        default:
-          // Broken trace file?
-          assert_unhandled_case(type);
-          break;
-      }
-    }
-    if (pending_break || current_frame.command_count) {
-      current_frame.end_ptr = trace_ptr;
-      frames_.push_back(std::move(current_frame));
-    }
-  }
-
-  std::unique_ptr<MappedMemory> mmap_;
-  const uint8_t* trace_data_;
-  size_t trace_size_;
-  std::vector<Frame> frames_;
-};
-
 class TracePlayer : public TraceReader {
  public:
   TracePlayer(xe::ui::Loop* loop, GraphicsSystem* graphics_system)
@@ -799,10 +566,22 @@ class TracePlayer : public TraceReader {
     if (current_frame_index_ == target_frame) {
       return;
     }
+    bool is_next_frame = target_frame == current_frame_index_ + 1;
     current_frame_index_ = target_frame;
     auto frame = current_frame();
     current_command_index_ = int(frame->commands.size()) - 1;
 
+    if (!is_next_frame) {
+      // Put back the memory the frame saw when recorded, in order with
+      // playback on the command processor thread.
+      auto gs = static_cast<gl4::GL4GraphicsSystem*>(graphics_system_);
+      auto physical_membase = graphics_system_->memory()->TranslatePhysical(0);
+      gs->command_processor()->CallInThread(
+          [this, target_frame, physical_membase]() {
+            RestoreMemory(target_frame, physical_membase);
+          });
+    }
+
     assert_true(frame->start_ptr <= frame->end_ptr);
     graphics_system_->PlayTrace(
         frame->start_ptr, frame->end_ptr - frame->start_ptr,
@@ -1414,7 +1193,7 @@ void DrawStateUI(xe::ui::Window* window, TracePlayer& player, Memory* memory) {
 
   auto frame = player.current_frame();
   const auto& command = frame->commands[player.current_command_index()];
-  auto packet_head = command.head_ptr + sizeof(PacketStartCommand);
+  auto packet_head = GetTracePacketData(command.head_ptr);
   uint32_t packet = xe::load_and_swap<uint32_t>(packet_head);
   uint32_t packet_type = packet >> 30;
   assert_true(packet_type == 0x03);
@@ -2057,7 +1836,7 @@ void DrawPacketDisassemblerUI(xe::ui::Window* window, TracePlayer& player,
               player.current_command_index());
   ImGui::Separator();
   ImGui::BeginChild("packet_disassembler_list");
-  const PacketStartCommand* pending_packet = nullptr;
+  const uint8_t* pending_packet_ptr = nullptr;
   auto trace_ptr = start_ptr;
   while (trace_ptr < end_ptr) {
     auto type = static_cast<TraceCommandType>(xe::load<uint32_t>(trace_ptr));
@@ -2090,17 +1869,21 @@ void DrawPacketDisassemblerUI(xe::ui::Window* window, TracePlayer& player,
       }
       case TraceCommandType::kPacketStart: {
         auto cmd = reinterpret_cast<const PacketStartCommand*>(trace_ptr);
+        pending_packet_ptr = trace_ptr;
         trace_ptr += sizeof(*cmd) + cmd->count * 4;
-        pending_packet = cmd;
+        break;
+      }
+      case TraceCommandType::kPacketStartRef: {
+        pending_packet_ptr = trace_ptr;
+        trace_ptr += sizeof(PacketStartRefCommand);
         break;
       }
       case TraceCommandType::kPacketEnd: {
         auto cmd = reinterpret_cast<const PacketEndCommand*>(trace_ptr);
         trace_ptr += sizeof(*cmd);
-        if (pending_packet) {
+        if (pending_packet_ptr) {
           PacketInfo packet_info;
-          if (DisasmPacket(reinterpret_cast<const uint8_t*>(pending_packet) +
-                               sizeof(PacketStartCommand),
+          if (DisasmPacket(GetTracePacketData(pending_packet_ptr),
                            &packet_info)) {
             if (packet_info.predicated) {
               ImGui::PushStyleColor(ImGuiCol_Text, kColorIgnored);
@@ -2142,7 +1925,7 @@ void DrawPacketDisassemblerUI(xe::ui::Window* window, TracePlayer& player,
           } else {
             ImGui::BulletText("<invalid packet>");
           }
-          pending_packet = nullptr;
+          pending_packet_ptr = nullptr;
         }
         break;
       }
@@ -2158,6 +1941,14 @@ void DrawPacketDisassemblerUI(xe::ui::Window* window, TracePlayer& player,
         // ImGui::BulletText("MemoryWrite");
         break;
       }
+      case TraceCommandType::kMemoryReadRef: {
+        trace_ptr += sizeof(MemoryReadRefCommand);
+        break;
+      }
+      case TraceCommandType::kMemoryWriteRef: {
+        trace_ptr += sizeof(MemoryWriteRefCommand);
+        break;
+      }
       case TraceCommandType::kEvent: {
         auto cmd = reinterpret_cast<const EventCommand*>(trace_ptr);
         trace_ptr += sizeof(*cmd);
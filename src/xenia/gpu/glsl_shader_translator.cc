@@ -7,16 +7,16 @@
  ******************************************************************************
  */
 
-#include "xenia/gpu/gl4/gl4_shader_translator.h"
+#include "xenia/gpu/glsl_shader_translator.h"
+
+#include <algorithm>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
-#include "xenia/gpu/gpu_flags.h"
 
 namespace xe {
 namespace gpu {
-namespace gl4 {
 
 using namespace xe::gpu::ucode;
 using namespace xe::gpu::xenos;
@@ -29,7 +29,7 @@ static const char chan_names[] = {
     '0', '1', '?', '_',
 };
 
-const char* GetVertexFormatTypeName(const GL4Shader::BufferDescElement& el) {
+const char* GetVertexFormatTypeName(const Shader::BufferDescElement& el) {
   switch (el.format) {
     case VertexFormat::k_32:
     case VertexFormat::k_32_FLOAT:
@@ -57,18 +57,199 @@ const char* GetVertexFormatTypeName(const GL4Shader::BufferDescElement& el) {
   }
 }
 
-GL4ShaderTranslator::GL4ShaderTranslator() : output_(kOutputCapacity) {}
-
-GL4ShaderTranslator::~GL4ShaderTranslator() = default;
-
-void GL4ShaderTranslator::Reset(GL4Shader* shader) {
+namespace {
+
+const std::string& GetHeader() {
+  static const std::string header =
+      "#version 450\n"
+      "#extension all : warn\n"
+      "#extension GL_ARB_bindless_texture : require\n"
+      "#extension GL_ARB_explicit_uniform_location : require\n"
+      "#extension GL_ARB_shader_draw_parameters : require\n"
+      "#extension GL_ARB_shader_storage_buffer_object : require\n"
+      "#extension GL_ARB_shading_language_420pack : require\n"
+      "#extension GL_ARB_fragment_coord_conventions : require\n"
+      "#define FLT_MAX 3.402823466e+38\n"
+      "precision highp float;\n"
+      "precision highp int;\n"
+      "layout(std140, column_major) uniform;\n"
+      "layout(std430, column_major) buffer;\n"
+      "\n"
+      // This must match DrawBatcher::CommonHeader.
+      "struct StateData {\n"
+      "  vec4 window_scale;\n"
+      "  vec4 vtx_fmt;\n"
+      "  vec4 alpha_test;\n"
+      // TODO(benvanik): variable length.
+      "  uvec2 texture_samplers[32];\n"
+      "  vec4 float_consts[512];\n"
+      "  int bool_consts[8];\n"
+      "  int loop_consts[32];\n"
+      "};\n"
+      "layout(binding = 0) buffer State {\n"
+      "  StateData states[];\n"
+      "};\n"
+      "\n"
+      "struct VertexData {\n"
+      "  vec4 o[16];\n"
+      "};\n";
+  return header;
+}
+
+const std::string& GetFooter() {
+  // http://www.nvidia.com/object/cube_map_ogl_tutorial.html
+  // http://developer.amd.com/wordpress/media/2012/10/R600_Instruction_Set_Architecture.pdf
+  // src0 = Rn.zzxy, src1 = Rn.yxzz
+  // dst.W = FaceId;
+  // dst.Z = 2.0f * MajorAxis;
+  // dst.Y = S cube coordinate;
+  // dst.X = T cube coordinate;
+  /*
+  major axis
+  direction     target                                sc     tc    ma
+  ----------   ------------------------------------   ---    ---   ---
+  +rx          GL_TEXTURE_CUBE_MAP_POSITIVE_X_EXT=0   -rz    -ry   rx
+  -rx          GL_TEXTURE_CUBE_MAP_NEGATIVE_X_EXT=1   +rz    -ry   rx
+  +ry          GL_TEXTURE_CUBE_MAP_POSITIVE_Y_EXT=2   +rx    +rz   ry
+  -ry          GL_TEXTURE_CUBE_MAP_NEGATIVE_Y_EXT=3   +rx    -rz   ry
+  +rz          GL_TEXTURE_CUBE_MAP_POSITIVE_Z_EXT=4   +rx    -ry   rz
+  -rz          GL_TEXTURE_CUBE_MAP_NEGATIVE_Z_EXT=5   -rx    -ry   rz
+  */
+  static const std::string footer =
+      "vec4 cube(vec4 src0, vec4 src1) {\n"
+      "  vec3 src = vec3(src1.y, src1.x, src1.z);\n"
+      "  vec3 abs_src = abs(src);\n"
+      "  int face_id;\n"
+      "  float sc;\n"
+      "  float tc;\n"
+      "  float ma;\n"
+      "  if (abs_src.x > abs_src.y && abs_src.x > abs_src.z) {\n"
+      "    if (src.x > 0.0) {\n"
+      "      face_id = 0; sc = -abs_src.z; tc = -abs_src.y; ma = abs_src.x;\n"
+      "    } else {\n"
+      "      face_id = 1; sc =  abs_src.z; tc = -abs_src.y; ma = abs_src.x;\n"
+      "    }\n"
+      "  } else if (abs_src.y > abs_src.x && abs_src.y > abs_src.z) {\n"
+      "    if (src.y > 0.0) {\n"
+      "      face_id = 2; sc =  abs_src.x; tc =  abs_src.z; ma = abs_src.y;\n"
+      "    } else {\n"
+      "      face_id = 3; sc =  abs_src.x; tc = -abs_src.z; ma = abs_src.y;\n"
+      "    }\n"
+      "  } else {\n"
+      "    if (src.z > 0.0) {\n"
+      "      face_id = 4; sc =  abs_src.x; tc = -abs_src.y; ma = abs_src.z;\n"
+      "    } else {\n"
+      "      face_id = 5; sc = -abs_src.x; tc = -abs_src.y; ma = abs_src.z;\n"
+      "    }\n"
+      "  }\n"
+      "  float s = (sc / ma + 1.0) / 2.0;\n"
+      "  float t = (tc / ma + 1.0) / 2.0;\n"
+      "  return vec4(t, s, 2.0 * ma, float(face_id));\n"
+      "}\n";
+  return footer;
+}
+
+}  // namespace
+
+GlslShaderTranslator::GlslShaderTranslator() : output_(kOutputCapacity) {}
+
+GlslShaderTranslator::~GlslShaderTranslator() = default;
+
+std::string GlslShaderTranslator::Translate(
+    Shader* shader, const xe_gpu_program_cntl_t& program_cntl) {
+  std::string source;
+  std::string translated_source;
+  if (shader->type() == ShaderType::kVertex) {
+    std::string apply_transform =
+        "vec4 applyTransform(const in StateData state, vec4 pos) {\n"
+        "  if (state.vtx_fmt.w == 0.0) {\n"
+        "    // w is 1/W0, so fix it.\n"
+        "    pos.w = 1.0 / pos.w;\n"
+        "  }\n"
+        "  if (state.vtx_fmt.x != 0.0) {\n"
+        "    // Already multiplied by 1/W0, so pull it out.\n"
+        "    pos.xy /= pos.w;\n"
+        "  }\n"
+        "  if (state.vtx_fmt.z != 0.0) {\n"
+        "    // Already multiplied by 1/W0, so pull it out.\n"
+        "    pos.z /= pos.w;\n"
+        "  }\n"
+        "  pos.xy *= state.window_scale.xy;\n"
+        "  return pos;\n"
+        "}\n";
+    source =
+        GetHeader() + apply_transform +
+        "out gl_PerVertex {\n"
+        "  vec4 gl_Position;\n"
+        "  float gl_PointSize;\n"
+        "  float gl_ClipDistance[];\n"
+        "};\n"
+        "layout(location = 0) flat out uint draw_id;\n"
+        "layout(location = 1) out VertexData vtx;\n"
+        "void processVertex(const in StateData state);\n"
+        "void main() {\n" +
+        (shader->alloc_counts().positions
+             ? "  gl_Position = vec4(0.0, 0.0, 0.0, 1.0);\n"
+             : "") +
+        (shader->alloc_counts().point_size ? "  gl_PointSize = 1.0;\n"
+                                           : "") +
+        "  for (int i = 0; i < vtx.o.length(); ++i) {\n"
+        "    vtx.o[i] = vec4(0.0, 0.0, 0.0, 0.0);\n"
+        "  }\n"
+        "  const StateData state = states[gl_DrawIDARB];\n"
+        "  processVertex(state);\n"
+        "  gl_Position = applyTransform(state, gl_Position);\n"
+        "  draw_id = gl_DrawIDARB;\n"
+        "}\n" +
+        GetFooter();
+    translated_source = TranslateVertexShader(shader, program_cntl);
+  } else {
+    source =
+        GetHeader() +
+        "layout(origin_upper_left, pixel_center_integer) in vec4 "
+        "gl_FragCoord;\n"
+        "layout(location = 0) flat in uint draw_id;\n"
+        "layout(location = 1) in VertexData vtx;\n"
+        "layout(location = 0) out vec4 oC[4];\n"
+        "void processFragment(const in StateData state);\n"
+        "void applyAlphaTest(int alpha_func, float alpha_ref) {\n"
+        "  bool passes = false;\n"
+        "  switch (alpha_func) {\n"
+        "  case 0:                                          break;\n"
+        "  case 1: if (oC[0].a <  alpha_ref) passes = true; break;\n"
+        "  case 2: if (oC[0].a == alpha_ref) passes = true; break;\n"
+        "  case 3: if (oC[0].a <= alpha_ref) passes = true; break;\n"
+        "  case 4: if (oC[0].a >  alpha_ref) passes = true; break;\n"
+        "  case 5: if (oC[0].a != alpha_ref) passes = true; break;\n"
+        "  case 6: if (oC[0].a >= alpha_ref) passes = true; break;\n"
+        "  case 7:                           passes = true; break;\n"
+        "  };\n"
+        "  if (!passes) discard;\n"
+        "}\n"
+        "void main() {\n" +
+        "  const StateData state = states[draw_id];\n"
+        "  processFragment(state);\n"
+        "  if (state.alpha_test.x != 0.0) {\n"
+        "    applyAlphaTest(int(state.alpha_test.y), state.alpha_test.z);\n"
+        "  }\n"
+        "}\n" +
+        GetFooter();
+    translated_source = TranslatePixelShader(shader, program_cntl);
+  }
+  if (translated_source.empty()) {
+    return translated_source;
+  }
+  return source + translated_source;
+}
+
+void GlslShaderTranslator::Reset(Shader* shader) {
   output_.Reset();
   shader_type_ = shader->type();
   dwords_ = shader->data();
 }
 
-std::string GL4ShaderTranslator::TranslateVertexShader(
-    GL4Shader* vertex_shader, const xe_gpu_program_cntl_t& program_cntl) {
+std::string GlslShaderTranslator::TranslateVertexShader(
+    Shader* vertex_shader, const xe_gpu_program_cntl_t& program_cntl) {
   Reset(vertex_shader);
 
   // Normal shaders only, for now.
@@ -126,8 +307,8 @@ std::string GL4ShaderTranslator::TranslateVertexShader(
   return output_.to_string();
 }
 
-std::string GL4ShaderTranslator::TranslatePixelShader(
-    GL4Shader* pixel_shader, const xe_gpu_program_cntl_t& program_cntl) {
+std::string GlslShaderTranslator::TranslatePixelShader(
+    Shader* pixel_shader, const xe_gpu_program_cntl_t& program_cntl) {
   Reset(pixel_shader);
 
   // We need an input VS to make decisions here.
@@ -161,7 +342,7 @@ std::string GL4ShaderTranslator::TranslatePixelShader(
   return output_.to_string();
 }
 
-void GL4ShaderTranslator::AppendSrcReg(const instr_alu_t& op, int i) {
+void GlslShaderTranslator::AppendSrcReg(const instr_alu_t& op, int i) {
   switch (i) {
     case 1: {
       int const_slot = 0;
@@ -184,9 +365,9 @@ void GL4ShaderTranslator::AppendSrcReg(const instr_alu_t& op, int i) {
   }
 }
 
-void GL4ShaderTranslator::AppendSrcReg(const instr_alu_t& op, uint32_t num,
-                                       uint32_t type, uint32_t swiz,
-                                       uint32_t negate, int const_slot) {
+void GlslShaderTranslator::AppendSrcReg(const instr_alu_t& op, uint32_t num,
+                                        uint32_t type, uint32_t swiz,
+                                        uint32_t negate, int const_slot) {
   if (negate) {
     Append("-");
   }
@@ -238,9 +419,9 @@ void GL4ShaderTranslator::AppendSrcReg(const instr_alu_t& op, uint32_t num,
   }
 }
 
-void GL4ShaderTranslator::PrintSrcReg(uint32_t num, uint32_t type,
-                                      uint32_t swiz, uint32_t negate,
-                                      uint32_t abs_constants) {
+void GlslShaderTranslator::PrintSrcReg(uint32_t num, uint32_t type,
+                                       uint32_t swiz, uint32_t negate,
+                                       uint32_t abs_constants) {
   if (negate) {
     Append("-");
   }
@@ -271,7 +452,7 @@ void GL4ShaderTranslator::PrintSrcReg(uint32_t num, uint32_t type,
   }
 }
 
-void GL4ShaderTranslator::PrintVectorDstReg(const instr_alu_t& alu) {
+void GlslShaderTranslator::PrintVectorDstReg(const instr_alu_t& alu) {
   Append("%s%u", alu.export_data ? "export" : "R", alu.vector_dest);
   auto mask = alu.scalar_write_mask;
   if (mask != 0xf) {
@@ -283,7 +464,7 @@ void GL4ShaderTranslator::PrintVectorDstReg(const instr_alu_t& alu) {
   }
 }
 
-void GL4ShaderTranslator::PrintScalarDstReg(const instr_alu_t& alu) {
+void GlslShaderTranslator::PrintScalarDstReg(const instr_alu_t& alu) {
   Append("%s%u", alu.export_data ? "export" : "R",
          alu.export_data ? alu.vector_dest : alu.scalar_dest);
   auto mask = alu.scalar_write_mask;
@@ -296,7 +477,7 @@ void GL4ShaderTranslator::PrintScalarDstReg(const instr_alu_t& alu) {
   }
 }
 
-void GL4ShaderTranslator::PrintExportComment(uint32_t num) {
+void GlslShaderTranslator::PrintExportComment(uint32_t num) {
   const char* name = nullptr;
   switch (shader_type_) {
     case ShaderType::kVertex:
@@ -331,17 +512,17 @@ void GL4ShaderTranslator::PrintExportComment(uint32_t num) {
   }
 }
 
-void GL4ShaderTranslator::BeginAppendVectorOp(const ucode::instr_alu_t& op) {
+void GlslShaderTranslator::BeginAppendVectorOp(const ucode::instr_alu_t& op) {
   Append("  pv = (");
 }
 
-void GL4ShaderTranslator::AppendVectorOpSrcReg(const ucode::instr_alu_t& op,
-                                               int i) {
+void GlslShaderTranslator::AppendVectorOpSrcReg(const ucode::instr_alu_t& op,
+                                                int i) {
   AppendSrcReg(op, i);
 }
 
-void GL4ShaderTranslator::EndAppendVectorOp(const ucode::instr_alu_t& op,
-                                            uint32_t append_flags) {
+void GlslShaderTranslator::EndAppendVectorOp(const ucode::instr_alu_t& op,
+                                             uint32_t append_flags) {
   Append(");\n");
   if (op.vector_clamp) {
     Append("  pv = clamp(pv, 0.0, 1.0);\n");
@@ -407,17 +588,17 @@ void GL4ShaderTranslator::EndAppendVectorOp(const ucode::instr_alu_t& op,
   }
 }
 
-void GL4ShaderTranslator::BeginAppendScalarOp(const ucode::instr_alu_t& op) {
+void GlslShaderTranslator::BeginAppendScalarOp(const ucode::instr_alu_t& op) {
   Append("  ps = (");
 }
 
-void GL4ShaderTranslator::AppendScalarOpSrcReg(const ucode::instr_alu_t& op,
-                                               int i) {
+void GlslShaderTranslator::AppendScalarOpSrcReg(const ucode::instr_alu_t& op,
+                                                int i) {
   AppendSrcReg(op, i);
 }
 
-void GL4ShaderTranslator::EndAppendScalarOp(const ucode::instr_alu_t& op,
-                                            uint32_t append_flags) {
+void GlslShaderTranslator::EndAppendScalarOp(const ucode::instr_alu_t& op,
+                                             uint32_t append_flags) {
   Append(").x;\n");
   if (op.scalar_clamp) {
     Append("  ps = clamp(ps, 0.0, 1.0);\n");
@@ -443,8 +624,8 @@ void GL4ShaderTranslator::EndAppendScalarOp(const ucode::instr_alu_t& op,
   }
 }
 
-void GL4ShaderTranslator::AppendOpDestRegName(const ucode::instr_alu_t& op,
-                                              uint32_t dest_num) {
+void GlslShaderTranslator::AppendOpDestRegName(const ucode::instr_alu_t& op,
+                                               uint32_t dest_num) {
   if (!op.export_data) {
     // Register.
     // TODO(benvanik): relative? abs? etc
@@ -494,7 +675,7 @@ void GL4ShaderTranslator::AppendOpDestRegName(const ucode::instr_alu_t& op,
   }
 }
 
-bool GL4ShaderTranslator::TranslateALU_ADDv(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_ADDv(const instr_alu_t& alu) {
   BeginAppendVectorOp(alu);
   AppendVectorOpSrcReg(alu, 1);
   Append(" + ");
@@ -503,7 +684,7 @@ bool GL4ShaderTranslator::TranslateALU_ADDv(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_MULv(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_MULv(const instr_alu_t& alu) {
   BeginAppendVectorOp(alu);
   AppendVectorOpSrcReg(alu, 1);
   Append(" * ");
@@ -512,7 +693,7 @@ bool GL4ShaderTranslator::TranslateALU_MULv(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_MAXv(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_MAXv(const instr_alu_t& alu) {
   BeginAppendVectorOp(alu);
   if (alu.src1_reg == alu.src2_reg && alu.src1_sel == alu.src2_sel &&
       alu.src1_swiz == alu.src2_swiz &&
@@ -530,7 +711,7 @@ bool GL4ShaderTranslator::TranslateALU_MAXv(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_MINv(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_MINv(const instr_alu_t& alu) {
   BeginAppendVectorOp(alu);
   Append("min(");
   AppendVectorOpSrcReg(alu, 1);
@@ -541,8 +722,8 @@ bool GL4ShaderTranslator::TranslateALU_MINv(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_SETXXv(const instr_alu_t& alu,
-                                              const char* op) {
+bool GlslShaderTranslator::TranslateALU_SETXXv(const instr_alu_t& alu,
+                                               const char* op) {
   BeginAppendVectorOp(alu);
   Append("vec4((");
   AppendVectorOpSrcReg(alu, 1);
@@ -564,20 +745,20 @@ bool GL4ShaderTranslator::TranslateALU_SETXXv(const instr_alu_t& alu,
   EndAppendVectorOp(alu);
   return true;
 }
-bool GL4ShaderTranslator::TranslateALU_SETEv(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_SETEv(const instr_alu_t& alu) {
   return TranslateALU_SETXXv(alu, "==");
 }
-bool GL4ShaderTranslator::TranslateALU_SETGTv(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_SETGTv(const instr_alu_t& alu) {
   return TranslateALU_SETXXv(alu, ">");
 }
-bool GL4ShaderTranslator::TranslateALU_SETGTEv(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_SETGTEv(const instr_alu_t& alu) {
   return TranslateALU_SETXXv(alu, ">=");
 }
-bool GL4ShaderTranslator::TranslateALU_SETNEv(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_SETNEv(const instr_alu_t& alu) {
   return TranslateALU_SETXXv(alu, "!=");
 }
 
-bool GL4ShaderTranslator::TranslateALU_FRACv(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_FRACv(const instr_alu_t& alu) {
   BeginAppendVectorOp(alu);
   Append("fract(");
   AppendVectorOpSrcReg(alu, 1);
@@ -586,7 +767,7 @@ bool GL4ShaderTranslator::TranslateALU_FRACv(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_TRUNCv(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_TRUNCv(const instr_alu_t& alu) {
   BeginAppendVectorOp(alu);
   Append("trunc(");
   AppendVectorOpSrcReg(alu, 1);
@@ -595,7 +776,7 @@ bool GL4ShaderTranslator::TranslateALU_TRUNCv(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_FLOORv(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_FLOORv(const instr_alu_t& alu) {
   BeginAppendVectorOp(alu);
   Append("floor(");
   AppendVectorOpSrcReg(alu, 1);
@@ -604,7 +785,7 @@ bool GL4ShaderTranslator::TranslateALU_FLOORv(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_MULADDv(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_MULADDv(const instr_alu_t& alu) {
   BeginAppendVectorOp(alu);
   Append("(");
   AppendVectorOpSrcReg(alu, 1);
@@ -616,8 +797,8 @@ bool GL4ShaderTranslator::TranslateALU_MULADDv(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_CNDXXv(const instr_alu_t& alu,
-                                              const char* op) {
+bool GlslShaderTranslator::TranslateALU_CNDXXv(const instr_alu_t& alu,
+                                               const char* op) {
   BeginAppendVectorOp(alu);
   // TODO(benvanik): check argument order - could be 3 as compare and 1 and 2 as
   // values.
@@ -649,17 +830,17 @@ bool GL4ShaderTranslator::TranslateALU_CNDXXv(const instr_alu_t& alu,
   EndAppendVectorOp(alu);
   return true;
 }
-bool GL4ShaderTranslator::TranslateALU_CNDEv(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_CNDEv(const instr_alu_t& alu) {
   return TranslateALU_CNDXXv(alu, "==");
 }
-bool GL4ShaderTranslator::TranslateALU_CNDGTEv(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_CNDGTEv(const instr_alu_t& alu) {
   return TranslateALU_CNDXXv(alu, ">=");
 }
-bool GL4ShaderTranslator::TranslateALU_CNDGTv(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_CNDGTv(const instr_alu_t& alu) {
   return TranslateALU_CNDXXv(alu, ">");
 }
 
-bool GL4ShaderTranslator::TranslateALU_DOT4v(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_DOT4v(const instr_alu_t& alu) {
   BeginAppendVectorOp(alu);
   Append("dot(");
   AppendVectorOpSrcReg(alu, 1);
@@ -670,7 +851,7 @@ bool GL4ShaderTranslator::TranslateALU_DOT4v(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_DOT3v(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_DOT3v(const instr_alu_t& alu) {
   BeginAppendVectorOp(alu);
   Append("dot(vec4(");
   AppendVectorOpSrcReg(alu, 1);
@@ -681,7 +862,7 @@ bool GL4ShaderTranslator::TranslateALU_DOT3v(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_DOT2ADDv(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_DOT2ADDv(const instr_alu_t& alu) {
   BeginAppendVectorOp(alu);
   Append("dot(vec4(");
   AppendVectorOpSrcReg(alu, 1);
@@ -694,7 +875,7 @@ bool GL4ShaderTranslator::TranslateALU_DOT2ADDv(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_CUBEv(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_CUBEv(const instr_alu_t& alu) {
   BeginAppendVectorOp(alu);
   Append("cube(");
   AppendVectorOpSrcReg(alu, 1);
@@ -705,7 +886,7 @@ bool GL4ShaderTranslator::TranslateALU_CUBEv(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_MAX4v(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_MAX4v(const instr_alu_t& alu) {
   BeginAppendVectorOp(alu);
   Append("max(");
   Append("max(");
@@ -722,7 +903,7 @@ bool GL4ShaderTranslator::TranslateALU_MAX4v(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_PRED_SETXX_PUSHv(
+bool GlslShaderTranslator::TranslateALU_PRED_SETXX_PUSHv(
     const ucode::instr_alu_t& alu, const char* op) {
   Append("  p = ((");
   AppendVectorOpSrcReg(alu, 1);
@@ -740,24 +921,24 @@ bool GL4ShaderTranslator::TranslateALU_PRED_SETXX_PUSHv(
   EndAppendVectorOp(alu);
   return true;
 }
-bool GL4ShaderTranslator::TranslateALU_PRED_SETE_PUSHv(
+bool GlslShaderTranslator::TranslateALU_PRED_SETE_PUSHv(
     const ucode::instr_alu_t& alu) {
   return TranslateALU_PRED_SETXX_PUSHv(alu, "==");
 }
-bool GL4ShaderTranslator::TranslateALU_PRED_SETNE_PUSHv(
+bool GlslShaderTranslator::TranslateALU_PRED_SETNE_PUSHv(
     const ucode::instr_alu_t& alu) {
   return TranslateALU_PRED_SETXX_PUSHv(alu, "!=");
 }
-bool GL4ShaderTranslator::TranslateALU_PRED_SETGT_PUSHv(
+bool GlslShaderTranslator::TranslateALU_PRED_SETGT_PUSHv(
     const ucode::instr_alu_t& alu) {
   return TranslateALU_PRED_SETXX_PUSHv(alu, ">");
 }
-bool GL4ShaderTranslator::TranslateALU_PRED_SETGTE_PUSHv(
+bool GlslShaderTranslator::TranslateALU_PRED_SETGTE_PUSHv(
     const ucode::instr_alu_t& alu) {
   return TranslateALU_PRED_SETXX_PUSHv(alu, ">=");
 }
 
-bool GL4ShaderTranslator::TranslateALU_DSTv(const ucode::instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_DSTv(const ucode::instr_alu_t& alu) {
   BeginAppendVectorOp(alu);
   Append("vec4(1.0, (");
   AppendVectorOpSrcReg(alu, 1);
@@ -772,7 +953,7 @@ bool GL4ShaderTranslator::TranslateALU_DSTv(const ucode::instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_MOVAv(const ucode::instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_MOVAv(const ucode::instr_alu_t& alu) {
   Append("  a0 = clamp(int(floor(");
   AppendVectorOpSrcReg(alu, 1);
   Append(".w + 0.5)), -256, 255);\n");
@@ -793,7 +974,7 @@ bool GL4ShaderTranslator::TranslateALU_MOVAv(const ucode::instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_ADDs(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_ADDs(const instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   AppendScalarOpSrcReg(alu, 3);
   Append(".x + ");
@@ -803,7 +984,7 @@ bool GL4ShaderTranslator::TranslateALU_ADDs(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_ADD_PREVs(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_ADD_PREVs(const instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   AppendSrcReg(alu, 3);
   Append(".x + ps");
@@ -811,7 +992,7 @@ bool GL4ShaderTranslator::TranslateALU_ADD_PREVs(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_MULs(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_MULs(const instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   AppendScalarOpSrcReg(alu, 3);
   Append(".x * ");
@@ -821,7 +1002,7 @@ bool GL4ShaderTranslator::TranslateALU_MULs(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_MUL_PREVs(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_MUL_PREVs(const instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   AppendSrcReg(alu, 3);
   Append(".x * ps");
@@ -831,7 +1012,7 @@ bool GL4ShaderTranslator::TranslateALU_MUL_PREVs(const instr_alu_t& alu) {
 
 // ...
 
-bool GL4ShaderTranslator::TranslateALU_MAXs(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_MAXs(const instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   if ((alu.src3_swiz & 0x3) == (((alu.src3_swiz >> 2) + 1) & 0x3)) {
     // This is a mov.
@@ -847,7 +1028,7 @@ bool GL4ShaderTranslator::TranslateALU_MAXs(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_MINs(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_MINs(const instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   Append("min(");
   AppendScalarOpSrcReg(alu, 3);
@@ -858,8 +1039,8 @@ bool GL4ShaderTranslator::TranslateALU_MINs(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_SETXXs(const instr_alu_t& alu,
-                                              const char* op) {
+bool GlslShaderTranslator::TranslateALU_SETXXs(const instr_alu_t& alu,
+                                               const char* op) {
   BeginAppendScalarOp(alu);
   Append("(");
   AppendScalarOpSrcReg(alu, 3);
@@ -867,20 +1048,20 @@ bool GL4ShaderTranslator::TranslateALU_SETXXs(const instr_alu_t& alu,
   EndAppendScalarOp(alu);
   return true;
 }
-bool GL4ShaderTranslator::TranslateALU_SETEs(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_SETEs(const instr_alu_t& alu) {
   return TranslateALU_SETXXs(alu, "==");
 }
-bool GL4ShaderTranslator::TranslateALU_SETGTs(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_SETGTs(const instr_alu_t& alu) {
   return TranslateALU_SETXXs(alu, ">");
 }
-bool GL4ShaderTranslator::TranslateALU_SETGTEs(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_SETGTEs(const instr_alu_t& alu) {
   return TranslateALU_SETXXs(alu, ">=");
 }
-bool GL4ShaderTranslator::TranslateALU_SETNEs(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_SETNEs(const instr_alu_t& alu) {
   return TranslateALU_SETXXs(alu, "!=");
 }
 
-bool GL4ShaderTranslator::TranslateALU_FRACs(const ucode::instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_FRACs(const ucode::instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   Append("fract(");
   AppendScalarOpSrcReg(alu, 3);
@@ -889,7 +1070,7 @@ bool GL4ShaderTranslator::TranslateALU_FRACs(const ucode::instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_TRUNCs(const ucode::instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_TRUNCs(const ucode::instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   Append("trunc(");
   AppendScalarOpSrcReg(alu, 3);
@@ -898,7 +1079,7 @@ bool GL4ShaderTranslator::TranslateALU_TRUNCs(const ucode::instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_FLOORs(const ucode::instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_FLOORs(const ucode::instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   Append("floor(");
   AppendScalarOpSrcReg(alu, 3);
@@ -907,7 +1088,7 @@ bool GL4ShaderTranslator::TranslateALU_FLOORs(const ucode::instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_EXP_IEEE(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_EXP_IEEE(const instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   Append("pow(2.0, ");
   AppendScalarOpSrcReg(alu, 3);
@@ -916,7 +1097,7 @@ bool GL4ShaderTranslator::TranslateALU_EXP_IEEE(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_LOG_CLAMP(
+bool GlslShaderTranslator::TranslateALU_LOG_CLAMP(
     const ucode::instr_alu_t& alu) {
   Append("  ps = log2(");
   AppendScalarOpSrcReg(alu, 3);
@@ -927,7 +1108,8 @@ bool GL4ShaderTranslator::TranslateALU_LOG_CLAMP(
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_LOG_IEEE(const ucode::instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_LOG_IEEE(
+    const ucode::instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   Append("log2(");
   AppendScalarOpSrcReg(alu, 3);
@@ -936,7 +1118,7 @@ bool GL4ShaderTranslator::TranslateALU_LOG_IEEE(const ucode::instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_RECIP_CLAMP(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_RECIP_CLAMP(const instr_alu_t& alu) {
   // if result == -inf result = -flt_max
   // if result == +inf result = flt_max
   BeginAppendScalarOp(alu);
@@ -946,7 +1128,7 @@ bool GL4ShaderTranslator::TranslateALU_RECIP_CLAMP(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_RECIP_FF(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_RECIP_FF(const instr_alu_t& alu) {
   // if result == -inf result = -zero
   // if result == +inf result = zero
   BeginAppendScalarOp(alu);
@@ -956,7 +1138,7 @@ bool GL4ShaderTranslator::TranslateALU_RECIP_FF(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_RECIP_IEEE(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_RECIP_IEEE(const instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   Append("1.0 / ");
   AppendScalarOpSrcReg(alu, 3);
@@ -964,7 +1146,7 @@ bool GL4ShaderTranslator::TranslateALU_RECIP_IEEE(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_RECIPSQ_CLAMP(
+bool GlslShaderTranslator::TranslateALU_RECIPSQ_CLAMP(
     const ucode::instr_alu_t& alu) {
   // if result == -inf result = -flt_max
   // if result == +inf result = flt_max
@@ -976,7 +1158,7 @@ bool GL4ShaderTranslator::TranslateALU_RECIPSQ_CLAMP(
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_RECIPSQ_FF(
+bool GlslShaderTranslator::TranslateALU_RECIPSQ_FF(
     const ucode::instr_alu_t& alu) {
   // if result == -inf result = -zero
   // if result == +inf result = zero
@@ -988,7 +1170,7 @@ bool GL4ShaderTranslator::TranslateALU_RECIPSQ_FF(
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_RECIPSQ_IEEE(
+bool GlslShaderTranslator::TranslateALU_RECIPSQ_IEEE(
     const ucode::instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   Append("inversesqrt(");
@@ -998,7 +1180,7 @@ bool GL4ShaderTranslator::TranslateALU_RECIPSQ_IEEE(
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_MOVAs(const ucode::instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_MOVAs(const ucode::instr_alu_t& alu) {
   Append("  a0 = clamp(int(floor(");
   AppendScalarOpSrcReg(alu, 3);
   Append(".x + 0.5)), -256, 255);\n");
@@ -1017,7 +1199,7 @@ bool GL4ShaderTranslator::TranslateALU_MOVAs(const ucode::instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_MOVA_FLOORs(
+bool GlslShaderTranslator::TranslateALU_MOVA_FLOORs(
     const ucode::instr_alu_t& alu) {
   Append("  a0 = clamp(int(floor(");
   AppendScalarOpSrcReg(alu, 3);
@@ -1037,7 +1219,7 @@ bool GL4ShaderTranslator::TranslateALU_MOVA_FLOORs(
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_SUBs(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_SUBs(const instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   AppendScalarOpSrcReg(alu, 3);
   Append(".x - ");
@@ -1047,7 +1229,7 @@ bool GL4ShaderTranslator::TranslateALU_SUBs(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_SUB_PREVs(
+bool GlslShaderTranslator::TranslateALU_SUB_PREVs(
     const ucode::instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   AppendScalarOpSrcReg(alu, 3);
@@ -1056,8 +1238,8 @@ bool GL4ShaderTranslator::TranslateALU_SUB_PREVs(
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_PRED_SETXXs(const instr_alu_t& alu,
-                                                   const char* op) {
+bool GlslShaderTranslator::TranslateALU_PRED_SETXXs(const instr_alu_t& alu,
+                                                    const char* op) {
   Append("  p = ");
   AppendScalarOpSrcReg(alu, 3);
   Append(".x %s 0.0;\n", op);
@@ -1066,20 +1248,20 @@ bool GL4ShaderTranslator::TranslateALU_PRED_SETXXs(const instr_alu_t& alu,
   EndAppendScalarOp(alu);
   return true;
 }
-bool GL4ShaderTranslator::TranslateALU_PRED_SETEs(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_PRED_SETEs(const instr_alu_t& alu) {
   return TranslateALU_PRED_SETXXs(alu, "==");
 }
-bool GL4ShaderTranslator::TranslateALU_PRED_SETNEs(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_PRED_SETNEs(const instr_alu_t& alu) {
   return TranslateALU_PRED_SETXXs(alu, "!=");
 }
-bool GL4ShaderTranslator::TranslateALU_PRED_SETGTs(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_PRED_SETGTs(const instr_alu_t& alu) {
   return TranslateALU_PRED_SETXXs(alu, ">");
 }
-bool GL4ShaderTranslator::TranslateALU_PRED_SETGTEs(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_PRED_SETGTEs(const instr_alu_t& alu) {
   return TranslateALU_PRED_SETXXs(alu, ">=");
 }
 
-bool GL4ShaderTranslator::TranslateALU_PRED_SET_INVs(
+bool GlslShaderTranslator::TranslateALU_PRED_SET_INVs(
     const ucode::instr_alu_t& alu) {
   Append("  ps = ");
   AppendScalarOpSrcReg(alu, 3);
@@ -1092,7 +1274,7 @@ bool GL4ShaderTranslator::TranslateALU_PRED_SET_INVs(
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_PRED_SET_POPs(
+bool GlslShaderTranslator::TranslateALU_PRED_SET_POPs(
     const ucode::instr_alu_t& alu) {
   Append("  ps = ");
   AppendScalarOpSrcReg(alu, 3);
@@ -1105,7 +1287,7 @@ bool GL4ShaderTranslator::TranslateALU_PRED_SET_POPs(
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_SQRT_IEEE(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_SQRT_IEEE(const instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   Append("sqrt(");
   AppendScalarOpSrcReg(alu, 3);
@@ -1114,7 +1296,7 @@ bool GL4ShaderTranslator::TranslateALU_SQRT_IEEE(const instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_MUL_CONST_0(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_MUL_CONST_0(const instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   uint32_t src3_swiz = alu.src3_swiz & ~0x3C;
   uint32_t swiz_a = ((src3_swiz >> 6) - 1) & 0x3;
@@ -1130,11 +1312,11 @@ bool GL4ShaderTranslator::TranslateALU_MUL_CONST_0(const instr_alu_t& alu) {
   EndAppendScalarOp(alu);
   return true;
 }
-bool GL4ShaderTranslator::TranslateALU_MUL_CONST_1(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_MUL_CONST_1(const instr_alu_t& alu) {
   return TranslateALU_MUL_CONST_0(alu);
 }
 
-bool GL4ShaderTranslator::TranslateALU_ADD_CONST_0(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_ADD_CONST_0(const instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   uint32_t src3_swiz = alu.src3_swiz & ~0x3C;
   uint32_t swiz_a = ((src3_swiz >> 6) - 1) & 0x3;
@@ -1150,11 +1332,11 @@ bool GL4ShaderTranslator::TranslateALU_ADD_CONST_0(const instr_alu_t& alu) {
   EndAppendScalarOp(alu);
   return true;
 }
-bool GL4ShaderTranslator::TranslateALU_ADD_CONST_1(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_ADD_CONST_1(const instr_alu_t& alu) {
   return TranslateALU_ADD_CONST_0(alu);
 }
 
-bool GL4ShaderTranslator::TranslateALU_SUB_CONST_0(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_SUB_CONST_0(const instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   uint32_t src3_swiz = alu.src3_swiz & ~0x3C;
   uint32_t swiz_a = ((src3_swiz >> 6) - 1) & 0x3;
@@ -1170,12 +1352,12 @@ bool GL4ShaderTranslator::TranslateALU_SUB_CONST_0(const instr_alu_t& alu) {
   EndAppendScalarOp(alu);
   return true;
 }
-bool GL4ShaderTranslator::TranslateALU_SUB_CONST_1(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_SUB_CONST_1(const instr_alu_t& alu) {
   // Handled as switch on scalar_opc.
   return TranslateALU_SUB_CONST_0(alu);
 }
 
-bool GL4ShaderTranslator::TranslateALU_SIN(const ucode::instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_SIN(const ucode::instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   Append("sin(");
   AppendScalarOpSrcReg(alu, 3);
@@ -1184,7 +1366,7 @@ bool GL4ShaderTranslator::TranslateALU_SIN(const ucode::instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_COS(const ucode::instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_COS(const ucode::instr_alu_t& alu) {
   BeginAppendScalarOp(alu);
   Append("cos(");
   AppendScalarOpSrcReg(alu, 3);
@@ -1193,7 +1375,7 @@ bool GL4ShaderTranslator::TranslateALU_COS(const ucode::instr_alu_t& alu) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateALU_RETAIN_PREV(const instr_alu_t& alu) {
+bool GlslShaderTranslator::TranslateALU_RETAIN_PREV(const instr_alu_t& alu) {
   // TODO(benvanik): figure out how this is used.
   // It seems like vector writes to export regs will use this to write 1's to
   // components (like w in position).
@@ -1203,7 +1385,7 @@ bool GL4ShaderTranslator::TranslateALU_RETAIN_PREV(const instr_alu_t& alu) {
   return true;
 }
 
-typedef bool (GL4ShaderTranslator::*TranslateFn)(const instr_alu_t& alu);
+typedef bool (GlslShaderTranslator::*TranslateFn)(const instr_alu_t& alu);
 typedef struct {
   uint32_t num_srcs;
   const char* name;
@@ -1212,9 +1394,9 @@ typedef struct {
 #define ALU_INSTR(opc, num_srcs) \
   { num_srcs, #opc, nullptr }
 #define ALU_INSTR_IMPL(opc, num_srcs) \
-  { num_srcs, #opc, &GL4ShaderTranslator::TranslateALU_##opc }
+  { num_srcs, #opc, &GlslShaderTranslator::TranslateALU_##opc }
 
-bool GL4ShaderTranslator::TranslateALU(const instr_alu_t* alu, int sync) {
+bool GlslShaderTranslator::TranslateALU(const instr_alu_t* alu, int sync) {
   static TranslateInfo vector_alu_instrs[0x20] = {
       ALU_INSTR_IMPL(ADDv, 2),               // 0
       ALU_INSTR_IMPL(MULv, 2),               // 1
@@ -1289,7 +1471,7 @@ bool GL4ShaderTranslator::TranslateALU(const instr_alu_t* alu, int sync) {
       ALU_INSTR(KILLNEs, 1),             // 38
       ALU_INSTR(KILLONEs, 1),            // 39
       ALU_INSTR_IMPL(SQRT_IEEE, 1),      // 40
-      {0, 0, false},                     //
+      {0, 0, nullptr},                   //
       ALU_INSTR_IMPL(MUL_CONST_0, 2),    // 42
       ALU_INSTR_IMPL(MUL_CONST_1, 2),    // 43
       ALU_INSTR_IMPL(ADD_CONST_0, 2),    // 44
@@ -1402,7 +1584,7 @@ bool GL4ShaderTranslator::TranslateALU(const instr_alu_t* alu, int sync) {
   return true;
 }
 
-void GL4ShaderTranslator::PrintDestFetch(uint32_t dst_reg, uint32_t dst_swiz) {
+void GlslShaderTranslator::PrintDestFetch(uint32_t dst_reg, uint32_t dst_swiz) {
   Append("\tR%u.", dst_reg);
   for (int i = 0; i < 4; i++) {
     Append("%c", chan_names[dst_swiz & 0x7]);
@@ -1410,7 +1592,8 @@ void GL4ShaderTranslator::PrintDestFetch(uint32_t dst_reg, uint32_t dst_swiz) {
   }
 }
 
-void GL4ShaderTranslator::AppendFetchDest(uint32_t dst_reg, uint32_t dst_swiz) {
+void GlslShaderTranslator::AppendFetchDest(uint32_t dst_reg,
+                                           uint32_t dst_swiz) {
   Append("r%u.", dst_reg);
   for (int i = 0; i < 4; i++) {
     Append("%c", chan_names[dst_swiz & 0x7]);
@@ -1418,23 +1601,24 @@ void GL4ShaderTranslator::AppendFetchDest(uint32_t dst_reg, uint32_t dst_swiz) {
   }
 }
 
-void GL4ShaderTranslator::AppendPredPre(bool is_cond_cf, uint32_t cf_condition,
-                                        uint32_t pred_select,
-                                        uint32_t condition) {
+void GlslShaderTranslator::AppendPredPre(bool is_cond_cf, uint32_t cf_condition,
+                                         uint32_t pred_select,
+                                         uint32_t condition) {
   if (pred_select && (!is_cond_cf || cf_condition != condition)) {
     Append("  if (%cp) {\n", condition ? ' ' : '!');
   }
 }
 
-void GL4ShaderTranslator::AppendPredPost(bool is_cond_cf, uint32_t cf_condition,
-                                         uint32_t pred_select,
-                                         uint32_t condition) {
+void GlslShaderTranslator::AppendPredPost(bool is_cond_cf,
+                                          uint32_t cf_condition,
+                                          uint32_t pred_select,
+                                          uint32_t condition) {
   if (pred_select && (!is_cond_cf || cf_condition != condition)) {
     Append("  }\n");
   }
 }
 
-bool GL4ShaderTranslator::TranslateBlocks(GL4Shader* shader) {
+bool GlslShaderTranslator::TranslateBlocks(Shader* shader) {
   Append(" int pc = 0;\n");
 
 #if FLOW_CONTROL
@@ -1545,7 +1729,7 @@ static const struct {
 #undef INSTR
 };
 
-bool GL4ShaderTranslator::TranslateExec(const instr_cf_exec_t& cf) {
+bool GlslShaderTranslator::TranslateExec(const instr_cf_exec_t& cf) {
   Append("  // %s ADDR(0x%x) CNT(0x%x)", cf_instructions[cf.opc].name,
          cf.address, cf.count);
   if (cf.yeild) {
@@ -1641,7 +1825,7 @@ bool GL4ShaderTranslator::TranslateExec(const instr_cf_exec_t& cf) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateJmp(const ucode::instr_cf_jmp_call_t& cf) {
+bool GlslShaderTranslator::TranslateJmp(const ucode::instr_cf_jmp_call_t& cf) {
   assert_true(cf.direction == 0);
   assert_true(cf.address_mode == 0);
   Append("  // %s", cf_instructions[cf.opc].name);
@@ -1681,7 +1865,8 @@ bool GL4ShaderTranslator::TranslateJmp(const ucode::instr_cf_jmp_call_t& cf) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateLoopStart(const ucode::instr_cf_loop_t& cf) {
+bool GlslShaderTranslator::TranslateLoopStart(
+    const ucode::instr_cf_loop_t& cf) {
   Append("  // %s", cf_instructions[cf.opc].name);
   Append(" ADDR(0x%x) LOOP ID(%d)", cf.address, cf.loop_id);
   if (cf.address_mode == ABSOLUTE_ADDR) {
@@ -1693,7 +1878,7 @@ bool GL4ShaderTranslator::TranslateLoopStart(const ucode::instr_cf_loop_t& cf) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateLoopEnd(const ucode::instr_cf_loop_t& cf) {
+bool GlslShaderTranslator::TranslateLoopEnd(const ucode::instr_cf_loop_t& cf) {
   Append("  // %s", cf_instructions[cf.opc].name);
   Append(" ADDR(0x%x) LOOP ID(%d)\n", cf.address, cf.loop_id);
   Append(" i%d_cnt = i%d_cnt + 1;\n", cf.loop_id, cf.loop_id);
@@ -1702,8 +1887,8 @@ bool GL4ShaderTranslator::TranslateLoopEnd(const ucode::instr_cf_loop_t& cf) {
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateVertexFetch(const instr_fetch_vtx_t* vtx,
-                                               int sync) {
+bool GlslShaderTranslator::TranslateVertexFetch(const instr_fetch_vtx_t* vtx,
+                                                int sync) {
   static const struct {
     const char* name;
   } fetch_types[0xff] = {
@@ -1834,8 +2019,8 @@ bool GL4ShaderTranslator::TranslateVertexFetch(const instr_fetch_vtx_t* vtx,
   return true;
 }
 
-bool GL4ShaderTranslator::TranslateTextureFetch(const instr_fetch_tex_t* tex,
-                                                int sync) {
+bool GlslShaderTranslator::TranslateTextureFetch(const instr_fetch_tex_t* tex,
+                                                 int sync) {
   int src_component_count = 0;
   const char* sampler_type;
   switch (tex->dimension) {
@@ -2012,6 +2197,5 @@ bool GL4ShaderTranslator::TranslateTextureFetch(const instr_fetch_tex_t* tex,
   return true;
 }
 
-}  // namespace gl4
 }  // namespace gpu
 }  // namespace xe
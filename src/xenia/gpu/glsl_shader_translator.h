@@ -7,36 +7,44 @@
  ******************************************************************************
  */
 
-#ifndef XENIA_GPU_GL4_GL4_SHADER_TRANSLATOR_H_
-#define XENIA_GPU_GL4_GL4_SHADER_TRANSLATOR_H_
+#ifndef XENIA_GPU_GLSL_SHADER_TRANSLATOR_H_
+#define XENIA_GPU_GLSL_SHADER_TRANSLATOR_H_
 
 #include <string>
 
 #include "xenia/base/string_buffer.h"
-#include "xenia/gpu/gl4/gl4_shader.h"
+#include "xenia/gpu/shader.h"
+#include "xenia/gpu/shader_translator.h"
 #include "xenia/gpu/ucode.h"
 #include "xenia/gpu/xenos.h"
-#include "xenia/ui/gl/gl_context.h"
 
 namespace xe {
 namespace gpu {
-namespace gl4 {
 
-class GL4ShaderTranslator {
+// Translates ucode into GLSL 4.5 programs for the GL4 backend. Touches no GL
+// state, so it can run on any thread.
+class GlslShaderTranslator : public ShaderTranslator {
  public:
   static const uint32_t kMaxInterpolators = 16;
+  // Bump when the generated source changes.
+  static const uint32_t kVersion = 1;
 
-  GL4ShaderTranslator();
-  ~GL4ShaderTranslator();
+  GlslShaderTranslator();
+  ~GlslShaderTranslator() override;
 
+  uint32_t version() const override { return kVersion; }
+  std::string Translate(
+      Shader* shader,
+      const xenos::xe_gpu_program_cntl_t& program_cntl) override;
+
+ protected:
   std::string TranslateVertexShader(
-      GL4Shader* vertex_shader,
+      Shader* vertex_shader,
       const xenos::xe_gpu_program_cntl_t& program_cntl);
   std::string TranslatePixelShader(
-      GL4Shader* pixel_shader,
+      Shader* pixel_shader,
       const xenos::xe_gpu_program_cntl_t& program_cntl);
 
- protected:
   ShaderType shader_type_;
   const uint32_t* dwords_ = nullptr;
 
@@ -46,7 +54,7 @@ class GL4ShaderTranslator {
   bool is_vertex_shader() const { return shader_type_ == ShaderType::kVertex; }
   bool is_pixel_shader() const { return shader_type_ == ShaderType::kPixel; }
 
-  void Reset(GL4Shader* shader);
+  void Reset(Shader* shader);
 
   void AppendSrcReg(const ucode::instr_alu_t& op, int i);
   void AppendSrcReg(const ucode::instr_alu_t& op, uint32_t num, uint32_t type,
@@ -153,7 +161,7 @@ class GL4ShaderTranslator {
   void AppendPredPost(bool is_cond_cf, uint32_t cf_condition,
                       uint32_t pred_select, uint32_t condition);
 
-  bool TranslateBlocks(GL4Shader* shader);
+  bool TranslateBlocks(Shader* shader);
   bool TranslateExec(const ucode::instr_cf_exec_t& cf);
   bool TranslateJmp(const ucode::instr_cf_jmp_call_t& cf);
   bool TranslateLoopStart(const ucode::instr_cf_loop_t& cf);
@@ -162,8 +170,7 @@ class GL4ShaderTranslator {
   bool TranslateTextureFetch(const ucode::instr_fetch_tex_t* tex, int sync);
 };
 
-}  // namespace gl4
 }  // namespace gpu
 }  // namespace xe
 
-#endif  // XENIA_GPU_GL4_GL4_SHADER_TRANSLATOR_H_
+#endif  // XENIA_GPU_GLSL_SHADER_TRANSLATOR_H_
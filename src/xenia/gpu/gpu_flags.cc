@@ -14,8 +14,22 @@ DEFINE_string(gpu, "any", "Graphics system. Use: [any, gl4]");
 DEFINE_string(trace_gpu_prefix, "scratch/gpu/gpu_trace_",
               "Prefix path for GPU trace files.");
 DEFINE_bool(trace_gpu_stream, false, "Trace all GPU packets.");
+DEFINE_bool(trace_gpu_compress, false,
+            "Compress GPU traces. Compressed traces are smaller but are "
+            "inflated into memory for playback.");
 
 DEFINE_string(dump_shaders, "",
               "Path to write GPU shaders to as they are compiled.");
+DEFINE_string(shader_cache_path, "",
+              "File to save translated shaders to and load them from on the "
+              "next run. Empty disables.");
+DEFINE_string(shader_pretranslate_trace, "",
+              "GPU trace whose shaders are translated at startup.");
+DEFINE_int32(shader_translation_threads, 4,
+             "Threads used to translate shaders ahead of their first use. 0 "
+             "disables.");
 
 DEFINE_bool(vsync, true, "Enable VSYNC.");
+
+DEFINE_int32(gpu_untile_threads, 4,
+             "Maximum threads used to untile large textures. 1 disables.");
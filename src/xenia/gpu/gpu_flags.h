@@ -16,9 +16,15 @@ DECLARE_string(gpu);
 
 DECLARE_string(trace_gpu_prefix);
 DECLARE_bool(trace_gpu_stream);
+DECLARE_bool(trace_gpu_compress);
 
 DECLARE_string(dump_shaders);
+DECLARE_string(shader_cache_path);
+DECLARE_string(shader_pretranslate_trace);
+DECLARE_int32(shader_translation_threads);
 
 DECLARE_bool(vsync);
 
+DECLARE_int32(gpu_untile_threads);
+
 #endif  // XENIA_GPU_GPU_FLAGS_H_
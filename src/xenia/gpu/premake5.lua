@@ -18,3 +18,29 @@ project("xenia-gpu")
     project_root.."/third_party/elemental-forms/src",
   })
   local_platform_files()
+
+test_suite("xenia-gpu-tests", project_root, ".", {
+  includedirs = {
+  },
+  links = {
+    "xenia-base",
+    "xenia-gpu",
+    "xxhash",
+  },
+})
+
+group("src")
+project("xenia-gpu-trace-stats")
+  uuid("8c3a3b0e-5a26-4d7e-9b1f-2f6e0f7c4d21")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "gflags",
+    "xenia-base",
+    "xenia-gpu",
+    "xxhash",
+  })
+  files({
+    "trace_stats_main.cc",
+    "../base/main_"..platform_suffix..".cc",
+  })
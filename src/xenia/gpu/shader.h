@@ -24,6 +24,8 @@ class Shader {
   virtual ~Shader();
 
   ShaderType type() const { return shader_type_; }
+  // XXH64 of the ucode as it is in guest memory.
+  uint64_t data_hash() const { return data_hash_; }
   bool has_prepared() const { return has_prepared_; }
   bool is_valid() const { return is_valid_; }
   const std::string& ucode_disassembly() const { return ucode_disassembly_; }
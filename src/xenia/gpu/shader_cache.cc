@@ -0,0 +1,466 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/shader_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+#include "xenia/base/byte_order.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
+#include "xenia/gpu/register_file.h"
+
+#include "third_party/xxhash/xxhash.h"
+
+namespace xe {
+namespace gpu {
+
+using namespace xe::gpu::xenos;
+
+namespace {
+
+const uint32_t kShaderCacheMagic = 0x43535358;  // 'XSSC'
+// Bump when the layout of the file changes.
+const uint32_t kShaderCacheFormatVersion = 1;
+
+// IM_LOAD sizes are 16 bits of dwords. Anything past these is corruption.
+const uint32_t kMaxUcodeDwordCount = 0xFFFF;
+const uint32_t kMaxSourceLength = 16 * 1024 * 1024;
+
+struct ShaderCacheHeader {
+  uint32_t magic;
+  uint32_t format_version;
+  uint32_t translator_version;
+  uint32_t reserved;
+};
+
+struct ShaderCacheEntryHeader {
+  uint64_t ucode_hash;
+  uint32_t type;
+  uint32_t program_cntl;
+  uint32_t ucode_dword_count;
+  uint32_t source_length;
+};
+
+// Builds a shader from ucode outside of any backend, for translation only.
+class UcodeShader : public Shader {
+ public:
+  UcodeShader(ShaderType shader_type, uint64_t data_hash,
+              const uint32_t* dword_ptr, uint32_t dword_count)
+      : Shader(shader_type, data_hash, dword_ptr, dword_count) {}
+};
+
+}  // namespace
+
+ShaderCache::ShaderCache(TranslatorFactory translator_factory)
+    : translator_factory_(std::move(translator_factory)),
+      translator_(translator_factory_()),
+      next_pretranslate_source_(0),
+      cancel_pretranslation_(false) {
+  translator_version_ = translator_->version();
+}
+
+ShaderCache::~ShaderCache() { Close(); }
+
+bool ShaderCache::Open(const std::wstring& path) {
+  Close();
+  std::lock_guard<xe::mutex> lock(mutex_);
+
+  // Anything unusable in the file means writing it out again with what was
+  // kept.
+  bool rewrite = true;
+  FILE* file = xe::filesystem::OpenFile(path, "rb");
+  if (file) {
+    ShaderCacheHeader header;
+    if (fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == kShaderCacheMagic &&
+        header.format_version == kShaderCacheFormatVersion) {
+      bool is_current = header.translator_version == translator_version_;
+      bool is_complete = true;
+      while (true) {
+        ShaderCacheEntryHeader entry_header;
+        size_t header_length =
+            fread(&entry_header, 1, sizeof(entry_header), file);
+        if (!header_length) {
+          break;
+        }
+        if (header_length != sizeof(entry_header) ||
+            entry_header.type > uint32_t(ShaderType::kPixel) ||
+            entry_header.ucode_dword_count > kMaxUcodeDwordCount ||
+            entry_header.source_length > kMaxSourceLength) {
+          is_complete = false;
+          break;
+        }
+        Entry entry;
+        entry.type = ShaderType(entry_header.type);
+        entry.ucode_hash = entry_header.ucode_hash;
+        entry.program_cntl = entry_header.program_cntl;
+        entry.ucode.resize(entry_header.ucode_dword_count);
+        entry.source.resize(entry_header.source_length);
+        if (fread(entry.ucode.data(), sizeof(uint32_t), entry.ucode.size(),
+                  file) != entry.ucode.size() ||
+            fread(const_cast<char*>(entry.source.data()), 1,
+                  entry.source.size(), file) != entry.source.size() ||
+            XXH64(entry.ucode.data(), entry.ucode.size() * sizeof(uint32_t),
+                  0) != entry.ucode_hash) {
+          is_complete = false;
+          break;
+        }
+        if (is_current && !entry.source.empty()) {
+          uint64_t key =
+              GetKey(entry.type, entry.ucode_hash, entry.program_cntl);
+          entries_[key] = std::move(entry);
+        } else {
+          stale_sources_.push_back({entry.type, entry.ucode_hash,
+                                    entry.program_cntl,
+                                    std::move(entry.ucode)});
+        }
+      }
+      // Ucode waiting for translation may have been translated later on.
+      size_t stale_count = stale_sources_.size();
+      stale_sources_.erase(
+          std::remove_if(stale_sources_.begin(), stale_sources_.end(),
+                         [this](const Source& source) {
+                           return Lookup(source.type, source.ucode_hash,
+                                         source.program_cntl,
+                                         source.ucode.data(),
+                                         uint32_t(source.ucode.size()),
+                                         false) != nullptr;
+                         }),
+          stale_sources_.end());
+      rewrite = !is_current || !is_complete ||
+                stale_sources_.size() != stale_count;
+      if (!is_complete) {
+        XELOGW("Shader cache is cut short or corrupt; rewriting it");
+      }
+    }
+    fclose(file);
+  }
+  XELOGI("Shader cache: %zu translations loaded, %zu waiting for translation",
+         entries_.size(), stale_sources_.size());
+
+  if (rewrite && !Rewrite(path)) {
+    XELOGE("Unable to write shader cache %ls", path.c_str());
+    return false;
+  }
+  file_ = xe::filesystem::OpenFile(path, "ab");
+  if (!file_) {
+    XELOGE("Unable to open shader cache %ls for writing", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool ShaderCache::Rewrite(const std::wstring& path) {
+  // Written beside the cache and moved over it once complete, so that a
+  // crash partway through doesn't lose the old one.
+  auto temp_path = path + L".tmp";
+  FILE* file = xe::filesystem::OpenFile(temp_path, "wb");
+  if (!file) {
+    return false;
+  }
+  ShaderCacheHeader header = {kShaderCacheMagic, kShaderCacheFormatVersion,
+                              translator_version_, 0};
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+  for (auto& it : entries_) {
+    auto& entry = it.second;
+    written = written &&
+              WriteEntry(file, entry.type, entry.ucode_hash,
+                         entry.program_cntl, entry.ucode, entry.source);
+  }
+  // Ucode from another translator version is kept, without its old source,
+  // until it has been translated again.
+  for (auto& source : stale_sources_) {
+    written = written &&
+              WriteEntry(file, source.type, source.ucode_hash,
+                         source.program_cntl, source.ucode, std::string());
+  }
+  written = fclose(file) == 0 && written;
+  if (!written || !xe::filesystem::RenameFile(temp_path, path)) {
+    xe::filesystem::DeleteFile(temp_path);
+    return false;
+  }
+  return true;
+}
+
+void ShaderCache::Close() {
+  cancel_pretranslation_ = true;
+  WaitForPretranslation();
+  cancel_pretranslation_ = false;
+  std::lock_guard<xe::mutex> lock(mutex_);
+  if (file_) {
+    fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+size_t ShaderCache::entry_count() {
+  std::lock_guard<xe::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+std::string ShaderCache::Translate(
+    Shader* shader, const xenos::xe_gpu_program_cntl_t& program_cntl) {
+  {
+    std::lock_guard<xe::mutex> lock(mutex_);
+    auto entry = Lookup(shader->type(), shader->data_hash(),
+                        program_cntl.dword_0, shader->data(),
+                        shader->dword_count(), true);
+    if (entry) {
+      return entry->source;
+    }
+  }
+
+  Entry entry;
+  {
+    std::lock_guard<xe::mutex> lock(translator_mutex_);
+    entry.source = translator_->Translate(shader, program_cntl);
+  }
+  if (entry.source.empty()) {
+    // Not saved, as a newer translator may do better.
+    return entry.source;
+  }
+  entry.type = shader->type();
+  entry.ucode_hash = shader->data_hash();
+  entry.program_cntl = program_cntl.dword_0;
+  entry.ucode.resize(shader->dword_count());
+  xe::copy_and_swap(entry.ucode.data(), shader->data(), entry.ucode.size());
+  std::string source = entry.source;
+  Insert(std::move(entry));
+  return source;
+}
+
+void ShaderCache::Pretranslate(std::vector<Source> sources,
+                               uint32_t thread_count) {
+  WaitForPretranslation();
+
+  pretranslate_sources_ = std::move(sources);
+  {
+    std::lock_guard<xe::mutex> lock(mutex_);
+    for (auto& source : stale_sources_) {
+      pretranslate_sources_.push_back(std::move(source));
+    }
+    stale_sources_.clear();
+  }
+  next_pretranslate_source_ = 0;
+
+  thread_count =
+      uint32_t(std::min(size_t(thread_count), pretranslate_sources_.size()));
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    pretranslate_threads_.emplace_back([this]() {
+      auto translator = translator_factory_();
+      PretranslateThread(translator.get());
+    });
+  }
+}
+
+void ShaderCache::WaitForPretranslation() {
+  for (auto& thread : pretranslate_threads_) {
+    thread.join();
+  }
+  pretranslate_threads_.clear();
+  pretranslate_sources_.clear();
+}
+
+void ShaderCache::PretranslateThread(ShaderTranslator* translator) {
+  size_t index;
+  while (!cancel_pretranslation_ &&
+         (index = next_pretranslate_source_++) <
+             pretranslate_sources_.size()) {
+    // Each source is only ever seen by one thread.
+    auto& source = pretranslate_sources_[index];
+    {
+      std::lock_guard<xe::mutex> lock(mutex_);
+      if (Lookup(source.type, source.ucode_hash, source.program_cntl,
+                 source.ucode.data(), uint32_t(source.ucode.size()), false)) {
+        continue;
+      }
+    }
+    UcodeShader shader(source.type, source.ucode_hash, source.ucode.data(),
+                       uint32_t(source.ucode.size()));
+    xe_gpu_program_cntl_t program_cntl;
+    program_cntl.dword_0 = source.program_cntl;
+    Entry entry;
+    entry.source = translator->Translate(&shader, program_cntl);
+    if (entry.source.empty()) {
+      continue;
+    }
+    entry.type = source.type;
+    entry.ucode_hash = source.ucode_hash;
+    entry.program_cntl = source.program_cntl;
+    entry.ucode = std::move(source.ucode);
+    Insert(std::move(entry));
+  }
+}
+
+uint64_t ShaderCache::GetKey(ShaderType type, uint64_t ucode_hash,
+                             uint32_t program_cntl) {
+  return ucode_hash ^ (((uint64_t(program_cntl) << 1) | uint64_t(type)) *
+                       0x9E3779B97F4A7C15ull);
+}
+
+const ShaderCache::Entry* ShaderCache::Lookup(ShaderType type,
+                                              uint64_t ucode_hash,
+                                              uint32_t program_cntl,
+                                              const uint32_t* ucode,
+                                              uint32_t ucode_dword_count,
+                                              bool ucode_swapped) const {
+  auto it = entries_.find(GetKey(type, ucode_hash, program_cntl));
+  if (it == entries_.end()) {
+    return nullptr;
+  }
+  auto& entry = it->second;
+  if (entry.type != type || entry.ucode_hash != ucode_hash ||
+      entry.program_cntl != program_cntl ||
+      entry.ucode.size() != ucode_dword_count) {
+    return nullptr;
+  }
+  // Guard against hash collisions.
+  for (uint32_t i = 0; i < ucode_dword_count; ++i) {
+    uint32_t dword = ucode_swapped ? xe::byte_swap(ucode[i]) : ucode[i];
+    if (entry.ucode[i] != dword) {
+      return nullptr;
+    }
+  }
+  return &entry;
+}
+
+void ShaderCache::Insert(Entry entry) {
+  std::lock_guard<xe::mutex> lock(mutex_);
+  if (Lookup(entry.type, entry.ucode_hash, entry.program_cntl,
+             entry.ucode.data(), uint32_t(entry.ucode.size()), false)) {
+    // Translated elsewhere in the meantime.
+    return;
+  }
+  uint64_t key = GetKey(entry.type, entry.ucode_hash, entry.program_cntl);
+  auto& stored = entries_[key];
+  stored = std::move(entry);
+  if (file_) {
+    WriteEntry(file_, stored.type, stored.ucode_hash, stored.program_cntl,
+               stored.ucode, stored.source);
+    fflush(file_);
+  }
+}
+
+bool ShaderCache::WriteEntry(FILE* file, ShaderType type,
+                             uint64_t ucode_hash, uint32_t program_cntl,
+                             const std::vector<uint32_t>& ucode,
+                             const std::string& source) {
+  ShaderCacheEntryHeader entry_header;
+  entry_header.ucode_hash = ucode_hash;
+  entry_header.type = uint32_t(type);
+  entry_header.program_cntl = program_cntl;
+  entry_header.ucode_dword_count = uint32_t(ucode.size());
+  entry_header.source_length = uint32_t(source.size());
+  return fwrite(&entry_header, sizeof(entry_header), 1, file) == 1 &&
+         fwrite(ucode.data(), sizeof(uint32_t), ucode.size(), file) ==
+             ucode.size() &&
+         fwrite(source.data(), 1, source.size(), file) == source.size();
+}
+
+// Tracks the state packets have left behind so far, as the command
+// processor would see it at each draw.
+class ShaderCache::SourceGatherer : public TracePacketHandler {
+ public:
+  explicit SourceGatherer(std::vector<Source>* sources) : sources_(sources) {}
+
+  void OnRegisterWrite(uint32_t index, uint32_t value) override {
+    if (index == XE_GPU_REG_SQ_PROGRAM_CNTL) {
+      program_cntl_ = value;
+    }
+  }
+  void OnShaderLoad(ShaderType type, uint32_t guest_address,
+                    uint32_t dword_count) override {
+    load_pending_ = true;
+    pending_type_ = type;
+    pending_address_ = CpuToGpu(guest_address);
+  }
+  void OnShaderLoadImmediate(ShaderType type, const uint8_t* ucode,
+                             uint32_t dword_count) override {
+    LoadUcode(type, ucode, dword_count);
+  }
+  void OnDraw() override {
+    for (uint32_t type = 0; type < 2; ++type) {
+      if (!has_loaded_[type]) {
+        continue;
+      }
+      auto& source = loaded_[type];
+      if (gathered_.insert(GetKey(source.type, source.ucode_hash,
+                                  program_cntl_)).second) {
+        sources_->push_back(source);
+        sources_->back().program_cntl = program_cntl_;
+      }
+    }
+  }
+
+  // The ucode of an IM_LOAD is in the memory read of its address.
+  void OnMemoryRead(uint32_t base_ptr, const uint8_t* data, uint32_t length) {
+    if (load_pending_ && CpuToGpu(base_ptr) == pending_address_) {
+      LoadUcode(pending_type_, data, length / 4);
+      load_pending_ = false;
+    }
+  }
+
+ private:
+  void LoadUcode(ShaderType type, const uint8_t* ucode,
+                 uint32_t dword_count) {
+    auto& source = loaded_[uint32_t(type)];
+    source.type = type;
+    source.ucode_hash = XXH64(ucode, dword_count * sizeof(uint32_t), 0);
+    source.ucode.resize(dword_count);
+    std::memcpy(source.ucode.data(), ucode, dword_count * sizeof(uint32_t));
+    has_loaded_[uint32_t(type)] = true;
+  }
+
+  std::vector<Source>* sources_;
+  std::unordered_set<uint64_t> gathered_;
+  uint32_t program_cntl_ = 0;
+  Source loaded_[2];
+  bool has_loaded_[2] = {false, false};
+  bool load_pending_ = false;
+  ShaderType pending_type_ = ShaderType::kVertex;
+  uint32_t pending_address_ = 0;
+};
+
+std::vector<ShaderCache::Source> ShaderCache::GatherTraceSources(
+    const TraceReader& reader) {
+  std::vector<Source> sources;
+  SourceGatherer gatherer(&sources);
+  const uint8_t* trace_data = reader.trace_data();
+  uint64_t offset = 0;
+  while (offset < reader.trace_size()) {
+    TraceCommandInfo info;
+    if (!DecodeTraceCommand(trace_data + offset,
+                            size_t(reader.trace_size() - offset), offset,
+                            &info)) {
+      break;
+    }
+    offset = info.end_offset;
+    const uint8_t* payload = trace_data + info.payload_offset;
+    switch (info.type) {
+      case TraceCommandType::kMemoryRead:
+      case TraceCommandType::kMemoryReadRef:
+        gatherer.OnMemoryRead(info.base_ptr, payload, info.length);
+        break;
+      case TraceCommandType::kPacketStart:
+      case TraceCommandType::kPacketStartRef:
+        DecodeTracePacket(payload, info.length / 4, &gatherer);
+        break;
+      default:
+        break;
+    }
+  }
+  return sources;
+}
+
+}  // namespace gpu
+}  // namespace xe
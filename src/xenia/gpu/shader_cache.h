@@ -0,0 +1,130 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_SHADER_CACHE_H_
+#define XENIA_GPU_SHADER_CACHE_H_
+
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/mutex.h"
+#include "xenia/gpu/shader.h"
+#include "xenia/gpu/shader_translator.h"
+#include "xenia/gpu/trace_reader.h"
+#include "xenia/gpu/xenos.h"
+
+namespace xe {
+namespace gpu {
+
+// Translated shader source keyed by ucode and program_cntl, optionally saved
+// to a file so that later runs skip translation. Shaders can be translated
+// ahead of their first draw on background threads, either from an earlier
+// run's file or from the draws of a trace.
+//
+// The file holds a header followed by entries, each an entry header then the
+// ucode then the source. New translations are appended as they are made, so
+// a file cut short by a crash only loses its last entry. Whole rewrites go
+// through a temporary file.
+class ShaderCache {
+ public:
+  using TranslatorFactory = std::function<std::unique_ptr<ShaderTranslator>()>;
+
+  // A shader and the program_cntl it is drawn with.
+  struct Source {
+    ShaderType type;
+    // XXH64 of ucode, as Shader::data_hash.
+    uint64_t ucode_hash;
+    uint32_t program_cntl;
+    // As in guest memory.
+    std::vector<uint32_t> ucode;
+  };
+
+  explicit ShaderCache(TranslatorFactory translator_factory);
+  ~ShaderCache();
+
+  // Loads the translations saved in path and saves new ones to it. Entries
+  // from another translator version lose their source but keep their ucode,
+  // both in the file and as sources for Pretranslate. Returns false if the
+  // file can't be written, in which case the cache only lives in memory.
+  bool Open(const std::wstring& path);
+  // Stops pretranslation and closes the file. The cache stays usable.
+  void Close();
+
+  size_t entry_count();
+
+  // Returns the source for shader with program_cntl, translating it on the
+  // calling thread if nothing has yet. Empty if translation failed.
+  std::string Translate(Shader* shader,
+                        const xenos::xe_gpu_program_cntl_t& program_cntl);
+
+  // Translates sources on thread_count background threads and returns
+  // without waiting. Sources already in the cache are skipped.
+  void Pretranslate(std::vector<Source> sources, uint32_t thread_count);
+  void WaitForPretranslation();
+
+  // Collects each distinct shader and program_cntl that draws in the trace.
+  static std::vector<Source> GatherTraceSources(const TraceReader& reader);
+
+ private:
+  class SourceGatherer;
+
+  struct Entry {
+    ShaderType type;
+    uint64_t ucode_hash;
+    uint32_t program_cntl;
+    std::vector<uint32_t> ucode;
+    std::string source;
+  };
+
+  static uint64_t GetKey(ShaderType type, uint64_t ucode_hash,
+                         uint32_t program_cntl);
+  // Returns the matching entry or null. Requires mutex_.
+  const Entry* Lookup(ShaderType type, uint64_t ucode_hash,
+                      uint32_t program_cntl, const uint32_t* ucode,
+                      uint32_t ucode_dword_count, bool ucode_swapped) const;
+  void Insert(Entry entry);
+  // Writes the whole cache to path. Requires mutex_.
+  bool Rewrite(const std::wstring& path);
+  // An empty source marks ucode waiting to be translated.
+  static bool WriteEntry(FILE* file, ShaderType type, uint64_t ucode_hash,
+                         uint32_t program_cntl,
+                         const std::vector<uint32_t>& ucode,
+                         const std::string& source);
+  void PretranslateThread(ShaderTranslator* translator);
+
+  TranslatorFactory translator_factory_;
+  uint32_t translator_version_;
+
+  xe::mutex mutex_;
+  std::unordered_map<uint64_t, Entry> entries_;
+  FILE* file_ = nullptr;
+  // Ucode loaded without a source for the current translator version.
+  std::vector<Source> stale_sources_;
+
+  // Used by Translate.
+  xe::mutex translator_mutex_;
+  std::unique_ptr<ShaderTranslator> translator_;
+
+  std::vector<Source> pretranslate_sources_;
+  std::atomic<size_t> next_pretranslate_source_;
+  // Set by Close so that shutdown doesn't wait for every remaining source.
+  std::atomic<bool> cancel_pretranslation_;
+  std::vector<std::thread> pretranslate_threads_;
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_SHADER_CACHE_H_
@@ -0,0 +1,419 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "third_party/catch/include/catch.hpp"
+#include "xenia/gpu/shader_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/gpu/glsl_shader_translator.h"
+#include "xenia/gpu/register_file.h"
+#include "xenia/gpu/trace_test_util.h"
+#include "xenia/gpu/tracing.h"
+#include "xenia/gpu/ucode.h"
+#include "xenia/gpu/xenos.h"
+
+#include "third_party/xxhash/xxhash.h"
+
+using namespace xe::gpu;
+using namespace xe::gpu::ucode;
+using xe::gpu::testing::PacketRecorder;
+
+namespace {
+
+const wchar_t* kCachePath = L"xenia-gpu-shader-cache-tests.cache";
+const char* kCachePathUtf8 = "xenia-gpu-shader-cache-tests.cache";
+const wchar_t* kTracePath = L"xenia-gpu-shader-cache-tests.trace";
+
+class TestShader : public Shader {
+ public:
+  // ucode is host order; the shader is built from it as guest memory.
+  TestShader(ShaderType shader_type, const std::vector<uint32_t>& ucode)
+      : TestShader(shader_type, ToGuest(ucode).data(),
+                   uint32_t(ucode.size())) {}
+
+  static std::vector<uint32_t> ToGuest(const std::vector<uint32_t>& ucode) {
+    std::vector<uint32_t> guest(ucode.size());
+    xe::copy_and_swap(guest.data(), ucode.data(), ucode.size());
+    return guest;
+  }
+
+ private:
+  TestShader(ShaderType shader_type, const uint32_t* guest,
+             uint32_t dword_count)
+      : Shader(shader_type, XXH64(guest, dword_count * sizeof(uint32_t), 0),
+               guest, dword_count) {}
+};
+
+// Host order ucode of instr_count ALU instructions in execs of up to six,
+// with operations and registers picked by seed so each seed differs.
+std::vector<uint32_t> BuildUcode(uint32_t seed, uint32_t instr_count) {
+  static const uint32_t vector_ops[] = {ADDv,  MULv,    MAXv,  MINv,
+                                        DOT4v, MULADDv, DOT3v, FRACv};
+  static const uint32_t scalar_ops[] = {ADDs, MULs, MAXs, MINs, FRACs};
+  uint32_t exec_count = (instr_count + 5) / 6;
+  uint32_t instr_base = (exec_count + 1) / 2;
+  std::vector<uint32_t> ucode((instr_base + instr_count) * 3);
+
+  std::vector<instr_cf_t> cfs((exec_count + 1) / 2 * 2);
+  std::memset(cfs.data(), 0, cfs.size() * sizeof(instr_cf_t));
+  for (uint32_t i = 0; i < exec_count; ++i) {
+    auto& exec = cfs[i].exec;
+    exec.address = instr_base + i * 6;
+    exec.count = std::min(6u, instr_count - i * 6);
+    exec.opc = i == exec_count - 1 ? EXEC_END : EXEC;
+  }
+  for (uint32_t i = 0; i < cfs.size() / 2; ++i) {
+    auto& a = cfs[i * 2];
+    auto& b = cfs[i * 2 + 1];
+    ucode[i * 3 + 0] = a.dword_0;
+    ucode[i * 3 + 1] = (a.dword_1 & 0xFFFF) | (b.dword_0 << 16);
+    ucode[i * 3 + 2] = (b.dword_0 >> 16) | (b.dword_1 << 16);
+  }
+
+  for (uint32_t i = 0; i < instr_count; ++i) {
+    uint32_t n = seed * 7 + i;
+    instr_alu_t alu;
+    std::memset(&alu, 0, sizeof(alu));
+    alu.vector_opc = vector_ops[n % xe::countof(vector_ops)];
+    alu.vector_dest = n % 8;
+    alu.vector_write_mask = 0xF;
+    alu.scalar_opc = scalar_ops[(n / 3) % xe::countof(scalar_ops)];
+    alu.scalar_dest = (n + 3) % 8;
+    alu.scalar_write_mask = 0x1;
+    alu.src1_reg = (seed + i) % 8;
+    alu.src2_reg = (seed >> 3) % 8;
+    alu.src3_reg = i % 8;
+    alu.src1_sel = 1;
+    alu.src2_sel = seed & 1;
+    alu.src3_sel = 1;
+    std::memcpy(ucode.data() + (instr_base + i) * 3, &alu, sizeof(alu));
+  }
+  return ucode;
+}
+
+ShaderCache::Source MakeSource(ShaderType type,
+                               const std::vector<uint32_t>& ucode,
+                               uint32_t program_cntl) {
+  ShaderCache::Source source;
+  source.type = type;
+  source.ucode = TestShader::ToGuest(ucode);
+  source.ucode_hash = XXH64(source.ucode.data(),
+                            source.ucode.size() * sizeof(uint32_t), 0);
+  source.program_cntl = program_cntl;
+  return source;
+}
+
+xenos::xe_gpu_program_cntl_t ProgramCntl(uint32_t value) {
+  xenos::xe_gpu_program_cntl_t program_cntl;
+  program_cntl.dword_0 = value;
+  return program_cntl;
+}
+
+// Names its input rather than translating it, and counts its calls.
+class CountingTranslator : public ShaderTranslator {
+ public:
+  explicit CountingTranslator(uint32_t version) : version_(version) {}
+
+  uint32_t version() const override { return version_; }
+  std::string Translate(
+      Shader* shader,
+      const xenos::xe_gpu_program_cntl_t& program_cntl) override {
+    ++translation_count;
+    char name[64];
+    std::snprintf(name, xe::countof(name), "v%u %.16llX %.8X", version_,
+                  static_cast<unsigned long long>(shader->data_hash()),
+                  program_cntl.dword_0);
+    return name;
+  }
+
+  static std::atomic<int> translation_count;
+
+ private:
+  uint32_t version_;
+};
+std::atomic<int> CountingTranslator::translation_count(0);
+
+ShaderCache::TranslatorFactory CountingFactory(uint32_t version) {
+  return [version]() { return std::make_unique<CountingTranslator>(version); };
+}
+
+ShaderCache::TranslatorFactory GlslFactory() {
+  return []() { return std::make_unique<GlslShaderTranslator>(); };
+}
+
+long FileSize(const char* path) {
+  FILE* file = std::fopen(path, "rb");
+  REQUIRE(file);
+  std::fseek(file, 0, SEEK_END);
+  long size = std::ftell(file);
+  std::fclose(file);
+  return size;
+}
+
+}  // namespace
+
+TEST_CASE("SHADER_CACHE_TRANSLATES_GLSL", "[gpu]") {
+  auto ucode = BuildUcode(1, 8);
+  TestShader vertex_shader(ShaderType::kVertex, ucode);
+  TestShader pixel_shader(ShaderType::kPixel, ucode);
+  GlslShaderTranslator translator;
+
+  auto vertex_source = translator.Translate(&vertex_shader, ProgramCntl(0));
+  REQUIRE(vertex_source.find("#version 450") == 0);
+  REQUIRE(vertex_source.find("void processVertex(") != std::string::npos);
+  REQUIRE(vertex_source.find("MULv") != std::string::npos);
+  REQUIRE(vertex_source.find("pc = 0xFFFF") != std::string::npos);
+
+  auto pixel_source = translator.Translate(&pixel_shader, ProgramCntl(0));
+  REQUIRE(pixel_source.find("void processFragment(") != std::string::npos);
+  REQUIRE(pixel_source.find("applyAlphaTest") != std::string::npos);
+
+  // Nothing carries over from one shader to the next.
+  REQUIRE(translator.Translate(&vertex_shader, ProgramCntl(0)) ==
+          vertex_source);
+}
+
+TEST_CASE("SHADER_CACHE_PERSISTS", "[gpu]") {
+  std::vector<std::unique_ptr<TestShader>> shaders;
+  for (uint32_t i = 0; i < 6; ++i) {
+    shaders.emplace_back(new TestShader(
+        i & 1 ? ShaderType::kPixel : ShaderType::kVertex, BuildUcode(i, 4)));
+  }
+  std::vector<std::string> sources;
+
+  CountingTranslator::translation_count = 0;
+  {
+    std::remove(kCachePathUtf8);
+    ShaderCache cache(CountingFactory(1));
+    REQUIRE(cache.Open(kCachePath));
+    for (auto& shader : shaders) {
+      sources.push_back(cache.Translate(shader.get(), ProgramCntl(3)));
+    }
+    for (size_t i = 0; i < shaders.size(); ++i) {
+      REQUIRE(cache.Translate(shaders[i].get(), ProgramCntl(3)) == sources[i]);
+    }
+    REQUIRE(CountingTranslator::translation_count.load() == 6);
+  }
+
+  CountingTranslator::translation_count = 0;
+  {
+    ShaderCache cache(CountingFactory(1));
+    REQUIRE(cache.Open(kCachePath));
+    REQUIRE(cache.entry_count() == 6);
+    for (size_t i = 0; i < shaders.size(); ++i) {
+      REQUIRE(cache.Translate(shaders[i].get(), ProgramCntl(3)) == sources[i]);
+    }
+    REQUIRE(CountingTranslator::translation_count.load() == 0);
+    // program_cntl is part of the key.
+    cache.Translate(shaders[0].get(), ProgramCntl(4));
+    REQUIRE(CountingTranslator::translation_count.load() == 1);
+  }
+
+  // A partly written last entry is dropped, along with nothing else.
+  long size = FileSize(kCachePathUtf8);
+  {
+    FILE* file = std::fopen(kCachePathUtf8, "rb");
+    std::vector<char> data(size);
+    REQUIRE(std::fread(data.data(), 1, data.size(), file) == data.size());
+    std::fclose(file);
+    file = std::fopen(kCachePathUtf8, "wb");
+    std::fwrite(data.data(), 1, data.size() - 5, file);
+    std::fclose(file);
+  }
+  {
+    ShaderCache cache(CountingFactory(1));
+    REQUIRE(cache.Open(kCachePath));
+    REQUIRE(cache.entry_count() == 6);
+  }
+  REQUIRE(FileSize(kCachePathUtf8) < size);
+  std::remove(kCachePathUtf8);
+}
+
+TEST_CASE("SHADER_CACHE_RETRANSLATES_OTHER_VERSIONS", "[gpu]") {
+  std::vector<std::unique_ptr<TestShader>> shaders;
+  for (uint32_t i = 0; i < 5; ++i) {
+    shaders.emplace_back(new TestShader(ShaderType::kVertex, BuildUcode(i, 4)));
+  }
+  {
+    std::remove(kCachePathUtf8);
+    ShaderCache cache(CountingFactory(1));
+    REQUIRE(cache.Open(kCachePath));
+    for (auto& shader : shaders) {
+      cache.Translate(shader.get(), ProgramCntl(0));
+    }
+  }
+
+  CountingTranslator::translation_count = 0;
+  {
+    ShaderCache cache(CountingFactory(2));
+    REQUIRE(cache.Open(kCachePath));
+    REQUIRE(cache.entry_count() == 0);
+    cache.Pretranslate({}, 3);
+    cache.WaitForPretranslation();
+    REQUIRE(cache.entry_count() == 5);
+    REQUIRE(CountingTranslator::translation_count.load() == 5);
+    REQUIRE(cache.Translate(shaders[2].get(), ProgramCntl(0)).find("v2 ") ==
+            0);
+    REQUIRE(CountingTranslator::translation_count.load() == 5);
+  }
+
+  // Saved again under the new version.
+  {
+    ShaderCache cache(CountingFactory(2));
+    REQUIRE(cache.Open(kCachePath));
+    REQUIRE(cache.entry_count() == 5);
+  }
+
+  // Ucode stays in the file until it is translated again, even when nothing
+  // gets to pretranslate it.
+  {
+    ShaderCache cache(CountingFactory(3));
+    REQUIRE(cache.Open(kCachePath));
+    REQUIRE(cache.entry_count() == 0);
+  }
+  CountingTranslator::translation_count = 0;
+  {
+    ShaderCache cache(CountingFactory(3));
+    REQUIRE(cache.Open(kCachePath));
+    cache.Pretranslate({}, 1);
+    cache.WaitForPretranslation();
+    REQUIRE(CountingTranslator::translation_count.load() == 5);
+  }
+  {
+    ShaderCache cache(CountingFactory(3));
+    REQUIRE(cache.Open(kCachePath));
+    REQUIRE(cache.entry_count() == 5);
+    cache.Pretranslate({}, 1);
+    cache.WaitForPretranslation();
+    REQUIRE(CountingTranslator::translation_count.load() == 5);
+  }
+  std::remove(kCachePathUtf8);
+}
+
+TEST_CASE("SHADER_CACHE_GATHERS_TRACE_SOURCES", "[gpu]") {
+  auto vertex_ucode = BuildUcode(10, 6);
+  auto pixel_ucode = BuildUcode(11, 9);
+  {
+    // Shaders loaded both inline and from memory.
+    std::vector<uint8_t> memory(4 * 1024 * 1024);
+    TraceWriter writer(memory.data());
+    REQUIRE(writer.Open(kTracePath, false));
+    writer.WritePrimaryBufferStart(PacketRecorder::kPacketBase, 0);
+    PacketRecorder recorder(&writer, &memory);
+    recorder.Type0(XE_GPU_REG_SQ_PROGRAM_CNTL, {0x1234});
+    recorder.LoadShaderImmediate(ShaderType::kVertex, vertex_ucode);
+    recorder.LoadShader(ShaderType::kPixel, 0x10000, pixel_ucode);
+    recorder.Draw();
+    recorder.Draw();
+    recorder.Type0(XE_GPU_REG_SQ_PROGRAM_CNTL, {0x5678});
+    recorder.Draw();
+    writer.WritePrimaryBufferEnd();
+    writer.WriteEvent(EventType::kSwap);
+    writer.Close();
+  }
+
+  TraceReader reader;
+  REQUIRE(reader.Open(kTracePath));
+  auto sources = ShaderCache::GatherTraceSources(reader);
+  reader.Close();
+  REQUIRE(sources.size() == 4);
+  std::vector<ShaderCache::Source> expected = {
+      MakeSource(ShaderType::kVertex, vertex_ucode, 0x1234),
+      MakeSource(ShaderType::kPixel, pixel_ucode, 0x1234),
+      MakeSource(ShaderType::kVertex, vertex_ucode, 0x5678),
+      MakeSource(ShaderType::kPixel, pixel_ucode, 0x5678),
+  };
+  for (size_t i = 0; i < expected.size(); ++i) {
+    REQUIRE(sources[i].type == expected[i].type);
+    REQUIRE(sources[i].ucode_hash == expected[i].ucode_hash);
+    REQUIRE(sources[i].program_cntl == expected[i].program_cntl);
+    REQUIRE(sources[i].ucode == expected[i].ucode);
+  }
+
+  // Pretranslating gives what translating at the draw would have.
+  ShaderCache cache(GlslFactory());
+  cache.Pretranslate(sources, 2);
+  cache.WaitForPretranslation();
+  REQUIRE(cache.entry_count() == 4);
+  TestShader vertex_shader(ShaderType::kVertex, vertex_ucode);
+  GlslShaderTranslator translator;
+  REQUIRE(cache.Translate(&vertex_shader, ProgramCntl(0x5678)) ==
+          translator.Translate(&vertex_shader, ProgramCntl(0x5678)));
+  REQUIRE(cache.entry_count() == 4);
+  std::remove("xenia-gpu-shader-cache-tests.trace");
+}
+
+TEST_CASE("SHADER_CACHE_BENCHMARK", "[.][benchmark]") {
+  // Sized like the shaders of a typical title, alternating vertex and pixel.
+  const uint32_t kShaderCount = 512;
+  std::vector<ShaderCache::Source> sources;
+  std::vector<std::unique_ptr<TestShader>> shaders;
+  for (uint32_t i = 0; i < kShaderCount; ++i) {
+    auto type = i & 1 ? ShaderType::kPixel : ShaderType::kVertex;
+    auto ucode = BuildUcode(i, 24 + i % 48);
+    sources.push_back(MakeSource(type, ucode, 0x10000004));
+    shaders.emplace_back(new TestShader(type, ucode));
+  }
+  auto seconds_since = [](std::chrono::high_resolution_clock::time_point t) {
+    return std::chrono::duration<double>(
+               std::chrono::high_resolution_clock::now() - t)
+        .count();
+  };
+  auto report = [](const char* name, double seconds) {
+    std::printf("%-28s %8.2f ms %10.0f shaders/s\n", name, seconds * 1000,
+                kShaderCount / seconds);
+  };
+
+  // As the command processor did before, one at a time at the draw.
+  {
+    std::remove(kCachePathUtf8);
+    ShaderCache cache(GlslFactory());
+    REQUIRE(cache.Open(kCachePath));
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto& shader : shaders) {
+      cache.Translate(shader.get(), ProgramCntl(0x10000004));
+    }
+    report("translate at draw", seconds_since(start));
+  }
+
+  for (uint32_t thread_count : {1u, 2u, 4u}) {
+    ShaderCache cache(GlslFactory());
+    auto start = std::chrono::high_resolution_clock::now();
+    cache.Pretranslate(sources, thread_count);
+    cache.WaitForPretranslation();
+    char name[64];
+    std::snprintf(name, xe::countof(name), "pretranslate, %u threads",
+                  thread_count);
+    report(name, seconds_since(start));
+    REQUIRE(cache.entry_count() == kShaderCount);
+  }
+
+  {
+    auto start = std::chrono::high_resolution_clock::now();
+    ShaderCache cache(GlslFactory());
+    REQUIRE(cache.Open(kCachePath));
+    for (auto& shader : shaders) {
+      cache.Translate(shader.get(), ProgramCntl(0x10000004));
+    }
+    report("load from file", seconds_since(start));
+    REQUIRE(cache.entry_count() == kShaderCount);
+  }
+  std::printf("cache file: %.1f KB\n", FileSize(kCachePathUtf8) / 1024.0);
+  std::remove(kCachePathUtf8);
+}
@@ -0,0 +1,41 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_SHADER_TRANSLATOR_H_
+#define XENIA_GPU_SHADER_TRANSLATOR_H_
+
+#include <cstdint>
+#include <string>
+
+#include "xenia/gpu/shader.h"
+#include "xenia/gpu/xenos.h"
+
+namespace xe {
+namespace gpu {
+
+// Turns guest ucode into host shader source. Implementations keep scratch
+// state between calls, so each thread needs its own instance.
+class ShaderTranslator {
+ public:
+  virtual ~ShaderTranslator() = default;
+
+  // Changes whenever the output for the same input does, so that saved
+  // translations from another version can be told apart.
+  virtual uint32_t version() const = 0;
+
+  // Returns the complete host source for shader, or an empty string if it
+  // can't be translated.
+  virtual std::string Translate(
+      Shader* shader, const xenos::xe_gpu_program_cntl_t& program_cntl) = 0;
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_SHADER_TRANSLATOR_H_
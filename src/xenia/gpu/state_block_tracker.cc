@@ -0,0 +1,106 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/state_block_tracker.h"
+
+#include <cstring>
+
+#include "xenia/base/assert.h"
+
+namespace xe {
+namespace gpu {
+
+namespace {
+
+// The registers each block reads. Keep in sync with the SetShadowRegister
+// calls of the matching Update* step of the command processor.
+uint32_t GetStateBlocks(Register reg) {
+  switch (reg) {
+    case XE_GPU_REG_PA_SU_SC_MODE_CNTL:
+      return kStateBlockShaders | kStateBlockViewport | kStateBlockRasterizer;
+    case XE_GPU_REG_SQ_PROGRAM_CNTL:
+      return kStateBlockShaders;
+
+    case XE_GPU_REG_RB_SURFACE_INFO:
+      return kStateBlockRenderTargets | kStateBlockViewport;
+    case XE_GPU_REG_RB_DEPTHCONTROL:
+    case XE_GPU_REG_RB_STENCILREFMASK:
+      return kStateBlockRenderTargets | kStateBlockDepthStencil;
+    case XE_GPU_REG_RB_MODECONTROL:
+    case XE_GPU_REG_RB_COLOR_INFO:
+    case XE_GPU_REG_RB_COLOR1_INFO:
+    case XE_GPU_REG_RB_COLOR2_INFO:
+    case XE_GPU_REG_RB_COLOR3_INFO:
+    case XE_GPU_REG_RB_COLOR_MASK:
+    case XE_GPU_REG_RB_DEPTH_INFO:
+      return kStateBlockRenderTargets;
+
+    case XE_GPU_REG_PA_CL_VTE_CNTL:
+    case XE_GPU_REG_PA_SC_WINDOW_OFFSET:
+    case XE_GPU_REG_PA_SC_WINDOW_SCISSOR_TL:
+    case XE_GPU_REG_PA_SC_WINDOW_SCISSOR_BR:
+    case XE_GPU_REG_PA_CL_VPORT_XOFFSET:
+    case XE_GPU_REG_PA_CL_VPORT_YOFFSET:
+    case XE_GPU_REG_PA_CL_VPORT_ZOFFSET:
+    case XE_GPU_REG_PA_CL_VPORT_XSCALE:
+    case XE_GPU_REG_PA_CL_VPORT_YSCALE:
+    case XE_GPU_REG_PA_CL_VPORT_ZSCALE:
+      return kStateBlockViewport;
+
+    case XE_GPU_REG_PA_SC_SCREEN_SCISSOR_TL:
+    case XE_GPU_REG_PA_SC_SCREEN_SCISSOR_BR:
+    case XE_GPU_REG_VGT_MULTI_PRIM_IB_RESET_INDX:
+      return kStateBlockRasterizer;
+
+    case XE_GPU_REG_RB_BLENDCONTROL_0:
+    case XE_GPU_REG_RB_BLENDCONTROL_1:
+    case XE_GPU_REG_RB_BLENDCONTROL_2:
+    case XE_GPU_REG_RB_BLENDCONTROL_3:
+    case XE_GPU_REG_RB_BLEND_RED:
+    case XE_GPU_REG_RB_BLEND_GREEN:
+    case XE_GPU_REG_RB_BLEND_BLUE:
+    case XE_GPU_REG_RB_BLEND_ALPHA:
+      return kStateBlockBlend;
+
+    default:
+      return 0;
+  }
+}
+
+// One byte per register so a write looks its blocks up with a single load.
+struct StateBlockTable {
+  uint8_t blocks[RegisterFile::kRegisterCount];
+
+  StateBlockTable() {
+    std::memset(blocks, 0, sizeof(blocks));
+#define XE_GPU_REGISTER(index, type, name) \
+  blocks[index] = uint8_t(GetStateBlocks(XE_GPU_REG_##name));
+#include "xenia/gpu/register_table.inc"
+#undef XE_GPU_REGISTER
+    // WriteRegister doesn't look at the table outside of the range.
+    for (uint32_t i = 0; i < RegisterFile::kRegisterCount; ++i) {
+      assert_true(!blocks[i] ||
+                  i - StateBlockTracker::kFirstBlockRegister <
+                      StateBlockTracker::kBlockRegisterSpan);
+    }
+  }
+};
+
+}  // namespace
+
+StateBlockTracker::StateBlockTracker()
+    : register_blocks_(register_blocks()), dirty_(kStateBlockAll) {}
+
+const uint8_t* StateBlockTracker::register_blocks() {
+  static const StateBlockTable table;
+  return table.blocks;
+}
+
+}  // namespace gpu
+}  // namespace xe
@@ -0,0 +1,84 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_STATE_BLOCK_TRACKER_H_
+#define XENIA_GPU_STATE_BLOCK_TRACKER_H_
+
+#include <cstdint>
+
+#include "xenia/gpu/register_file.h"
+
+namespace xe {
+namespace gpu {
+
+// Host state derived from a fixed group of registers, one per Update* step of
+// a draw. A block only needs recomputing once one of its registers changes.
+enum StateBlock : uint32_t {
+  kStateBlockShaders = 1 << 0,
+  kStateBlockRenderTargets = 1 << 1,
+  kStateBlockViewport = 1 << 2,
+  kStateBlockRasterizer = 1 << 3,
+  kStateBlockBlend = 1 << 4,
+  kStateBlockDepthStencil = 1 << 5,
+
+  kStateBlockAll = (1 << 6) - 1,
+};
+
+// Keeps a dirty bit per StateBlock, set as registers are written with new
+// values. Drawing tests and clears the bit of each block before looking at
+// its registers, so unchanged blocks cost nothing per draw.
+class StateBlockTracker {
+ public:
+  // Every register that feeds a block lies in this range.
+  static const uint32_t kFirstBlockRegister = XE_GPU_REG_RB_SURFACE_INFO;
+  static const uint32_t kBlockRegisterSpan =
+      XE_GPU_REG_RB_BLENDCONTROL_3 + 1 - kFirstBlockRegister;
+
+  // Everything starts dirty, as nothing has been computed yet.
+  StateBlockTracker();
+
+  // The StateBlocks each register feeds, indexed by register. Built from
+  // register_table.inc.
+  static const uint8_t* register_blocks();
+
+  // Stores value into the register file and marks the blocks the register
+  // feeds dirty if it changed.
+  void WriteRegister(RegisterFile* register_file, uint32_t index,
+                     uint32_t value) {
+    uint32_t& dest = register_file->values[index].u32;
+    // Most writes are shader constants, past every block register, so they
+    // skip the table.
+    if (index - kFirstBlockRegister < kBlockRegisterSpan) {
+      uint32_t blocks = register_blocks_[index];
+      if (blocks && dest != value) {
+        dirty_ |= blocks;
+      }
+    }
+    dest = value;
+  }
+
+  uint32_t dirty() const { return dirty_; }
+  bool is_dirty(StateBlock block) const { return (dirty_ & block) != 0; }
+  void MarkDirty(uint32_t blocks) { dirty_ |= blocks; }
+  // Clears the bit of block, returning whether it was set.
+  bool ConsumeDirty(StateBlock block) {
+    bool was_dirty = (dirty_ & block) != 0;
+    dirty_ &= ~uint32_t(block);
+    return was_dirty;
+  }
+
+ private:
+  const uint8_t* register_blocks_;
+  uint32_t dirty_;
+};
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_STATE_BLOCK_TRACKER_H_
@@ -0,0 +1,336 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "third_party/catch/include/catch.hpp"
+#include "xenia/gpu/state_block_tracker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "xenia/gpu/trace_reader.h"
+#include "xenia/gpu/trace_test_util.h"
+
+using namespace xe::gpu;
+using xe::gpu::testing::PacketRecorder;
+
+namespace {
+
+const wchar_t* kTracePath = L"xenia-gpu-state-block-tests.trace";
+const char* kTracePathUtf8 = "xenia-gpu-state-block-tests.trace";
+
+const size_t kMemorySize = 4 * 1024 * 1024;
+const int kStateBlockCount = 6;
+
+// The registers each Update* step of gl4::CommandProcessor shadows, in
+// StateBlock order. Kept apart from StateBlockTracker's own table so that the
+// tests check it rather than trust it.
+const std::vector<uint32_t> kBlockRegisters[kStateBlockCount] = {
+    // UpdateShaders.
+    {XE_GPU_REG_PA_SU_SC_MODE_CNTL, XE_GPU_REG_SQ_PROGRAM_CNTL},
+    // UpdateRenderTargets.
+    {XE_GPU_REG_RB_MODECONTROL, XE_GPU_REG_RB_SURFACE_INFO,
+     XE_GPU_REG_RB_COLOR_INFO, XE_GPU_REG_RB_COLOR1_INFO,
+     XE_GPU_REG_RB_COLOR2_INFO, XE_GPU_REG_RB_COLOR3_INFO,
+     XE_GPU_REG_RB_COLOR_MASK, XE_GPU_REG_RB_DEPTHCONTROL,
+     XE_GPU_REG_RB_STENCILREFMASK, XE_GPU_REG_RB_DEPTH_INFO},
+    // UpdateViewportState.
+    {XE_GPU_REG_RB_SURFACE_INFO, XE_GPU_REG_PA_CL_VTE_CNTL,
+     XE_GPU_REG_PA_SU_SC_MODE_CNTL, XE_GPU_REG_PA_SC_WINDOW_OFFSET,
+     XE_GPU_REG_PA_SC_WINDOW_SCISSOR_TL, XE_GPU_REG_PA_SC_WINDOW_SCISSOR_BR,
+     XE_GPU_REG_PA_CL_VPORT_XOFFSET, XE_GPU_REG_PA_CL_VPORT_YOFFSET,
+     XE_GPU_REG_PA_CL_VPORT_ZOFFSET, XE_GPU_REG_PA_CL_VPORT_XSCALE,
+     XE_GPU_REG_PA_CL_VPORT_YSCALE, XE_GPU_REG_PA_CL_VPORT_ZSCALE},
+    // UpdateRasterizerState.
+    {XE_GPU_REG_PA_SU_SC_MODE_CNTL, XE_GPU_REG_PA_SC_SCREEN_SCISSOR_TL,
+     XE_GPU_REG_PA_SC_SCREEN_SCISSOR_BR,
+     XE_GPU_REG_VGT_MULTI_PRIM_IB_RESET_INDX},
+    // UpdateBlendState.
+    {XE_GPU_REG_RB_BLENDCONTROL_0, XE_GPU_REG_RB_BLENDCONTROL_1,
+     XE_GPU_REG_RB_BLENDCONTROL_2, XE_GPU_REG_RB_BLENDCONTROL_3,
+     XE_GPU_REG_RB_BLEND_RED, XE_GPU_REG_RB_BLEND_GREEN,
+     XE_GPU_REG_RB_BLEND_BLUE, XE_GPU_REG_RB_BLEND_ALPHA},
+    // UpdateDepthStencilState.
+    {XE_GPU_REG_RB_DEPTHCONTROL, XE_GPU_REG_RB_STENCILREFMASK},
+};
+
+uint32_t FloatBits(float value) {
+  union {
+    float f;
+    uint32_t u;
+  } bits;
+  bits.f = value;
+  return bits.u;
+}
+
+// Records frames of draws with new shader constants each. Passes change
+// targets and viewports, and blend, depth and culling switch every few draws.
+// With resend_state every draw writes the whole render state again, though
+// little of it differs from the last draw. Otherwise only the register ranges
+// holding a change are written, as D3D does.
+void RecordTrace(int frame_count, int draw_count, bool resend_state) {
+  std::vector<uint8_t> memory(kMemorySize);
+  TraceWriter writer(memory.data());
+  REQUIRE(writer.Open(kTracePath, false));
+  PacketRecorder recorder(&writer, &memory);
+  for (int frame = 0; frame < frame_count; ++frame) {
+    recorder.Reset();
+    writer.WritePrimaryBufferStart(0x1000, 0);
+    for (int draw = 0; draw < draw_count; ++draw) {
+      bool new_pass = resend_state || draw % 100 == 0;
+      bool new_blend = resend_state || draw % 8 == 0;
+      uint32_t pass = draw / 100;
+      uint32_t width = pass % 2 ? 640 : 1280;
+      // RB_SURFACE_INFO to PA_SC_SCREEN_SCISSOR_BR.
+      std::vector<uint32_t> surface(0x10);
+      surface[0x0] = width;
+      surface[0x1] = (pass * 0x100) & 0xFFF;
+      surface[0x2] = 0x10000 | 0x800;
+      surface[0xF] = (720 << 16) | width;
+      if (new_pass) {
+        recorder.SetConstant(4, 0x000, surface);
+      }
+      // VGT_MULTI_PRIM_IB_RESET_INDX to PA_CL_VPORT_ZOFFSET.
+      std::vector<uint32_t> viewport(0x12);
+      viewport[0x0] = 0xFFFF;
+      viewport[0x1] = 0xF;
+      viewport[0xA] = 0xFF0000;
+      viewport[0xC] = FloatBits(width / 2.0f);
+      viewport[0xD] = FloatBits(width / 2.0f);
+      viewport[0xE] = FloatBits(-360.0f);
+      viewport[0xF] = FloatBits(360.0f);
+      viewport[0x10] = FloatBits(1.0f);
+      if (new_pass) {
+        recorder.SetConstant(4, 0x103, viewport);
+      }
+      // RB_DEPTHCONTROL to RB_BLENDCONTROL_3.
+      std::vector<uint32_t> blend(0xC);
+      blend[0x0] = draw % 32 < 16 ? 0x6 : 0x2;
+      blend[0x1] = draw % 16 < 8 ? 0x10001 : 0x07060706;
+      blend[0x5] = draw % 64 < 32 ? 0x4 : 0x2;
+      blend[0x6] = 0x43F;
+      blend[0x8] = 4;
+      if (new_blend) {
+        recorder.SetConstant(4, 0x200, blend);
+      }
+      if (new_pass) {
+        recorder.Type0(XE_GPU_REG_SQ_PROGRAM_CNTL, {0x10020001});
+      }
+      // Per draw transforms and vertex fetch constants.
+      std::vector<uint32_t> constants(64);
+      for (size_t i = 0; i < constants.size(); ++i) {
+        constants[i] = FloatBits(float(frame * draw_count + draw + i));
+      }
+      recorder.SetConstant(0, 0, constants);
+      recorder.SetConstant(1, 0, {0x1000000u | (draw * 0x100), 0x400});
+      recorder.Draw();
+    }
+    writer.WritePrimaryBufferEnd();
+    writer.WriteEvent(EventType::kSwap);
+    recorder.Swap();
+    writer.Flush();
+  }
+  writer.Close();
+}
+
+// A register write, or a draw if index is kDrawIndex.
+struct ReplayOp {
+  uint32_t index;
+  uint32_t value;
+};
+const uint32_t kDrawIndex = ~0u;
+
+class ReplayOpRecorder : public TracePacketHandler {
+ public:
+  explicit ReplayOpRecorder(std::vector<ReplayOp>* ops) : ops_(ops) {}
+  void OnRegisterWrite(uint32_t index, uint32_t value) override {
+    ops_->push_back({index, value});
+  }
+  void OnDraw() override { ops_->push_back({kDrawIndex, 0}); }
+
+ private:
+  std::vector<ReplayOp>* ops_;
+};
+
+// Decodes every frame of a trace up front, so that replays only time the
+// register writes and draws and not parsing.
+std::vector<ReplayOp> DecodeTrace(const TraceReader& reader) {
+  std::vector<ReplayOp> ops;
+  ReplayOpRecorder recorder(&ops);
+  for (int i = 0; i < reader.frame_count(); ++i) {
+    reader.ForEachPacket(i, [&](const TraceCommandInfo& info) {
+      DecodeTracePacket(reader.trace_data() + info.payload_offset,
+                        info.length / 4, &recorder);
+    });
+  }
+  return ops;
+}
+
+struct ReplayStats {
+  uint64_t draw_count = 0;
+  uint64_t register_write_count = 0;
+  // Blocks whose registers were compared against their shadow copies.
+  uint64_t block_update_count = 0;
+  // Blocks found to differ, which would have changed host state.
+  uint64_t block_change_count = 0;
+  std::vector<uint32_t> changed_blocks;
+};
+
+// Replays register writes and, at each draw, brings each block's shadow copy
+// of its registers up to date like the Update* steps of the command
+// processor. With track_dirty, blocks are skipped unless a write changed one
+// of their registers. Otherwise every block is compared at every draw.
+ReplayStats Replay(const std::vector<ReplayOp>& ops, bool track_dirty,
+                   bool keep_changes) {
+  const auto& block_registers = kBlockRegisters;
+  std::vector<uint32_t> shadows[kStateBlockCount];
+  for (int b = 0; b < kStateBlockCount; ++b) {
+    shadows[b].resize(block_registers[b].size());
+  }
+
+  ReplayStats stats;
+  auto register_file = std::make_unique<RegisterFile>();
+  StateBlockTracker tracker;
+  for (auto& op : ops) {
+    if (op.index != kDrawIndex) {
+      if (op.index >= RegisterFile::kRegisterCount) {
+        continue;
+      }
+      ++stats.register_write_count;
+      if (track_dirty) {
+        tracker.WriteRegister(register_file.get(), op.index, op.value);
+      } else {
+        register_file->values[op.index].u32 = op.value;
+      }
+      continue;
+    }
+    ++stats.draw_count;
+    uint32_t changed = 0;
+    for (int b = 0; b < kStateBlockCount; ++b) {
+      if (track_dirty && !tracker.ConsumeDirty(StateBlock(1 << b))) {
+        continue;
+      }
+      ++stats.block_update_count;
+      bool dirty = false;
+      for (size_t i = 0; i < block_registers[b].size(); ++i) {
+        uint32_t value = register_file->values[block_registers[b][i]].u32;
+        if (shadows[b][i] != value) {
+          shadows[b][i] = value;
+          dirty = true;
+        }
+      }
+      if (dirty) {
+        ++stats.block_change_count;
+        changed |= 1 << b;
+      }
+    }
+    if (keep_changes) {
+      stats.changed_blocks.push_back(changed);
+    }
+  }
+  return stats;
+}
+
+}  // namespace
+
+TEST_CASE("STATE_BLOCK_TRACKER_WRITES", "[gpu]") {
+  // The tracker marks exactly the blocks that shadow each register.
+  std::vector<uint32_t> expected_blocks(RegisterFile::kRegisterCount);
+  for (int b = 0; b < kStateBlockCount; ++b) {
+    for (uint32_t index : kBlockRegisters[b]) {
+      expected_blocks[index] |= 1 << b;
+    }
+  }
+  auto register_blocks = StateBlockTracker::register_blocks();
+  for (uint32_t i = 0; i < RegisterFile::kRegisterCount; ++i) {
+    INFO("register " << i);
+    REQUIRE(register_blocks[i] == expected_blocks[i]);
+  }
+
+  auto register_file = std::make_unique<RegisterFile>();
+  StateBlockTracker tracker;
+  REQUIRE(tracker.dirty() == kStateBlockAll);
+  for (int b = 0; b < kStateBlockCount; ++b) {
+    REQUIRE(tracker.ConsumeDirty(StateBlock(1 << b)));
+  }
+  REQUIRE(tracker.dirty() == 0);
+
+  // Writing what is already there changes nothing.
+  tracker.WriteRegister(register_file.get(), XE_GPU_REG_RB_DEPTHCONTROL, 0);
+  REQUIRE(tracker.dirty() == 0);
+  tracker.WriteRegister(register_file.get(), XE_GPU_REG_RB_DEPTHCONTROL, 6);
+  REQUIRE(register_file->values[XE_GPU_REG_RB_DEPTHCONTROL].u32 == 6);
+  REQUIRE(tracker.dirty() ==
+          (kStateBlockRenderTargets | kStateBlockDepthStencil));
+  REQUIRE(tracker.ConsumeDirty(kStateBlockDepthStencil));
+  REQUIRE_FALSE(tracker.is_dirty(kStateBlockDepthStencil));
+  REQUIRE(tracker.is_dirty(kStateBlockRenderTargets));
+
+  tracker.WriteRegister(register_file.get(), XE_GPU_REG_SHADER_CONSTANT_000_X,
+                        1);
+  REQUIRE(tracker.dirty() == kStateBlockRenderTargets);
+}
+
+TEST_CASE("STATE_BLOCK_TRACKER_REPLAY_MATCHES_SHADOWS", "[gpu]") {
+  RecordTrace(3, 500, true);
+  TraceReader reader;
+  REQUIRE(reader.Open(kTracePath));
+  auto ops = DecodeTrace(reader);
+  auto tracked = Replay(ops, true, true);
+  auto compared = Replay(ops, false, true);
+  REQUIRE(tracked.draw_count == 3 * 500);
+  // Skipping clean blocks never misses a change.
+  REQUIRE(tracked.changed_blocks == compared.changed_blocks);
+  REQUIRE(tracked.block_update_count < compared.block_update_count);
+  std::remove(kTracePathUtf8);
+}
+
+TEST_CASE("STATE_BLOCK_TRACKER_BENCHMARK", "[.][benchmark]") {
+  // A few short frames replayed many times, so that the register file and
+  // the decoded writes stay in cache and only the draw path is timed. The
+  // fastest of several interleaved runs is kept.
+  const int run_count = 5;
+  const int replay_count = 100;
+  for (bool resend_state : {true, false}) {
+    RecordTrace(4, 500, resend_state);
+    TraceReader reader;
+    REQUIRE(reader.Open(kTracePath));
+    auto ops = DecodeTrace(reader);
+    ReplayStats stats[2];
+    double seconds[2] = {1e9, 1e9};
+    for (int run = 0; run < run_count; ++run) {
+      for (int track_dirty = 0; track_dirty < 2; ++track_dirty) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < replay_count; ++i) {
+          stats[track_dirty] = Replay(ops, track_dirty != 0, false);
+        }
+        seconds[track_dirty] = std::min(
+            seconds[track_dirty],
+            std::chrono::duration<double>(
+                std::chrono::high_resolution_clock::now() - start)
+                .count());
+      }
+    }
+    for (int track_dirty = 0; track_dirty < 2; ++track_dirty) {
+      auto& s = stats[track_dirty];
+      std::printf(
+          "%s, %s: %.1f register writes, %.2f blocks updated and %.2f "
+          "changed per draw, %.1f ns per draw\n",
+          resend_state ? "all state per draw" : "changed state per draw",
+          track_dirty ? "dirty blocks" : "shadow compare",
+          double(s.register_write_count) / s.draw_count,
+          double(s.block_update_count) / s.draw_count,
+          double(s.block_change_count) / s.draw_count,
+          seconds[track_dirty] * 1e9 / (s.draw_count * replay_count));
+    }
+  }
+  std::remove(kTracePathUtf8);
+}
@@ -0,0 +1,473 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/texture_conversion.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/cpu_features.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/platform.h"
+#include "xenia/base/worker_pool.h"
+#include "xenia/gpu/gpu_flags.h"
+
+namespace xe {
+namespace gpu {
+namespace texture_conversion {
+
+using xenos::Endian;
+
+void CopySwapBlock(Endian endianness, void* output, const void* input,
+                   size_t length) {
+  switch (endianness) {
+    case Endian::k8in16:
+      xe::copy_and_swap_16_aligned(reinterpret_cast<uint16_t*>(output),
+                                   reinterpret_cast<const uint16_t*>(input),
+                                   length / 2);
+      break;
+    case Endian::k8in32:
+      xe::copy_and_swap_32_aligned(reinterpret_cast<uint32_t*>(output),
+                                   reinterpret_cast<const uint32_t*>(input),
+                                   length / 4);
+      break;
+    case Endian::k16in32:  // Swap high and low 16 bits within a 32 bit word
+      xe::copy_and_swap_16_in_32_aligned(
+          reinterpret_cast<uint32_t*>(output),
+          reinterpret_cast<const uint32_t*>(input), length / 4);
+      break;
+    default:
+    case Endian::kUnspecified:
+      std::memcpy(output, input, length);
+      break;
+  }
+}
+
+UntileInfo UntileInfo::For2D(const TextureInfo& texture_info) {
+  UntileInfo info;
+  TextureInfo::GetPackedTileOffset(texture_info, &info.offset_x,
+                                   &info.offset_y);
+  info.width = texture_info.size_2d.block_width;
+  info.height = std::min(texture_info.size_2d.block_height,
+                         texture_info.size_2d.logical_height);
+  info.input_pitch = texture_info.size_2d.input_width /
+                     texture_info.format_info->block_width;
+  info.output_pitch = texture_info.size_2d.output_pitch;
+  info.bytes_per_block = texture_info.format_info->block_width *
+                         texture_info.format_info->block_height *
+                         texture_info.format_info->bits_per_pixel / 8;
+  info.endianness = texture_info.endianness;
+  return info;
+}
+
+UntileInfo UntileInfo::ForCube(const TextureInfo& texture_info) {
+  UntileInfo info;
+  TextureInfo::GetPackedTileOffset(texture_info, &info.offset_x,
+                                   &info.offset_y);
+  info.width = texture_info.size_cube.block_width;
+  info.height = texture_info.size_cube.block_height;
+  info.input_pitch = texture_info.size_cube.input_width /
+                     texture_info.format_info->block_width;
+  info.output_pitch = texture_info.size_cube.output_pitch;
+  info.bytes_per_block = texture_info.format_info->block_width *
+                         texture_info.format_info->block_height *
+                         texture_info.format_info->bits_per_pixel / 8;
+  info.endianness = texture_info.endianness;
+  return info;
+}
+
+namespace {
+
+// Surfaces smaller than this are not worth waking up other threads for.
+const size_t kParallelThreshold = 1024 * 1024;
+
+// The guest endian swaps only move bytes within a 32-bit word, so byte i of
+// the swapped data is byte i ^ SwapXor of the source.
+uint32_t SwapXor(Endian endianness) {
+  switch (endianness) {
+    case Endian::k8in16:
+      return 1;
+    case Endian::k8in32:
+      return 3;
+    case Endian::k16in32:
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+// pshufb masks for each SwapXor value, wide enough for AVX2.
+alignas(32) const uint8_t kSwapMasks[4][32] = {
+    {0, 1, 2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15,
+     0, 1, 2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15},
+    {1, 0, 3,  2,  5,  4,  7,  6,  9,  8,  11, 10, 13, 12, 15, 14,
+     1, 0, 3,  2,  5,  4,  7,  6,  9,  8,  11, 10, 13, 12, 15, 14},
+    {2, 3, 0,  1,  6,  7,  4,  5,  10, 11, 8,  9,  14, 15, 12, 13,
+     2, 3, 0,  1,  6,  7,  4,  5,  10, 11, 8,  9,  14, 15, 12, 13},
+    {3, 2, 1,  0,  7,  6,  5,  4,  11, 10, 9,  8,  15, 14, 13, 12,
+     3, 2, 1,  0,  7,  6,  5,  4,  11, 10, 9,  8,  15, 14, 13, 12},
+};
+
+// Byte offset of block (x, y) in the tiled input.
+inline uint32_t TiledOffset(uint32_t x, uint32_t y, uint32_t input_pitch,
+                            uint32_t log_bpb) {
+  uint32_t base = TextureInfo::TiledOffset2DOuter(y, input_pitch, log_bpb);
+  return (TextureInfo::TiledOffset2DInner(x, y, log_bpb, base) >> log_bpb)
+         << log_bpb;
+}
+
+// Within a row of a 32x32 macro tile, blocks come in contiguous runs of 16
+// bytes (8 bytes for 1-byte blocks). Runs start 8-byte aligned, so the endian
+// swap never crosses a run boundary. The offset of a run relative to its macro
+// tile is the same in every macro tile of the surface.
+template <uint32_t kLogBpb>
+struct RunLayout {
+  static const uint32_t kBytesPerBlock = 1 << kLogBpb;
+  static const uint32_t kRunBytes = kLogBpb ? 16 : 8;
+  static const uint32_t kRunBlocks = kRunBytes >> kLogBpb;
+  static const uint32_t kRunsPerTileRow = 32 / kRunBlocks;
+};
+
+// Copies the [begin, begin + length) bytes of a run.
+inline void CopyPartialRun(uint8_t* output, const uint8_t* run_input,
+                           uint32_t begin, uint32_t length,
+                           uint32_t swap_xor) {
+  for (uint32_t i = 0; i < length; ++i) {
+    output[i] = run_input[(begin + i) ^ swap_xor];
+  }
+}
+
+// Copies the whole runs of row_count consecutive rows of a macro tile. Runs
+// of a row go to consecutive output bytes. run_offsets points at the first run
+// of the first row and rows are runs_per_row apart. Each path is a struct with
+// a Copy template specialized on the run size.
+struct ScalarRuns {
+  template <uint32_t kRunBytes>
+  static void Copy(uint8_t* output, uint32_t output_pitch,
+                   const uint8_t* tile_input, const uint32_t* run_offsets,
+                   uint32_t runs_per_row, uint32_t row_count,
+                   uint32_t run_count, uint32_t swap_xor) {
+    for (uint32_t row = 0; row < row_count; ++row) {
+      uint8_t* dest = output + row * output_pitch;
+      const uint32_t* row_runs = run_offsets + row * runs_per_row;
+      for (uint32_t run = 0; run < run_count; ++run, dest += kRunBytes) {
+        const uint8_t* run_input = tile_input + row_runs[run];
+        if (!swap_xor) {
+          std::memcpy(dest, run_input, kRunBytes);
+        } else {
+          CopyPartialRun(dest, run_input, 0, kRunBytes, swap_xor);
+        }
+      }
+    }
+  }
+};
+
+struct SSSE3Runs {
+  template <uint32_t kRunBytes>
+  static void Copy(uint8_t* output, uint32_t output_pitch,
+                   const uint8_t* tile_input, const uint32_t* run_offsets,
+                   uint32_t runs_per_row, uint32_t row_count,
+                   uint32_t run_count, uint32_t swap_xor);
+};
+
+template <>
+void SSSE3Runs::Copy<16>(uint8_t* output, uint32_t output_pitch,
+                         const uint8_t* tile_input, const uint32_t* run_offsets,
+                         uint32_t runs_per_row, uint32_t row_count,
+                         uint32_t run_count, uint32_t swap_xor) {
+  __m128i mask =
+      _mm_load_si128(reinterpret_cast<const __m128i*>(kSwapMasks[swap_xor]));
+  for (uint32_t row = 0; row < row_count; ++row) {
+    uint8_t* dest = output + row * output_pitch;
+    const uint32_t* row_runs = run_offsets + row * runs_per_row;
+    for (uint32_t run = 0; run < run_count; ++run, dest += 16) {
+      __m128i data = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(tile_input + row_runs[run]));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dest),
+                       _mm_shuffle_epi8(data, mask));
+    }
+  }
+}
+
+template <>
+void SSSE3Runs::Copy<8>(uint8_t* output, uint32_t output_pitch,
+                        const uint8_t* tile_input, const uint32_t* run_offsets,
+                        uint32_t runs_per_row, uint32_t row_count,
+                        uint32_t run_count, uint32_t swap_xor) {
+  __m128i mask =
+      _mm_load_si128(reinterpret_cast<const __m128i*>(kSwapMasks[swap_xor]));
+  for (uint32_t row = 0; row < row_count; ++row) {
+    uint8_t* dest = output + row * output_pitch;
+    const uint32_t* row_runs = run_offsets + row * runs_per_row;
+    uint32_t run = 0;
+    for (; run + 2 <= run_count; run += 2, dest += 16) {
+      __m128i lo = _mm_loadl_epi64(
+          reinterpret_cast<const __m128i*>(tile_input + row_runs[run]));
+      __m128i hi = _mm_loadl_epi64(
+          reinterpret_cast<const __m128i*>(tile_input + row_runs[run + 1]));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dest),
+                       _mm_shuffle_epi8(_mm_unpacklo_epi64(lo, hi), mask));
+    }
+    if (run < run_count) {
+      __m128i data = _mm_loadl_epi64(
+          reinterpret_cast<const __m128i*>(tile_input + row_runs[run]));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(dest),
+                       _mm_shuffle_epi8(data, mask));
+    }
+  }
+}
+
+// The AVX2 copy can't be inlined into the (non-AVX2) tile loop, so it is an
+// out-of-line function called once per macro tile.
+XE_TARGET_AVX2 void CopyRunsAVX2_16(uint8_t* output, uint32_t output_pitch,
+                                    const uint8_t* tile_input,
+                                    const uint32_t* run_offsets,
+                                    uint32_t runs_per_row, uint32_t row_count,
+                                    uint32_t run_count, uint32_t swap_xor) {
+  __m256i mask = _mm256_load_si256(
+      reinterpret_cast<const __m256i*>(kSwapMasks[swap_xor]));
+  for (uint32_t row = 0; row < row_count; ++row) {
+    uint8_t* dest = output + row * output_pitch;
+    const uint32_t* row_runs = run_offsets + row * runs_per_row;
+    uint32_t run = 0;
+    for (; run + 2 <= run_count; run += 2, dest += 32) {
+      __m128i lo = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(tile_input + row_runs[run]));
+      __m128i hi = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(tile_input + row_runs[run + 1]));
+      __m256i data =
+          _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest),
+                          _mm256_shuffle_epi8(data, mask));
+    }
+    if (run < run_count) {
+      __m128i data = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(tile_input + row_runs[run]));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dest),
+                       _mm_shuffle_epi8(data, _mm256_castsi256_si128(mask)));
+    }
+  }
+}
+
+struct AVX2Runs {
+  template <uint32_t kRunBytes>
+  static void Copy(uint8_t* output, uint32_t output_pitch,
+                   const uint8_t* tile_input, const uint32_t* run_offsets,
+                   uint32_t runs_per_row, uint32_t row_count,
+                   uint32_t run_count, uint32_t swap_xor) {
+    if (kRunBytes == 16) {
+      CopyRunsAVX2_16(output, output_pitch, tile_input, run_offsets,
+                      runs_per_row, row_count, run_count, swap_xor);
+    } else {
+      // Gathering four 8-byte runs into a ymm register costs more than it
+      // saves, so 1-byte blocks stay on the 16-byte path.
+      SSSE3Runs::Copy<8>(output, output_pitch, tile_input, run_offsets,
+                         runs_per_row, row_count, run_count, swap_xor);
+    }
+  }
+};
+
+// Copies part of one run in each of row_count consecutive rows.
+inline void CopyPartialRuns(uint8_t* output, uint32_t output_pitch,
+                            const uint8_t* tile_input,
+                            const uint32_t* run_offsets, uint32_t runs_per_row,
+                            uint32_t row_count, uint32_t begin,
+                            uint32_t length, uint32_t swap_xor) {
+  for (uint32_t row = 0; row < row_count; ++row) {
+    CopyPartialRun(output + row * output_pitch,
+                   tile_input + run_offsets[row * runs_per_row], begin, length,
+                   swap_xor);
+  }
+}
+
+// Untiles output rows [row_begin, row_end) one macro tile at a time.
+template <uint32_t kLogBpb, typename Runs>
+void UntileRows(uint8_t* output, const uint8_t* input, const UntileInfo& info,
+                uint32_t row_begin, uint32_t row_end) {
+  typedef RunLayout<kLogBpb> Layout;
+  const uint32_t kBytesPerBlock = Layout::kBytesPerBlock;
+  const uint32_t kRunBlocks = Layout::kRunBlocks;
+  const uint32_t kRunsPerTileRow = Layout::kRunsPerTileRow;
+  uint32_t swap_xor = SwapXor(info.endianness);
+
+  uint32_t run_offsets[32][kRunsPerTileRow];
+  for (uint32_t y = 0; y < 32; ++y) {
+    for (uint32_t run = 0; run < kRunsPerTileRow; ++run) {
+      run_offsets[y][run] =
+          TiledOffset(run * kRunBlocks, y, info.input_pitch, kLogBpb);
+    }
+  }
+
+  uint32_t x_begin = info.offset_x;
+  uint32_t x_end = info.offset_x + info.width;
+  uint32_t y_end = info.offset_y + row_end;
+  for (uint32_t y = info.offset_y + row_begin; y < y_end;) {
+    uint32_t tile_y = y & ~31u;
+    uint32_t row_count = std::min(tile_y + 32, y_end) - y;
+    for (uint32_t tile_x = x_begin & ~31u; tile_x < x_end; tile_x += 32) {
+      const uint8_t* tile_input =
+          input + TiledOffset(tile_x, tile_y, info.input_pitch, kLogBpb);
+      uint32_t x = std::max(x_begin, tile_x) - tile_x;
+      uint32_t last = std::min(x_end, tile_x + 32) - tile_x;
+      uint8_t* dest = output + (y - info.offset_y) * info.output_pitch +
+                      (tile_x + x - x_begin) * kBytesPerBlock;
+      const uint32_t* first_row_runs = run_offsets[y & 31];
+      if (x % kRunBlocks) {
+        // Starts in the middle of a run.
+        uint32_t end = std::min(last, (x / kRunBlocks + 1) * kRunBlocks);
+        uint32_t length = (end - x) * kBytesPerBlock;
+        CopyPartialRuns(dest, info.output_pitch, tile_input,
+                        first_row_runs + x / kRunBlocks, kRunsPerTileRow,
+                        row_count, (x % kRunBlocks) * kBytesPerBlock, length,
+                        swap_xor);
+        dest += length;
+        x = end;
+      }
+      uint32_t run_count = (last - x) / kRunBlocks;
+      if (run_count) {
+        Runs::template Copy<Layout::kRunBytes>(
+            dest, info.output_pitch, tile_input,
+            first_row_runs + x / kRunBlocks, kRunsPerTileRow, row_count,
+            run_count, swap_xor);
+        dest += run_count * Layout::kRunBytes;
+        x += run_count * kRunBlocks;
+      }
+      if (x < last) {
+        CopyPartialRuns(dest, info.output_pitch, tile_input,
+                        first_row_runs + x / kRunBlocks, kRunsPerTileRow,
+                        row_count, 0, (last - x) * kBytesPerBlock, swap_xor);
+      }
+    }
+    y += row_count;
+  }
+}
+
+// Block by block, for block sizes that aren't a power of two.
+void UntileBlocks(uint8_t* output, const uint8_t* input,
+                  const UntileInfo& info, uint32_t row_begin,
+                  uint32_t row_end) {
+  uint32_t bytes_per_block = info.bytes_per_block;
+  uint32_t log_bpb = (bytes_per_block >> 2) +
+                     ((bytes_per_block >> 1) >> (bytes_per_block >> 2));
+  uint32_t swap_xor = SwapXor(info.endianness);
+  for (uint32_t y = row_begin; y < row_end; ++y) {
+    uint32_t input_base_offset = TextureInfo::TiledOffset2DOuter(
+        info.offset_y + y, info.input_pitch, log_bpb);
+    uint8_t* dest = output + y * info.output_pitch;
+    for (uint32_t x = 0; x < info.width; ++x, dest += bytes_per_block) {
+      uint32_t input_offset =
+          (TextureInfo::TiledOffset2DInner(info.offset_x + x, info.offset_y + y,
+                                           log_bpb, input_base_offset) >>
+           log_bpb) *
+          bytes_per_block;
+      for (uint32_t i = 0; i < bytes_per_block; ++i) {
+        dest[i] = input[(input_offset + i) ^ swap_xor];
+      }
+    }
+  }
+}
+
+typedef void (*UntileRowsFn)(uint8_t* output, const uint8_t* input,
+                             const UntileInfo& info, uint32_t row_begin,
+                             uint32_t row_end);
+
+template <typename Runs>
+UntileRowsFn SelectUntileRows(uint32_t bytes_per_block) {
+  switch (bytes_per_block) {
+    case 1:
+      return UntileRows<0, Runs>;
+    case 2:
+      return UntileRows<1, Runs>;
+    case 4:
+      return UntileRows<2, Runs>;
+    case 8:
+      return UntileRows<3, Runs>;
+    case 16:
+      return UntileRows<4, Runs>;
+    default:
+      return UntileBlocks;
+  }
+}
+
+}  // namespace
+
+bool IsUntilePathSupported(UntilePath path) {
+  static const bool has_avx2 =
+      (xe::host_cpu_features() & xe::kCpuFeatureAVX2) != 0;
+  switch (path) {
+    case UntilePath::kScalar:
+    case UntilePath::kSSSE3:
+      return true;
+    case UntilePath::kAVX2:
+      return has_avx2;
+    default:
+      return false;
+  }
+}
+
+void Untile(uint8_t* output, const uint8_t* input, const UntileInfo& info) {
+  UntilePath path = IsUntilePathSupported(UntilePath::kAVX2)
+                        ? UntilePath::kAVX2
+                        : UntilePath::kSSSE3;
+  uint32_t thread_count =
+      std::min(uint32_t(std::max(FLAGS_gpu_untile_threads, 1)),
+               xe::threading::WorkerPool::shared()->worker_count() + 1);
+  Untile(output, input, info, path, thread_count);
+}
+
+void Untile(uint8_t* output, const uint8_t* input, const UntileInfo& info,
+            UntilePath path, uint32_t thread_count) {
+  if (!info.width || !info.height || !info.bytes_per_block) {
+    return;
+  }
+  UntileRowsFn untile_rows;
+  switch (path) {
+    case UntilePath::kScalar:
+      untile_rows = SelectUntileRows<ScalarRuns>(info.bytes_per_block);
+      break;
+    case UntilePath::kSSSE3:
+      untile_rows = SelectUntileRows<SSSE3Runs>(info.bytes_per_block);
+      break;
+    case UntilePath::kAVX2:
+      assert_true(IsUntilePathSupported(path));
+      untile_rows = SelectUntileRows<AVX2Runs>(info.bytes_per_block);
+      break;
+    default:
+      assert_unhandled_case(path);
+      return;
+  }
+
+  // Split into bands of whole macro tile rows, a few per thread so that
+  // threads finishing early can take more, and untile them on the shared
+  // worker pool.
+  uint32_t tile_rows = (info.height + 31) / 32;
+  thread_count = std::min(thread_count, tile_rows);
+  if (thread_count <= 1 ||
+      size_t(info.height) * info.output_pitch < kParallelThreshold) {
+    untile_rows(output, input, info, 0, info.height);
+    return;
+  }
+  uint32_t band_count = std::min(thread_count * 4, tile_rows);
+  uint32_t band_rows = (tile_rows + band_count - 1) / band_count * 32;
+  band_count = (info.height + band_rows - 1) / band_rows;
+  xe::threading::WorkerPool::shared()->ParallelFor(
+      band_count, thread_count, [&](size_t band) {
+        uint32_t row = uint32_t(band) * band_rows;
+        untile_rows(output, input, info, row,
+                    std::min(row + band_rows, info.height));
+      });
+}
+
+}  // namespace texture_conversion
+}  // namespace gpu
+}  // namespace xe
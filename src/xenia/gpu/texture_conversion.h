@@ -0,0 +1,73 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_TEXTURE_CONVERSION_H_
+#define XENIA_GPU_TEXTURE_CONVERSION_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "xenia/gpu/texture_info.h"
+#include "xenia/gpu/xenos.h"
+
+namespace xe {
+namespace gpu {
+namespace texture_conversion {
+
+// Copies length bytes of guest texture data, applying the guest endian swap.
+void CopySwapBlock(xenos::Endian endianness, void* output, const void* input,
+                   size_t length);
+
+// Describes a tiled 2D surface (or a single cube face) to untile.
+// All coordinates and sizes are in blocks unless noted otherwise.
+struct UntileInfo {
+  // Position of the surface within the tiled input, for packed mips.
+  uint32_t offset_x;
+  uint32_t offset_y;
+  // Number of blocks to produce per row and number of rows.
+  uint32_t width;
+  uint32_t height;
+  // Width of the tiled input in blocks.
+  uint32_t input_pitch;
+  // Distance between output rows in bytes.
+  uint32_t output_pitch;
+  uint32_t bytes_per_block;
+  xenos::Endian endianness;
+
+  static UntileInfo For2D(const TextureInfo& texture_info);
+  static UntileInfo ForCube(const TextureInfo& texture_info);
+};
+
+enum class UntilePath {
+  // Per-run scalar copies. Always available.
+  kScalar,
+  // 16-byte pshufb swaps. Always available, as the build targets AVX.
+  kSSSE3,
+  // 32-byte pshufb swaps, two runs at a time.
+  kAVX2,
+};
+
+// Whether the host can run the given path.
+bool IsUntilePathSupported(UntilePath path);
+
+// Untiles a surface with the fastest path the host supports. Large surfaces
+// are split across up to --gpu_untile_threads threads of the shared worker
+// pool.
+void Untile(uint8_t* output, const uint8_t* input, const UntileInfo& info);
+
+// Untiles a surface with the given path and number of threads.
+// Exposed for tests and benchmarks.
+void Untile(uint8_t* output, const uint8_t* input, const UntileInfo& info,
+            UntilePath path, uint32_t thread_count);
+
+}  // namespace texture_conversion
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_TEXTURE_CONVERSION_H_
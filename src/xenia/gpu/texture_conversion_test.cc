@@ -0,0 +1,202 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "third_party/catch/include/catch.hpp"
+#include "xenia/gpu/texture_conversion.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using namespace xe::gpu;
+using namespace xe::gpu::texture_conversion;
+
+namespace {
+
+// The block-by-block loop TextureCache used before, with the endian swap
+// applied to each byte of guest memory.
+void UntileReference(uint8_t* output, const uint8_t* input,
+                     const UntileInfo& info) {
+  uint32_t bytes_per_block = info.bytes_per_block;
+  uint32_t bpp = (bytes_per_block >> 2) +
+                 ((bytes_per_block >> 1) >> (bytes_per_block >> 2));
+  uint32_t swap_xor = 0;
+  switch (info.endianness) {
+    case xenos::Endian::k8in16:
+      swap_xor = 1;
+      break;
+    case xenos::Endian::k8in32:
+      swap_xor = 3;
+      break;
+    case xenos::Endian::k16in32:
+      swap_xor = 2;
+      break;
+    default:
+      break;
+  }
+  for (uint32_t y = 0, output_base_offset = 0; y < info.height;
+       y++, output_base_offset += info.output_pitch) {
+    auto input_base_offset = TextureInfo::TiledOffset2DOuter(
+        info.offset_y + y, info.input_pitch, bpp);
+    for (uint32_t x = 0, output_offset = output_base_offset; x < info.width;
+         x++, output_offset += bytes_per_block) {
+      auto input_offset =
+          TextureInfo::TiledOffset2DInner(info.offset_x + x, info.offset_y + y,
+                                          bpp, input_base_offset) >>
+          bpp;
+      for (uint32_t i = 0; i < bytes_per_block; ++i) {
+        output[output_offset + i] =
+            input[(input_offset * bytes_per_block + i) ^ swap_xor];
+      }
+    }
+  }
+}
+
+UntileInfo MakeInfo(uint32_t width, uint32_t height, uint32_t bytes_per_block,
+                    xenos::Endian endianness) {
+  UntileInfo info;
+  info.offset_x = 0;
+  info.offset_y = 0;
+  info.width = width;
+  info.height = height;
+  info.input_pitch = (width + 31) & ~31u;
+  info.output_pitch = width * bytes_per_block;
+  info.bytes_per_block = bytes_per_block;
+  info.endianness = endianness;
+  return info;
+}
+
+// Tiled input covering every block of the padded surface. Small blocks don't
+// pack macro tiles densely, so this is sized by the largest tiled offset.
+std::vector<uint8_t> MakeInput(const UntileInfo& info) {
+  uint32_t bytes_per_block = info.bytes_per_block;
+  uint32_t bpp = (bytes_per_block >> 2) +
+                 ((bytes_per_block >> 1) >> (bytes_per_block >> 2));
+  uint32_t rows = (info.offset_y + info.height + 31) & ~31u;
+  size_t length = 0;
+  for (uint32_t y = 0; y < rows; ++y) {
+    auto base = TextureInfo::TiledOffset2DOuter(y, info.input_pitch, bpp);
+    for (uint32_t x = 0; x < info.input_pitch; ++x) {
+      auto offset = TextureInfo::TiledOffset2DInner(x, y, bpp, base) >> bpp;
+      length = std::max(length, size_t(offset + 1) * bytes_per_block);
+    }
+  }
+  // Runs are swapped as a whole, so keep the last one complete.
+  std::vector<uint8_t> input(length + 16);
+  for (size_t i = 0; i < input.size(); ++i) {
+    input[i] = uint8_t(i * 7 + (i >> 8));
+  }
+  return input;
+}
+
+void CheckUntile(const UntileInfo& info) {
+  auto input = MakeInput(info);
+  std::vector<uint8_t> expected(size_t(info.output_pitch) * info.height);
+  UntileReference(expected.data(), input.data(), info);
+  for (auto path :
+       {UntilePath::kScalar, UntilePath::kSSSE3, UntilePath::kAVX2}) {
+    if (!IsUntilePathSupported(path)) {
+      continue;
+    }
+    for (uint32_t thread_count : {1, 3}) {
+      std::vector<uint8_t> output(expected.size(), 0xCD);
+      Untile(output.data(), input.data(), info, path, thread_count);
+      INFO("path " << int(path) << " bpb " << info.bytes_per_block << " "
+                   << info.width << "x" << info.height << " offset "
+                   << info.offset_x << "," << info.offset_y << " endian "
+                   << int(info.endianness));
+      REQUIRE(output == expected);
+    }
+  }
+}
+
+double MeasureUntileRate(const UntileInfo& info, UntilePath path,
+                         uint32_t thread_count) {
+  auto input = MakeInput(info);
+  std::vector<uint8_t> output(size_t(info.output_pitch) * info.height);
+  const int iterations = 50;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int n = 0; n < iterations; ++n) {
+    if (thread_count) {
+      Untile(output.data(), input.data(), info, path, thread_count);
+    } else {
+      UntileReference(output.data(), input.data(), info);
+    }
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  double seconds = std::chrono::duration<double>(end - start).count();
+  return output.size() * double(iterations) / seconds / (1024 * 1024);
+}
+
+}  // namespace
+
+TEST_CASE("UNTILE_MATCHES_REFERENCE", "[texture_conversion]") {
+  for (uint32_t bytes_per_block : {1, 2, 4, 8, 12, 16}) {
+    for (auto endianness : {xenos::Endian::kUnspecified, xenos::Endian::k8in16,
+                            xenos::Endian::k8in32, xenos::Endian::k16in32}) {
+      // Whole tiles, partial tiles and surfaces narrower than a run.
+      CheckUntile(MakeInfo(64, 64, bytes_per_block, endianness));
+      CheckUntile(MakeInfo(100, 37, bytes_per_block, endianness));
+      CheckUntile(MakeInfo(3, 5, bytes_per_block, endianness));
+    }
+  }
+}
+
+TEST_CASE("UNTILE_PACKED_MIPS", "[texture_conversion]") {
+  // Small mips are packed into a single tile at an offset.
+  for (uint32_t bytes_per_block : {1, 2, 4, 8, 16}) {
+    for (uint32_t size : {1, 2, 4, 8, 16}) {
+      auto info = MakeInfo(size, size, bytes_per_block, xenos::Endian::k8in32);
+      info.input_pitch = 32;
+      info.offset_x = 16;
+      CheckUntile(info);
+      info.offset_x = 0;
+      info.offset_y = 16;
+      CheckUntile(info);
+      info.offset_x = 4;
+      info.offset_y = 0;
+      CheckUntile(info);
+    }
+  }
+}
+
+TEST_CASE("UNTILE_MULTITHREADED", "[texture_conversion]") {
+  // Big enough to be split across threads.
+  CheckUntile(MakeInfo(1024, 720, 4, xenos::Endian::k8in32));
+  CheckUntile(MakeInfo(1280, 720, 2, xenos::Endian::k8in16));
+}
+
+TEST_CASE("UNTILE_BENCHMARK", "[.][benchmark]") {
+  for (uint32_t bytes_per_block : {1, 2, 4, 8, 16}) {
+    auto info = MakeInfo(2048, 2048 / bytes_per_block, bytes_per_block,
+                         xenos::Endian::k8in32);
+    double reference_rate = MeasureUntileRate(info, UntilePath::kScalar, 0);
+    std::printf("%2u bytes/block: reference %8.1f MB/s", bytes_per_block,
+                reference_rate);
+    struct {
+      const char* name;
+      UntilePath path;
+      uint32_t thread_count;
+    } configs[] = {
+        {"scalar", UntilePath::kScalar, 1},
+        {"ssse3", UntilePath::kSSSE3, 1},
+        {"avx2", UntilePath::kAVX2, 1},
+        {"avx2 x4", UntilePath::kAVX2, 4},
+    };
+    for (auto& config : configs) {
+      if (!IsUntilePathSupported(config.path)) {
+        continue;
+      }
+      std::printf(", %s %8.1f MB/s", config.name,
+                  MeasureUntileRate(info, config.path, config.thread_count));
+    }
+    std::printf("\n");
+  }
+}
@@ -0,0 +1,309 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/trace_reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+
+namespace xe {
+namespace gpu {
+
+bool TraceReader::Open(const std::wstring& path, bool rebuild_index) {
+  Close();
+
+  if (!file_.Open(path)) {
+    return false;
+  }
+
+  trace_data_ = file_.data();
+  trace_size_ = file_.size();
+
+  has_file_index_ = !rebuild_index && LoadIndex();
+  if (!has_file_index_) {
+    BuildIndex();
+  }
+  BuildFrames();
+
+  return true;
+}
+
+void TraceReader::Close() {
+  file_.Close();
+  trace_data_ = nullptr;
+  trace_size_ = 0;
+  has_file_index_ = false;
+  index_frames_.clear();
+  index_draws_.clear();
+  index_memory_reads_.clear();
+  frames_.clear();
+}
+
+bool TraceReader::LoadIndex() {
+  auto footer = file_.index_footer();
+  if (!footer) {
+    return false;
+  }
+  // The tables are copied out as they may not be aligned in the file.
+  auto index_ptr = file_.index_data();
+  auto read_table = [&index_ptr](void* table, size_t length) {
+    std::memcpy(table, index_ptr, length);
+    index_ptr += length;
+  };
+  index_frames_.resize(footer->frame_count);
+  read_table(index_frames_.data(),
+             index_frames_.size() * sizeof(TraceFrameIndexEntry));
+  index_draws_.resize(footer->draw_count);
+  read_table(index_draws_.data(),
+             index_draws_.size() * sizeof(TraceDrawIndexEntry));
+  index_memory_reads_.resize(footer->memory_read_count);
+  read_table(index_memory_reads_.data(),
+             index_memory_reads_.size() * sizeof(TraceMemoryReadIndexEntry));
+
+  // Everything else trusts these offsets, so check them once here.
+  bool valid = true;
+  for (auto& frame : index_frames_) {
+    valid &= frame.start_offset <= frame.end_offset &&
+             frame.end_offset <= trace_size_ &&
+             uint64_t(frame.first_draw) + frame.draw_count <=
+                 index_draws_.size() &&
+             uint64_t(frame.first_memory_read) + frame.memory_read_count <=
+                 index_memory_reads_.size();
+  }
+  for (auto& draw : index_draws_) {
+    valid &= draw.head_offset < draw.end_offset &&
+             draw.start_offset <= draw.end_offset &&
+             draw.end_offset <= trace_size_;
+  }
+  for (auto& memory_read : index_memory_reads_) {
+    valid &= memory_read.payload_offset + memory_read.length <= trace_size_;
+  }
+  if (!valid) {
+    XELOGW("Trace index is out of range of the trace; rebuilding it");
+    index_frames_.clear();
+    index_draws_.clear();
+    index_memory_reads_.clear();
+    return false;
+  }
+  return true;
+}
+
+void TraceReader::BuildIndex() {
+  TraceIndexBuilder builder;
+  uint64_t offset = 0;
+  while (offset < trace_size_) {
+    TraceCommandInfo info;
+    if (!DecodeTraceCommand(trace_data_ + offset, size_t(trace_size_ - offset),
+                            offset, &info)) {
+      // Broken trace file?
+      XELOGW("Unknown trace command at offset %llu; ignoring the rest",
+             static_cast<unsigned long long>(offset));
+      break;
+    }
+    builder.AddCommand(info, trace_data_ + info.payload_offset);
+    offset = info.end_offset;
+  }
+  builder.Finish(offset);
+  index_frames_ = builder.frames();
+  index_draws_ = builder.draws();
+  index_memory_reads_ = builder.memory_reads();
+}
+
+void TraceReader::BuildFrames() {
+  frames_.resize(index_frames_.size());
+  for (size_t i = 0; i < index_frames_.size(); ++i) {
+    auto& entry = index_frames_[i];
+    auto& frame = frames_[i];
+    frame.start_ptr = trace_data_ + entry.start_offset;
+    frame.end_ptr = trace_data_ + entry.end_offset;
+    frame.command_count = int(entry.command_count);
+    frame.commands.resize(entry.draw_count);
+    for (uint32_t j = 0; j < entry.draw_count; ++j) {
+      auto& draw = index_draws_[entry.first_draw + j];
+      auto& command = frame.commands[j];
+      command.type = Frame::Command::Type::kDraw;
+      command.head_ptr = trace_data_ + draw.head_offset;
+      command.start_ptr = trace_data_ + draw.start_offset;
+      command.end_ptr = trace_data_ + draw.end_offset;
+    }
+  }
+}
+
+size_t TraceReader::RestoreMemory(int n, uint8_t* physical_membase) const {
+  // Walk the reads backwards, copying only the bytes no later read covers.
+  // covered maps the start of each written range to its end; ranges never
+  // touch or overlap.
+  std::map<uint64_t, uint64_t> covered;
+  size_t copied = 0;
+  for (size_t i = index_frames_[n].first_memory_read; i-- > 0;) {
+    auto& memory_read = index_memory_reads_[i];
+    if (!memory_read.length) {
+      continue;
+    }
+    uint64_t start = memory_read.base_ptr & 0x1FFFFFFF;
+    uint64_t end = start + memory_read.length;
+    auto copy = [&](uint64_t copy_start, uint64_t copy_end) {
+      std::memcpy(physical_membase + copy_start,
+                  trace_data_ + memory_read.payload_offset +
+                      (copy_start - start),
+                  size_t(copy_end - copy_start));
+      copied += size_t(copy_end - copy_start);
+    };
+
+    auto it = covered.upper_bound(start);
+    if (it != covered.begin() && std::prev(it)->second >= start) {
+      --it;
+    }
+    auto first_touching = it;
+    uint64_t cursor = start;
+    while (cursor < end && it != covered.end() && it->first <= end) {
+      if (it->first > cursor) {
+        copy(cursor, it->first);
+      }
+      cursor = std::max(cursor, it->second);
+      ++it;
+    }
+    if (cursor < end) {
+      copy(cursor, end);
+    }
+
+    // Merge the read with every range it touches.
+    uint64_t merged_start = start;
+    uint64_t merged_end = end;
+    if (first_touching != it) {
+      merged_start = std::min(merged_start, first_touching->first);
+      merged_end = std::max(merged_end, std::prev(it)->second);
+      covered.erase(first_touching, it);
+    }
+    covered[merged_start] = merged_end;
+  }
+  return copied;
+}
+
+void TraceReader::ForEachPacket(
+    int n, std::function<void(const TraceCommandInfo&)> fn) const {
+  auto& entry = index_frames_[n];
+  uint64_t offset = entry.start_offset;
+  while (offset < entry.end_offset) {
+    TraceCommandInfo info;
+    if (!DecodeTraceCommand(trace_data_ + offset,
+                            size_t(entry.end_offset - offset), offset,
+                            &info)) {
+      break;
+    }
+    if (info.type == TraceCommandType::kPacketStart ||
+        info.type == TraceCommandType::kPacketStartRef) {
+      fn(info);
+    }
+    offset = info.end_offset;
+  }
+}
+
+void DecodeTracePacket(const uint8_t* data, uint32_t dword_count,
+                       TracePacketHandler* handler) {
+  using namespace xe::gpu::xenos;
+  if (!dword_count) {
+    return;
+  }
+  auto read = [data](uint32_t n) {
+    return xe::load_and_swap<uint32_t>(data + n * 4);
+  };
+  uint32_t packet = read(0);
+  if (!packet) {
+    // Nop.
+    return;
+  }
+  // Never trust the header to stay within what was recorded.
+  uint32_t count = std::min(((packet >> 16) & 0x3FFF) + 1, dword_count - 1);
+  switch (packet >> 30) {
+    case 0x0: {
+      uint32_t base_index = packet & 0x7FFF;
+      uint32_t write_one_reg = (packet >> 15) & 0x1;
+      for (uint32_t m = 0; m < count; m++) {
+        handler->OnRegisterWrite(write_one_reg ? base_index : base_index + m,
+                                 read(1 + m));
+      }
+      break;
+    }
+    case 0x1:
+      if (dword_count >= 3) {
+        handler->OnRegisterWrite(packet & 0x7FF, read(1));
+        handler->OnRegisterWrite((packet >> 11) & 0x7FF, read(2));
+      }
+      break;
+    case 0x3: {
+      uint32_t opcode = (packet >> 8) & 0x7F;
+      switch (opcode) {
+        case PM4_DRAW_INDX:
+        case PM4_DRAW_INDX_2:
+          handler->OnDraw();
+          break;
+        case PM4_SET_CONSTANT: {
+          static const uint32_t type_base[] = {0x4000, 0x4800, 0x4900, 0x4908,
+                                               0x2000};
+          if (!count) {
+            break;
+          }
+          uint32_t offset_type = read(1);
+          uint32_t type = (offset_type >> 16) & 0xFF;
+          if (type < xe::countof(type_base)) {
+            uint32_t index = type_base[type] + (offset_type & 0x7FF);
+            for (uint32_t n = 2; n < 1 + count; n++) {
+              handler->OnRegisterWrite(index++, read(n));
+            }
+          }
+          break;
+        }
+        case PM4_SET_CONSTANT2: {
+          if (!count) {
+            break;
+          }
+          uint32_t index = read(1) & 0xFFFF;
+          for (uint32_t n = 2; n < 1 + count; n++) {
+            handler->OnRegisterWrite(index++, read(n));
+          }
+          break;
+        }
+        case PM4_IM_LOAD: {
+          if (count < 2) {
+            break;
+          }
+          uint32_t addr_type = read(1);
+          if ((addr_type & 0x3) <= uint32_t(ShaderType::kPixel)) {
+            handler->OnShaderLoad(ShaderType(addr_type & 0x3),
+                                  addr_type & ~0x3, read(2) & 0xFFFF);
+          }
+          break;
+        }
+        case PM4_IM_LOAD_IMMEDIATE: {
+          if (count < 2) {
+            break;
+          }
+          uint32_t type = read(1);
+          uint32_t size_dwords = read(2) & 0xFFFF;
+          if (type <= uint32_t(ShaderType::kPixel) &&
+              3 + size_dwords <= dword_count) {
+            handler->OnShaderLoadImmediate(ShaderType(type), data + 3 * 4,
+                                           size_dwords);
+          }
+          break;
+        }
+      }
+      break;
+    }
+  }
+}
+
+}  // namespace gpu
+}  // namespace xe
@@ -0,0 +1,125 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_TRACE_READER_H_
+#define XENIA_GPU_TRACE_READER_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "xenia/gpu/tracing.h"
+#include "xenia/gpu/xenos.h"
+
+namespace xe {
+namespace gpu {
+
+// Reads the frames and draws of a trace from its index, building the index
+// with a pass over the trace if the file doesn't have one. Nothing past the
+// index is read until asked for, so opening and seeking don't depend on the
+// length of the trace.
+class TraceReader {
+ public:
+  struct Frame {
+    struct Command {
+      enum class Type {
+        kDraw,
+        kSwap,
+      };
+      const uint8_t* head_ptr;
+      const uint8_t* start_ptr;
+      const uint8_t* end_ptr;
+      Type type;
+      union {
+        struct {
+          //
+        } draw;
+        struct {
+          //
+        } swap;
+      };
+    };
+
+    const uint8_t* start_ptr;
+    const uint8_t* end_ptr;
+    int command_count;
+    std::vector<Command> commands;
+  };
+
+  TraceReader() = default;
+  ~TraceReader() = default;
+
+  const Frame* frame(int n) const { return &frames_[n]; }
+  int frame_count() const { return int(frames_.size()); }
+  // Packet, draw and byte counts of frame n.
+  const TraceFrameIndexEntry& frame_stats(int n) const {
+    return index_frames_[n];
+  }
+
+  const uint8_t* trace_data() const { return trace_data_; }
+  size_t trace_size() const { return trace_size_; }
+  // Whether the index was read from the file rather than built on open.
+  bool has_file_index() const { return has_file_index_; }
+
+  // Ignores the index in the file and builds it again if rebuild_index is
+  // set.
+  bool Open(const std::wstring& path, bool rebuild_index = false);
+  void Close();
+
+  // Copies in the most recent MemoryRead data of every address read before
+  // frame n starts, so that frame n plays as recorded without playing the
+  // frames before it. Each byte is copied once, however often it was read.
+  // Returns the number of bytes copied.
+  size_t RestoreMemory(int n, uint8_t* physical_membase) const;
+
+  // Calls fn for each packet command of frame n. Packet data isn't read;
+  // it's at trace_data() + payload_offset.
+  void ForEachPacket(int n,
+                     std::function<void(const TraceCommandInfo&)> fn) const;
+
+ protected:
+  bool LoadIndex();
+  void BuildIndex();
+  void BuildFrames();
+
+  TraceFile file_;
+  const uint8_t* trace_data_ = nullptr;
+  size_t trace_size_ = 0;
+  bool has_file_index_ = false;
+  std::vector<TraceFrameIndexEntry> index_frames_;
+  std::vector<TraceDrawIndexEntry> index_draws_;
+  std::vector<TraceMemoryReadIndexEntry> index_memory_reads_;
+  std::vector<Frame> frames_;
+};
+
+// Receives what a recorded PM4 packet does, as the command processor would
+// execute it. Anything else in the packet is skipped.
+class TracePacketHandler {
+ public:
+  virtual ~TracePacketHandler() = default;
+
+  virtual void OnRegisterWrite(uint32_t index, uint32_t value) {}
+  // IM_LOAD. The ucode is recorded by the memory read of guest_address that
+  // follows the packet.
+  virtual void OnShaderLoad(ShaderType type, uint32_t guest_address,
+                            uint32_t dword_count) {}
+  // IM_LOAD_IMMEDIATE, with ucode in guest byte order.
+  virtual void OnShaderLoadImmediate(ShaderType type, const uint8_t* ucode,
+                                     uint32_t dword_count) {}
+  virtual void OnDraw() {}
+};
+
+// Walks the packet of a packet command, dword_count dwords at data.
+void DecodeTracePacket(const uint8_t* data, uint32_t dword_count,
+                       TracePacketHandler* handler);
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_TRACE_READER_H_
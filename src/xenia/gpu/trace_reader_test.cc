@@ -0,0 +1,263 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "third_party/catch/include/catch.hpp"
+#include "xenia/gpu/trace_reader.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <tuple>
+#include <vector>
+
+#include "xenia/base/memory.h"
+#include "xenia/gpu/trace_test_util.h"
+#include "xenia/gpu/xenos.h"
+
+using namespace xe::gpu;
+using xe::gpu::testing::PacketRecorder;
+
+namespace {
+
+const wchar_t* kTracePath = L"xenia-gpu-reader-tests.trace";
+
+const uint32_t kReadBase = 0x10000;
+const uint32_t kReadLength = 0x1000;
+const size_t kMemorySize = 4 * 1024 * 1024;
+
+// A packet of dword_count dwords with nothing but zeros after its header.
+void WritePacket(PacketRecorder* recorder, uint32_t header,
+                 uint32_t dword_count) {
+  std::vector<uint32_t> dwords(dword_count);
+  dwords[0] = header;
+  recorder->Write(dwords);
+}
+
+// Records one frame of register writes with a draw every tenth packet, and
+// vertex data reads into overlapping windows that move from frame to frame.
+void RecordFrame(TraceWriter* writer, std::vector<uint8_t>* memory, int frame,
+                 int packet_count) {
+  const uint32_t draw_header =
+      PacketRecorder::Type3Header(xenos::PM4_DRAW_INDX, 8);
+  const uint32_t swap_header =
+      PacketRecorder::Type3Header(xenos::PM4_XE_SWAP, 63);
+  PacketRecorder recorder(writer, memory);
+  writer->WritePrimaryBufferStart(0x1000, 0);
+  for (int i = 0; i < packet_count; ++i) {
+    if (i % 50 == 0) {
+      uint32_t read_ptr = kReadBase + ((frame * 3 + i) % 64) * 0x800;
+      // Repeats every few frames, so some reads are written as Refs.
+      std::memset(memory->data() + read_ptr, (frame % 3) * 50 + i % 200,
+                  kReadLength);
+      writer->WriteMemoryRead(read_ptr, kReadLength);
+    }
+    uint32_t header = i % 10 == 9 ? draw_header : (6 << 16) | (0x2000 + i);
+    WritePacket(&recorder, header, 8);
+  }
+  writer->WritePrimaryBufferEnd();
+  writer->WriteEvent(EventType::kSwap);
+  WritePacket(&recorder, swap_header, 64);
+}
+
+void RecordTrace(bool compress, int frame_count, int packet_count) {
+  std::vector<uint8_t> memory(kMemorySize);
+  TraceWriter writer(memory.data());
+  REQUIRE(writer.Open(kTracePath, compress));
+  for (int frame = 0; frame < frame_count; ++frame) {
+    RecordFrame(&writer, &memory, frame, packet_count);
+    writer.Flush();
+  }
+  writer.Close();
+}
+
+// Memory as playing every frame before frame n would leave it.
+std::vector<uint8_t> ReplayMemoryReads(const TraceReader& reader, int n) {
+  std::vector<uint8_t> memory(kMemorySize);
+  uint64_t end_offset = reader.frame_stats(n).start_offset;
+  uint64_t offset = 0;
+  while (offset < end_offset) {
+    TraceCommandInfo info;
+    REQUIRE(DecodeTraceCommand(reader.trace_data() + offset,
+                               reader.trace_size() - offset, offset, &info));
+    if (info.type == TraceCommandType::kMemoryRead ||
+        info.type == TraceCommandType::kMemoryReadRef) {
+      std::memcpy(memory.data() + (info.base_ptr & 0x1FFFFFFF),
+                  reader.trace_data() + info.payload_offset, info.length);
+    }
+    offset = info.end_offset;
+  }
+  return memory;
+}
+
+// Everything DecodeTracePacket reports, in order.
+class PacketLog : public TracePacketHandler {
+ public:
+  typedef std::tuple<char, uint32_t, uint32_t> Event;
+
+  void OnRegisterWrite(uint32_t index, uint32_t value) override {
+    events.emplace_back('w', index, value);
+  }
+  void OnShaderLoad(ShaderType type, uint32_t guest_address,
+                    uint32_t dword_count) override {
+    events.emplace_back('l', guest_address | uint32_t(type), dword_count);
+  }
+  void OnShaderLoadImmediate(ShaderType type, const uint8_t* ucode,
+                             uint32_t dword_count) override {
+    events.emplace_back('i', uint32_t(type),
+                        xe::load_and_swap<uint32_t>(ucode));
+  }
+  void OnDraw() override { events.emplace_back('d', 0, 0); }
+
+  std::vector<Event> events;
+};
+
+}  // namespace
+
+TEST_CASE("TRACE_READER_INDEX_MATCHES_SCAN", "[tracing]") {
+  for (bool compress : {false, true}) {
+    RecordTrace(compress, 12, 300);
+
+    TraceReader indexed;
+    REQUIRE(indexed.Open(kTracePath));
+    REQUIRE(indexed.has_file_index());
+    TraceReader scanned;
+    REQUIRE(scanned.Open(kTracePath, true));
+    REQUIRE_FALSE(scanned.has_file_index());
+
+    REQUIRE(indexed.frame_count() == 12);
+    REQUIRE(scanned.frame_count() == 12);
+    for (int i = 0; i < indexed.frame_count(); ++i) {
+      auto& stats = indexed.frame_stats(i);
+      REQUIRE(std::memcmp(&stats, &scanned.frame_stats(i), sizeof(stats)) ==
+              0);
+      REQUIRE(stats.packet_count == 301);
+      REQUIRE(stats.draw_count == 30);
+      REQUIRE(stats.memory_read_count == 6);
+
+      auto frame = indexed.frame(i);
+      REQUIRE(frame->commands.size() == 30);
+      for (auto& command : frame->commands) {
+        REQUIRE(frame->start_ptr <= command.start_ptr);
+        REQUIRE(command.end_ptr <= frame->end_ptr);
+        auto packet = GetTracePacketData(command.head_ptr);
+        REQUIRE(((xe::load_and_swap<uint32_t>(packet) >> 8) & 0x7F) ==
+                xenos::PM4_DRAW_INDX);
+      }
+      // The swap packet closes each frame.
+      REQUIRE(frame->end_ptr == (i + 1 < indexed.frame_count()
+                                     ? indexed.frame(i + 1)->start_ptr
+                                     : indexed.trace_data() +
+                                           indexed.trace_size()));
+
+      uint32_t packet_count = 0;
+      indexed.ForEachPacket(i, [&](const TraceCommandInfo& info) {
+        REQUIRE(info.length == (packet_count == 300 ? 64 * 4 : 8 * 4));
+        ++packet_count;
+      });
+      REQUIRE(packet_count == stats.packet_count);
+    }
+  }
+}
+
+TEST_CASE("TRACE_READER_RESTORES_MEMORY", "[tracing]") {
+  RecordTrace(false, 12, 300);
+  TraceReader reader;
+  REQUIRE(reader.Open(kTracePath));
+  std::vector<uint8_t> memory(kMemorySize);
+  for (int n : {0, 1, 5, 11}) {
+    std::memset(memory.data(), 0, memory.size());
+    size_t copied = reader.RestoreMemory(n, memory.data());
+    INFO("frame " << n);
+    REQUIRE(memory == ReplayMemoryReads(reader, n));
+    // Overlapping reads are only copied once.
+    REQUIRE(copied <= 64 * 0x800 + kReadLength);
+  }
+}
+
+TEST_CASE("TRACE_READER_DECODES_PACKETS", "[tracing]") {
+  {
+    std::vector<uint8_t> memory(kMemorySize);
+    TraceWriter writer(memory.data());
+    REQUIRE(writer.Open(kTracePath, false));
+    PacketRecorder recorder(&writer, &memory);
+    writer.WritePrimaryBufferStart(PacketRecorder::kPacketBase, 0);
+    recorder.Type0(0x2000, {1, 2});
+    recorder.SetConstant(4, 0x10, {3});
+    recorder.SetConstant(0, 0x20, {4});
+    recorder.LoadShader(ShaderType::kPixel, 0x10000, {5, 6});
+    recorder.LoadShaderImmediate(ShaderType::kVertex, {7});
+    recorder.Draw();
+    // A header claiming more registers than the packet that was recorded.
+    recorder.Write({(7u << 16) | 0x2100, 8});
+    writer.WritePrimaryBufferEnd();
+    writer.WriteEvent(EventType::kSwap);
+    recorder.Swap();
+    writer.Close();
+  }
+
+  TraceReader reader;
+  REQUIRE(reader.Open(kTracePath));
+  REQUIRE(reader.frame_count() == 1);
+  PacketLog log;
+  reader.ForEachPacket(0, [&](const TraceCommandInfo& info) {
+    DecodeTracePacket(reader.trace_data() + info.payload_offset,
+                      info.length / 4, &log);
+  });
+  std::vector<PacketLog::Event> expected = {
+      PacketLog::Event('w', 0x2000, 1),
+      PacketLog::Event('w', 0x2001, 2),
+      PacketLog::Event('w', 0x2010, 3),
+      PacketLog::Event('w', 0x4020, 4),
+      PacketLog::Event('l', 0x10000 | uint32_t(ShaderType::kPixel), 2),
+      PacketLog::Event('i', uint32_t(ShaderType::kVertex), 7),
+      PacketLog::Event('d', 0, 0),
+      PacketLog::Event('w', 0x2100, 8),
+  };
+  REQUIRE(log.events == expected);
+}
+
+TEST_CASE("TRACE_READER_BENCHMARK", "[.][benchmark]") {
+  // A streamed trace of 600 frames, then opening it and seeking to its last
+  // frame. Without an index, opening scans the whole trace and seeking plays
+  // back every memory read before the frame.
+  const int frame_count = 600;
+  RecordTrace(false, frame_count, 5000);
+  for (bool rebuild_index : {true, false}) {
+    TraceReader reader;
+    auto start = std::chrono::high_resolution_clock::now();
+    REQUIRE(reader.Open(kTracePath, rebuild_index));
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::high_resolution_clock::now() - start)
+                         .count();
+    std::printf("open %.1f MB, %d frames from %s: %.2f ms\n",
+                reader.trace_size() / (1024.0 * 1024.0), reader.frame_count(),
+                rebuild_index ? "a scan" : "the index", seconds * 1000.0);
+  }
+
+  TraceReader reader;
+  REQUIRE(reader.Open(kTracePath));
+  int n = frame_count - 1;
+  std::vector<uint8_t> memory(kMemorySize);
+  auto start = std::chrono::high_resolution_clock::now();
+  ReplayMemoryReads(reader, n);
+  double replay_seconds =
+      std::chrono::duration<double>(
+          std::chrono::high_resolution_clock::now() - start)
+          .count();
+  start = std::chrono::high_resolution_clock::now();
+  size_t copied = reader.RestoreMemory(n, memory.data());
+  double restore_seconds =
+      std::chrono::duration<double>(
+          std::chrono::high_resolution_clock::now() - start)
+          .count();
+  std::printf(
+      "seek to frame %d: replaying reads %.2f ms, restoring from the index "
+      "%.2f ms (%zu bytes)\n",
+      n, replay_seconds * 1000.0, restore_seconds * 1000.0, copied);
+}
@@ -0,0 +1,127 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <gflags/gflags.h>
+
+#include <cstdio>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/main.h"
+#include "xenia/base/string.h"
+#include "xenia/gpu/trace_reader.h"
+
+DEFINE_string(target_trace_file, "", "Specifies the trace file to load.");
+DEFINE_bool(trace_stats_rebuild_index, false,
+            "Ignores the index stored in the trace and scans the trace.");
+DEFINE_int32(trace_stats_frame, -1,
+             "Lists the packets of this frame instead of all frames.");
+
+namespace xe {
+namespace gpu {
+
+// Counts what a single packet does, for the packet listing.
+class PacketCounter : public TracePacketHandler {
+ public:
+  void OnRegisterWrite(uint32_t index, uint32_t value) override {
+    ++register_write_count;
+  }
+  void OnDraw() override { ++draw_count; }
+
+  uint32_t register_write_count = 0;
+  uint32_t draw_count = 0;
+};
+
+void PrintFramePackets(const TraceReader& reader, int frame_index) {
+  std::printf("%12s %8s %8s %8s %s\n", "offset", "base", "dwords", "writes",
+              "data");
+  reader.ForEachPacket(frame_index, [&](const TraceCommandInfo& info) {
+    PacketCounter counter;
+    DecodeTracePacket(reader.trace_data() + info.payload_offset,
+                      info.length / 4, &counter);
+    bool is_ref = info.type == TraceCommandType::kPacketStartRef;
+    std::printf("%12llu %.8X %8u %8u %s%s\n",
+                static_cast<unsigned long long>(info.offset), info.base_ptr,
+                info.length / 4, counter.register_write_count,
+                is_ref ? "ref" : "inline", counter.draw_count ? " draw" : "");
+  });
+}
+
+void PrintFrameStats(const TraceReader& reader) {
+  std::printf("%6s %9s %8s %6s %12s %12s %12s\n", "frame", "commands",
+              "packets", "draws", "bytes", "packet bytes", "read bytes");
+  uint64_t total_packets = 0;
+  uint64_t total_draws = 0;
+  uint64_t total_packet_bytes = 0;
+  uint64_t total_memory_read_bytes = 0;
+  for (int i = 0; i < reader.frame_count(); ++i) {
+    auto& stats = reader.frame_stats(i);
+    std::printf("%6d %9u %8u %6u %12llu %12llu %12llu\n", i,
+                stats.command_count, stats.packet_count, stats.draw_count,
+                static_cast<unsigned long long>(stats.end_offset -
+                                                stats.start_offset),
+                static_cast<unsigned long long>(stats.packet_bytes),
+                static_cast<unsigned long long>(stats.memory_read_bytes));
+    total_packets += stats.packet_count;
+    total_draws += stats.draw_count;
+    total_packet_bytes += stats.packet_bytes;
+    total_memory_read_bytes += stats.memory_read_bytes;
+  }
+  std::printf("%6s %9s %8llu %6llu %12llu %12llu %12llu\n", "total", "",
+              static_cast<unsigned long long>(total_packets),
+              static_cast<unsigned long long>(total_draws),
+              static_cast<unsigned long long>(reader.trace_size()),
+              static_cast<unsigned long long>(total_packet_bytes),
+              static_cast<unsigned long long>(total_memory_read_bytes));
+}
+
+int trace_stats_main(std::vector<std::wstring>& args) {
+  // Grab path from the flag or unnamed argument.
+  if (FLAGS_target_trace_file.empty() && args.size() < 2) {
+    XELOGE("No trace file specified");
+    return 1;
+  }
+  std::wstring path;
+  if (!FLAGS_target_trace_file.empty()) {
+    path = xe::to_wstring(FLAGS_target_trace_file);
+  } else {
+    path = args[1];
+  }
+  auto abs_path = xe::to_absolute_path(path);
+
+  TraceReader reader;
+  uint64_t start_ticks = Clock::QueryHostTickCount();
+  if (!reader.Open(abs_path, FLAGS_trace_stats_rebuild_index)) {
+    XELOGE("Could not load trace file");
+    return 1;
+  }
+  double open_millis = (Clock::QueryHostTickCount() - start_ticks) * 1000.0 /
+                       Clock::host_tick_frequency();
+  std::printf("%ls: %d frames, opened in %.1fms from %s\n", path.c_str(),
+              reader.frame_count(), open_millis,
+              reader.has_file_index() ? "its index" : "a scan");
+
+  if (FLAGS_trace_stats_frame >= 0) {
+    if (FLAGS_trace_stats_frame >= reader.frame_count()) {
+      XELOGE("Frame %d is past the end of the trace", FLAGS_trace_stats_frame);
+      return 1;
+    }
+    PrintFramePackets(reader, FLAGS_trace_stats_frame);
+  } else {
+    PrintFrameStats(reader);
+  }
+  return 0;
+}
+
+}  // namespace gpu
+}  // namespace xe
+
+DEFINE_ENTRY_POINT(L"xenia-gpu-trace-stats",
+                   L"xenia-gpu-trace-stats some.trace",
+                   xe::gpu::trace_stats_main);
@@ -0,0 +1,106 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_TRACE_TEST_UTIL_H_
+#define XENIA_GPU_TRACE_TEST_UTIL_H_
+
+#include <functional>
+#include <vector>
+
+#include "xenia/base/memory.h"
+#include "xenia/gpu/tracing.h"
+#include "xenia/gpu/xenos.h"
+
+namespace xe {
+namespace gpu {
+namespace testing {
+
+// Writes packets into guest memory and records them, as the command processor
+// does when streaming a trace. Packets are placed one after another from
+// kPacketBase.
+class PacketRecorder {
+ public:
+  static const uint32_t kPacketBase = 0x100000;
+
+  PacketRecorder(TraceWriter* writer, std::vector<uint8_t>* memory)
+      : writer_(writer), memory_(memory), ptr_(kPacketBase) {}
+
+  static uint32_t Type3Header(uint32_t opcode, uint32_t count) {
+    return (3u << 30) | ((count - 1) << 16) | (opcode << 8);
+  }
+
+  // Starts placing packets at kPacketBase again.
+  void Reset() { ptr_ = kPacketBase; }
+
+  // Records a packet of dwords, header included. record_reads, if given, is
+  // called inside the packet to record the memory it reads.
+  void Write(const std::vector<uint32_t>& dwords,
+             std::function<void()> record_reads = nullptr) {
+    uint32_t start = ptr_;
+    for (uint32_t value : dwords) {
+      xe::store_and_swap<uint32_t>(memory_->data() + ptr_, value);
+      ptr_ += 4;
+    }
+    writer_->WritePacketStart(start, uint32_t(dwords.size()));
+    if (record_reads) {
+      record_reads();
+    }
+    writer_->WritePacketEnd();
+  }
+
+  void Type0(uint32_t base_index, const std::vector<uint32_t>& values) {
+    std::vector<uint32_t> dwords = {uint32_t(values.size() - 1) << 16 |
+                                    base_index};
+    dwords.insert(dwords.end(), values.begin(), values.end());
+    Write(dwords);
+  }
+  // SET_CONSTANT of type 0 (ALU), 1 (fetch) or 4 (registers).
+  void SetConstant(uint32_t type, uint32_t index,
+                   const std::vector<uint32_t>& values) {
+    std::vector<uint32_t> dwords = {
+        Type3Header(xenos::PM4_SET_CONSTANT, uint32_t(values.size()) + 1),
+        (type << 16) | index};
+    dwords.insert(dwords.end(), values.begin(), values.end());
+    Write(dwords);
+  }
+  // IM_LOAD_IMMEDIATE of host order ucode.
+  void LoadShaderImmediate(ShaderType type,
+                           const std::vector<uint32_t>& ucode) {
+    std::vector<uint32_t> dwords = {
+        Type3Header(xenos::PM4_IM_LOAD_IMMEDIATE, 2 + uint32_t(ucode.size())),
+        uint32_t(type), uint32_t(ucode.size())};
+    dwords.insert(dwords.end(), ucode.begin(), ucode.end());
+    Write(dwords);
+  }
+  // IM_LOAD of host order ucode, placed at guest_address.
+  void LoadShader(ShaderType type, uint32_t guest_address,
+                  const std::vector<uint32_t>& ucode) {
+    for (size_t i = 0; i < ucode.size(); ++i) {
+      xe::store_and_swap<uint32_t>(memory_->data() + guest_address + i * 4,
+                                   ucode[i]);
+    }
+    uint32_t length = uint32_t(ucode.size()) * 4;
+    Write({Type3Header(xenos::PM4_IM_LOAD, 2), guest_address | uint32_t(type),
+           uint32_t(ucode.size())},
+          [&]() { writer_->WriteMemoryRead(guest_address, length); });
+  }
+  void Draw() { Write({Type3Header(xenos::PM4_DRAW_INDX, 3), 0, 0, 0}); }
+  void Swap() { Write({Type3Header(xenos::PM4_XE_SWAP, 1), 0}); }
+
+ private:
+  TraceWriter* writer_;
+  std::vector<uint8_t>* memory_;
+  uint32_t ptr_;
+};
+
+}  // namespace testing
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_TRACE_TEST_UTIL_H_
@@ -9,18 +9,467 @@
 
 #include "xenia/gpu/tracing.h"
 
+#include <cstring>
+
+#include "third_party/xxhash/xxhash.h"
+#include "xenia/base/assert.h"
 #include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
 #include "xenia/base/string.h"
+#include "xenia/gpu/xenos.h"
 
 namespace xe {
 namespace gpu {
 
+namespace {
+
+// Payloads shorter than this are cheaper to repeat than to reference.
+const size_t kMinDedupLength = 64;
+// Bound the payload copies kept for dedup. The least recently referenced
+// ones are dropped first.
+const size_t kMaxTrackedPayloads = 64 * 1024;
+const size_t kMaxTrackedPayloadBytes = 8 * 1024 * 1024;
+// How many chunks may wait for the writer thread before recording blocks.
+const size_t kMaxPendingChunks = 32;
+
+// A small LZ77 codec in the style of LZ4 blocks. Each sequence is a token
+// byte (literal count in the high nibble, match length - 4 in the low
+// nibble, 15 meaning more length bytes follow), the literals, then a 16-bit
+// little-endian match offset and any extra match length bytes. The final
+// sequence has literals only.
+const size_t kMinMatch = 4;
+const size_t kMaxOffset = 0xFFFF;
+const int kHashBits = 16;
+
+void WriteLength(size_t length, std::vector<uint8_t>* out) {
+  while (length >= 255) {
+    out->push_back(255);
+    length -= 255;
+  }
+  out->push_back(uint8_t(length));
+}
+
+void CompressChunk(const uint8_t* src, size_t size, std::vector<uint8_t>* out) {
+  out->clear();
+  out->reserve(size + size / 255 + 16);
+  std::vector<uint32_t> table(size_t(1) << kHashBits, UINT32_MAX);
+  size_t anchor = 0;
+  size_t i = 0;
+  while (i + kMinMatch <= size) {
+    uint32_t sequence;
+    std::memcpy(&sequence, src + i, 4);
+    uint32_t hash = (sequence * 2654435761u) >> (32 - kHashBits);
+    size_t candidate = table[hash];
+    table[hash] = uint32_t(i);
+    if (candidate == UINT32_MAX || i - candidate > kMaxOffset ||
+        std::memcmp(src + candidate, src + i, 4) != 0) {
+      ++i;
+      continue;
+    }
+    size_t match_length = kMinMatch;
+    while (i + match_length < size &&
+           src[candidate + match_length] == src[i + match_length]) {
+      ++match_length;
+    }
+
+    size_t literal_length = i - anchor;
+    size_t extra_match = match_length - kMinMatch;
+    out->push_back(uint8_t((literal_length < 15 ? literal_length : 15) << 4 |
+                           (extra_match < 15 ? extra_match : 15)));
+    if (literal_length >= 15) {
+      WriteLength(literal_length - 15, out);
+    }
+    out->insert(out->end(), src + anchor, src + i);
+    size_t offset = i - candidate;
+    out->push_back(uint8_t(offset));
+    out->push_back(uint8_t(offset >> 8));
+    if (extra_match >= 15) {
+      WriteLength(extra_match - 15, out);
+    }
+    i += match_length;
+    anchor = i;
+  }
+
+  size_t literal_length = size - anchor;
+  out->push_back(uint8_t((literal_length < 15 ? literal_length : 15) << 4));
+  if (literal_length >= 15) {
+    WriteLength(literal_length - 15, out);
+  }
+  out->insert(out->end(), src + anchor, src + size);
+}
+
+bool ReadLength(const uint8_t** src, const uint8_t* src_end, size_t* length) {
+  uint8_t value;
+  do {
+    if (*src == src_end) {
+      return false;
+    }
+    value = *(*src)++;
+    *length += value;
+  } while (value == 255);
+  return true;
+}
+
+bool DecompressChunk(const uint8_t* src, size_t size, uint8_t* dest,
+                     size_t dest_size) {
+  const uint8_t* src_end = src + size;
+  size_t written = 0;
+  while (src < src_end) {
+    uint8_t token = *src++;
+    size_t literal_length = token >> 4;
+    if (literal_length == 15 && !ReadLength(&src, src_end, &literal_length)) {
+      return false;
+    }
+    if (literal_length > size_t(src_end - src) ||
+        literal_length > dest_size - written) {
+      return false;
+    }
+    std::memcpy(dest + written, src, literal_length);
+    src += literal_length;
+    written += literal_length;
+    if (src == src_end) {
+      // The final sequence has no match.
+      break;
+    }
+
+    if (src_end - src < 2) {
+      return false;
+    }
+    size_t offset = src[0] | (src[1] << 8);
+    src += 2;
+    size_t match_length = token & 0xF;
+    if (match_length == 15 && !ReadLength(&src, src_end, &match_length)) {
+      return false;
+    }
+    match_length += kMinMatch;
+    if (!offset || offset > written || match_length > dest_size - written) {
+      return false;
+    }
+    // Matches may overlap the bytes they produce, so copy forwards.
+    const uint8_t* match = dest + written - offset;
+    for (size_t n = 0; n < match_length; ++n) {
+      dest[written + n] = match[n];
+    }
+    written += match_length;
+  }
+  return written == dest_size;
+}
+
+}  // namespace
+
+bool DecodeTraceCommand(const uint8_t* command_ptr, size_t available,
+                        uint64_t offset, TraceCommandInfo* out_info) {
+  std::memset(out_info, 0, sizeof(*out_info));
+  if (available < sizeof(TraceCommandType)) {
+    return false;
+  }
+  auto type = static_cast<TraceCommandType>(xe::load<uint32_t>(command_ptr));
+  out_info->type = type;
+  out_info->offset = offset;
+  size_t size = 0;
+  switch (type) {
+    case TraceCommandType::kPrimaryBufferStart:
+    case TraceCommandType::kIndirectBufferStart: {
+      auto cmd =
+          reinterpret_cast<const PrimaryBufferStartCommand*>(command_ptr);
+      if (available < sizeof(*cmd)) {
+        return false;
+      }
+      size = sizeof(*cmd) + cmd->count * 4;
+      break;
+    }
+    case TraceCommandType::kPrimaryBufferEnd:
+    case TraceCommandType::kIndirectBufferEnd:
+    case TraceCommandType::kPacketEnd:
+      size = sizeof(PacketEndCommand);
+      break;
+    case TraceCommandType::kPacketStart:
+    case TraceCommandType::kMemoryRead:
+    case TraceCommandType::kMemoryWrite: {
+      // All inline payload command structs share this layout.
+      auto cmd = reinterpret_cast<const PacketStartCommand*>(command_ptr);
+      if (available < sizeof(*cmd)) {
+        return false;
+      }
+      out_info->base_ptr = cmd->base_ptr;
+      out_info->length =
+          type == TraceCommandType::kPacketStart ? cmd->count * 4 : cmd->count;
+      out_info->payload_offset = offset + sizeof(*cmd);
+      size = sizeof(*cmd) + out_info->length;
+      break;
+    }
+    case TraceCommandType::kPacketStartRef:
+    case TraceCommandType::kMemoryReadRef:
+    case TraceCommandType::kMemoryWriteRef: {
+      // All Ref command structs share this layout.
+      auto cmd = reinterpret_cast<const PacketStartRefCommand*>(command_ptr);
+      if (available < sizeof(*cmd) || cmd->payload_distance > offset) {
+        return false;
+      }
+      out_info->base_ptr = cmd->base_ptr;
+      out_info->length = type == TraceCommandType::kPacketStartRef
+                             ? cmd->count * 4
+                             : cmd->count;
+      out_info->payload_offset = offset - cmd->payload_distance;
+      size = sizeof(*cmd);
+      break;
+    }
+    case TraceCommandType::kEvent: {
+      auto cmd = reinterpret_cast<const EventCommand*>(command_ptr);
+      if (available < sizeof(*cmd)) {
+        return false;
+      }
+      out_info->event_type = cmd->event_type;
+      size = sizeof(*cmd);
+      break;
+    }
+    default:
+      return false;
+  }
+  if (size > available) {
+    return false;
+  }
+  out_info->end_offset = offset + size;
+  return true;
+}
+
+void TraceIndexBuilder::Reset() {
+  frames_.clear();
+  draws_.clear();
+  memory_reads_.clear();
+  std::memset(&current_frame_, 0, sizeof(current_frame_));
+  last_draw_end_offset_ = 0;
+  has_pending_packet_ = false;
+  pending_packet_is_draw_ = false;
+  pending_packet_offset_ = 0;
+  pending_break_ = false;
+}
+
+void TraceIndexBuilder::AddCommand(const TraceCommandInfo& info,
+                                   const uint8_t* payload) {
+  ++current_frame_.command_count;
+  switch (info.type) {
+    case TraceCommandType::kPacketStart:
+    case TraceCommandType::kPacketStartRef: {
+      ++current_frame_.packet_count;
+      current_frame_.packet_bytes += info.length;
+      has_pending_packet_ = true;
+      pending_packet_offset_ = info.offset;
+      pending_packet_is_draw_ = false;
+      if (info.length >= 4) {
+        uint32_t packet = xe::load_and_swap<uint32_t>(payload);
+        uint32_t opcode = (packet >> 8) & 0x7F;
+        pending_packet_is_draw_ = (packet >> 30) == 0x03 &&
+                                  (opcode == xenos::PM4_DRAW_INDX ||
+                                   opcode == xenos::PM4_DRAW_INDX_2);
+      }
+      break;
+    }
+    case TraceCommandType::kPacketEnd: {
+      if (!has_pending_packet_) {
+        break;
+      }
+      has_pending_packet_ = false;
+      if (pending_packet_is_draw_) {
+        draws_.push_back(
+            {pending_packet_offset_, last_draw_end_offset_, info.end_offset});
+        ++current_frame_.draw_count;
+        last_draw_end_offset_ = info.end_offset;
+      }
+      if (pending_break_) {
+        current_frame_.end_offset = info.end_offset;
+        frames_.push_back(current_frame_);
+        std::memset(&current_frame_, 0, sizeof(current_frame_));
+        current_frame_.start_offset = info.end_offset;
+        current_frame_.first_draw = uint32_t(draws_.size());
+        current_frame_.first_memory_read = uint32_t(memory_reads_.size());
+        last_draw_end_offset_ = info.end_offset;
+        pending_break_ = false;
+      }
+      break;
+    }
+    case TraceCommandType::kMemoryRead:
+    case TraceCommandType::kMemoryReadRef: {
+      memory_reads_.push_back(
+          {info.payload_offset, info.base_ptr, info.length});
+      ++current_frame_.memory_read_count;
+      current_frame_.memory_read_bytes += info.length;
+      break;
+    }
+    case TraceCommandType::kEvent: {
+      if (info.event_type == EventType::kSwap) {
+        pending_break_ = true;
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void TraceIndexBuilder::Finish(uint64_t end_offset) {
+  if (pending_break_ || current_frame_.command_count) {
+    current_frame_.end_offset = end_offset;
+    frames_.push_back(current_frame_);
+    std::memset(&current_frame_, 0, sizeof(current_frame_));
+    current_frame_.start_offset = end_offset;
+    current_frame_.first_draw = uint32_t(draws_.size());
+    current_frame_.first_memory_read = uint32_t(memory_reads_.size());
+    pending_break_ = false;
+  }
+}
+
+void TraceIndexBuilder::Serialize(uint64_t index_offset, uint64_t stream_size,
+                                  std::vector<uint8_t>* out) const {
+  auto append = [out](const void* data, size_t length) {
+    auto bytes = reinterpret_cast<const uint8_t*>(data);
+    out->insert(out->end(), bytes, bytes + length);
+  };
+  append(frames_.data(), frames_.size() * sizeof(TraceFrameIndexEntry));
+  append(draws_.data(), draws_.size() * sizeof(TraceDrawIndexEntry));
+  append(memory_reads_.data(),
+         memory_reads_.size() * sizeof(TraceMemoryReadIndexEntry));
+  TraceIndexFooter footer = {
+      kTraceIndexMagic,          uint32_t(frames_.size()),
+      uint32_t(draws_.size()),   uint32_t(memory_reads_.size()),
+      index_offset,              stream_size,
+  };
+  append(&footer, sizeof(footer));
+}
+
+bool TraceFile::Open(const std::wstring& path) {
+  Close();
+
+  mmap_ = MappedMemory::Open(path, MappedMemory::Mode::kRead);
+  if (!mmap_) {
+    return false;
+  }
+  auto file_data = reinterpret_cast<const uint8_t*>(mmap_->data());
+  size_t file_size = mmap_->size();
+
+  TraceFileHeader header = {0};
+  if (file_size >= sizeof(header)) {
+    std::memcpy(&header, file_data, sizeof(header));
+  }
+  if (header.magic != kTraceFileMagic) {
+    // Written before traces had a header.
+    data_ = file_data;
+    size_ = file_size;
+    return true;
+  }
+  if (header.version > kTraceFileVersion) {
+    XELOGE("Trace version %u is newer than supported (%u)", header.version,
+           kTraceFileVersion);
+    Close();
+    return false;
+  }
+  version_ = header.version;
+
+  if (header.flags & kTraceFileIndexed) {
+    // Only trust a footer whose tables exactly fill the end of the file.
+    auto& footer = index_footer_storage_;
+    std::memset(&footer, 0, sizeof(footer));
+    if (file_size >= sizeof(header) + sizeof(footer)) {
+      std::memcpy(&footer, file_data + file_size - sizeof(footer),
+                  sizeof(footer));
+    }
+    if (footer.magic == kTraceIndexMagic &&
+        footer.index_offset >= sizeof(header) &&
+        footer.index_offset +
+                footer.frame_count * sizeof(TraceFrameIndexEntry) +
+                footer.draw_count * sizeof(TraceDrawIndexEntry) +
+                footer.memory_read_count * sizeof(TraceMemoryReadIndexEntry) +
+                sizeof(footer) ==
+            file_size) {
+      index_footer_ = &footer;
+      index_data_ = file_data + footer.index_offset;
+      file_size = size_t(footer.index_offset);
+    } else {
+      XELOGW("Trace index is damaged; ignoring it");
+      index_footer_ = nullptr;
+    }
+  }
+  file_data += sizeof(header);
+  file_size -= sizeof(header);
+
+  if (!(header.flags & kTraceFileCompressed)) {
+    data_ = file_data;
+    size_ = file_size;
+    if (index_footer_ && index_footer_->stream_size != size_) {
+      XELOGW("Trace index doesn't match the trace; ignoring it");
+      index_footer_ = nullptr;
+      index_data_ = nullptr;
+    }
+    return true;
+  }
+
+  // Inflate all chunks; Ref commands may point anywhere earlier in the stream.
+  auto ptr = file_data;
+  auto end = file_data + file_size;
+  while (ptr < end) {
+    TraceChunkHeader chunk;
+    if (size_t(end - ptr) < sizeof(chunk)) {
+      break;
+    }
+    std::memcpy(&chunk, ptr, sizeof(chunk));
+    ptr += sizeof(chunk);
+    if (chunk.compressed_size > size_t(end - ptr)) {
+      break;
+    }
+    size_t offset = inflated_data_.size();
+    inflated_data_.resize(offset + chunk.uncompressed_size);
+    if (chunk.compressed_size == chunk.uncompressed_size) {
+      std::memcpy(inflated_data_.data() + offset, ptr, chunk.compressed_size);
+    } else if (!DecompressChunk(ptr, chunk.compressed_size,
+                                inflated_data_.data() + offset,
+                                chunk.uncompressed_size)) {
+      inflated_data_.resize(offset);
+      break;
+    }
+    ptr += chunk.compressed_size;
+  }
+  if (ptr != end) {
+    // A trace cut short still plays up to the damage.
+    XELOGW("Trace is truncated or corrupt; using the first %zu bytes",
+           inflated_data_.size());
+  }
+  data_ = inflated_data_.data();
+  size_ = inflated_data_.size();
+  if (!index_footer_) {
+    mmap_.reset();
+  } else if (index_footer_->stream_size != size_) {
+    XELOGW("Trace index doesn't match the trace; ignoring it");
+    index_footer_ = nullptr;
+    index_data_ = nullptr;
+    mmap_.reset();
+  }
+  return true;
+}
+
+void TraceFile::Close() {
+  mmap_.reset();
+  inflated_data_.clear();
+  inflated_data_.shrink_to_fit();
+  version_ = 0;
+  data_ = nullptr;
+  size_ = 0;
+  index_footer_ = nullptr;
+  index_data_ = nullptr;
+}
+
 TraceWriter::TraceWriter(uint8_t* membase)
-    : membase_(membase), file_(nullptr) {}
+    : membase_(membase),
+      file_(nullptr),
+      compress_(false),
+      buffer_offset_(0),
+      payload_bytes_(0),
+      file_size_(0),
+      writer_running_(false) {}
 
-TraceWriter::~TraceWriter() = default;
+TraceWriter::~TraceWriter() { Close(); }
 
-bool TraceWriter::Open(const std::wstring& path) {
+bool TraceWriter::Open(const std::wstring& path, bool compress) {
   Close();
 
   auto canonical_path = xe::to_absolute_path(path);
@@ -28,21 +477,192 @@ bool TraceWriter::Open(const std::wstring& path) {
   xe::filesystem::CreateFolder(base_path);
 
   file_ = xe::filesystem::OpenFile(canonical_path, "wb");
-  return file_ != nullptr;
+  if (!file_) {
+    return false;
+  }
+
+  compress_ = compress;
+  TraceFileHeader header = {
+      kTraceFileMagic, kTraceFileVersion,
+      compress ? uint32_t(kTraceFileCompressed) : 0, 0,
+  };
+  fwrite(&header, 1, sizeof(header), file_);
+
+  buffer_.reserve(kChunkSize + 64 * 1024);
+  buffer_offset_ = 0;
+  file_size_ = sizeof(header);
+  index_builder_.Reset();
+  writer_running_ = true;
+  writer_thread_ = std::thread([this]() { WriterThread(); });
+  return true;
 }
 
 void TraceWriter::Flush() {
-  if (file_) {
-    fflush(file_);
+  if (file_ && !buffer_.empty()) {
+    SubmitBuffer();
   }
 }
 
 void TraceWriter::Close() {
-  if (file_) {
-    fflush(file_);
-    fclose(file_);
-    file_ = nullptr;
+  if (!file_) {
+    return;
+  }
+  Flush();
+  {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    writer_running_ = false;
+    writer_cond_.notify_all();
+  }
+  writer_thread_.join();
+
+  // The index goes after the stream, and the header is rewritten to say it's
+  // there.
+  index_builder_.Finish(buffer_offset_);
+  std::vector<uint8_t> index;
+  index_builder_.Serialize(file_size_, buffer_offset_, &index);
+  fwrite(index.data(), 1, index.size(), file_);
+  TraceFileHeader header = {
+      kTraceFileMagic, kTraceFileVersion,
+      (compress_ ? uint32_t(kTraceFileCompressed) : 0) | kTraceFileIndexed, 0,
+  };
+  fseek(file_, 0, SEEK_SET);
+  fwrite(&header, 1, sizeof(header), file_);
+
+  fflush(file_);
+  fclose(file_);
+  file_ = nullptr;
+  payloads_.clear();
+  payload_lru_.clear();
+  payload_bytes_ = 0;
+  free_chunks_.clear();
+  index_builder_.Reset();
+}
+
+void TraceWriter::WritePayloadCommand(TraceCommandType type,
+                                      TraceCommandType ref_type,
+                                      uint32_t base_ptr, uint32_t count,
+                                      size_t length) {
+  const uint8_t* payload = membase_ + base_ptr;
+  uint64_t command_offset = buffer_offset_ + buffer_.size();
+  TraceCommandInfo info = {type, command_offset};
+  info.base_ptr = base_ptr;
+  info.length = uint32_t(length);
+  if (length >= kMinDedupLength) {
+    uint64_t hash = XXH64(payload, length, 0);
+    auto it = payloads_.find(hash);
+    if (it != payloads_.end() && it->second.data.size() == length &&
+        command_offset - it->second.offset <= UINT32_MAX &&
+        !std::memcmp(it->second.data.data(), payload, length)) {
+      // All Ref command structs share this layout.
+      auto cmd = PacketStartRefCommand({
+          ref_type, base_ptr, count,
+          uint32_t(command_offset - it->second.offset),
+      });
+      info.type = ref_type;
+      info.end_offset = command_offset + sizeof(cmd);
+      info.payload_offset = it->second.offset;
+      index_builder_.AddCommand(info, payload);
+      Append(&cmd, sizeof(cmd));
+      payload_lru_.splice(payload_lru_.end(), payload_lru_,
+                          it->second.lru_it);
+      return;
+    }
+    if (length <= kMaxTrackedPayloadBytes) {
+      // Copies too far back to reference, or colliding ones, are replaced by
+      // this one.
+      auto& location = payloads_[hash];
+      if (location.data.empty()) {
+        location.lru_it = payload_lru_.insert(payload_lru_.end(), hash);
+      } else {
+        payload_bytes_ -= location.data.size();
+        payload_lru_.splice(payload_lru_.end(), payload_lru_,
+                            location.lru_it);
+      }
+      payload_bytes_ += length;
+      location.offset = command_offset + sizeof(PacketStartCommand);
+      location.data.assign(payload, payload + length);
+      // This one is the most recent, and fits on its own.
+      while (payload_bytes_ > kMaxTrackedPayloadBytes ||
+             payloads_.size() > kMaxTrackedPayloads) {
+        auto evicted = payloads_.find(payload_lru_.front());
+        payload_bytes_ -= evicted->second.data.size();
+        payloads_.erase(evicted);
+        payload_lru_.pop_front();
+      }
+    }
+  }
+  // All inline payload command structs share this layout.
+  auto cmd = PacketStartCommand({type, base_ptr, count});
+  info.payload_offset = command_offset + sizeof(cmd);
+  info.end_offset = info.payload_offset + length;
+  index_builder_.AddCommand(info, payload);
+  buffer_.insert(buffer_.end(), reinterpret_cast<const uint8_t*>(&cmd),
+                 reinterpret_cast<const uint8_t*>(&cmd) + sizeof(cmd));
+  Append(payload, length);
+}
+
+void TraceWriter::SubmitBuffer() {
+  buffer_offset_ += buffer_.size();
+  std::vector<uint8_t> next_buffer;
+  {
+    std::unique_lock<std::mutex> lock(writer_mutex_);
+    // Apply backpressure rather than queueing without bound.
+    writer_cond_.wait(lock, [this]() {
+      return pending_chunks_.size() < kMaxPendingChunks;
+    });
+    pending_chunks_.push_back(std::move(buffer_));
+    if (!free_chunks_.empty()) {
+      next_buffer = std::move(free_chunks_.back());
+      free_chunks_.pop_back();
+    }
+    writer_cond_.notify_all();
+  }
+  buffer_ = std::move(next_buffer);
+  buffer_.clear();
+  buffer_.reserve(kChunkSize + 64 * 1024);
+}
+
+void TraceWriter::WriterThread() {
+  std::vector<uint8_t> compressed;
+  while (true) {
+    std::vector<uint8_t> chunk;
+    {
+      std::unique_lock<std::mutex> lock(writer_mutex_);
+      writer_cond_.wait(lock, [this]() {
+        return !pending_chunks_.empty() || !writer_running_;
+      });
+      if (pending_chunks_.empty()) {
+        break;
+      }
+      chunk = std::move(pending_chunks_.front());
+      pending_chunks_.pop_front();
+      // Wake a recorder waiting on backpressure.
+      writer_cond_.notify_all();
+    }
+
+    if (compress_) {
+      CompressChunk(chunk.data(), chunk.size(), &compressed);
+      TraceChunkHeader header;
+      header.uncompressed_size = uint32_t(chunk.size());
+      if (compressed.size() < chunk.size()) {
+        header.compressed_size = uint32_t(compressed.size());
+        fwrite(&header, 1, sizeof(header), file_);
+        fwrite(compressed.data(), 1, compressed.size(), file_);
+      } else {
+        header.compressed_size = header.uncompressed_size;
+        fwrite(&header, 1, sizeof(header), file_);
+        fwrite(chunk.data(), 1, chunk.size(), file_);
+      }
+      file_size_ += sizeof(header) + header.compressed_size;
+    } else {
+      fwrite(chunk.data(), 1, chunk.size(), file_);
+      file_size_ += chunk.size();
+    }
+
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    free_chunks_.push_back(std::move(chunk));
   }
+  fflush(file_);
 }
 
 }  //  namespace gpu
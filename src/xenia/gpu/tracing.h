@@ -10,13 +10,48 @@
 #ifndef XENIA_GPU_TRACING_H_
 #define XENIA_GPU_TRACING_H_
 
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
+#include "xenia/base/mapped_memory.h"
 #include "xenia/memory.h"
 
 namespace xe {
 namespace gpu {
 
+// Traces start with a TraceFileHeader since version 1. Older traces have no
+// header and start directly with a command. Version 2 traces may end with an
+// index of their frames.
+constexpr uint32_t kTraceFileMagic = 0x43525458;  // 'XTRC'
+constexpr uint32_t kTraceFileVersion = 2;
+
+enum TraceFileFlags : uint32_t {
+  // The command stream is split into TraceChunkHeader-prefixed chunks, each
+  // compressed on its own.
+  kTraceFileCompressed = 1 << 0,
+  // The file ends with a TraceIndexFooter.
+  kTraceFileIndexed = 1 << 1,
+};
+
+struct TraceFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t flags;  // TraceFileFlags
+  uint32_t reserved;
+};
+
+struct TraceChunkHeader {
+  // Equal to uncompressed_size if the chunk is stored as is.
+  uint32_t compressed_size;
+  uint32_t uncompressed_size;
+};
+
 enum class TraceCommandType : uint32_t {
   kPrimaryBufferStart,
   kPrimaryBufferEnd,
@@ -27,6 +62,11 @@ enum class TraceCommandType : uint32_t {
   kMemoryRead,
   kMemoryWrite,
   kEvent,
+  // Version 1: the payload is identical to that of an earlier command, found
+  // payload_distance bytes before the start of this command.
+  kPacketStartRef,
+  kMemoryReadRef,
+  kMemoryWriteRef,
 };
 
 struct PrimaryBufferStartCommand {
@@ -71,6 +111,37 @@ struct MemoryWriteCommand {
   uint32_t length;
 };
 
+struct PacketStartRefCommand {
+  TraceCommandType type;
+  uint32_t base_ptr;
+  uint32_t count;
+  uint32_t payload_distance;
+};
+
+struct MemoryReadRefCommand {
+  TraceCommandType type;
+  uint32_t base_ptr;
+  uint32_t length;
+  uint32_t payload_distance;
+};
+
+struct MemoryWriteRefCommand {
+  TraceCommandType type;
+  uint32_t base_ptr;
+  uint32_t length;
+  uint32_t payload_distance;
+};
+
+// Returns the packet dwords of a kPacketStart or kPacketStartRef command.
+inline const uint8_t* GetTracePacketData(const uint8_t* command_ptr) {
+  auto type = *reinterpret_cast<const TraceCommandType*>(command_ptr);
+  if (type == TraceCommandType::kPacketStartRef) {
+    auto cmd = reinterpret_cast<const PacketStartRefCommand*>(command_ptr);
+    return command_ptr - cmd->payload_distance;
+  }
+  return command_ptr + sizeof(PacketStartCommand);
+}
+
 enum class EventType {
   kSwap,
 };
@@ -80,6 +151,143 @@ struct EventCommand {
   EventType event_type;
 };
 
+// The header of a command, decoded without reading its payload. Offsets are
+// into the command stream, which excludes the file header and is always
+// uncompressed.
+struct TraceCommandInfo {
+  TraceCommandType type;
+  uint64_t offset;
+  uint64_t end_offset;
+  // Packet and memory commands only.
+  uint32_t base_ptr;
+  uint32_t length;  // In bytes.
+  // For Ref commands, the offset of the earlier copy.
+  uint64_t payload_offset;
+  // Event commands only.
+  EventType event_type;
+};
+
+// Decodes the command at command_ptr, found at offset in a stream with
+// available bytes left. Returns false if the command is unknown or runs past
+// the end of the stream.
+bool DecodeTraceCommand(const uint8_t* command_ptr, size_t available,
+                        uint64_t offset, TraceCommandInfo* out_info);
+
+constexpr uint32_t kTraceIndexMagic = 0x49525458;  // 'XTRI'
+
+struct TraceFrameIndexEntry {
+  uint64_t start_offset;
+  uint64_t end_offset;
+  uint32_t first_draw;
+  uint32_t draw_count;
+  uint32_t first_memory_read;
+  uint32_t memory_read_count;
+  uint32_t command_count;
+  uint32_t packet_count;
+  uint64_t packet_bytes;
+  uint64_t memory_read_bytes;
+};
+
+struct TraceDrawIndexEntry {
+  // The packet command containing the draw.
+  uint64_t head_offset;
+  // Commands from start_offset to end_offset are those since the previous
+  // draw in the frame, ending with this one.
+  uint64_t start_offset;
+  uint64_t end_offset;
+};
+
+struct TraceMemoryReadIndexEntry {
+  uint64_t payload_offset;
+  uint32_t base_ptr;
+  uint32_t length;
+};
+
+// The last bytes of an indexed trace. The frame, draw and memory read tables
+// follow each other from index_offset, which is a file offset.
+struct TraceIndexFooter {
+  uint32_t magic;
+  uint32_t frame_count;
+  uint32_t draw_count;
+  uint32_t memory_read_count;
+  uint64_t index_offset;
+  uint64_t stream_size;
+};
+
+// Builds the trace index from commands given in stream order. A frame ends
+// with the first packet after a swap event, as the viewer has always split
+// them.
+class TraceIndexBuilder {
+ public:
+  TraceIndexBuilder() { Reset(); }
+
+  const std::vector<TraceFrameIndexEntry>& frames() const { return frames_; }
+  const std::vector<TraceDrawIndexEntry>& draws() const { return draws_; }
+  const std::vector<TraceMemoryReadIndexEntry>& memory_reads() const {
+    return memory_reads_;
+  }
+
+  void Reset();
+  // payload is the packet data of packet commands, of which only the first
+  // dword is read. It may be null for other commands.
+  void AddCommand(const TraceCommandInfo& info, const uint8_t* payload);
+  // Ends the last frame at the end of the stream.
+  void Finish(uint64_t end_offset);
+
+  // Appends the tables and the footer for a trace whose index starts at
+  // index_offset in the file.
+  void Serialize(uint64_t index_offset, uint64_t stream_size,
+                 std::vector<uint8_t>* out) const;
+
+ private:
+  std::vector<TraceFrameIndexEntry> frames_;
+  std::vector<TraceDrawIndexEntry> draws_;
+  std::vector<TraceMemoryReadIndexEntry> memory_reads_;
+  TraceFrameIndexEntry current_frame_;
+  uint64_t last_draw_end_offset_;
+  bool has_pending_packet_;
+  bool pending_packet_is_draw_;
+  uint64_t pending_packet_offset_;
+  bool pending_break_;
+};
+
+// A trace opened for playback: the command stream with the file header and
+// index stripped and any compressed chunks inflated into memory. Uncompressed
+// traces, including those from before version 1, are mapped in place.
+class TraceFile {
+ public:
+  TraceFile() = default;
+  ~TraceFile() = default;
+
+  bool Open(const std::wstring& path);
+  void Close();
+
+  // Zero for traces without a TraceFileHeader.
+  uint32_t version() const { return version_; }
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // Null if the file has no index or it doesn't match the command stream.
+  const TraceIndexFooter* index_footer() const { return index_footer_; }
+  // The frame table, followed by the draw and memory read tables. Not
+  // necessarily aligned.
+  const uint8_t* index_data() const { return index_data_; }
+
+ private:
+  std::unique_ptr<MappedMemory> mmap_;
+  std::vector<uint8_t> inflated_data_;
+  uint32_t version_ = 0;
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  TraceIndexFooter index_footer_storage_;
+  const TraceIndexFooter* index_footer_ = nullptr;
+  const uint8_t* index_data_ = nullptr;
+};
+
+// Records commands into an in-memory buffer that a writer thread drains to
+// disk (compressing it first, if asked to). Payloads already present earlier
+// in the trace are written as references to the earlier copy. The frame index
+// is built while recording and written on Close.
 class TraceWriter {
  public:
   TraceWriter(uint8_t* membase);
@@ -87,8 +295,10 @@ class TraceWriter {
 
   bool is_open() const { return file_ != nullptr; }
 
-  bool Open(const std::wstring& path);
+  bool Open(const std::wstring& path, bool compress);
+  // Hands buffered commands to the writer thread without waiting for them.
   void Flush();
+  // Writes out everything buffered and the index, and closes the file.
   void Close();
 
   void WritePrimaryBufferStart(uint32_t base_ptr, uint32_t count) {
@@ -98,7 +308,7 @@ class TraceWriter {
     auto cmd = PrimaryBufferStartCommand({
         TraceCommandType::kPrimaryBufferStart, base_ptr, 0,
     });
-    fwrite(&cmd, 1, sizeof(cmd), file_);
+    AppendCommand(&cmd, sizeof(cmd));
   }
 
   void WritePrimaryBufferEnd() {
@@ -108,7 +318,7 @@ class TraceWriter {
     auto cmd = PrimaryBufferEndCommand({
         TraceCommandType::kPrimaryBufferEnd,
     });
-    fwrite(&cmd, 1, sizeof(cmd), file_);
+    AppendCommand(&cmd, sizeof(cmd));
   }
 
   void WriteIndirectBufferStart(uint32_t base_ptr, uint32_t count) {
@@ -118,7 +328,7 @@ class TraceWriter {
     auto cmd = IndirectBufferStartCommand({
         TraceCommandType::kIndirectBufferStart, base_ptr, 0,
     });
-    fwrite(&cmd, 1, sizeof(cmd), file_);
+    AppendCommand(&cmd, sizeof(cmd));
   }
 
   void WriteIndirectBufferEnd() {
@@ -128,18 +338,16 @@ class TraceWriter {
     auto cmd = IndirectBufferEndCommand({
         TraceCommandType::kIndirectBufferEnd,
     });
-    fwrite(&cmd, 1, sizeof(cmd), file_);
+    AppendCommand(&cmd, sizeof(cmd));
   }
 
   void WritePacketStart(uint32_t base_ptr, uint32_t count) {
     if (!file_) {
       return;
     }
-    auto cmd = PacketStartCommand({
-        TraceCommandType::kPacketStart, base_ptr, count,
-    });
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(membase_ + base_ptr, 4, count, file_);
+    WritePayloadCommand(TraceCommandType::kPacketStart,
+                        TraceCommandType::kPacketStartRef, base_ptr, count,
+                        count * 4);
   }
 
   void WritePacketEnd() {
@@ -149,29 +357,25 @@ class TraceWriter {
     auto cmd = PacketEndCommand({
         TraceCommandType::kPacketEnd,
     });
-    fwrite(&cmd, 1, sizeof(cmd), file_);
+    AppendCommand(&cmd, sizeof(cmd));
   }
 
   void WriteMemoryRead(uint32_t base_ptr, size_t length) {
     if (!file_) {
       return;
     }
-    auto cmd = MemoryReadCommand({
-        TraceCommandType::kMemoryRead, base_ptr, uint32_t(length),
-    });
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(membase_ + base_ptr, 1, length, file_);
+    WritePayloadCommand(TraceCommandType::kMemoryRead,
+                        TraceCommandType::kMemoryReadRef, base_ptr,
+                        uint32_t(length), length);
   }
 
   void WriteMemoryWrite(uint32_t base_ptr, size_t length) {
     if (!file_) {
       return;
     }
-    auto cmd = MemoryWriteCommand({
-        TraceCommandType::kMemoryWrite, base_ptr, uint32_t(length),
-    });
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(membase_ + base_ptr, 1, length, file_);
+    WritePayloadCommand(TraceCommandType::kMemoryWrite,
+                        TraceCommandType::kMemoryWriteRef, base_ptr,
+                        uint32_t(length), length);
   }
 
   void WriteEvent(EventType event_type) {
@@ -181,12 +385,64 @@ class TraceWriter {
     auto cmd = EventCommand({
         TraceCommandType::kEvent, event_type,
     });
-    fwrite(&cmd, 1, sizeof(cmd), file_);
+    AppendCommand(&cmd, sizeof(cmd));
   }
 
  private:
+  void Append(const void* data, size_t length) {
+    auto bytes = reinterpret_cast<const uint8_t*>(data);
+    buffer_.insert(buffer_.end(), bytes, bytes + length);
+    if (buffer_.size() >= kChunkSize) {
+      SubmitBuffer();
+    }
+  }
+  // Appends a command without a payload.
+  void AppendCommand(const void* cmd, size_t length) {
+    TraceCommandInfo info;
+    DecodeTraceCommand(reinterpret_cast<const uint8_t*>(cmd), length,
+                       buffer_offset_ + buffer_.size(), &info);
+    index_builder_.AddCommand(info, nullptr);
+    Append(cmd, length);
+  }
+  // Writes a packet or memory command, or its Ref form if an identical
+  // payload was written before.
+  void WritePayloadCommand(TraceCommandType type, TraceCommandType ref_type,
+                           uint32_t base_ptr, uint32_t count, size_t length);
+  void SubmitBuffer();
+  void WriterThread();
+
+  // Commands are handed to the writer thread in chunks of about this size.
+  static const size_t kChunkSize = 4 * 1024 * 1024;
+
   uint8_t* membase_;
   FILE* file_;
+  bool compress_;
+
+  std::vector<uint8_t> buffer_;
+  // Stream offset of buffer_[0], excluding the file header.
+  uint64_t buffer_offset_;
+  // Payload hash to the stream offset of its first copy. The bytes are kept
+  // so that a hash collision can't reference a different payload.
+  struct PayloadLocation {
+    uint64_t offset;
+    std::vector<uint8_t> data;
+    std::list<uint64_t>::iterator lru_it;
+  };
+  std::unordered_map<uint64_t, PayloadLocation> payloads_;
+  // Hashes in payloads_, least recently referenced first.
+  std::list<uint64_t> payload_lru_;
+  size_t payload_bytes_;
+  TraceIndexBuilder index_builder_;
+  // Bytes written to the file so far, including the header. Only the writer
+  // thread touches it while it runs.
+  uint64_t file_size_;
+
+  std::thread writer_thread_;
+  std::mutex writer_mutex_;
+  std::condition_variable writer_cond_;
+  std::list<std::vector<uint8_t>> pending_chunks_;
+  std::vector<std::vector<uint8_t>> free_chunks_;
+  bool writer_running_;
 };
 
 }  // namespace gpu
@@ -0,0 +1,265 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "third_party/catch/include/catch.hpp"
+#include "xenia/gpu/tracing.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace xe::gpu;
+
+namespace {
+
+const wchar_t* kTracePath = L"xenia-gpu-tests.trace";
+const char* kTracePathA = "xenia-gpu-tests.trace";
+
+struct RecordedPayload {
+  TraceCommandType type;  // Never a Ref type.
+  uint32_t base_ptr;
+  std::vector<uint8_t> data;
+};
+
+// Records one frame: a block of packets that are the same every frame (as
+// with shader and state uploads), a few that change, and a poll read.
+void RecordFrame(TraceWriter* writer, std::vector<uint8_t>* memory, int frame,
+                 int packet_count, std::vector<RecordedPayload>* expected) {
+  auto record = [&](TraceCommandType type, uint32_t base_ptr, size_t length) {
+    if (expected) {
+      expected->push_back({type, base_ptr,
+                           std::vector<uint8_t>(memory->data() + base_ptr,
+                                                memory->data() + base_ptr +
+                                                    length)});
+    }
+  };
+  writer->WritePrimaryBufferStart(0x1000, 0);
+  for (int i = 0; i < packet_count; ++i) {
+    uint32_t base_ptr = 0x10000 + i * 0x400;
+    uint32_t count = 16 + (i % 7) * 32;
+    if (i % 4 == 3) {
+      // Changes every frame.
+      std::memset(memory->data() + base_ptr, frame * 7 + i, count * 4);
+    }
+    writer->WritePacketStart(base_ptr, count);
+    record(TraceCommandType::kPacketStart, base_ptr, count * 4);
+    writer->WritePacketEnd();
+  }
+  writer->WriteMemoryRead(0x2000, 4);
+  record(TraceCommandType::kMemoryRead, 0x2000, 4);
+  writer->WriteMemoryWrite(0x3000, 256);
+  record(TraceCommandType::kMemoryWrite, 0x3000, 256);
+  writer->WritePrimaryBufferEnd();
+  writer->WriteEvent(EventType::kSwap);
+}
+
+std::vector<uint8_t> CreateMemory() {
+  std::vector<uint8_t> memory(8 * 1024 * 1024);
+  for (size_t i = 0; i < memory.size(); ++i) {
+    memory[i] = uint8_t(i * 13 + (i >> 9));
+  }
+  return memory;
+}
+
+// Walks the trace, resolving Ref commands to the payload they point at.
+std::vector<RecordedPayload> ReadPayloads(const TraceFile& file,
+                                          size_t* out_ref_count) {
+  std::vector<RecordedPayload> payloads;
+  auto trace_ptr = file.data();
+  auto trace_end = file.data() + file.size();
+  *out_ref_count = 0;
+  while (trace_ptr < trace_end) {
+    auto type = *reinterpret_cast<const TraceCommandType*>(trace_ptr);
+    switch (type) {
+      case TraceCommandType::kPrimaryBufferStart:
+      case TraceCommandType::kIndirectBufferStart: {
+        auto cmd =
+            reinterpret_cast<const PrimaryBufferStartCommand*>(trace_ptr);
+        trace_ptr += sizeof(*cmd) + cmd->count * 4;
+        break;
+      }
+      case TraceCommandType::kPrimaryBufferEnd:
+      case TraceCommandType::kIndirectBufferEnd:
+      case TraceCommandType::kPacketEnd:
+        trace_ptr += sizeof(PacketEndCommand);
+        break;
+      case TraceCommandType::kPacketStart: {
+        auto cmd = reinterpret_cast<const PacketStartCommand*>(trace_ptr);
+        auto data = GetTracePacketData(trace_ptr);
+        payloads.push_back({type, cmd->base_ptr,
+                            std::vector<uint8_t>(data, data + cmd->count * 4)});
+        trace_ptr += sizeof(*cmd) + cmd->count * 4;
+        break;
+      }
+      case TraceCommandType::kPacketStartRef: {
+        auto cmd = reinterpret_cast<const PacketStartRefCommand*>(trace_ptr);
+        auto data = GetTracePacketData(trace_ptr);
+        payloads.push_back({TraceCommandType::kPacketStart, cmd->base_ptr,
+                            std::vector<uint8_t>(data, data + cmd->count * 4)});
+        trace_ptr += sizeof(*cmd);
+        ++*out_ref_count;
+        break;
+      }
+      case TraceCommandType::kMemoryRead:
+      case TraceCommandType::kMemoryWrite: {
+        auto cmd = reinterpret_cast<const MemoryReadCommand*>(trace_ptr);
+        auto data = trace_ptr + sizeof(*cmd);
+        payloads.push_back({type, cmd->base_ptr,
+                            std::vector<uint8_t>(data, data + cmd->length)});
+        trace_ptr += sizeof(*cmd) + cmd->length;
+        break;
+      }
+      case TraceCommandType::kMemoryReadRef:
+      case TraceCommandType::kMemoryWriteRef: {
+        auto cmd = reinterpret_cast<const MemoryReadRefCommand*>(trace_ptr);
+        auto data = trace_ptr - cmd->payload_distance;
+        payloads.push_back({type == TraceCommandType::kMemoryReadRef
+                                ? TraceCommandType::kMemoryRead
+                                : TraceCommandType::kMemoryWrite,
+                            cmd->base_ptr,
+                            std::vector<uint8_t>(data, data + cmd->length)});
+        trace_ptr += sizeof(*cmd);
+        ++*out_ref_count;
+        break;
+      }
+      case TraceCommandType::kEvent:
+        trace_ptr += sizeof(EventCommand);
+        break;
+      default:
+        FAIL("Unknown trace command");
+        return payloads;
+    }
+  }
+  REQUIRE(trace_ptr == trace_end);
+  return payloads;
+}
+
+size_t GetFileSize(const char* path) {
+  FILE* file = std::fopen(path, "rb");
+  if (!file) {
+    return 0;
+  }
+  std::fseek(file, 0, SEEK_END);
+  size_t size = size_t(std::ftell(file));
+  std::fclose(file);
+  return size;
+}
+
+}  // namespace
+
+TEST_CASE("TRACE_ROUND_TRIP", "[tracing]") {
+  for (bool compress : {false, true}) {
+    auto memory = CreateMemory();
+    std::vector<RecordedPayload> expected;
+    {
+      TraceWriter writer(memory.data());
+      REQUIRE(writer.Open(kTracePath, compress));
+      for (int frame = 0; frame < 4; ++frame) {
+        RecordFrame(&writer, &memory, frame, 200, &expected);
+        writer.Flush();
+      }
+      writer.Close();
+    }
+
+    TraceFile file;
+    REQUIRE(file.Open(kTracePath));
+    REQUIRE(file.version() == kTraceFileVersion);
+    size_t ref_count = 0;
+    auto payloads = ReadPayloads(file, &ref_count);
+    REQUIRE(payloads.size() == expected.size());
+    for (size_t i = 0; i < payloads.size(); ++i) {
+      INFO("payload " << i);
+      REQUIRE(payloads[i].type == expected[i].type);
+      REQUIRE(payloads[i].base_ptr == expected[i].base_ptr);
+      REQUIRE(payloads[i].data == expected[i].data);
+    }
+    // Frames after the first repeat most packets and the memory write.
+    REQUIRE(ref_count >= 3 * (150 + 1));
+  }
+}
+
+TEST_CASE("TRACE_LOADS_UNVERSIONED", "[tracing]") {
+  // As written before traces had a header.
+  const uint32_t packet[] = {0xC0002D00, 0x11223344};
+  FILE* out = std::fopen(kTracePathA, "wb");
+  REQUIRE(out != nullptr);
+  auto start = PacketStartCommand({TraceCommandType::kPacketStart, 0x100, 2});
+  auto end = PacketEndCommand({TraceCommandType::kPacketEnd});
+  std::fwrite(&start, 1, sizeof(start), out);
+  std::fwrite(packet, 1, sizeof(packet), out);
+  std::fwrite(&end, 1, sizeof(end), out);
+  std::fclose(out);
+
+  TraceFile file;
+  REQUIRE(file.Open(kTracePath));
+  REQUIRE(file.version() == 0);
+  size_t ref_count = 0;
+  auto payloads = ReadPayloads(file, &ref_count);
+  REQUIRE(payloads.size() == 1);
+  REQUIRE(payloads[0].base_ptr == 0x100);
+  REQUIRE(std::memcmp(payloads[0].data.data(), packet, sizeof(packet)) == 0);
+}
+
+TEST_CASE("TRACE_BENCHMARK", "[.][benchmark]") {
+  // Capture cost per frame for a frame of 5000 packets, against writing the
+  // same commands unbuffered as the writer used to.
+  const int frame_count = 60;
+  const int packet_count = 5000;
+  auto memory = CreateMemory();
+  {
+    FILE* out = std::fopen(kTracePathA, "wb");
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int frame = 0; frame < frame_count; ++frame) {
+      for (int i = 0; i < packet_count; ++i) {
+        uint32_t base_ptr = 0x10000 + i * 0x400;
+        uint32_t count = 16 + (i % 7) * 32;
+        auto cmd = PacketStartCommand(
+            {TraceCommandType::kPacketStart, base_ptr, count});
+        std::fwrite(&cmd, 1, sizeof(cmd), out);
+        std::fwrite(memory.data() + base_ptr, 4, count, out);
+        auto end_cmd = PacketEndCommand({TraceCommandType::kPacketEnd});
+        std::fwrite(&end_cmd, 1, sizeof(end_cmd), out);
+      }
+      std::fflush(out);
+    }
+    std::fclose(out);
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::high_resolution_clock::now() - start)
+                         .count();
+    std::printf("unbuffered: %.3f ms/frame, %.1f MB\n",
+                seconds * 1000.0 / frame_count,
+                GetFileSize(kTracePathA) / (1024.0 * 1024.0));
+  }
+  for (bool compress : {false, true}) {
+    TraceWriter writer(memory.data());
+    REQUIRE(writer.Open(kTracePath, compress));
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int frame = 0; frame < frame_count; ++frame) {
+      RecordFrame(&writer, &memory, frame, packet_count, nullptr);
+      writer.Flush();
+    }
+    double record_seconds =
+        std::chrono::duration<double>(
+            std::chrono::high_resolution_clock::now() - start)
+            .count();
+    writer.Close();
+    double total_seconds =
+        std::chrono::duration<double>(
+            std::chrono::high_resolution_clock::now() - start)
+            .count();
+    std::printf(
+        "%s: %.3f ms/frame on the recording thread, %.3f ms/frame including "
+        "the writer, %.1f MB\n",
+        compress ? "compressed  " : "uncompressed",
+        record_seconds * 1000.0 / frame_count,
+        total_seconds * 1000.0 / frame_count,
+        GetFileSize(kTracePathA) / (1024.0 * 1024.0));
+  }
+}
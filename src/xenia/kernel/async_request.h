@@ -20,6 +20,7 @@ namespace kernel {
 class KernelState;
 class XEvent;
 class XObject;
+class XThread;
 
 class XAsyncRequest {
  public:
@@ -34,7 +35,17 @@ class XAsyncRequest {
 
   void AddWaitEvent(XEvent* ev);
 
-  // Complete(result)
+  // Guest X_IO_STATUS_BLOCK filled in on completion, if any.
+  void set_io_status_block(uint32_t io_status_block_ptr) {
+    io_status_block_ptr_ = io_status_block_ptr;
+  }
+  // Queues the APC on the given thread once the request completes.
+  void SetApc(XThread* thread, uint32_t apc_routine, uint32_t apc_context);
+
+  // Writes the status block, signals all wait events and queues the APC, then
+  // calls the completion callback (which may delete the request).
+  // May be called from any host thread.
+  void Complete(X_STATUS result, uint32_t information);
 
  protected:
   KernelState* kernel_state_;
@@ -43,6 +54,8 @@ class XAsyncRequest {
   void* callback_context_;
 
   std::vector<XEvent*> wait_events_;
+  uint32_t io_status_block_ptr_;
+  XThread* apc_thread_;
   uint32_t apc_routine_;
   uint32_t apc_context_;
 };
@@ -11,6 +11,8 @@
 
 #include <gflags/gflags.h>
 
+#include <algorithm>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/string.h"
 #include "xenia/cpu/processor.h"
@@ -32,6 +34,9 @@ DEFINE_bool(headless, false,
             "Don't display any UI, using defaults for prompts as needed.");
 DEFINE_string(content_root, "content",
               "Root path for content (save/etc) storage.");
+DEFINE_int32(io_worker_threads, 4,
+             "Host threads servicing asynchronous file reads; 0 completes "
+             "all reads on the calling guest thread.");
 
 namespace xe {
 namespace kernel {
@@ -52,7 +57,8 @@ KernelState::KernelState(Emulator* emulator)
       has_notified_startup_(false),
       process_type_(X_PROCTYPE_USER),
       process_info_block_address_(0),
-      dispatch_thread_running_(false) {
+      dispatch_thread_running_(false),
+      io_threads_running_(false) {
   processor_ = emulator->processor();
   file_system_ = emulator->file_system();
 
@@ -97,6 +103,17 @@ KernelState::~KernelState() {
     dispatch_thread_->Wait(0, 0, 0, nullptr);
   }
 
+  // Drain outstanding reads before the objects they reference go away.
+  {
+    std::lock_guard<std::mutex> lock(io_mutex_);
+    io_threads_running_ = false;
+    io_cond_.notify_all();
+  }
+  for (auto& io_thread : io_threads_) {
+    io_thread->Wait(0, 0, 0, nullptr);
+  }
+  io_threads_.clear();
+
   if (process_info_block_address_) {
     memory_->SystemHeapFree(process_info_block_address_);
   }
@@ -590,5 +607,41 @@ void KernelState::CompleteOverlappedDeferredEx(
   dispatch_cond_.notify_all();
 }
 
+void KernelState::QueueIoRequest(std::function<void()> fn) {
+  std::lock_guard<std::mutex> lock(io_mutex_);
+  if (!io_threads_running_) {
+    io_threads_running_ = true;
+    for (int32_t i = 0; i < std::max(FLAGS_io_worker_threads, 1); ++i) {
+      auto io_thread = object_ref<XHostThread>(new XHostThread(
+          this, 128 * 1024, 0, [this]() { return RunIoThread(); }));
+      io_thread->set_name("Kernel I/O Thread");
+      io_thread->Create();
+      io_threads_.push_back(std::move(io_thread));
+    }
+  }
+  io_queue_.push_back(std::move(fn));
+  io_cond_.notify_one();
+}
+
+int KernelState::RunIoThread() {
+  while (true) {
+    std::function<void()> fn;
+    {
+      std::unique_lock<std::mutex> lock(io_mutex_);
+      io_cond_.wait(lock, [this]() {
+        return !io_queue_.empty() || !io_threads_running_;
+      });
+      if (io_queue_.empty()) {
+        // Shutting down and nothing left to run.
+        break;
+      }
+      fn = std::move(io_queue_.front());
+      io_queue_.pop_front();
+    }
+    fn();
+  }
+  return 0;
+}
+
 }  // namespace kernel
 }  // namespace xe
@@ -18,6 +18,7 @@
 #include <list>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 #include "xenia/base/mutex.h"
 #include "xenia/cpu/export_resolver.h"
@@ -37,6 +38,7 @@ class Processor;
 }  // namespace xe
 
 DECLARE_bool(headless);
+DECLARE_int32(io_worker_threads);
 
 namespace xe {
 namespace kernel {
@@ -163,8 +165,13 @@ class KernelState {
                                     uint32_t overlapped_ptr, X_RESULT result,
                                     uint32_t extended_error, uint32_t length);
 
+  // Runs a blocking host I/O call on one of the I/O worker threads, so that
+  // the guest thread that issued it can keep running.
+  void QueueIoRequest(std::function<void()> fn);
+
  private:
   void LoadKernelModule(object_ref<XKernelModule> kernel_module);
+  int RunIoThread();
 
   Emulator* emulator_;
   Memory* memory_;
@@ -197,6 +204,12 @@ class KernelState {
   std::condition_variable dispatch_cond_;
   std::list<std::function<void()>> dispatch_queue_;
 
+  bool io_threads_running_;
+  std::vector<object_ref<XHostThread>> io_threads_;
+  std::mutex io_mutex_;
+  std::condition_variable io_cond_;
+  std::list<std::function<void()>> io_queue_;
+
   friend class XObject;
 };
 
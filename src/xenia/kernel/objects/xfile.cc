@@ -11,6 +11,7 @@
 
 #include "xenia/base/math.h"
 #include "xenia/kernel/async_request.h"
+#include "xenia/kernel/kernel_state.h"
 #include "xenia/kernel/objects/xevent.h"
 
 namespace xe {
@@ -99,12 +100,22 @@ X_STATUS XFile::Read(void* buffer, size_t buffer_length, size_t byte_offset,
 
 X_STATUS XFile::Read(void* buffer, size_t buffer_length, size_t byte_offset,
                      XAsyncRequest* request) {
-  // Also tack on our event so that any waiters wake.
+  if (byte_offset == -1) {
+    // Asynchronous handles don't track a position, but honor it if set.
+    byte_offset = position_;
+  }
+  // Waiters on the file handle must wait for this read, not an earlier one.
+  async_event_->Reset();
   request->AddWaitEvent(async_event_);
-  position_ = byte_offset;
-  // return entry_->ReadAsync(buffer, buffer_length, byte_offset, request);
-  X_STATUS result = X_STATUS_NOT_IMPLEMENTED;
-  return result;
+  // The request keeps this file alive until it completes.
+  kernel_state()->QueueIoRequest(
+      [this, buffer, buffer_length, byte_offset, request]() {
+        size_t bytes_read = 0;
+        X_STATUS result =
+            ReadSync(buffer, buffer_length, byte_offset, &bytes_read);
+        request->Complete(result, static_cast<uint32_t>(bytes_read));
+      });
+  return X_STATUS_PENDING;
 }
 
 X_STATUS XFile::Write(const void* buffer, size_t buffer_length,
@@ -90,11 +90,17 @@ class XFile : public XObject {
   size_t position() const { return position_; }
   void set_position(size_t value) { position_ = value; }
 
+  // Opened with FILE_SYNCHRONOUS_IO_*, so I/O never returns pending.
+  bool is_synchronous() const { return is_synchronous_; }
+  void set_is_synchronous(bool value) { is_synchronous_ = value; }
+
   X_STATUS QueryDirectory(X_FILE_DIRECTORY_INFORMATION* out_info, size_t length,
                           const char* file_name, bool restart);
 
   X_STATUS Read(void* buffer, size_t buffer_length, size_t byte_offset,
                 size_t* out_bytes_read);
+  // Queues the read on the kernel I/O threads and returns X_STATUS_PENDING;
+  // the request is completed from an I/O thread.
   X_STATUS Read(void* buffer, size_t buffer_length, size_t byte_offset,
                 XAsyncRequest* request);
 
@@ -120,6 +126,7 @@ class XFile : public XObject {
   XEvent* async_event_ = nullptr;
 
   // TODO(benvanik): create flags, open state, etc.
+  bool is_synchronous_ = false;
 
   size_t position_ = 0;
 
@@ -25,3 +25,15 @@ project("xenia-kernel")
   files({
     "debug_visualizers.natvis",
   })
+
+test_suite("xenia-kernel-tests", project_root, ".", {
+  includedirs = {
+    project_root.."/third_party/elemental-forms/src",
+  },
+  links = {
+    "xenia-base",
+    "xenia-core",
+    "xenia-cpu",
+    "xenia-kernel",
+  },
+})
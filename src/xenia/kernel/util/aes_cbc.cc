@@ -0,0 +1,235 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/util/aes_cbc.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "third_party/crypto/rijndael-alg-fst.h"
+#include "third_party/crypto/rijndael-alg-fst.c"
+
+#include "xenia/base/assert.h"
+#include "xenia/base/cpu_features.h"
+#include "xenia/base/worker_pool.h"
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+namespace {
+
+// Each thread gets at least this much, so that decrypting outweighs waking it
+// up.
+const size_t kMinThreadLength = 256 * 1024;
+// Pieces are small enough that threads finishing early can take more.
+const size_t kMinPieceLength = 64 * 1024;
+
+typedef void (*CbcDecryptFn)(const AesDecryptKey& key, const uint8_t iv[16],
+                             const uint8_t* input, uint8_t* output,
+                             size_t length);
+
+void CbcDecryptReference(const AesDecryptKey& key, const uint8_t iv[16],
+                         const uint8_t* input, uint8_t* output,
+                         size_t length) {
+  uint8_t ivec[16];
+  std::memcpy(ivec, iv, 16);
+  for (size_t n = 0; n < length; n += 16) {
+    // Keep the ciphertext, output may overwrite it.
+    uint8_t ct[16];
+    std::memcpy(ct, input + n, 16);
+    rijndaelDecrypt(key.rk, 10, ct, output + n);
+    for (size_t i = 0; i < 16; i++) {
+      output[n + i] ^= ivec[i];
+    }
+    std::memcpy(ivec, ct, 16);
+  }
+}
+
+// Decryption of each block is independent, only the XOR needs the previous
+// ciphertext, so eight blocks go through aesdec together to hide its latency.
+// All of a group is loaded before any of it is stored for in-place use.
+XE_TARGET_AESNI void CbcDecryptAESNI(const AesDecryptKey& key,
+                                     const uint8_t iv[16], const uint8_t* input,
+                                     uint8_t* output, size_t length) {
+  __m128i rk[11];
+  for (int i = 0; i < 11; ++i) {
+    rk[i] = _mm_load_si128(reinterpret_cast<const __m128i*>(key.round_keys[i]));
+  }
+  __m128i prev = _mm_loadu_si128(reinterpret_cast<const __m128i*>(iv));
+  auto src = reinterpret_cast<const __m128i*>(input);
+  auto dest = reinterpret_cast<__m128i*>(output);
+  size_t count = length / 16;
+  size_t n = 0;
+  for (; n + 8 <= count; n += 8) {
+    __m128i ct[8], b[8];
+    for (int i = 0; i < 8; ++i) {
+      ct[i] = _mm_loadu_si128(src + n + i);
+      b[i] = _mm_xor_si128(ct[i], rk[0]);
+    }
+    for (int r = 1; r < 10; ++r) {
+      for (int i = 0; i < 8; ++i) {
+        b[i] = _mm_aesdec_si128(b[i], rk[r]);
+      }
+    }
+    for (int i = 0; i < 8; ++i) {
+      b[i] = _mm_aesdeclast_si128(b[i], rk[10]);
+    }
+    _mm_storeu_si128(dest + n, _mm_xor_si128(b[0], prev));
+    for (int i = 1; i < 8; ++i) {
+      _mm_storeu_si128(dest + n + i, _mm_xor_si128(b[i], ct[i - 1]));
+    }
+    prev = ct[7];
+  }
+  for (; n < count; ++n) {
+    __m128i ct = _mm_loadu_si128(src + n);
+    __m128i b = _mm_xor_si128(ct, rk[0]);
+    for (int r = 1; r < 10; ++r) {
+      b = _mm_aesdec_si128(b, rk[r]);
+    }
+    b = _mm_aesdeclast_si128(b, rk[10]);
+    _mm_storeu_si128(dest + n, _mm_xor_si128(b, prev));
+    prev = ct;
+  }
+}
+
+CbcDecryptFn GetCbcDecryptFn(AesPath path) {
+  switch (path) {
+    case AesPath::kReference:
+      return CbcDecryptReference;
+    case AesPath::kAESNI:
+      assert_true(IsAesPathSupported(path));
+      return CbcDecryptAESNI;
+    default:
+      assert_unhandled_case(path);
+      return nullptr;
+  }
+}
+
+void CbcDecryptRanges(const AesDecryptKey& key, const AesCbcRange* ranges,
+                      size_t range_count, CbcDecryptFn decrypt,
+                      uint32_t thread_count) {
+  size_t total_length = 0;
+  for (size_t i = 0; i < range_count; ++i) {
+    assert_zero(ranges[i].length % 16);
+    total_length += ranges[i].length;
+  }
+  thread_count = uint32_t(std::max(
+      std::min(size_t(thread_count), total_length / kMinThreadLength),
+      size_t(1)));
+  if (thread_count == 1) {
+    for (size_t i = 0; i < range_count; ++i) {
+      decrypt(key, ranges[i].iv, ranges[i].input, ranges[i].output,
+              ranges[i].length);
+    }
+    return;
+  }
+
+  // Split into whole-block pieces for the threads to take in turn. The IV of
+  // each piece is the ciphertext block before it. Take copies before
+  // anything is decrypted in place over them.
+  size_t piece_length = std::max(
+      kMinPieceLength, (total_length / (thread_count * 4) + 15) & ~size_t(15));
+  std::vector<AesCbcRange> pieces;
+  std::vector<uint8_t> ivs;
+  for (size_t i = 0; i < range_count; ++i) {
+    auto& range = ranges[i];
+    for (size_t offset = 0; offset < range.length; offset += piece_length) {
+      const uint8_t* iv = offset ? range.input + offset - 16 : range.iv;
+      ivs.insert(ivs.end(), iv, iv + 16);
+      pieces.push_back({nullptr, range.input + offset, range.output + offset,
+                        std::min(piece_length, range.length - offset)});
+    }
+  }
+  xe::threading::WorkerPool::shared()->ParallelFor(
+      pieces.size(), thread_count, [&](size_t i) {
+        auto& piece = pieces[i];
+        decrypt(key, &ivs[i * 16], piece.input, piece.output, piece.length);
+      });
+}
+
+}  // namespace
+
+AesDecryptKey::AesDecryptKey(const uint8_t key[16]) {
+  rijndaelKeySetupDec(rk, key, 128);
+  // The reference schedule is already the equivalent inverse cipher's, as
+  // aesdec wants it. It just keeps each column as a big endian word.
+  for (int i = 0; i < 4 * (10 + 1); ++i) {
+    uint8_t* column = &round_keys[i / 4][(i % 4) * 4];
+    column[0] = uint8_t(rk[i] >> 24);
+    column[1] = uint8_t(rk[i] >> 16);
+    column[2] = uint8_t(rk[i] >> 8);
+    column[3] = uint8_t(rk[i]);
+  }
+}
+
+bool IsAesPathSupported(AesPath path) {
+  static const bool has_aesni =
+      (xe::host_cpu_features() & xe::kCpuFeatureAESNI) != 0;
+  switch (path) {
+    case AesPath::kReference:
+      return true;
+    case AesPath::kAESNI:
+      return has_aesni;
+    default:
+      return false;
+  }
+}
+
+void AesCbcDecrypt(const AesDecryptKey& key, const uint8_t iv[16],
+                   const uint8_t* input, uint8_t* output, size_t length,
+                   uint32_t thread_count) {
+  AesPath path = IsAesPathSupported(AesPath::kAESNI) ? AesPath::kAESNI
+                                                     : AesPath::kReference;
+  AesCbcDecrypt(key, iv, input, output, length, path, thread_count);
+}
+
+void AesCbcDecrypt(const AesDecryptKey& key, const uint8_t iv[16],
+                   const uint8_t* input, uint8_t* output, size_t length,
+                   AesPath path, uint32_t thread_count) {
+  CbcDecryptFn decrypt = GetCbcDecryptFn(path);
+  if (!decrypt) {
+    return;
+  }
+  AesCbcRange range = {iv, input, output, length};
+  CbcDecryptRanges(key, &range, 1, decrypt, thread_count);
+}
+
+void AesCbcDecrypt(const AesDecryptKey& key,
+                   const std::vector<AesCbcRange>& ranges,
+                   uint32_t thread_count) {
+  AesPath path = IsAesPathSupported(AesPath::kAESNI) ? AesPath::kAESNI
+                                                     : AesPath::kReference;
+  CbcDecryptRanges(key, ranges.data(), ranges.size(), GetCbcDecryptFn(path),
+                   thread_count);
+}
+
+void AesCbcEncrypt(const uint8_t key[16], const uint8_t iv[16],
+                   const uint8_t* input, uint8_t* output, size_t length) {
+  assert_zero(length % 16);
+  uint32_t rk[4 * (10 + 1)];
+  int nr = rijndaelKeySetupEnc(rk, key, 128);
+  uint8_t ivec[16];
+  std::memcpy(ivec, iv, 16);
+  for (size_t n = 0; n < length; n += 16) {
+    uint8_t pt[16];
+    for (size_t i = 0; i < 16; i++) {
+      pt[i] = input[n + i] ^ ivec[i];
+    }
+    rijndaelEncrypt(rk, nr, pt, output + n);
+    std::memcpy(ivec, output + n, 16);
+  }
+}
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
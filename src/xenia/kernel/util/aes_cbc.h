@@ -0,0 +1,80 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_KERNEL_UTIL_AES_CBC_H_
+#define XENIA_KERNEL_UTIL_AES_CBC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+// An expanded AES-128 decryption key.
+struct AesDecryptKey {
+  explicit AesDecryptKey(const uint8_t key[16]);
+
+  // Round keys for the reference implementation, as rijndaelKeySetupDec
+  // produces them.
+  uint32_t rk[4 * (10 + 1)];
+  // The same round keys as bytes, in the order aesdec consumes them.
+  alignas(16) uint8_t round_keys[10 + 1][16];
+};
+
+enum class AesPath {
+  // The table driven reference implementation. Always available.
+  kReference,
+  // AES-NI with eight blocks in flight.
+  kAESNI,
+};
+
+// Whether the host can run the given path.
+bool IsAesPathSupported(AesPath path);
+
+// A run of AES-128-CBC ciphertext and the IV it starts with.
+struct AesCbcRange {
+  const uint8_t* iv;
+  const uint8_t* input;
+  uint8_t* output;
+  size_t length;
+};
+
+// Decrypts AES-128-CBC data with the fastest path the host supports. length
+// must be a multiple of 16 and input may equal output. CBC decryption of a
+// block only needs the ciphertext before it, so large buffers are split
+// across up to thread_count threads of the shared worker pool.
+void AesCbcDecrypt(const AesDecryptKey& key, const uint8_t iv[16],
+                   const uint8_t* input, uint8_t* output, size_t length,
+                   uint32_t thread_count = 1);
+
+// Decrypts several ranges as one job, so that many small ones still spread
+// across threads. Each range may decrypt in place, but no range's output may
+// overlap another's input or IV.
+void AesCbcDecrypt(const AesDecryptKey& key,
+                   const std::vector<AesCbcRange>& ranges,
+                   uint32_t thread_count);
+
+// Decrypts with the given path and number of threads.
+// Exposed for tests and benchmarks.
+void AesCbcDecrypt(const AesDecryptKey& key, const uint8_t iv[16],
+                   const uint8_t* input, uint8_t* output, size_t length,
+                   AesPath path, uint32_t thread_count);
+
+// Encrypts AES-128-CBC data with the reference implementation. length must
+// be a multiple of 16. Only used to build test images.
+void AesCbcEncrypt(const uint8_t key[16], const uint8_t iv[16],
+                   const uint8_t* input, uint8_t* output, size_t length);
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
+
+#endif  // XENIA_KERNEL_UTIL_AES_CBC_H_
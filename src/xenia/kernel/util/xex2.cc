@@ -11,12 +11,11 @@
 
 #include <algorithm>
 #include <cstring>
+#include <thread>
 #include <vector>
 
 #include <gflags/gflags.h>
 
-#include "third_party/crypto/rijndael-alg-fst.h"
-#include "third_party/crypto/rijndael-alg-fst.c"
 #include "third_party/mspack/lzx.h"
 #include "third_party/mspack/lzxd.c"
 #include "third_party/mspack/mspack.h"
@@ -26,10 +25,17 @@
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/platform.h"
+#include "xenia/kernel/util/aes_cbc.h"
 
 namespace xe {}  // namespace xe
 
 DEFINE_bool(xex_dev_key, false, "Use the devkit key.");
+DEFINE_int32(xex_decrypt_threads, 4,
+             "Maximum threads used to decrypt large XEX images. 1 disables.");
+
+using xe::kernel::util::AesCbcDecrypt;
+using xe::kernel::util::AesCbcRange;
+using xe::kernel::util::AesDecryptKey;
 
 typedef struct xe_xex2 {
   xe::Memory* memory;
@@ -443,10 +449,11 @@ int xe_xex2_decrypt_key(xe_xex2_header_t* header) {
     xexkey = xe_xex2_devkit_key;
   }
 
-  // Decrypt the header key.
-  uint32_t rk[4 * (MAXNR + 1)];
-  int32_t Nr = rijndaelKeySetupDec(rk, xexkey, 128);
-  rijndaelDecrypt(rk, Nr, header->loader_info.file_key, header->session_key);
+  // Decrypt the header key. It's a single block, where CBC with a zero IV is
+  // plain AES.
+  const uint8_t zero_iv[16] = {0};
+  AesCbcDecrypt(AesDecryptKey(xexkey), zero_iv, header->loader_info.file_key,
+                header->session_key, 16);
 
   return 0;
 }
@@ -515,25 +522,20 @@ struct mspack_system* mspack_memory_sys_create() {
 }
 void mspack_memory_sys_destroy(struct mspack_system* sys) { free(sys); }
 
+uint32_t xe_xex2_decrypt_thread_count() {
+  return std::min(uint32_t(std::max(FLAGS_xex_decrypt_threads, 1)),
+                  std::max(std::thread::hardware_concurrency(), 1u));
+}
+
+// output_buffer may be input_buffer. A partial block at the end is skipped.
 void xe_xex2_decrypt_buffer(const uint8_t* session_key,
                             const uint8_t* input_buffer,
                             const size_t input_size, uint8_t* output_buffer,
                             const size_t output_size) {
-  uint32_t rk[4 * (MAXNR + 1)];
-  uint8_t ivec[16] = {0};
-  int32_t Nr = rijndaelKeySetupDec(rk, session_key, 128);
-  const uint8_t* ct = input_buffer;
-  uint8_t* pt = output_buffer;
-  for (size_t n = 0; n < input_size; n += 16, ct += 16, pt += 16) {
-    // Decrypt 16 uint8_ts from input -> output.
-    rijndaelDecrypt(rk, Nr, ct, pt);
-    for (size_t i = 0; i < 16; i++) {
-      // XOR with previous.
-      pt[i] ^= ivec[i];
-      // Set previous.
-      ivec[i] = ct[i];
-    }
-  }
+  const uint8_t zero_iv[16] = {0};
+  size_t length = std::min(input_size, output_size) & ~size_t(15);
+  AesCbcDecrypt(AesDecryptKey(session_key), zero_iv, input_buffer,
+                output_buffer, length, xe_xex2_decrypt_thread_count());
 }
 
 int xe_xex2_read_image_uncompressed(const xe_xex2_header_t* header,
@@ -617,48 +619,52 @@ int xe_xex2_read_image_basic_compressed(const xe_xex2_header_t* header,
     return 1;
   }
   uint8_t* buffer = memory->TranslateVirtual(header->exe_address);
-  std::memset(buffer, 0, total_size);  // Quickly zero the contents.
   uint8_t* d = buffer;
 
-  uint32_t rk[4 * (MAXNR + 1)];
-  uint8_t ivec[16] = {0};
-  int32_t Nr = rijndaelKeySetupDec(rk, header->session_key, 128);
+  // Each block's data goes straight from the file into guest memory. The CBC
+  // chain runs over the file, so the IV of each block is the ciphertext that
+  // ends the previous one. That lets all blocks be decrypted as one job once
+  // they have been checked.
+  const uint8_t zero_iv[16] = {0};
+  std::vector<AesCbcRange> ranges;
 
   for (size_t n = 0; n < comp_info->block_count; n++) {
     const uint32_t data_size = comp_info->blocks[n].data_size;
     const uint32_t zero_size = comp_info->blocks[n].zero_size;
+    if (data_size > exe_length - (p - source_buffer) ||
+        data_size + zero_size > total_size - (d - buffer)) {
+      // Overflow.
+      return 1;
+    }
 
     switch (header->file_format_info.encryption_type) {
       case XEX_ENCRYPTION_NONE:
-        if (exe_length - (p - source_buffer) >
-            uncompressed_size - (d - buffer)) {
-          // Overflow.
+        memcpy(d, p, data_size);
+        break;
+      case XEX_ENCRYPTION_NORMAL:
+        if (data_size % 16) {
+          XELOGE("XEX block %zu is not a whole number of AES blocks.", n);
           return 1;
         }
-        memcpy(d, p, exe_length - (p - source_buffer));
+        ranges.push_back(
+            {p == source_buffer ? zero_iv : p - 16, p, d, data_size});
         break;
-      case XEX_ENCRYPTION_NORMAL: {
-        const uint8_t* ct = p;
-        uint8_t* pt = d;
-        for (size_t m = 0; m < data_size; m += 16, ct += 16, pt += 16) {
-          // Decrypt 16 uint8_ts from input -> output.
-          rijndaelDecrypt(rk, Nr, ct, pt);
-          for (size_t i = 0; i < 16; i++) {
-            // XOR with previous.
-            pt[i] ^= ivec[i];
-            // Set previous.
-            ivec[i] = ct[i];
-          }
-        }
-      } break;
       default:
         assert_always();
         return 1;
     }
+    std::memset(d + data_size, 0, zero_size);
 
     p += data_size;
     d += data_size + zero_size;
   }
+  // Zero whatever the blocks don't cover.
+  std::memset(d, 0, total_size - (d - buffer));
+
+  if (!ranges.empty()) {
+    AesCbcDecrypt(AesDecryptKey(header->session_key), ranges,
+                  xe_xex2_decrypt_thread_count());
+  }
 
   return 0;
 }
@@ -683,7 +689,6 @@ int xe_xex2_read_image_compressed(const xe_xex2_header_t* header,
   uint8_t* compress_buffer = NULL;
   const uint8_t* p = NULL;
   uint8_t* d = NULL;
-  uint8_t* deblock_buffer = NULL;
   size_t block_size = 0;
   uint32_t uncompressed_size = 0;
   struct mspack_system* sys = NULL;
@@ -691,33 +696,27 @@ int xe_xex2_read_image_compressed(const xe_xex2_header_t* header,
   mspack_memory_file* lzxdst = NULL;
   struct lzxd_stream* lzxd = NULL;
 
-  // Decrypt (if needed).
-  bool free_input = false;
-  const uint8_t* input_buffer = exe_buffer;
-  const size_t input_size = exe_length;
+  // De-block into one working buffer, decrypting into it first if needed.
+  // De-blocking only drops headers, so it can then work in place without
+  // ever writing past where it reads.
+  compress_buffer = (uint8_t*)calloc(1, exe_length);
+  p = exe_buffer;
+  d = compress_buffer;
   switch (header->file_format_info.encryption_type) {
     case XEX_ENCRYPTION_NONE:
-      // No-op.
       break;
     case XEX_ENCRYPTION_NORMAL:
-      // TODO: a way to do without a copy/alloc?
-      free_input = true;
-      input_buffer = (const uint8_t*)calloc(1, input_size);
       xe_xex2_decrypt_buffer(header->session_key, exe_buffer, exe_length,
-                             (uint8_t*)input_buffer, input_size);
+                             compress_buffer, exe_length);
+      p = compress_buffer;
       break;
     default:
       assert_always();
-      return false;
+      free(compress_buffer);
+      return 1;
   }
 
-  compress_buffer = (uint8_t*)calloc(1, exe_length);
-
-  p = input_buffer;
-  d = compress_buffer;
-
   // De-block.
-  deblock_buffer = (uint8_t*)calloc(1, input_size);
   block_size = header->file_format_info.compression_info.normal.block_size;
   while (block_size) {
     const uint8_t* pnext = p + block_size;
@@ -731,7 +730,7 @@ int xe_xex2_read_image_compressed(const xe_xex2_header_t* header,
       if (!chunk_size) {
         break;
       }
-      memcpy(d, p, chunk_size);
+      memmove(d, p, chunk_size);
       p += chunk_size;
       d += chunk_size;
 
@@ -752,10 +751,9 @@ int xe_xex2_read_image_compressed(const xe_xex2_header_t* header,
   if (!alloc_result) {
     XELOGE("Unable to allocate XEX memory at %.8X-%.8X.", header->exe_address,
            uncompressed_size);
-    result_code = 2;
-    // Not doing any cleanup here;
     // TODO(benvanik): rewrite this entire file using RAII.
     assert_always();
+    free(compress_buffer);
     return 1;
   }
   uint8_t* buffer = memory->TranslateVirtual(header->exe_address);
@@ -788,10 +786,6 @@ int xe_xex2_read_image_compressed(const xe_xex2_header_t* header,
     sys = NULL;
   }
   free(compress_buffer);
-  free(deblock_buffer);
-  if (free_input) {
-    free((void*)input_buffer);
-  }
   return result_code;
 }
 
@@ -0,0 +1,385 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "third_party/catch/include/catch.hpp"
+#include "xenia/kernel/util/aes_cbc.h"
+#include "xenia/kernel/util/xex2.h"
+
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "third_party/pe/pe_image.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+
+DECLARE_int32(xex_decrypt_threads);
+
+using namespace xe::kernel::util;
+
+namespace {
+
+const AesPath kAllPaths[] = {AesPath::kReference, AesPath::kAESNI};
+const char* kPathNames[] = {"reference", "AES-NI"};
+
+const uint32_t kImageBase = 0x82000000;
+// Pages of images below 0x90000000 are 64KiB.
+const uint32_t kPageSize = 64 * 1024;
+
+std::vector<uint8_t> MakeData(size_t length, uint32_t seed) {
+  std::vector<uint8_t> data(length);
+  for (size_t i = 0; i < length; ++i) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = uint8_t(seed >> 16);
+  }
+  return data;
+}
+
+void Store32(std::vector<uint8_t>& data, size_t offset, uint32_t value) {
+  xe::store_and_swap<uint32_t>(data.data() + offset, value);
+}
+
+void Store16(std::vector<uint8_t>& data, size_t offset, uint16_t value) {
+  xe::store_and_swap<uint16_t>(data.data() + offset, value);
+}
+
+// The plaintext PE image a synthetic XEX holds: a minimal Xbox PE header
+// followed by data, with every fourth 64KiB page left as zeros so that basic
+// compression has something to drop.
+std::vector<uint8_t> MakeImage(uint32_t page_count) {
+  auto image = MakeData(page_count * kPageSize, page_count);
+  for (uint32_t page = 3; page < page_count; page += 4) {
+    std::memset(image.data() + page * kPageSize, 0, kPageSize);
+  }
+  std::memset(image.data(), 0, 0x200);
+  auto dos_header = reinterpret_cast<IMAGE_DOS_HEADER*>(image.data());
+  dos_header->e_magic = IMAGE_DOS_SIGNATURE;
+  dos_header->e_lfanew = sizeof(IMAGE_DOS_HEADER);
+  auto nt_headers = reinterpret_cast<IMAGE_NT_HEADERS32*>(
+      image.data() + sizeof(IMAGE_DOS_HEADER));
+  nt_headers->Signature = IMAGE_NT_SIGNATURE;
+  nt_headers->FileHeader.Machine = IMAGE_FILE_MACHINE_POWERPCBE;
+  nt_headers->FileHeader.Characteristics = IMAGE_FILE_32BIT_MACHINE;
+  nt_headers->FileHeader.SizeOfOptionalHeader =
+      IMAGE_SIZEOF_NT_OPTIONAL_HEADER;
+  nt_headers->OptionalHeader.Magic = IMAGE_NT_OPTIONAL_HDR32_MAGIC;
+  nt_headers->OptionalHeader.Subsystem = IMAGE_SUBSYSTEM_XBOX;
+  return image;
+}
+
+// Basic compression stores runs of data followed by runs of zeros. Each run
+// of data here ends where a zero page starts.
+std::vector<uint8_t> MakeBasicPayload(const std::vector<uint8_t>& image,
+                                      std::vector<uint8_t>* format_info) {
+  std::vector<uint8_t> payload;
+  std::vector<std::pair<uint32_t, uint32_t>> blocks;
+  size_t offset = 0;
+  while (offset < image.size()) {
+    size_t data_end = std::min(offset + 3 * kPageSize, image.size());
+    size_t zero_end = std::min(data_end + kPageSize, image.size());
+    payload.insert(payload.end(), image.begin() + offset,
+                   image.begin() + data_end);
+    blocks.emplace_back(uint32_t(data_end - offset),
+                        uint32_t(zero_end - data_end));
+    offset = zero_end;
+  }
+  format_info->resize(8 + blocks.size() * 8);
+  Store32(*format_info, 0, uint32_t(format_info->size()));
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    Store32(*format_info, 8 + i * 8, blocks[i].first);
+    Store32(*format_info, 12 + i * 8, blocks[i].second);
+  }
+  return payload;
+}
+
+// Normal compression is an LZX stream cut into chunks of one 32KiB frame
+// each, grouped in blocks that carry the size of the next one. There's no
+// LZX compressor around, so every frame is an LZX stored block. Decompression
+// is then about as fast as LZX gets, and what's measured is mostly the
+// decryption and de-blocking around it.
+std::vector<uint8_t> MakeNormalPayload(const std::vector<uint8_t>& image,
+                                       std::vector<uint8_t>* format_info) {
+  const size_t kFrameSize = 0x8000;
+  const size_t kFramesPerBlock = 16;
+  std::vector<std::vector<uint8_t>> blocks;
+  for (size_t frame = 0; frame * kFrameSize < image.size(); ++frame) {
+    if (frame % kFramesPerBlock == 0) {
+      // Next block size and hash, filled in below.
+      blocks.emplace_back(24);
+    }
+    auto& block = blocks.back();
+    // Block type 3 (stored) and its 24-bit length, after the one bit header
+    // of the stream saying there's no x86 call translation. 16-bit words in
+    // little endian, with the bits read from the top of each.
+    uint32_t bits = frame ? (3u << 29) | (uint32_t(kFrameSize) << 5)
+                          : (3u << 28) | (uint32_t(kFrameSize) << 4);
+    const uint8_t frame_header[] = {
+        uint8_t(bits >> 16), uint8_t(bits >> 24), uint8_t(bits),
+        uint8_t(bits >> 8),
+        // Repeated match offsets R0-R2.
+        1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0,
+    };
+    size_t chunk_size = sizeof(frame_header) + kFrameSize;
+    block.push_back(uint8_t(chunk_size >> 8));
+    block.push_back(uint8_t(chunk_size));
+    block.insert(block.end(), frame_header, std::end(frame_header));
+    block.insert(block.end(), image.begin() + frame * kFrameSize,
+                 image.begin() + (frame + 1) * kFrameSize);
+    if (frame % kFramesPerBlock == kFramesPerBlock - 1 ||
+        (frame + 1) * kFrameSize >= image.size()) {
+      // No more chunks.
+      block.insert(block.end(), 2, 0);
+    }
+  }
+  std::vector<uint8_t> payload;
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    uint32_t next_size =
+        i + 1 < blocks.size() ? uint32_t(blocks[i + 1].size()) : 0;
+    Store32(blocks[i], 0, next_size);
+    payload.insert(payload.end(), blocks[i].begin(), blocks[i].end());
+  }
+  format_info->resize(0x24);
+  Store32(*format_info, 0, uint32_t(format_info->size()));
+  // Window size.
+  Store32(*format_info, 8, 0x8000);
+  Store32(*format_info, 12, uint32_t(blocks[0].size()));
+  return payload;
+}
+
+// Builds a XEX file holding image with the given compression and encryption.
+// The session key is wrapped with the devkit key, which is picked for images
+// without a title ID.
+std::vector<uint8_t> BuildXex(const std::vector<uint8_t>& image,
+                              xe_xex2_compression_type compression,
+                              bool encrypted) {
+  std::vector<uint8_t> format_info;
+  std::vector<uint8_t> payload;
+  switch (compression) {
+    case XEX_COMPRESSION_BASIC:
+      payload = MakeBasicPayload(image, &format_info);
+      break;
+    case XEX_COMPRESSION_NORMAL:
+      payload = MakeNormalPayload(image, &format_info);
+      break;
+    default:
+      REQUIRE(false);
+  }
+  Store16(format_info, 4, encrypted ? XEX_ENCRYPTION_NORMAL
+                                    : XEX_ENCRYPTION_NONE);
+  Store16(format_info, 6, uint16_t(compression));
+
+  const size_t kHeaderCount = 2;
+  const size_t format_info_offset = 0x18 + kHeaderCount * 8;
+  const size_t certificate_offset =
+      xe::round_up(format_info_offset + format_info.size(), size_t(16));
+  const size_t section_count = 1;
+  const size_t exe_offset = xe::round_up(
+      certificate_offset + 0x184 + section_count * 24, size_t(0x1000));
+  payload.resize(xe::round_up(payload.size(), size_t(16)));
+
+  std::vector<uint8_t> xex(exe_offset + payload.size());
+  Store32(xex, 0x00, 'XEX2');
+  Store32(xex, 0x08, uint32_t(exe_offset));
+  Store32(xex, 0x10, uint32_t(certificate_offset));
+  Store32(xex, 0x14, uint32_t(kHeaderCount));
+  Store32(xex, 0x18, XEX_HEADER_IMAGE_BASE_ADDRESS);
+  Store32(xex, 0x1C, kImageBase);
+  Store32(xex, 0x20, XEX_HEADER_FILE_FORMAT_INFO);
+  Store32(xex, 0x24, uint32_t(format_info_offset));
+  std::memcpy(&xex[format_info_offset], format_info.data(),
+              format_info.size());
+
+  Store32(xex, certificate_offset + 0x004, uint32_t(image.size()));
+  const uint8_t devkit_key[16] = {0};
+  const uint8_t zero_iv[16] = {0};
+  auto session_key = MakeData(16, 0x5E55);
+  AesCbcEncrypt(devkit_key, zero_iv, session_key.data(),
+                &xex[certificate_offset + 0x150], 16);
+  Store32(xex, certificate_offset + 0x180, uint32_t(section_count));
+  // Code section covering the whole image.
+  Store32(xex, certificate_offset + 0x184,
+          uint32_t(image.size() / kPageSize) << 4 | XEX_SECTION_CODE);
+
+  if (encrypted) {
+    AesCbcEncrypt(session_key.data(), zero_iv, payload.data(), &xex[exe_offset],
+                  payload.size());
+  } else {
+    std::memcpy(&xex[exe_offset], payload.data(), payload.size());
+  }
+  return xex;
+}
+
+// Loads a XEX and returns whether it produced image, leaving guest memory as
+// it found it.
+bool LoadXex(xe::Memory* memory, const std::vector<uint8_t>& xex,
+             const std::vector<uint8_t>* image) {
+  xe_xex2_ref ref = xe_xex2_load(memory, xex.data(), xex.size(), {0});
+  if (!ref) {
+    return false;
+  }
+  bool matches =
+      !image || std::memcmp(memory->TranslateVirtual(kImageBase),
+                            image->data(), image->size()) == 0;
+  xe_xex2_dealloc(ref);
+  memory->LookupHeap(kImageBase)->Release(kImageBase);
+  return matches;
+}
+
+const struct {
+  xe_xex2_compression_type compression;
+  bool encrypted;
+  const char* name;
+} kVariants[] = {
+    {XEX_COMPRESSION_BASIC, false, "basic"},
+    {XEX_COMPRESSION_BASIC, true, "basic encrypted"},
+    {XEX_COMPRESSION_NORMAL, false, "normal"},
+    {XEX_COMPRESSION_NORMAL, true, "normal encrypted"},
+};
+
+}  // namespace
+
+TEST_CASE("aes_cbc_decrypt", "AES-128-CBC") {
+  // FIPS-197 appendix C.1. One block with a zero IV is plain AES.
+  const uint8_t key[16] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                           0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F};
+  const uint8_t plaintext[16] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+                                 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB,
+                                 0xCC, 0xDD, 0xEE, 0xFF};
+  const uint8_t ciphertext[16] = {0x69, 0xC4, 0xE0, 0xD8, 0x6A, 0x7B,
+                                  0x04, 0x30, 0xD8, 0xCD, 0xB7, 0x80,
+                                  0x70, 0xB4, 0xC5, 0x5A};
+  const uint8_t zero_iv[16] = {0};
+  uint8_t block[16];
+  AesCbcEncrypt(key, zero_iv, plaintext, block, 16);
+  REQUIRE(std::memcmp(block, ciphertext, 16) == 0);
+
+  AesDecryptKey decrypt_key(key);
+  auto iv = MakeData(16, 1);
+  for (size_t p = 0; p < 2; ++p) {
+    if (!IsAesPathSupported(kAllPaths[p])) {
+      continue;
+    }
+    INFO(kPathNames[p]);
+    AesCbcDecrypt(decrypt_key, zero_iv, ciphertext, block, 16, kAllPaths[p],
+                  1);
+    REQUIRE(std::memcmp(block, plaintext, 16) == 0);
+
+    // Lengths around the 8 block groups, and past the size where the
+    // buffer is split between threads.
+    for (size_t length : {16, 112, 128, 144, 4096, 4 * 1024 * 1024 + 48}) {
+      auto expected = MakeData(length, uint32_t(length));
+      std::vector<uint8_t> encrypted(length);
+      AesCbcEncrypt(key, iv.data(), expected.data(), encrypted.data(),
+                    length);
+      for (uint32_t thread_count : {1, 3, 4}) {
+        std::vector<uint8_t> decrypted(length);
+        AesCbcDecrypt(decrypt_key, iv.data(), encrypted.data(),
+                      decrypted.data(), length, kAllPaths[p], thread_count);
+        REQUIRE(decrypted == expected);
+        // In place.
+        decrypted = encrypted;
+        AesCbcDecrypt(decrypt_key, iv.data(), decrypted.data(),
+                      decrypted.data(), length, kAllPaths[p], thread_count);
+        REQUIRE(decrypted == expected);
+      }
+    }
+  }
+
+  // Uneven ranges of one chain decrypted together, as XEX blocks are, with
+  // each IV the ciphertext before the range.
+  size_t length = 4 * 1024 * 1024 + 48;
+  auto expected = MakeData(length, 2);
+  std::vector<uint8_t> encrypted(length);
+  AesCbcEncrypt(key, iv.data(), expected.data(), encrypted.data(), length);
+  std::vector<AesCbcRange> ranges;
+  std::vector<uint8_t> decrypted(length);
+  for (size_t offset = 0, range_length = 16; offset < length;
+       offset += range_length, range_length *= 4) {
+    range_length = std::min(range_length, length - offset);
+    ranges.push_back({offset ? &encrypted[offset - 16] : iv.data(),
+                      &encrypted[offset], &decrypted[offset], range_length});
+  }
+  for (uint32_t thread_count : {1, 4}) {
+    std::fill(decrypted.begin(), decrypted.end(), uint8_t(0));
+    AesCbcDecrypt(decrypt_key, ranges, thread_count);
+    REQUIRE(decrypted == expected);
+  }
+}
+
+TEST_CASE("xex2_load", "XEX2") {
+  auto memory = std::make_unique<xe::Memory>();
+  REQUIRE(memory->Initialize() == 0);
+  // Five data runs with zero pages between them, the last one partial.
+  auto image = MakeImage(18);
+  for (auto& variant : kVariants) {
+    INFO(variant.name);
+    auto xex = BuildXex(image, variant.compression, variant.encrypted);
+    REQUIRE(LoadXex(memory.get(), xex, &image));
+  }
+}
+
+TEST_CASE("xex2_load_benchmark", "[.][benchmark]") {
+  auto memory = std::make_unique<xe::Memory>();
+  REQUIRE(memory->Initialize() == 0);
+  // About the size of a large title's executable.
+  const uint32_t kPageCount = 1024;
+  const int kLoads = 8;
+  auto image = MakeImage(kPageCount);
+  const double megabytes = image.size() / (1024.0 * 1024.0);
+
+  std::vector<uint8_t> ciphertext(image.size());
+  const uint8_t zero_iv[16] = {0};
+  AesCbcEncrypt(zero_iv, zero_iv, image.data(), ciphertext.data(),
+                image.size());
+  AesDecryptKey key(zero_iv);
+  for (size_t p = 0; p < 2; ++p) {
+    if (!IsAesPathSupported(kAllPaths[p])) {
+      continue;
+    }
+    for (uint32_t thread_count : {1, 4}) {
+      auto start = std::chrono::high_resolution_clock::now();
+      for (int i = 0; i < kLoads; ++i) {
+        AesCbcDecrypt(key, zero_iv, ciphertext.data(), image.data(),
+                      image.size(), kAllPaths[p], thread_count);
+      }
+      double seconds = std::chrono::duration<double>(
+                           std::chrono::high_resolution_clock::now() - start)
+                           .count();
+      std::printf("AES-128-CBC decrypt %s, %u threads: %.0f MB/s\n",
+                  kPathNames[p], thread_count, megabytes * kLoads / seconds);
+    }
+  }
+
+  image = MakeImage(kPageCount);
+  int32_t default_threads = FLAGS_xex_decrypt_threads;
+  for (auto& variant : kVariants) {
+    auto xex = BuildXex(image, variant.compression, variant.encrypted);
+    for (int32_t thread_count : {1, default_threads}) {
+      FLAGS_xex_decrypt_threads = thread_count;
+      REQUIRE(LoadXex(memory.get(), xex, &image));
+      auto start = std::chrono::high_resolution_clock::now();
+      for (int i = 0; i < kLoads; ++i) {
+        LoadXex(memory.get(), xex, nullptr);
+      }
+      double seconds = std::chrono::duration<double>(
+                           std::chrono::high_resolution_clock::now() - start)
+                           .count();
+      std::printf("XEX load %s, %d threads: %.1f ms for %.0f MB\n",
+                  variant.name, thread_count, seconds * 1000.0 / kLoads,
+                  megabytes);
+    }
+  }
+  FLAGS_xex_decrypt_threads = default_threads;
+}
@@ -131,6 +131,10 @@ dword_result_t NtCreateFile(lpdword_t handle_out, dword_t desired_access,
 
   X_HANDLE handle = X_INVALID_HANDLE_VALUE;
   if (XSUCCEEDED(result)) {
+    file->set_is_synchronous(
+        (create_options & (X_FILE_SYNCHRONOUS_IO_ALERT |
+                           X_FILE_SYNCHRONOUS_IO_NONALERT)) != 0);
+
     // Handle ref is incremented, so return that.
     handle = file->handle();
   }
@@ -156,14 +160,8 @@ dword_result_t NtOpenFile(lpdword_t handle_out, dword_t desired_access,
 }
 DECLARE_XBOXKRNL_EXPORT(NtOpenFile, ExportTag::kImplemented);
 
-class xeNtReadFileState {
- public:
-  uint32_t x;
-};
-void xeNtReadFileCompleted(XAsyncRequest* request, xeNtReadFileState* state) {
-  // TODO(benvanik): set io_status_block_ptr
+void xeNtReadFileCompleted(XAsyncRequest* request, void* context) {
   delete request;
-  delete state;
 }
 
 dword_result_t NtReadFile(dword_t file_handle, dword_t event_handle,
@@ -185,7 +183,7 @@ dword_result_t NtReadFile(dword_t file_handle, dword_t event_handle,
   }
 
   if (XSUCCEEDED(result)) {
-    if (true) {
+    if (file->is_synchronous() || FLAGS_io_worker_threads <= 0) {
       // Synchronous.
       size_t bytes_read = 0;
       result = file->Read(buffer, buffer_length,
@@ -212,23 +210,28 @@ dword_result_t NtReadFile(dword_t file_handle, dword_t event_handle,
       // we have written the info out.
       signal_event = true;
     } else {
-      // TODO: Async.
+      // Asynchronous: an I/O thread fills in the status block, signals the
+      // event and file and queues the APC once the read is done.
+      auto request = new XAsyncRequest(kernel_state(), file.get(),
+                                       xeNtReadFileCompleted, nullptr);
+      request->set_io_status_block(io_status_block.guest_address());
+      if (ev) {
+        // The event is only signaled once this read completes.
+        ev->Reset();
+        request->AddWaitEvent(ev.get());
+      }
+      if (((uint32_t)apc_routine_ptr & ~1) && apc_context) {
+        request->SetApc(XThread::GetCurrentThread(),
+                        (uint32_t)apc_routine_ptr & ~1, apc_context);
+      }
 
-      // X_STATUS_PENDING if not returning immediately.
-      // XFile is waitable and signalled after each async req completes.
-      // reset the input event (->Reset())
-      /*xeNtReadFileState* call_state = new xeNtReadFileState();
-      XAsyncRequest* request = new XAsyncRequest(
-      state, file,
-      (XAsyncRequest::CompletionCallback)xeNtReadFileCompleted,
-      call_state);*/
-      // result = file->Read(buffer, buffer_length, byte_offset, request);
+      // X_STATUS_PENDING until the I/O thread completes the request.
       if (io_status_block) {
         io_status_block->status = X_STATUS_PENDING;
         io_status_block->information = 0;
       }
-
-      result = X_STATUS_PENDING;
+      result = file->Read(buffer, buffer_length,
+                          byte_offset_ptr ? *byte_offset_ptr : -1, request);
     }
   }
 
@@ -295,7 +295,9 @@ struct X_RTL_CRITICAL_SECTION {
   xe::be<uint8_t> unk_00;              // 0x0
   xe::be<uint8_t> spin_count_div_256;  // 0x1
   xe::be<uint16_t> __padding0;         // 0x2
-  xe::be<uint32_t> unk_04;             // 0x4 maybe the handle to the event?
+  // 0x4 signal state of the embedded event. Set by a leaving owner to hand
+  // the lock to one waiter.
+  uint32_t signal_state;
   xe::be<uint32_t> queue_head;  // 0x8 head of queue, pointing to this offset
   xe::be<uint32_t> queue_tail;  // 0xC tail of queue?
   int32_t lock_count;           // 0x10 -1 -> 0 on first lock 0x10
@@ -309,6 +311,7 @@ void xeRtlInitializeCriticalSection(X_RTL_CRITICAL_SECTION* cs,
                                     uint32_t cs_ptr) {
   cs->unk_00 = 1;
   cs->spin_count_div_256 = 0;
+  cs->signal_state = 0;
   cs->queue_head = cs_ptr + 8;
   cs->queue_tail = cs_ptr + 8;
   cs->lock_count = -1;
@@ -333,6 +336,7 @@ X_STATUS xeRtlInitializeCriticalSectionAndSpinCount(X_RTL_CRITICAL_SECTION* cs,
 
   cs->unk_00 = 1;
   cs->spin_count_div_256 = spin_count_div_256;
+  cs->signal_state = 0;
   cs->queue_head = cs_ptr + 8;
   cs->queue_tail = cs_ptr + 8;
   cs->lock_count = -1;
@@ -350,40 +354,33 @@ dword_result_t RtlInitializeCriticalSectionAndSpinCount(
 DECLARE_XBOXKRNL_EXPORT(RtlInitializeCriticalSectionAndSpinCount,
                         ExportTag::kImplemented);
 
-SHIM_CALL RtlEnterCriticalSection_shim(PPCContext* ppc_context,
-                                       KernelState* kernel_state) {
-  // VOID
-  // _Inout_  LPCRITICAL_SECTION lpCriticalSection
-  uint32_t cs_ptr = SHIM_GET_ARG_32(0);
-
-  // XELOGD("RtlEnterCriticalSection(%.8X)", cs_ptr);
-
-  uint32_t thread_id = XThread::GetCurrentThreadId();
+void xeRtlEnterCriticalSection(X_RTL_CRITICAL_SECTION* cs,
+                               uint32_t thread_id) {
+  // If this thread already owns the CS increment the recursion count.
+  if (cs->owning_thread_id == thread_id) {
+    xe::atomic_inc(&cs->lock_count);
+    cs->recursion_count++;
+    return;
+  }
 
-  auto cs = (X_RTL_CRITICAL_SECTION*)SHIM_MEM_ADDR(cs_ptr);
+  // Spin for a bit first in case the owner is about to leave, as configured
+  // by RtlInitializeCriticalSectionAndSpinCount.
   uint32_t spin_wait_remaining = cs->spin_count_div_256 * 256;
-
-spin:
-  if (xe::atomic_inc(&cs->lock_count) != 0) {
-    // If this thread already owns the CS increment the recursion count.
-    if (cs->owning_thread_id == thread_id) {
-      cs->recursion_count++;
+  while (spin_wait_remaining--) {
+    if (*reinterpret_cast<volatile int32_t*>(&cs->lock_count) == -1 &&
+        xe::atomic_cas(-1, 0, &cs->lock_count)) {
+      cs->owning_thread_id = thread_id;
+      cs->recursion_count = 1;
       return;
     }
-    xe::atomic_dec(&cs->lock_count);
+  }
 
-    // Thread was locked - spin wait.
-    if (spin_wait_remaining) {
-      spin_wait_remaining--;
-      goto spin;
+  if (xe::atomic_inc(&cs->lock_count) != 0) {
+    // Contended. We stay counted in lock_count, so whoever leaves next sees
+    // a waiter and signals the event, handing the lock to exactly one of us.
+    while (!xe::atomic_cas(1u, 0u, &cs->signal_state)) {
+      xe::threading::WaitOnAddress(&cs->signal_state, 0);
     }
-
-    // All out of spin waits, create a full waiter.
-    // TODO(benvanik): contention - do a real wait!
-    // XELOGE("RtlEnterCriticalSection tried to really lock!");
-    spin_wait_remaining = 0;  // HACK: spin forever
-    xe::threading::MaybeYield();
-    goto spin;
   }
 
   // Now own the lock.
@@ -391,45 +388,22 @@ spin:
   cs->recursion_count = 1;
 }
 
-SHIM_CALL RtlTryEnterCriticalSection_shim(PPCContext* ppc_context,
-                                          KernelState* kernel_state) {
-  // DWORD
-  // _Inout_  LPCRITICAL_SECTION lpCriticalSection
-  uint32_t cs_ptr = SHIM_GET_ARG_32(0);
-
-  // XELOGD("RtlTryEnterCriticalSection(%.8X)", cs_ptr);
-
-  uint32_t thread_id = XThread::GetCurrentThreadId();
-
-  auto cs = (X_RTL_CRITICAL_SECTION*)SHIM_MEM_ADDR(cs_ptr);
-
-  uint32_t result = 0;
+bool xeRtlTryEnterCriticalSection(X_RTL_CRITICAL_SECTION* cs,
+                                  uint32_t thread_id) {
   if (xe::atomic_cas(-1, 0, &cs->lock_count)) {
     // Able to steal the lock right away.
     cs->owning_thread_id = thread_id;
     cs->recursion_count = 1;
-    result = 1;
+    return true;
   } else if (cs->owning_thread_id == thread_id) {
     xe::atomic_inc(&cs->lock_count);
     ++cs->recursion_count;
-    result = 1;
+    return true;
   }
-  SHIM_SET_RETURN_32(result);
+  return false;
 }
 
-SHIM_CALL RtlLeaveCriticalSection_shim(PPCContext* ppc_context,
-                                       KernelState* kernel_state) {
-  // VOID
-  // _Inout_  LPCRITICAL_SECTION lpCriticalSection
-  uint32_t cs_ptr = SHIM_GET_ARG_32(0);
-
-  // XELOGD("RtlLeaveCriticalSection(%.8X)", cs_ptr);
-
-  // FYI: No need to check if the owning thread is calling this, as that should
-  // be the only case.
-
-  auto cs = (X_RTL_CRITICAL_SECTION*)SHIM_MEM_ADDR(cs_ptr);
-
+void xeRtlLeaveCriticalSection(X_RTL_CRITICAL_SECTION* cs) {
   // Drop recursion count - if we are still not zero'ed return.
   int32_t recursion_count = --cs->recursion_count;
   assert_true(recursion_count > -1);
@@ -444,9 +418,50 @@ SHIM_CALL RtlLeaveCriticalSection_shim(PPCContext* ppc_context,
   cs->owning_thread_id = 0;
   if (xe::atomic_dec(&cs->lock_count) != -1) {
     // There were waiters - wake one of them.
-    // TODO(benvanik): wake a waiter.
-    XELOGE("RtlLeaveCriticalSection would have woken a waiter");
+    xe::atomic_exchange(1u, &cs->signal_state);
+    xe::threading::WakeOneOnAddress(&cs->signal_state);
   }
+}
+
+SHIM_CALL RtlEnterCriticalSection_shim(PPCContext* ppc_context,
+                                       KernelState* kernel_state) {
+  // VOID
+  // _Inout_  LPCRITICAL_SECTION lpCriticalSection
+  uint32_t cs_ptr = SHIM_GET_ARG_32(0);
+
+  // XELOGD("RtlEnterCriticalSection(%.8X)", cs_ptr);
+
+  auto cs = (X_RTL_CRITICAL_SECTION*)SHIM_MEM_ADDR(cs_ptr);
+  xeRtlEnterCriticalSection(cs, XThread::GetCurrentThreadId());
+}
+
+SHIM_CALL RtlTryEnterCriticalSection_shim(PPCContext* ppc_context,
+                                          KernelState* kernel_state) {
+  // DWORD
+  // _Inout_  LPCRITICAL_SECTION lpCriticalSection
+  uint32_t cs_ptr = SHIM_GET_ARG_32(0);
+
+  // XELOGD("RtlTryEnterCriticalSection(%.8X)", cs_ptr);
+
+  auto cs = (X_RTL_CRITICAL_SECTION*)SHIM_MEM_ADDR(cs_ptr);
+  uint32_t result =
+      xeRtlTryEnterCriticalSection(cs, XThread::GetCurrentThreadId()) ? 1 : 0;
+  SHIM_SET_RETURN_32(result);
+}
+
+SHIM_CALL RtlLeaveCriticalSection_shim(PPCContext* ppc_context,
+                                       KernelState* kernel_state) {
+  // VOID
+  // _Inout_  LPCRITICAL_SECTION lpCriticalSection
+  uint32_t cs_ptr = SHIM_GET_ARG_32(0);
+
+  // XELOGD("RtlLeaveCriticalSection(%.8X)", cs_ptr);
+
+  // FYI: No need to check if the owning thread is calling this, as that should
+  // be the only case.
+
+  auto cs = (X_RTL_CRITICAL_SECTION*)SHIM_MEM_ADDR(cs_ptr);
+  xeRtlLeaveCriticalSection(cs);
 
   XThread::GetCurrentThread()->CheckApcs();
 }
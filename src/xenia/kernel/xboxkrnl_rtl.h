@@ -23,6 +23,13 @@ X_STATUS xeRtlInitializeCriticalSectionAndSpinCount(X_RTL_CRITICAL_SECTION* cs,
                                                     uint32_t cs_ptr,
                                                     uint32_t spin_count);
 
+// Critical section operations on behalf of the given guest thread. Contended
+// enters park the host thread until a leave hands the lock over.
+void xeRtlEnterCriticalSection(X_RTL_CRITICAL_SECTION* cs, uint32_t thread_id);
+bool xeRtlTryEnterCriticalSection(X_RTL_CRITICAL_SECTION* cs,
+                                  uint32_t thread_id);
+void xeRtlLeaveCriticalSection(X_RTL_CRITICAL_SECTION* cs);
+
 }  // namespace kernel
 }  // namespace xe
 
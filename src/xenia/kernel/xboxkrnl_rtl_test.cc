@@ -0,0 +1,102 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "third_party/catch/include/catch.hpp"
+#include "xenia/kernel/xboxkrnl_rtl.h"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace xe::kernel;
+
+namespace {
+
+// Critical sections are opaque 28 byte blocks of guest memory.
+struct GuestCriticalSection {
+  GuestCriticalSection(uint32_t spin_count) {
+    xeRtlInitializeCriticalSectionAndSpinCount(cs(), 0x80001000, spin_count);
+  }
+  X_RTL_CRITICAL_SECTION* cs() {
+    return reinterpret_cast<X_RTL_CRITICAL_SECTION*>(storage);
+  }
+  alignas(8) uint8_t storage[28];
+};
+
+// Each thread bumps a shared counter under the lock, with a little work
+// inside and outside of it. Returns acquisitions per second.
+double RunContention(uint32_t spin_count, uint32_t thread_count,
+                     uint32_t iterations, uint64_t* out_counter) {
+  GuestCriticalSection lock(spin_count);
+  uint64_t counter = 0;
+  std::vector<std::thread> threads;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threads.emplace_back([&, i] {
+      uint32_t thread_id = 0x100 + i;
+      volatile uint32_t scratch = 0;
+      for (uint32_t j = 0; j < iterations; ++j) {
+        xeRtlEnterCriticalSection(lock.cs(), thread_id);
+        // Recursive acquires must not deadlock.
+        xeRtlEnterCriticalSection(lock.cs(), thread_id);
+        uint64_t value = counter;
+        for (int k = 0; k < 16; ++k) {
+          scratch = scratch + k;
+        }
+        counter = value + 1;
+        xeRtlLeaveCriticalSection(lock.cs());
+        xeRtlLeaveCriticalSection(lock.cs());
+        for (int k = 0; k < 64; ++k) {
+          scratch = scratch + k;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  *out_counter = counter;
+  double seconds = std::chrono::duration<double>(end - start).count();
+  return thread_count * iterations / seconds;
+}
+
+}  // namespace
+
+TEST_CASE("CRITICAL_SECTION_TRY_ENTER", "[rtl]") {
+  GuestCriticalSection lock(0);
+  REQUIRE(xeRtlTryEnterCriticalSection(lock.cs(), 1));
+  REQUIRE(xeRtlTryEnterCriticalSection(lock.cs(), 1));
+  REQUIRE_FALSE(xeRtlTryEnterCriticalSection(lock.cs(), 2));
+  xeRtlLeaveCriticalSection(lock.cs());
+  REQUIRE_FALSE(xeRtlTryEnterCriticalSection(lock.cs(), 2));
+  xeRtlLeaveCriticalSection(lock.cs());
+  REQUIRE(xeRtlTryEnterCriticalSection(lock.cs(), 2));
+  xeRtlLeaveCriticalSection(lock.cs());
+}
+
+TEST_CASE("CRITICAL_SECTION_CONTENTION", "[rtl]") {
+  for (uint32_t spin_count : {0, 4000}) {
+    uint64_t counter;
+    RunContention(spin_count, 4, 20000, &counter);
+    REQUIRE(counter == 4 * 20000);
+  }
+}
+
+TEST_CASE("CRITICAL_SECTION_BENCHMARK", "[.][benchmark]") {
+  for (uint32_t spin_count : {0, 1024, 4000}) {
+    for (uint32_t thread_count : {1, 2, 4, 8}) {
+      uint64_t counter;
+      double rate = RunContention(spin_count, thread_count, 200000, &counter);
+      std::printf("spin %4u, %u threads: %.2f M acquisitions/s\n", spin_count,
+                  thread_count, rate / 1000000.0);
+    }
+  }
+}
@@ -11,6 +11,7 @@
 #include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/mutex.h"
+#include "xenia/base/threading.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/kernel/dispatcher.h"
 #include "xenia/kernel/kernel_state.h"
@@ -961,6 +962,30 @@ SHIM_CALL NtSignalAndWaitForSingleObjectEx_shim(PPCContext* ppc_context,
   SHIM_SET_RETURN_32(result);
 }
 
+// Spin locks are a single word: 0 when free, 1 when held and 2 when held
+// with threads parked on it.
+void xeKeAcquireSpinLock(uint32_t* lock) {
+  // Spin locks are held briefly, so try a while before parking.
+  for (uint32_t i = 0; i < 1024; ++i) {
+    if (*reinterpret_cast<volatile uint32_t*>(lock) == 0 &&
+        xe::atomic_cas(0u, 1u, lock)) {
+      return;
+    }
+  }
+  // Titles may release with a plain store rather than through the kernel, in
+  // which case nobody wakes us, so don't park for long.
+  // TODO(benvanik): error on deadlock?
+  while (xe::atomic_exchange(2u, lock) != 0) {
+    xe::threading::WaitOnAddress(lock, 2, std::chrono::milliseconds(1));
+  }
+}
+
+void xeKeReleaseSpinLock(uint32_t* lock) {
+  if (xe::atomic_exchange(0u, lock) == 2) {
+    xe::threading::WakeOneOnAddress(lock);
+  }
+}
+
 SHIM_CALL KfAcquireSpinLock_shim(PPCContext* ppc_context,
                                  KernelState* kernel_state) {
   uint32_t lock_ptr = SHIM_GET_ARG_32(0);
@@ -971,11 +996,7 @@ SHIM_CALL KfAcquireSpinLock_shim(PPCContext* ppc_context,
 
   // Lock.
   auto lock = reinterpret_cast<uint32_t*>(SHIM_MEM_ADDR(lock_ptr));
-  while (!xe::atomic_cas(0, 1, lock)) {
-    // Spin!
-    // TODO(benvanik): error on deadlock?
-    xe::threading::MaybeYield();
-  }
+  xeKeAcquireSpinLock(lock);
 
   // Raise IRQL to DISPATCH.
   XThread* thread = XThread::GetCurrentThread();
@@ -1000,7 +1021,7 @@ SHIM_CALL KfReleaseSpinLock_shim(PPCContext* ppc_context,
 
   // Unlock.
   auto lock = reinterpret_cast<uint32_t*>(SHIM_MEM_ADDR(lock_ptr));
-  xe::atomic_dec(lock);
+  xeKeReleaseSpinLock(lock);
 }
 
 SHIM_CALL KeAcquireSpinLockAtRaisedIrql_shim(PPCContext* ppc_context,
@@ -1013,10 +1034,7 @@ SHIM_CALL KeAcquireSpinLockAtRaisedIrql_shim(PPCContext* ppc_context,
 
   // Lock.
   auto lock = reinterpret_cast<uint32_t*>(SHIM_MEM_ADDR(lock_ptr));
-  while (!xe::atomic_cas(0, 1, lock)) {
-    // Spin!
-    // TODO(benvanik): error on deadlock?
-  }
+  xeKeAcquireSpinLock(lock);
 }
 
 SHIM_CALL KeReleaseSpinLockFromRaisedIrql_shim(PPCContext* ppc_context,
@@ -1029,7 +1047,7 @@ SHIM_CALL KeReleaseSpinLockFromRaisedIrql_shim(PPCContext* ppc_context,
 
   // Unlock.
   auto lock = reinterpret_cast<uint32_t*>(SHIM_MEM_ADDR(lock_ptr));
-  xe::atomic_dec(lock);
+  xeKeReleaseSpinLock(lock);
 }
 
 SHIM_CALL KeEnterCriticalRegion_shim(PPCContext* ppc_context,
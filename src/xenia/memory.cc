@@ -445,6 +445,63 @@ void BaseHeap::Initialize(uint8_t* membase, uint32_t heap_base,
   heap_size_ = heap_size - 1;
   page_size_ = page_size;
   page_table_.resize(heap_size / page_size);
+  free_extents_.clear();
+  free_extents_.emplace(0, uint32_t(page_table_.size()));
+}
+
+void BaseHeap::MarkPagesFree(uint32_t start_page_number, uint32_t page_count) {
+  if (!page_count) {
+    return;
+  }
+  uint32_t end_page_number = start_page_number + page_count;
+  // Absorb following extents that touch or overlap the range.
+  auto next_it = free_extents_.lower_bound(start_page_number);
+  while (next_it != free_extents_.end() &&
+         next_it->first <= end_page_number) {
+    end_page_number =
+        std::max(end_page_number, next_it->first + next_it->second);
+    next_it = free_extents_.erase(next_it);
+  }
+  // And the preceding one, if it reaches the range.
+  if (next_it != free_extents_.begin()) {
+    auto prev_it = std::prev(next_it);
+    if (prev_it->first + prev_it->second >= start_page_number) {
+      start_page_number = prev_it->first;
+      end_page_number =
+          std::max(end_page_number, prev_it->first + prev_it->second);
+      free_extents_.erase(prev_it);
+    }
+  }
+  free_extents_.emplace_hint(next_it, start_page_number,
+                             end_page_number - start_page_number);
+}
+
+void BaseHeap::MarkPagesUsed(uint32_t start_page_number, uint32_t page_count) {
+  uint32_t end_page_number = start_page_number + page_count;
+  // Start from the extent that may contain the first page.
+  auto it = free_extents_.upper_bound(start_page_number);
+  if (it != free_extents_.begin()) {
+    --it;
+  }
+  while (it != free_extents_.end() && it->first < end_page_number) {
+    uint32_t extent_start = it->first;
+    uint32_t extent_end = it->first + it->second;
+    if (extent_end <= start_page_number) {
+      ++it;
+      continue;
+    }
+    // Cut the range out, keeping whatever is left on either side.
+    it = free_extents_.erase(it);
+    if (extent_start < start_page_number) {
+      free_extents_.emplace_hint(it, extent_start,
+                                 start_page_number - extent_start);
+    }
+    if (extent_end > end_page_number) {
+      free_extents_.emplace_hint(it, end_page_number,
+                                 extent_end - end_page_number);
+      break;
+    }
+  }
 }
 
 void BaseHeap::Dispose() {
@@ -594,6 +651,7 @@ bool BaseHeap::AllocFixed(uint32_t base_address, uint32_t size,
     page_entry.current_protect = protect;
     page_entry.state = kMemoryAllocationReserve | allocation_type;
   }
+  MarkPagesUsed(start_page_number, page_count);
 
   return true;
 }
@@ -623,76 +681,55 @@ bool BaseHeap::AllocRange(uint32_t low_address, uint32_t high_address,
   std::lock_guard<xe::recursive_mutex> lock(heap_mutex_);
 
   // Find a free page range.
-  // The base page must match the requested alignment, so we first scan for
-  // a free aligned page and only then check for continuous free pages.
-  // TODO(benvanik): optimized searching (free list buckets, bitmap, etc).
+  // The base page must match the requested alignment, so within each free
+  // extent only the first (or last, going top-down) aligned base can fit.
   uint32_t start_page_number = UINT_MAX;
   uint32_t end_page_number = UINT_MAX;
   uint32_t page_scan_stride = alignment / page_size_;
   high_page_number = high_page_number - (high_page_number % page_scan_stride);
   if (top_down) {
-    for (int64_t base_page_number = high_page_number - page_count;
-         base_page_number >= low_page_number;
-         base_page_number -= page_scan_stride) {
-      if (page_table_[base_page_number].state != 0) {
-        // Base page not free, skip to next usable page.
-        continue;
+    auto it = free_extents_.lower_bound(high_page_number);
+    while (it != free_extents_.begin()) {
+      --it;
+      if (it->first + it->second <= low_page_number) {
+        // This and all lower extents are below the range.
+        break;
       }
-      // Check requested range to ensure free.
-      start_page_number = uint32_t(base_page_number);
-      end_page_number = uint32_t(base_page_number) + page_count - 1;
-      assert_true(end_page_number < page_table_.size());
-      bool any_taken = false;
-      for (uint32_t page_number = uint32_t(base_page_number);
-           !any_taken && page_number <= end_page_number; ++page_number) {
-        bool is_free = page_table_[page_number].state == 0;
-        if (!is_free) {
-          // At least one page in the range is used, skip to next.
-          // We know we'll be starting at least before this page.
-          any_taken = true;
-          base_page_number = page_number - page_count;
-          base_page_number -= base_page_number % page_scan_stride;
-          base_page_number += page_scan_stride;  // cancel out loop logic
-          break;
-        }
+      uint32_t extent_start = std::max(it->first, low_page_number);
+      uint32_t extent_end = std::min(it->first + it->second, high_page_number);
+      if (extent_end - extent_start < page_count) {
+        continue;
       }
-      if (!any_taken) {
+      uint32_t base_page_number = extent_end - page_count;
+      base_page_number -= base_page_number % page_scan_stride;
+      if (base_page_number >= extent_start) {
         // Found our place.
+        start_page_number = base_page_number;
+        end_page_number = base_page_number + page_count - 1;
         break;
       }
-      // Retry.
-      start_page_number = end_page_number = UINT_MAX;
     }
   } else {
-    for (uint32_t base_page_number = low_page_number;
-         base_page_number <= high_page_number - page_count;
-         base_page_number += page_scan_stride) {
-      if (page_table_[base_page_number].state != 0) {
-        // Base page not free, skip to next usable page.
+    auto it = free_extents_.upper_bound(low_page_number);
+    if (it != free_extents_.begin()) {
+      --it;
+    }
+    for (; it != free_extents_.end() && it->first < high_page_number; ++it) {
+      uint32_t extent_start = std::max(it->first, low_page_number);
+      uint32_t extent_end = std::min(it->first + it->second, high_page_number);
+      if (extent_end <= extent_start) {
         continue;
       }
-      // Check requested range to ensure free.
-      start_page_number = base_page_number;
-      end_page_number = base_page_number + page_count - 1;
-      bool any_taken = false;
-      for (uint32_t page_number = base_page_number;
-           !any_taken && page_number <= end_page_number; ++page_number) {
-        bool is_free = page_table_[page_number].state == 0;
-        if (!is_free) {
-          // At least one page in the range is used, skip to next.
-          // We know we'll be starting at least after this page.
-          any_taken = true;
-          base_page_number = xe::round_up(page_number + 1, page_scan_stride);
-          base_page_number -= page_scan_stride;  // cancel out loop logic
-          break;
-        }
-      }
-      if (!any_taken) {
+      uint32_t base_page_number =
+          (extent_start + page_scan_stride - 1) / page_scan_stride *
+          page_scan_stride;
+      if (base_page_number < extent_end &&
+          extent_end - base_page_number >= page_count) {
         // Found our place.
+        start_page_number = base_page_number;
+        end_page_number = base_page_number + page_count - 1;
         break;
       }
-      // Retry.
-      start_page_number = end_page_number = UINT_MAX;
     }
   }
   if (start_page_number == UINT_MAX || end_page_number == UINT_MAX) {
@@ -732,6 +769,7 @@ bool BaseHeap::AllocRange(uint32_t low_address, uint32_t high_address,
     page_entry.current_protect = protect;
     page_entry.state = kMemoryAllocationReserve | allocation_type;
   }
+  MarkPagesUsed(start_page_number, page_count);
 
   *out_address = heap_base_ + (start_page_number * page_size_);
   return true;
@@ -813,6 +851,7 @@ bool BaseHeap::Release(uint32_t base_address, uint32_t* out_region_size) {
     auto& page_entry = page_table_[page_number];
     page_entry.qword = 0;
   }
+  MarkPagesFree(base_page_number, base_page_entry.region_page_count);
 
   return true;
 }
@@ -907,16 +946,12 @@ bool BaseHeap::QueryRegionInfo(uint32_t base_address,
       out_info->region_size += page_size_;
     }
   } else {
-    // Free region.
-    for (uint32_t page_number = start_page_number;
-         page_number < page_table_.size(); ++page_number) {
-      auto page_entry = page_table_[page_number];
-      if (page_entry.state) {
-        // First non-free page; done with region.
-        break;
-      }
-      out_info->region_size += page_size_;
-    }
+    // Free region, which runs to the end of its extent.
+    auto it = free_extents_.upper_bound(start_page_number);
+    assert_true(it != free_extents_.begin());
+    --it;
+    out_info->region_size =
+        (it->first + it->second - start_page_number) * page_size_;
   }
   return true;
 }
@@ -11,6 +11,7 @@
 #define XENIA_MEMORY_H_
 
 #include <cstdint>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -111,11 +112,20 @@ class BaseHeap {
   void Initialize(uint8_t* membase, uint32_t heap_base, uint32_t heap_size,
                   uint32_t page_size);
 
+  // Keep free_extents_ in sync with page_table_ as pages become free or
+  // used. Require heap_mutex_.
+  void MarkPagesFree(uint32_t start_page_number, uint32_t page_count);
+  void MarkPagesUsed(uint32_t start_page_number, uint32_t page_count);
+
   uint8_t* membase_;
   uint32_t heap_base_;
   uint32_t heap_size_;
   uint32_t page_size_;
   std::vector<PageEntry> page_table_;
+  // Runs of free pages as start page -> page count, coalesced so that no two
+  // runs touch. Lets allocations skip over used regions without walking
+  // their pages.
+  std::map<uint32_t, uint32_t> free_extents_;
   xe::recursive_mutex heap_mutex_;
 };
 
@@ -14,7 +14,8 @@
 namespace xe {
 namespace vfs {
 
-Device::Device(const std::string& mount_path) : mount_path_(mount_path) {}
+Device::Device(const std::string& mount_path)
+    : mount_path_(mount_path), generation_(0) {}
 
 Device::~Device() = default;
 
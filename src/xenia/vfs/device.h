@@ -10,6 +10,7 @@
 #ifndef XENIA_VFS_DEVICE_H_
 #define XENIA_VFS_DEVICE_H_
 
+#include <atomic>
 #include <memory>
 #include <string>
 
@@ -33,6 +34,11 @@ class Device {
 
   virtual bool is_read_only() const { return true; }
 
+  // Changes whenever an entry is deleted, so that holders of cached Entry
+  // pointers can tell when they may be stale.
+  uint32_t generation() const { return generation_; }
+  void IncrementGeneration() { ++generation_; }
+
   Entry* ResolvePath(std::string path);
 
   virtual uint32_t total_allocation_units() const = 0;
@@ -44,6 +50,7 @@ class Device {
   xe::recursive_mutex mutex_;
   std::string mount_path_;
   std::unique_ptr<Entry> root_entry_;
+  std::atomic<uint32_t> generation_;
 };
 
 }  // namespace vfs
@@ -16,6 +16,9 @@
 namespace xe {
 namespace vfs {
 
+// Directories with fewer children than this are searched linearly.
+const size_t kChildIndexThreshold = 16;
+
 Entry::Entry(Device* device, Entry* parent, const std::string& path)
     : device_(device),
       parent_(parent),
@@ -48,13 +51,23 @@ bool Entry::is_read_only() const { return device_->is_read_only(); }
 
 Entry* Entry::GetChild(std::string name) {
   std::lock_guard<xe::recursive_mutex> lock(device_->mutex());
-  // TODO(benvanik): a faster search
-  for (auto& child : children_) {
-    if (strcasecmp(child->name().c_str(), name.c_str()) == 0) {
-      return child.get();
+  if (children_.size() < kChildIndexThreshold) {
+    for (auto& child : children_) {
+      if (strcasecmp(child->name().c_str(), name.c_str()) == 0) {
+        return child.get();
+      }
     }
+    return nullptr;
   }
-  return nullptr;
+
+  // Pick up any children added since the last lookup. emplace keeps the first
+  // of several names differing only in case, as the linear search would.
+  for (; indexed_child_count_ < children_.size(); ++indexed_child_count_) {
+    auto child = children_[indexed_child_count_].get();
+    child_index_.emplace(xe::to_lower_ascii(child->name()), child);
+  }
+  auto it = child_index_.find(xe::to_lower_ascii(std::move(name)));
+  return it != child_index_.end() ? it->second : nullptr;
 }
 
 Entry* Entry::IterateChildren(const xe::filesystem::WildcardEngine& engine,
@@ -106,6 +119,9 @@ bool Entry::Delete(Entry* entry) {
       break;
     }
   }
+  child_index_.clear();
+  indexed_child_count_ = 0;
+  device_->IncrementGeneration();
   Touch();
   return true;
 }
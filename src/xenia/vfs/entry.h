@@ -12,6 +12,7 @@
 
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "xenia/base/filesystem.h"
@@ -141,6 +142,13 @@ class Entry {
   uint64_t access_timestamp_;
   uint64_t write_timestamp_;
   std::vector<std::unique_ptr<Entry>> children_;
+
+ private:
+  // Case-folded name to child, covering children_[0, indexed_child_count_).
+  // Devices append to children_ directly, so the index is built lazily by
+  // GetChild and only for directories large enough to need it.
+  std::unordered_map<std::string, Entry*> child_index_;
+  size_t indexed_child_count_ = 0;
 };
 
 }  // namespace vfs
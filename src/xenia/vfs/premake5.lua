@@ -14,3 +14,12 @@ project("xenia-vfs")
   includedirs({
   })
   recursive_platform_files()
+
+test_suite("xenia-vfs-tests", project_root, ".", {
+  includedirs = {
+  },
+  links = {
+    "xenia-base",
+    "xenia-vfs",
+  },
+})
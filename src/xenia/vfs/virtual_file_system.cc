@@ -29,6 +29,7 @@ VirtualFileSystem::~VirtualFileSystem() {
 bool VirtualFileSystem::RegisterDevice(std::unique_ptr<Device> device) {
   std::lock_guard<xe::mutex> lock(mutex_);
   devices_.emplace_back(std::move(device));
+  resolved_paths_.clear();
   return true;
 }
 
@@ -36,6 +37,7 @@ bool VirtualFileSystem::RegisterSymbolicLink(std::string path,
                                              std::string target) {
   std::lock_guard<xe::mutex> lock(mutex_);
   symlinks_.insert({path, target});
+  resolved_paths_.clear();
   return true;
 }
 
@@ -46,6 +48,7 @@ bool VirtualFileSystem::UnregisterSymbolicLink(std::string path) {
     return false;
   }
   symlinks_.erase(it);
+  resolved_paths_.clear();
   return true;
 }
 
@@ -55,6 +58,32 @@ Entry* VirtualFileSystem::ResolvePath(std::string path) {
   // Resolve relative paths
   std::string normalized_path(xe::filesystem::CanonicalizePath(path));
 
+  auto key = xe::to_lower_ascii(normalized_path);
+  auto it = resolved_paths_.find(key);
+  if (it != resolved_paths_.end() &&
+      it->second.device->generation() == it->second.generation) {
+    return it->second.entry;
+  }
+
+  std::string relative_path;
+  auto device = FindDevice(path, normalized_path, &relative_path);
+  if (!device) {
+    return nullptr;
+  }
+
+  // Read the generation before walking, so that a delete racing with the walk
+  // leaves the cached result stale rather than dangling.
+  uint32_t generation = device->generation();
+  auto entry = device->ResolvePath(relative_path);
+  if (entry) {
+    resolved_paths_[std::move(key)] = {device, generation, entry};
+  }
+  return entry;
+}
+
+Device* VirtualFileSystem::FindDevice(const std::string& path,
+                                      const std::string& normalized_path,
+                                      std::string* out_relative_path) {
   // Resolve symlinks.
   std::string device_path;
   std::string relative_path;
@@ -85,7 +114,8 @@ Entry* VirtualFileSystem::ResolvePath(std::string path) {
   // Scan all devices.
   for (auto& device : devices_) {
     if (strcasecmp(device_path.c_str(), device->mount_path().c_str()) == 0) {
-      return device->ResolvePath(relative_path);
+      *out_relative_path = std::move(relative_path);
+      return device.get();
     }
   }
 
@@ -45,9 +45,23 @@ class VirtualFileSystem {
                     FileAction* out_action);
 
  private:
+  // Finds the device owning the canonical path and the path within it.
+  Device* FindDevice(const std::string& path,
+                     const std::string& normalized_path,
+                     std::string* out_relative_path);
+
   xe::mutex mutex_;
   std::vector<std::unique_ptr<Device>> devices_;
   std::unordered_map<std::string, std::string> symlinks_;
+
+  // Successful resolutions keyed by case-folded canonical path. An entry is
+  // only trusted while its device generation is unchanged.
+  struct ResolvedPath {
+    Device* device;
+    uint32_t generation;
+    Entry* entry;
+  };
+  std::unordered_map<std::string, ResolvedPath> resolved_paths_;
 };
 
 }  // namespace vfs
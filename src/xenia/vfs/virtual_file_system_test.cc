@@ -0,0 +1,150 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "third_party/catch/include/catch.hpp"
+#include "xenia/vfs/virtual_file_system.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace xe;
+using namespace xe::vfs;
+
+namespace {
+
+// In-memory tree that can't be opened, for exercising path lookups.
+class TestEntry : public Entry {
+ public:
+  TestEntry(Device* device, Entry* parent, const std::string& path,
+            uint32_t attributes)
+      : Entry(device, parent, path) {
+    attributes_ = attributes;
+  }
+
+  TestEntry* AddChild(const std::string& name, uint32_t attributes) {
+    auto entry = static_cast<TestEntry*>(
+        CreateEntryInternal(name, attributes).release());
+    children_.emplace_back(entry);
+    return entry;
+  }
+
+  X_STATUS Open(KernelState* kernel_state, uint32_t desired_access,
+                object_ref<XFile>* out_file) override {
+    return X_STATUS_ACCESS_DENIED;
+  }
+
+ protected:
+  std::unique_ptr<Entry> CreateEntryInternal(std::string name,
+                                             uint32_t attributes) override {
+    return std::make_unique<TestEntry>(
+        device_, this, xe::join_paths(path_, name), attributes);
+  }
+  bool DeleteEntryInternal(Entry* entry) override { return true; }
+};
+
+class TestDevice : public Device {
+ public:
+  explicit TestDevice(const std::string& mount_path) : Device(mount_path) {}
+
+  bool Initialize() override {
+    root_entry_.reset(
+        new TestEntry(this, nullptr, "", kFileAttributeDirectory));
+    return true;
+  }
+
+  bool is_read_only() const override { return false; }
+
+  TestEntry* root() { return static_cast<TestEntry*>(root_entry_.get()); }
+
+  uint32_t total_allocation_units() const override { return 0; }
+  uint32_t available_allocation_units() const override { return 0; }
+  uint32_t sectors_per_allocation_unit() const override { return 0; }
+  uint32_t bytes_per_sector() const override { return 0; }
+};
+
+// Builds \Device\Test\dir<i>\file<j> with the given number of files in total,
+// spread over directories of files_per_dir, and returns every file path.
+std::vector<std::string> BuildTree(VirtualFileSystem* vfs, size_t file_count,
+                                   size_t files_per_dir) {
+  auto device = new TestDevice("\\Device\\Test");
+  REQUIRE(device->Initialize());
+  std::vector<std::string> paths;
+  TestEntry* dir = nullptr;
+  for (size_t i = 0; i < file_count; ++i) {
+    if (i % files_per_dir == 0) {
+      dir = device->root()->AddChild(
+          "Dir" + std::to_string(i / files_per_dir), kFileAttributeDirectory);
+    }
+    auto name = "File" + std::to_string(i) + ".bin";
+    dir->AddChild(name, kFileAttributeNormal);
+    paths.push_back("game:\\" + dir->name() + "\\" + name);
+  }
+  vfs->RegisterDevice(std::unique_ptr<Device>(device));
+  vfs->RegisterSymbolicLink("game:", "\\Device\\Test");
+  return paths;
+}
+
+}  // namespace
+
+TEST_CASE("VFS_RESOLVE_CASE_INSENSITIVE", "[vfs]") {
+  VirtualFileSystem vfs;
+  // Large enough directories to be indexed.
+  auto paths = BuildTree(&vfs, 1000, 100);
+
+  auto entry = vfs.ResolvePath("game:\\Dir3\\File350.bin");
+  REQUIRE(entry != nullptr);
+  REQUIRE(entry->name() == "File350.bin");
+  REQUIRE(vfs.ResolvePath("GAME:\\dir3\\FILE350.BIN") == entry);
+  REQUIRE(vfs.ResolvePath("game:\\Dir3\\.\\File350.bin") == entry);
+  REQUIRE(vfs.ResolvePath("\\Device\\Test\\Dir3\\File350.bin") == entry);
+  REQUIRE(vfs.ResolvePath("game:\\Dir3\\File9999.bin") == nullptr);
+  REQUIRE(vfs.ResolvePath("game:\\Dir4\\File350.bin") == nullptr);
+}
+
+TEST_CASE("VFS_RESOLVE_AFTER_CHANGES", "[vfs]") {
+  VirtualFileSystem vfs;
+  auto paths = BuildTree(&vfs, 1000, 100);
+
+  // Cached, then deleted: the cache must not hand back the dead entry.
+  REQUIRE(vfs.ResolvePath(paths[5]) != nullptr);
+  REQUIRE(vfs.DeletePath(paths[5]));
+  REQUIRE(vfs.ResolvePath(paths[5]) == nullptr);
+  REQUIRE(vfs.ResolvePath(paths[6]) != nullptr);
+
+  // Created after the directory was indexed.
+  auto entry = vfs.ResolvePath("game:\\Dir0")
+                   ->CreateEntry("Late.bin", kFileAttributeNormal);
+  REQUIRE(entry != nullptr);
+  REQUIRE(vfs.ResolvePath("game:\\dir0\\late.bin") == entry);
+}
+
+TEST_CASE("VFS_RESOLVE_BENCHMARK", "[.][benchmark]") {
+  const size_t file_count = 100000;
+  for (size_t files_per_dir : {100, 10000}) {
+    VirtualFileSystem vfs;
+    auto paths = BuildTree(&vfs, file_count, files_per_dir);
+    // The first pass walks the tree; the second hits the path cache.
+    for (int pass = 0; pass < 2; ++pass) {
+      size_t found = 0;
+      auto start = std::chrono::high_resolution_clock::now();
+      for (auto& path : paths) {
+        found += vfs.ResolvePath(path) ? 1 : 0;
+      }
+      auto end = std::chrono::high_resolution_clock::now();
+      REQUIRE(found == file_count);
+      double seconds = std::chrono::duration<double>(end - start).count();
+      std::printf("%zu files, %zu per directory, %s: %.2f us per lookup\n",
+                  file_count, files_per_dir, pass ? "cached" : "uncached",
+                  seconds * 1000000.0 / file_count);
+    }
+  }
+}
@@ -150,6 +150,17 @@ enum X_FILE_ATTRIBUTES : uint32_t {
   X_FILE_ATTRIBUTE_ENCRYPTED = 0x4000,
 };
 
+// NtCreateFile create_options.
+enum X_FILE_CREATE_OPTIONS : uint32_t {
+  X_FILE_DIRECTORY_FILE = 0x0001,
+  X_FILE_WRITE_THROUGH = 0x0002,
+  X_FILE_SEQUENTIAL_ONLY = 0x0004,
+  X_FILE_NO_INTERMEDIATE_BUFFERING = 0x0008,
+  X_FILE_SYNCHRONOUS_IO_ALERT = 0x0010,
+  X_FILE_SYNCHRONOUS_IO_NONALERT = 0x0020,
+  X_FILE_NON_DIRECTORY_FILE = 0x0040,
+};
+
 // http://code.google.com/p/vdash/source/browse/trunk/vdash/include/kernel.h
 enum X_FILE_INFORMATION_CLASS {
   XFileDirectoryInformation = 1,